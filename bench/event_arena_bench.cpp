@@ -0,0 +1,148 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+#include "data/relay_message_parser.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+using nlohmann::json;
+
+#pragma region Allocation Counting
+
+// Every heap allocation in the benchmark binary is counted, so each benchmark can report the
+// number of allocations its loop performs.
+static atomic<size_t> allocationCount{0};
+
+void* operator new(size_t size)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    if (void* pointer = malloc(size == 0 ? 1 : size))
+    {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+// The default memory resource allocates through the aligned form.
+void* operator new(size_t size, align_val_t alignment)
+{
+    allocationCount.fetch_add(1, memory_order_relaxed);
+    size_t align = static_cast<size_t>(alignment);
+    if (void* pointer = aligned_alloc(align, (size + align - 1) / align * align))
+    {
+        return pointer;
+    }
+    throw bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, align_val_t) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t, align_val_t) noexcept
+{
+    free(pointer);
+}
+
+#pragma endregion
+
+static const int BENCH_BATCH_SIZE = 64;
+
+/**
+ * @brief Builds the EVENT frames a relay sends in answer to a query: short notes, each with a few
+ * tags.
+ */
+static vector<string> benchFrames()
+{
+    vector<string> frames;
+    for (int i = 0; i < BENCH_BATCH_SIZE; i++)
+    {
+        json tags = json::array();
+        for (int j = 0; j < 8; j++)
+        {
+            tags.push_back(json::array({ "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca", "wss://nostr.example.com" }));
+        }
+
+        json event = {
+            { "id", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" },
+            { "pubkey", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" },
+            { "created_at", 1627846261 + i },
+            { "kind", 1 },
+            { "tags", tags },
+            { "content", "GM, Nostr!  This is a short note that is long enough to need its own buffer." },
+            { "sig", "908a15e46fb4d8675bab026fc230a0e3542bfade63da02d542fb78b2a8513fcd0092619a2c8c1221e581946e0191f2af505dfdf8657a414dbca329186f009262" }
+        };
+        frames.push_back(json::array({ "EVENT", "sub-1", event }).dump());
+    }
+
+    return frames;
+}
+
+/**
+ * @brief Parses a batch of query results into events and then discards them, as the query path
+ * does with its results.
+ */
+static void runBatch(const vector<string>& frames, shared_ptr<EventArena> arena)
+{
+    RelayMessageParser parser(RelayMessageParser::DEFAULT_MAX_MESSAGE_SIZE, arena);
+    vector<shared_ptr<Event>> events;
+    events.reserve(frames.size());
+    for (const string& frame : frames)
+    {
+        events.push_back(parser.parse(frame).event);
+    }
+    benchmark::DoNotOptimize(events);
+}
+
+static void BM_QueryBatch_Heap(benchmark::State& state)
+{
+    vector<string> frames = benchFrames();
+    size_t allocations = 0;
+
+    for (auto _ : state)
+    {
+        size_t before = allocationCount.load(memory_order_relaxed);
+        runBatch(frames, nullptr);
+        allocations += allocationCount.load(memory_order_relaxed) - before;
+    }
+
+    state.counters["allocs_per_batch"] = static_cast<double>(allocations) / state.iterations();
+    state.SetItemsProcessed(state.iterations() * BENCH_BATCH_SIZE);
+}
+BENCHMARK(BM_QueryBatch_Heap);
+
+static void BM_QueryBatch_Arena(benchmark::State& state)
+{
+    vector<string> frames = benchFrames();
+    size_t allocations = 0;
+
+    for (auto _ : state)
+    {
+        size_t before = allocationCount.load(memory_order_relaxed);
+        runBatch(frames, EventArena::create());
+        allocations += allocationCount.load(memory_order_relaxed) - before;
+    }
+
+    state.counters["allocs_per_batch"] = static_cast<double>(allocations) / state.iterations();
+    state.SetItemsProcessed(state.iterations() * BENCH_BATCH_SIZE);
+}
+BENCHMARK(BM_QueryBatch_Arena);
@@ -0,0 +1,108 @@
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+#include "data/canonical_event_writer.hpp"
+#include "cryptography/sha256_context.hpp"
+
+using namespace nostr::cryptography;
+using namespace nostr::data;
+using namespace std;
+
+using nlohmann::json;
+
+static Event benchEvent(int tagCount)
+{
+    Event event;
+    event.pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+    event.createdAt = 1627846261;
+    event.kind = 1;
+    for (int i = 0; i < tagCount; i++)
+    {
+        event.tags.push_back({ "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" });
+    }
+    event.content = "GM, Nostr!  This is a short note with a \"quoted\" phrase and a newline.\n";
+
+    return event;
+}
+
+/**
+ * @brief The ID generation path used before the canonical writer: the event is copied into a JSON
+ * array, dumped to a string, hashed in one shot, and hex-encoded through a string stream.
+ */
+static void BM_EventId_JsonDump(benchmark::State& state)
+{
+    Event event = benchEvent(state.range(0));
+
+    for (auto _ : state)
+    {
+        json arr = { 0, toHex(event.pubkey), event.createdAt, event.kind, event.tags, event.content };
+        string serializedData = arr.dump();
+
+        unsigned char hash[SHA256_DIGEST_LENGTH];
+        EVP_Digest(serializedData.c_str(), serializedData.length(), hash, NULL, EVP_sha256(), NULL);
+
+        stringstream ss;
+        for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+        {
+            ss << hex << setw(2) << setfill('0') << (int)hash[i];
+        }
+        string id = ss.str();
+        benchmark::DoNotOptimize(id);
+    }
+}
+BENCHMARK(BM_EventId_JsonDump)->Arg(3)->Arg(1000);
+
+static void BM_EventId_CanonicalWriter(benchmark::State& state)
+{
+    Event event = benchEvent(state.range(0));
+    Sha256Context sha256;
+    uint8_t hash[Sha256Context::DIGEST_SIZE];
+
+    for (auto _ : state)
+    {
+        sha256.reset();
+        CanonicalEventWriter<Sha256Context> writer(sha256);
+        writer.write(event);
+        sha256.finalize(hash);
+        benchmark::DoNotOptimize(hash);
+    }
+}
+BENCHMARK(BM_EventId_CanonicalWriter)->Arg(3)->Arg(1000);
+
+/**
+ * @brief Serializing an event whose fields change before every call, so the ID and JSON are
+ * generated each time.
+ */
+static void BM_EventSerialize_Changed(benchmark::State& state)
+{
+    Event event = benchEvent(state.range(0));
+
+    for (auto _ : state)
+    {
+        event.createdAt++;
+        auto serialized = event.serializeShared();
+        benchmark::DoNotOptimize(serialized);
+    }
+}
+BENCHMARK(BM_EventSerialize_Changed)->Arg(3)->Arg(1000);
+
+/**
+ * @brief Serializing an unchanged event again, as the signer and `publishEvent` do.
+ */
+static void BM_EventSerialize_Unchanged(benchmark::State& state)
+{
+    Event event = benchEvent(state.range(0));
+    event.serializeShared();
+
+    for (auto _ : state)
+    {
+        auto serialized = event.serializeShared();
+        benchmark::DoNotOptimize(serialized);
+    }
+}
+BENCHMARK(BM_EventSerialize_Unchanged)->Arg(3)->Arg(1000);
@@ -0,0 +1,188 @@
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+#include "store/mmap_event_store.hpp"
+
+using namespace nostr::data;
+using namespace nostr::store;
+using namespace std;
+
+static const uint64_t QUERY_BENCH_AUTHOR_COUNT = 100000;
+
+static const uint64_t QUERY_BENCH_TOPIC_COUNT = 1000;
+
+static inline uint64_t nextRandom(uint64_t& state)
+{
+    state = state * 6364136223846793005 + 1442695040888963407;
+    return state >> 16;
+};
+
+static PublicKey queryBenchAuthor(uint64_t number)
+{
+    PublicKey pubkey;
+    uint64_t state = number * 0x9e3779b97f4a7c15 + 7;
+    for (auto& byte : pubkey)
+    {
+        byte = static_cast<uint8_t>(nextRandom(state));
+    }
+
+    return pubkey;
+};
+
+/**
+ * @brief Makes the given event of a synthetic corpus.  Authors and topics are skewed so a few
+ * are far more active than the rest, most events are text notes, and each mentions an author.
+ */
+static Event queryBenchEvent(uint64_t number)
+{
+    uint64_t state = number * 0x9e3779b97f4a7c15 + 1;
+    Event event;
+    for (auto& byte : event.id)
+    {
+        byte = static_cast<uint8_t>(nextRandom(state));
+    }
+
+    uint64_t activity = nextRandom(state) % QUERY_BENCH_AUTHOR_COUNT;
+    event.pubkey = queryBenchAuthor(activity * activity / QUERY_BENCH_AUTHOR_COUNT);
+    event.createdAt = 1600000000 + number * 3;
+
+    uint64_t kindRoll = nextRandom(state) % 100;
+    event.kind = kindRoll < 70 ? 1 : kindRoll < 90 ? 7 : kindRoll < 95 ? 6 : kindRoll < 98 ? 0 : 3;
+
+    event.tags.push_back({ "p", toHex(queryBenchAuthor(nextRandom(state) % QUERY_BENCH_AUTHOR_COUNT)) });
+    if (event.kind == 1)
+    {
+        uint64_t topic = nextRandom(state) % QUERY_BENCH_TOPIC_COUNT;
+        event.tags.push_back({ "t", "topic-" + to_string(topic * topic / QUERY_BENCH_TOPIC_COUNT) });
+    }
+    event.content = "A typical short text note, about as long as most notes on the network are.";
+
+    return event;
+};
+
+/**
+ * @brief Opens a store holding the first `count` events of the corpus, building it on first
+ * use.  The store is kept in the temporary directory between runs, since building the largest
+ * corpus takes minutes.
+ */
+static MmapEventStore& queryBenchStore(int64_t count)
+{
+    static map<int64_t, unique_ptr<MmapEventStore>> stores;
+    auto& eventStore = stores[count];
+    if (eventStore != nullptr)
+    {
+        return *eventStore;
+    }
+
+    auto directory = filesystem::temp_directory_path() / ("aedile-query-bench-" + to_string(count));
+    eventStore = make_unique<MmapEventStore>(directory.string());
+    for (int64_t i = static_cast<int64_t>(eventStore->size()); i < count; i++)
+    {
+        eventStore->append(queryBenchEvent(i));
+    }
+    eventStore->flush();
+
+    return *eventStore;
+};
+
+static void runQuery(benchmark::State& state, const Filters& filters)
+{
+    MmapEventStore& eventStore = queryBenchStore(state.range(0));
+    size_t resultCount = 0;
+    for (auto _ : state)
+    {
+        auto events = eventStore.query(filters);
+        resultCount = events.size();
+        benchmark::DoNotOptimize(events);
+    }
+    state.counters["results"] = static_cast<double>(resultCount);
+};
+
+/**
+ * @brief The latest notes by one of the most active authors, as a profile page shows.
+ */
+static void BM_Query_AuthorNotes(benchmark::State& state)
+{
+    Filters filters;
+    filters.authors = { toHex(queryBenchAuthor(0)) };
+    filters.kinds = { 1 };
+    filters.limit = 20;
+    runQuery(state, filters);
+}
+BENCHMARK(BM_Query_AuthorNotes)->Arg(1000000)->Arg(10000000)->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief The latest reactions and reposts mentioning an author, as a notifications page shows.
+ */
+static void BM_Query_Mentions(benchmark::State& state)
+{
+    Filters filters;
+    filters.kinds = { 6, 7 };
+    filters.tags["p"] = { toHex(queryBenchAuthor(42)) };
+    filters.limit = 50;
+    runQuery(state, filters);
+}
+BENCHMARK(BM_Query_Mentions)->Arg(1000000)->Arg(10000000)->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief The latest notes on a rare topic within a day, where the kind is unselective and the
+ * tag is the index to use.
+ */
+static void BM_Query_TopicInRange(benchmark::State& state)
+{
+    Filters filters;
+    filters.kinds = { 1 };
+    filters.tags["t"] = { "topic-900" };
+    filters.until = 1600000000 + state.range(0) * 3;
+    filters.since = filters.until - 24 * 60 * 60;
+    filters.limit = 100;
+    runQuery(state, filters);
+}
+BENCHMARK(BM_Query_TopicInRange)->Arg(1000000)->Arg(10000000)->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief The global feed of the latest notes, whose postings are merged from the kind index
+ * and cut off at the limit.
+ */
+static void BM_Query_GlobalFeed(benchmark::State& state)
+{
+    Filters filters;
+    filters.kinds = { 1 };
+    filters.limit = 100;
+    runQuery(state, filters);
+}
+BENCHMARK(BM_Query_GlobalFeed)->Arg(1000000)->Arg(10000000)->Unit(benchmark::kMicrosecond);
+
+/**
+ * @brief A profile query answered by scanning the whole log, as the store would without
+ * posting indexes, for comparison with `BM_Query_AuthorNotes`.
+ */
+static void BM_Query_AuthorNotes_Scan(benchmark::State& state)
+{
+    Filters filters;
+    filters.authors = { toHex(queryBenchAuthor(0)) };
+    filters.kinds = { 1 };
+    filters.limit = 20;
+    FilterMatcher matcher = filters.compile();
+
+    MmapEventStore& eventStore = queryBenchStore(state.range(0));
+    for (auto _ : state)
+    {
+        vector<shared_ptr<Event>> events;
+        eventStore.scan([&matcher, &events](shared_ptr<Event> event)
+        {
+            if (matcher.matches(*event))
+            {
+                events.push_back(event);
+            }
+            return true;
+        });
+        benchmark::DoNotOptimize(matcher.select(events));
+    }
+}
+BENCHMARK(BM_Query_AuthorNotes_Scan)->Arg(1000000)->Iterations(1)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,121 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cstring>
+
+#include <benchmark/benchmark.h>
+#include <noscrypt.h>
+#include <noscryptutil.h>
+
+#include "data/data.hpp"
+#include "service/event_verifier.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+static vector<shared_ptr<Event>> benchEvents(size_t count)
+{
+    vector<shared_ptr<Event>> events;
+    for (size_t i = 0; i < count; i++)
+    {
+        Event event;
+        event.pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+        event.createdAt = 1627846261 + i;
+        event.kind = 1;
+        event.tags = {
+            { "e", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36", "wss://nostr.example.com" },
+            { "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" }
+        };
+        event.content = "GM, Nostr!  This is note number " + to_string(i) + " in a batch of test notes.";
+        event.serialize();
+        events.push_back(make_shared<Event>(event));
+    }
+
+    return events;
+}
+
+/**
+ * @brief Verifies batches of events.  Arguments are the batch size and the number of workers.
+ * @remark The `events_per_second_per_core` counter divides the events verified by the time the
+ * workers spent verifying them, so it is comparable across worker counts.
+ */
+static void BM_EventVerifier_Verify(benchmark::State& state)
+{
+    vector<shared_ptr<Event>> events = benchEvents(state.range(0));
+    EventVerifierOptions options;
+    options.workerCount = state.range(1);
+    EventVerifier verifier(options);
+
+    for (auto _ : state)
+    {
+        vector<bool> results = verifier.verify(events);
+        benchmark::DoNotOptimize(results);
+    }
+
+    state.SetItemsProcessed(state.iterations() * events.size());
+    state.counters["events_per_second_per_core"] = verifier.counters().eventsPerSecondPerCore();
+}
+BENCHMARK(BM_EventVerifier_Verify)
+    ->Args({ 1024, 1 })
+    ->Args({ 1024, 2 })
+    ->Args({ 1024, 4 })
+    ->UseRealTime();
+
+/**
+ * @brief Signs each event with a fixed key so that its signature verifies.
+ */
+static void signBenchEvents(vector<shared_ptr<Event>>& events)
+{
+    shared_ptr<NCContext> context(NCUtilContextAlloc(), &NCUtilContextFree);
+    uint8_t entropy[NC_CONTEXT_ENTROPY_SIZE] = { 0 };
+    NCInitContext(context.get(), entropy);
+
+    NCSecretKey secretKey;
+    for (size_t i = 0; i < sizeof(secretKey.key); i++)
+    {
+        secretKey.key[i] = static_cast<uint8_t>(i + 1);
+    }
+    NCPublicKey publicKey;
+    NCGetPublicKey(context.get(), &secretKey, &publicKey);
+
+    uint8_t random[32] = { 0 };
+    for (auto& event : events)
+    {
+        memcpy(event->pubkey.data(), publicKey.key, sizeof(publicKey.key));
+        event->serialize();
+        NCSignDigest(context.get(), &secretKey, random, event->id.data(), event->sig.data());
+    }
+}
+
+/**
+ * @brief Verifies the IDs and signatures of batches of distinct events.  Arguments are the batch
+ * size and the number of workers.
+ * @remark The verified-event cache is disabled so that every iteration checks every signature.
+ */
+static void BM_EventVerifier_VerifySignatures(benchmark::State& state)
+{
+    vector<shared_ptr<Event>> events = benchEvents(state.range(0));
+    signBenchEvents(events);
+
+    EventVerifierOptions options;
+    options.workerCount = state.range(1);
+    options.verifySignatures = true;
+    options.verifiedCacheCapacity = 0;
+    EventVerifier verifier(options);
+
+    for (auto _ : state)
+    {
+        vector<bool> results = verifier.verify(events);
+        benchmark::DoNotOptimize(results);
+    }
+
+    state.SetItemsProcessed(state.iterations() * events.size());
+    state.counters["events_per_second_per_core"] = verifier.counters().eventsPerSecondPerCore();
+}
+BENCHMARK(BM_EventVerifier_VerifySignatures)
+    ->Args({ 256, 1 })
+    ->Args({ 256, 2 })
+    ->Args({ 256, 4 })
+    ->UseRealTime();
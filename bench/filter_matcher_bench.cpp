@@ -0,0 +1,110 @@
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+static const int BENCH_AUTHOR_COUNT = 1000;
+static const int BENCH_EVENT_POOL_SIZE = 1 << 16;
+static const int BENCH_MATCHES_PER_ITERATION = 10000000;
+
+/**
+ * @brief Builds a filter for 1,000 authors and a pool of events, a quarter of which are by those
+ * authors.
+ * @remark Matching runs over the pool repeatedly rather than over 10M distinct events, which
+ * would not fit in memory with their tags and content.
+ */
+static void setupBench(Filters& filters, vector<Event>& events)
+{
+    mt19937_64 rng(42);
+    auto randomKey = [&rng]()
+    {
+        PublicKey key;
+        for (size_t i = 0; i < key.size(); i += 8)
+        {
+            uint64_t word = rng();
+            memcpy(key.data() + i, &word, 8);
+        }
+        return key;
+    };
+
+    vector<PublicKey> authors;
+    for (int i = 0; i < BENCH_AUTHOR_COUNT; i++)
+    {
+        authors.push_back(randomKey());
+        filters.authors.push_back(toHex(authors.back()));
+    }
+    filters.kinds = { 1, 6, 7 };
+    filters.since = 1600000000;
+
+    events.resize(BENCH_EVENT_POOL_SIZE);
+    for (auto& event : events)
+    {
+        event.pubkey = rng() % 4 == 0 ? authors[rng() % authors.size()] : randomKey();
+        event.createdAt = 1600000000 + static_cast<time_t>(rng() % 100000000);
+        event.kind = static_cast<int>(rng() % 8);
+        event.tags = { { "p", toHex(randomKey()) } };
+        event.content = "Hello, World!";
+    }
+};
+
+/**
+ * @brief A straightforward matcher that hex-encodes each event's author and looks it up in a
+ * set of strings.
+ */
+static void BM_FilterMatch_HexStringSet(benchmark::State& state)
+{
+    Filters filters;
+    vector<Event> events;
+    setupBench(filters, events);
+
+    unordered_set<string> authors(filters.authors.begin(), filters.authors.end());
+    unordered_set<int> kinds(filters.kinds.begin(), filters.kinds.end());
+
+    for (auto _ : state)
+    {
+        size_t matched = 0;
+        for (int i = 0; i < BENCH_MATCHES_PER_ITERATION; i++)
+        {
+            const Event& event = events[i & (BENCH_EVENT_POOL_SIZE - 1)];
+            if (event.createdAt >= filters.since
+                && kinds.count(event.kind) > 0
+                && authors.count(toHex(event.pubkey)) > 0)
+            {
+                matched++;
+            }
+        }
+        benchmark::DoNotOptimize(matched);
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_MATCHES_PER_ITERATION);
+}
+BENCHMARK(BM_FilterMatch_HexStringSet)->Unit(benchmark::kMillisecond);
+
+static void BM_FilterMatch_Compiled(benchmark::State& state)
+{
+    Filters filters;
+    vector<Event> events;
+    setupBench(filters, events);
+
+    auto matcher = filters.compile();
+
+    for (auto _ : state)
+    {
+        size_t matched = 0;
+        for (int i = 0; i < BENCH_MATCHES_PER_ITERATION; i++)
+        {
+            matched += matcher.matches(events[i & (BENCH_EVENT_POOL_SIZE - 1)]);
+        }
+        benchmark::DoNotOptimize(matched);
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_MATCHES_PER_ITERATION);
+}
+BENCHMARK(BM_FilterMatch_Compiled)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,82 @@
+#include <iomanip>
+#include <sstream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+#include "encoding/hex_codec.hpp"
+
+using namespace nostr::encoding;
+using namespace std;
+
+static const string benchKey = "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca";
+
+/**
+ * @brief The key accessor path used before the hex codec: a string stream with `setw` and
+ * `setfill` for each byte.
+ */
+static void BM_HexEncode_StringStream(benchmark::State& state)
+{
+    uint8_t key[32];
+    HexCodec::decode(benchKey.data(), sizeof(key), key);
+
+    for (auto _ : state)
+    {
+        stringstream ss;
+        for (int i = 0; i < sizeof(key); i++)
+        {
+            ss << hex << setw(2) << setfill('0') << static_cast<int>(key[i]);
+        }
+        string hex = ss.str();
+        benchmark::DoNotOptimize(hex);
+    }
+}
+BENCHMARK(BM_HexEncode_StringStream);
+
+static void BM_HexEncode_Codec(benchmark::State& state)
+{
+    uint8_t key[32];
+    HexCodec::decode(benchKey.data(), sizeof(key), key);
+
+    for (auto _ : state)
+    {
+        string hex(2 * sizeof(key), '\0');
+        HexCodec::encode(key, sizeof(key), &hex[0]);
+        benchmark::DoNotOptimize(hex);
+    }
+}
+BENCHMARK(BM_HexEncode_Codec);
+
+/**
+ * @brief The key setter path used before the hex codec, with the byte read fixed to parse an
+ * integer rather than a character.
+ */
+static void BM_HexDecode_StringStream(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        uint8_t key[32];
+        for (int i = 0; i < sizeof(key); i++)
+        {
+            stringstream ss;
+            ss << hex << benchKey.substr(i * 2, 2);
+            int byte;
+            ss >> byte;
+            key[i] = static_cast<uint8_t>(byte);
+        }
+        benchmark::DoNotOptimize(key);
+    }
+}
+BENCHMARK(BM_HexDecode_StringStream);
+
+static void BM_HexDecode_Codec(benchmark::State& state)
+{
+    for (auto _ : state)
+    {
+        uint8_t key[32];
+        bool valid = HexCodec::decode(benchKey.data(), sizeof(key), key);
+        benchmark::DoNotOptimize(valid);
+        benchmark::DoNotOptimize(key);
+    }
+}
+BENCHMARK(BM_HexDecode_Codec);
@@ -0,0 +1,107 @@
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+#include "store/mmap_event_store.hpp"
+
+using namespace nostr::data;
+using namespace nostr::store;
+using namespace std;
+
+static Event benchStoreEvent(uint64_t number)
+{
+    Event event;
+    uint64_t state = number * 0x9e3779b97f4a7c15 + 1;
+    for (auto& byte : event.id)
+    {
+        state = state * 6364136223846793005 + 1442695040888963407;
+        byte = static_cast<uint8_t>(state >> 56);
+    }
+    event.pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+    event.createdAt = 1627846261 + number;
+    event.kind = 1;
+    event.tags.push_back({ "p", "3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d" });
+    event.content = "A typical short text note, about as long as most notes on the network are.";
+    return event;
+};
+
+static string benchStoreDirectory(const string& name)
+{
+    auto path = filesystem::temp_directory_path() / ("aedile-bench-" + name);
+    filesystem::remove_all(path);
+    return path.string();
+};
+
+/**
+ * @brief Appends events to a store without syncing, as the service does for received events.
+ */
+static void BM_MmapEventStore_Append(benchmark::State& state)
+{
+    string directory = benchStoreDirectory("append");
+    {
+        MmapEventStore eventStore(directory);
+        uint64_t number = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(eventStore.append(benchStoreEvent(number++)));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    filesystem::remove_all(directory);
+}
+BENCHMARK(BM_MmapEventStore_Append);
+
+/**
+ * @brief Looks up stored events by ID.
+ */
+static void BM_MmapEventStore_Find(benchmark::State& state)
+{
+    string directory = benchStoreDirectory("find");
+    {
+        MmapEventStore eventStore(directory);
+        vector<EventId> ids;
+        for (uint64_t i = 0; i < 100000; i++)
+        {
+            Event event = benchStoreEvent(i);
+            eventStore.append(event);
+            ids.push_back(event.id);
+        }
+
+        size_t i = 0;
+        for (auto _ : state)
+        {
+            benchmark::DoNotOptimize(eventStore.find(ids[i++ % ids.size()]));
+        }
+        state.SetItemsProcessed(state.iterations());
+    }
+    filesystem::remove_all(directory);
+}
+BENCHMARK(BM_MmapEventStore_Find);
+
+/**
+ * @brief Opens a cleanly closed store holding the given number of events.  Only the index
+ * header is read, so the time should not grow with the size of the log.
+ */
+static void BM_MmapEventStore_Open(benchmark::State& state)
+{
+    string directory = benchStoreDirectory("open");
+    {
+        MmapEventStore eventStore(directory);
+        for (int64_t i = 0; i < state.range(0); i++)
+        {
+            eventStore.append(benchStoreEvent(i));
+        }
+    }
+
+    for (auto _ : state)
+    {
+        auto eventStore = make_unique<MmapEventStore>(directory);
+        benchmark::DoNotOptimize(eventStore->size());
+    }
+    filesystem::remove_all(directory);
+}
+BENCHMARK(BM_MmapEventStore_Open)->Arg(10000)->Arg(200000)->Unit(benchmark::kMicrosecond);
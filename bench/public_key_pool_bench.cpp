@@ -0,0 +1,102 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+static const size_t BENCH_AUTHOR_COUNT = 4096;
+
+static vector<PublicKey> benchAuthors()
+{
+    vector<PublicKey> authors(BENCH_AUTHOR_COUNT);
+    uint64_t state = 0x9e3779b97f4a7c15;
+    for (auto& author : authors)
+    {
+        for (auto& byte : author)
+        {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            byte = static_cast<uint8_t>(state >> 56);
+        }
+    }
+
+    return authors;
+};
+
+/**
+ * @brief Interns keys that are already in the pool, as the parser does for nearly every event.
+ * Run on several threads to show contention between the IO thread and handler threads.
+ */
+static void BM_Intern_ExistingKeys(benchmark::State& state)
+{
+    static vector<PublicKey> authors = benchAuthors();
+    PublicKeyPool& pool = PublicKeyPool::global();
+    for (const auto& author : authors)
+    {
+        pool.intern(author);
+    }
+
+    size_t i = state.thread_index() * 997;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(pool.intern(authors[i++ % BENCH_AUTHOR_COUNT]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Intern_ExistingKeys)->Threads(1)->Threads(4);
+
+/**
+ * @brief Counts the events by one author among many, comparing the authors as hex strings.
+ */
+static void BM_AuthorEquality_Hex(benchmark::State& state)
+{
+    vector<PublicKey> authors = benchAuthors();
+    vector<string> eventAuthors;
+    for (size_t i = 0; i < 100000; i++)
+    {
+        eventAuthors.push_back(toHex(authors[(i * 31) % BENCH_AUTHOR_COUNT]));
+    }
+    string target = toHex(authors[7]);
+
+    for (auto _ : state)
+    {
+        size_t count = 0;
+        for (const string& author : eventAuthors)
+        {
+            count += author == target;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * eventAuthors.size());
+}
+BENCHMARK(BM_AuthorEquality_Hex);
+
+/**
+ * @brief Counts the events by one author among many, comparing the authors by handle.
+ */
+static void BM_AuthorEquality_Handle(benchmark::State& state)
+{
+    vector<PublicKey> authors = benchAuthors();
+    PublicKeyPool& pool = PublicKeyPool::global();
+    vector<PublicKeyHandle> eventAuthors;
+    for (size_t i = 0; i < 100000; i++)
+    {
+        eventAuthors.push_back(pool.intern(authors[(i * 31) % BENCH_AUTHOR_COUNT]));
+    }
+    PublicKeyHandle target = pool.intern(authors[7]);
+
+    for (auto _ : state)
+    {
+        size_t count = 0;
+        for (PublicKeyHandle author : eventAuthors)
+        {
+            count += author == target;
+        }
+        benchmark::DoNotOptimize(count);
+    }
+    state.SetItemsProcessed(state.iterations() * eventAuthors.size());
+}
+BENCHMARK(BM_AuthorEquality_Handle);
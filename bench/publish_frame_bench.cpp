@@ -0,0 +1,82 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+using nlohmann::json;
+
+static const int BENCH_RELAY_COUNT = 24;
+
+static Event benchLongNote()
+{
+    Event event;
+    event.pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+    event.kind = 30023;
+    event.createdAt = 1627846261;
+    for (int i = 0; i < 20; i++)
+    {
+        event.tags.push_back({ "t", "topic-" + to_string(i) });
+    }
+    for (int i = 0; i < 200; i++)
+    {
+        event.content += "A \"quoted\" line of a long-form note, with\ttabs and escapes.\n";
+    }
+
+    return event;
+}
+
+/**
+ * @brief Publishing as `publishEvent` did before: the event is stringified into the frame, and
+ * the frame is dumped again for every relay.
+ */
+static void BM_PublishFrames_DumpPerRelay(benchmark::State& state)
+{
+    Event event = benchLongNote();
+
+    for (auto _ : state)
+    {
+        json message = json::array({ "EVENT", event.serialize() });
+        for (int i = 0; i < BENCH_RELAY_COUNT; i++)
+        {
+            string frame = message.dump();
+            benchmark::DoNotOptimize(frame);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_RELAY_COUNT);
+}
+BENCHMARK(BM_PublishFrames_DumpPerRelay);
+
+/**
+ * @brief Publishing as `publishEvent` does now: the frame is rendered once, and every relay
+ * receives the same buffer.
+ */
+static void BM_PublishFrames_SharedFrame(benchmark::State& state)
+{
+    Event event = benchLongNote();
+
+    for (auto _ : state)
+    {
+        string serializedEvent = event.serialize();
+        auto frame = make_shared<string>();
+        frame->reserve(serializedEvent.size() + 10);
+        frame->append("[\"EVENT\",").append(serializedEvent).append("]");
+        shared_ptr<const string> message = move(frame);
+
+        for (int i = 0; i < BENCH_RELAY_COUNT; i++)
+        {
+            shared_ptr<const string> relayMessage = message;
+            benchmark::DoNotOptimize(relayMessage);
+        }
+    }
+
+    state.SetItemsProcessed(state.iterations() * BENCH_RELAY_COUNT);
+}
+BENCHMARK(BM_PublishFrames_SharedFrame);
@@ -0,0 +1,87 @@
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+#include "data/relay_message_parser.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+using nlohmann::json;
+
+static json benchEventJson(int tagCount)
+{
+    json tags = json::array();
+    for (int i = 0; i < tagCount; i++)
+    {
+        tags.push_back({ "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca", "wss://nostr.example.com" });
+    }
+
+    return {
+        { "id", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" },
+        { "pubkey", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" },
+        { "created_at", 1627846261 },
+        { "kind", tagCount > 100 ? 3 : 1 },
+        { "tags", tags },
+        { "content", "GM, Nostr!  This is a short note with a \"quoted\" phrase and a newline.\n" },
+        { "sig", "908a15e46fb4d8675bab026fc230a0e3542bfade63da02d542fb78b2a8513fcd0092619a2c8c1221e581946e0191f2af505dfdf8657a414dbca329186f009262" }
+    };
+}
+
+/**
+ * @brief The message handling path used before the single-pass parser: the frame is parsed into
+ * a DOM, and the stringified event it carries is parsed a second time.
+ */
+static void BM_DomParse_StringifiedEvent(benchmark::State& state)
+{
+    string frame = json::array({ "EVENT", "sub-1", benchEventJson(state.range(0)).dump() }).dump();
+
+    for (auto _ : state)
+    {
+        json jMessage = json::parse(frame);
+        string messageType = jMessage.at(0);
+        string subscriptionId = jMessage.at(1);
+        Event event = Event::fromString(jMessage.at(2));
+        benchmark::DoNotOptimize(event);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_DomParse_StringifiedEvent)->Arg(4)->Arg(1000);
+
+/**
+ * @brief A DOM parse of a NIP-01 frame, converting the embedded event object with `from_json`.
+ */
+static void BM_DomParse_EventObject(benchmark::State& state)
+{
+    string frame = json::array({ "EVENT", "sub-1", benchEventJson(state.range(0)) }).dump();
+
+    for (auto _ : state)
+    {
+        json jMessage = json::parse(frame);
+        string messageType = jMessage.at(0);
+        string subscriptionId = jMessage.at(1);
+        Event event = jMessage.at(2).get<Event>();
+        benchmark::DoNotOptimize(event);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_DomParse_EventObject)->Arg(4)->Arg(1000);
+
+static void BM_RelayMessageParser_EventObject(benchmark::State& state)
+{
+    string frame = json::array({ "EVENT", "sub-1", benchEventJson(state.range(0)) }).dump();
+    RelayMessageParser parser;
+
+    for (auto _ : state)
+    {
+        RelayMessage message = parser.parse(frame);
+        benchmark::DoNotOptimize(message);
+    }
+
+    state.SetBytesProcessed(state.iterations() * frame.size());
+}
+BENCHMARK(BM_RelayMessageParser_EventObject)->Arg(4)->Arg(1000);
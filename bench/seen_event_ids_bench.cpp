@@ -0,0 +1,91 @@
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+#include "service/seen_event_ids.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+/**
+ * @brief Makes the given number of IDs, where each is received twice, as from two relays.
+ */
+static vector<EventId> seenBenchIds(int64_t count)
+{
+    vector<EventId> ids;
+    uint64_t state = 1;
+    for (int64_t i = 0; i < count; i++)
+    {
+        EventId id;
+        for (auto& byte : id)
+        {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            byte = static_cast<uint8_t>(state >> 56);
+        }
+        ids.push_back(id);
+    }
+    ids.insert(ids.end(), ids.begin(), ids.end());
+    return ids;
+};
+
+/**
+ * @brief Deduplicates by the hex string of each ID, as queries once did.
+ */
+static void BM_Dedupe_HexStringSet(benchmark::State& state)
+{
+    vector<EventId> ids = seenBenchIds(state.range(0));
+    for (auto _ : state)
+    {
+        unordered_set<string> seenIds;
+        size_t uniqueCount = 0;
+        for (const auto& id : ids)
+        {
+            uniqueCount += seenIds.insert(toHex(id)).second ? 1 : 0;
+        }
+        benchmark::DoNotOptimize(uniqueCount);
+    }
+    state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK(BM_Dedupe_HexStringSet)->Arg(1000)->Arg(100000);
+
+static void BM_Dedupe_SeenEventIds(benchmark::State& state)
+{
+    vector<EventId> ids = seenBenchIds(state.range(0));
+    for (auto _ : state)
+    {
+        SeenEventIds seenIds;
+        size_t uniqueCount = 0;
+        for (const auto& id : ids)
+        {
+            uniqueCount += seenIds.insert(id) ? 1 : 0;
+        }
+        benchmark::DoNotOptimize(uniqueCount);
+    }
+    state.SetItemsProcessed(state.iterations() * ids.size());
+}
+BENCHMARK(BM_Dedupe_SeenEventIds)->Arg(1000)->Arg(100000);
+
+/**
+ * @brief Looks up unseen IDs in a large set, with and without the Bloom filter.
+ */
+static void BM_SeenEventIds_ContainsUnseen(benchmark::State& state)
+{
+    vector<EventId> ids = seenBenchIds(1000000);
+    SeenEventIds seenIds(SeenEventIds::DEFAULT_EXPECTED_COUNT, state.range(0) != 0);
+    for (size_t i = 0; i < ids.size() / 4; i++)
+    {
+        seenIds.insert(ids[i]);
+    }
+
+    size_t next = ids.size() / 4;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(seenIds.contains(ids[next]));
+        next = next + 1 < ids.size() / 2 ? next + 1 : ids.size() / 4;
+    }
+}
+BENCHMARK(BM_SeenEventIds_ContainsUnseen)->Arg(0)->Arg(1);
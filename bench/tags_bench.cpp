@@ -0,0 +1,72 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+static const string benchKey = "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca";
+
+static vector<vector<string>> benchContactList(int tagCount)
+{
+    vector<vector<string>> tags;
+    for (int i = 0; i < tagCount; i++)
+    {
+        tags.push_back({ "p", benchKey, "wss://nostr.example.com" });
+    }
+
+    return tags;
+}
+
+/**
+ * @brief Copying the tags of a contact list when they were held as nested vectors, which
+ * allocates once for each tag and each long field.
+ */
+static void BM_TagsCopy_NestedVectors(benchmark::State& state)
+{
+    vector<vector<string>> tags = benchContactList(state.range(0));
+
+    for (auto _ : state)
+    {
+        vector<vector<string>> copy = tags;
+        benchmark::DoNotOptimize(copy);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TagsCopy_NestedVectors)->Arg(50)->Arg(2000);
+
+static void BM_TagsCopy_Flat(benchmark::State& state)
+{
+    Tags tags(benchContactList(state.range(0)));
+
+    for (auto _ : state)
+    {
+        Tags copy = tags;
+        benchmark::DoNotOptimize(copy);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TagsCopy_Flat)->Arg(50)->Arg(2000);
+
+static void BM_TagsValues_Flat(benchmark::State& state)
+{
+    Tags tags(benchContactList(state.range(0)));
+
+    for (auto _ : state)
+    {
+        size_t length = 0;
+        for (string_view value : tags.values("p"))
+        {
+            length += value.size();
+        }
+        benchmark::DoNotOptimize(length);
+    }
+
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TagsValues_Flat)->Arg(50)->Arg(2000);
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
+#include <tuple>
 
 namespace nostr
 {
@@ -60,6 +62,25 @@ public:
         std::function<void(const std::string&)> messageHandler
     ) = 0;
 
+    /**
+     * @brief Sends a shared, immutable message to the given server and sets up a message handler
+     * for messages received from the server.
+     * @returns A tuple indicating the server URI and whether the message was successfully
+     * sent.
+     * @remark Use this method to send the same message to many servers, serialized once.
+     * Implementations should pass the shared buffer to their transport without copying it into
+     * an intermediate string; the transport may still copy it into its own frame.  The default
+     * implementation copies it and calls the `std::string` overload.
+     */
+    virtual std::tuple<std::string, bool> send(
+        std::shared_ptr<const std::string> message,
+        std::string uri,
+        std::function<void(const std::string&)> messageHandler
+    )
+    {
+        return this->send(*message, uri, messageHandler);
+    };
+
     /**
      * @brief Sets up a message handler for the given server.
      * @param uri The URI of the server to which the message handler should be attached.
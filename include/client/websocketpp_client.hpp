@@ -35,6 +35,12 @@ public:
         std::function<void(const std::string&)> messageHandler
     ) override;
 
+    std::tuple<std::string, bool> send(
+        std::shared_ptr<const std::string> message,
+        std::string uri,
+        std::function<void(const std::string&)> messageHandler
+    ) override;
+
     void receive(std::string uri, std::function<void(const std::string&)> messageHandler) override;
 
     void closeConnection(std::string uri) override;
@@ -1,8 +1,22 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <nlohmann/json.hpp>
@@ -13,29 +27,507 @@ namespace nostr
 {
 namespace data
 {
+using EventId = std::array<uint8_t, 32>; ///< A 32-byte SHA-256 event ID.
+using PublicKey = std::array<uint8_t, 32>; ///< A 32-byte x-only secp256k1 public key.
+using Signature = std::array<uint8_t, 64>; ///< A 64-byte BIP-340 Schnorr signature.
+
+/**
+ * @brief Encodes the given bytes as a lowercase hex string.
+ */
+std::string toHex(const uint8_t* bytes, std::size_t length);
+
+/**
+ * @brief Encodes a fixed-width binary value, such as an `EventId`, as a lowercase hex string.
+ */
+template <std::size_t N>
+std::string toHex(const std::array<uint8_t, N>& bytes)
+{
+    return toHex(bytes.data(), N);
+};
+
+/**
+ * @brief Decodes a hex string into the given buffer.
+ * @param hex A string of exactly `2 * length` hex characters.
+ * @param bytes The buffer into which the decoded bytes are written.
+ * @param length The number of bytes to decode.
+ * @returns True if the string was decoded, false if it has the wrong length or contains
+ * characters that are not hex digits.
+ */
+bool fromHex(const std::string& hex, uint8_t* bytes, std::size_t length);
+
+/**
+ * @brief Decodes a hex string into a fixed-width binary value, such as a `PublicKey`.
+ * @throws `std::invalid_argument` if the string is not a hex encoding of the value.
+ */
+template <class TBytes>
+TBytes fromHex(const std::string& hex)
+{
+    TBytes bytes;
+    if (!fromHex(hex, bytes.data(), bytes.size()))
+    {
+        throw std::invalid_argument("fromHex: The string is not a valid hex encoding of the value.");
+    }
+
+    return bytes;
+};
+
+/**
+ * @brief Hashes fixed-width binary identifiers, such as event IDs and public keys, for use in
+ * unordered containers.
+ * @remark The leading bytes of a hash digest or curve point are already uniformly distributed,
+ * so they are used as the hash value directly.
+ */
+struct BytesHash
+{
+    template <std::size_t N>
+    std::size_t operator()(const std::array<uint8_t, N>& bytes) const noexcept
+    {
+        static_assert(N >= sizeof(std::size_t), "BytesHash requires at least 8 bytes of input.");
+
+        std::size_t hash;
+        std::memcpy(&hash, bytes.data(), sizeof(hash));
+        return hash;
+    };
+};
+
+/**
+ * @brief A compact stand-in for a `PublicKey` interned in a `PublicKeyPool`.
+ * @remark Two handles from the same pool are equal if and only if their keys are equal, so
+ * comparing keys by handle is a single integer comparison.  `NONE` stands for no key.
+ */
+enum class PublicKeyHandle : uint32_t
+{
+    NONE = 0
+};
+
+/**
+ * @brief A concurrent intern pool mapping public keys to compact handles.
+ * @remark The same few thousand authors recur across every event a client receives.  Interning
+ * each key once lets events and filters refer to it by a 4-byte handle.
+ * @remark Handles are assigned densely from 1, so they may index tables and bitmaps.  Keys are
+ * stored in geometrically growing segments that never move, so a key looked up by handle is
+ * read without locking.  Interning locks one of several shards, chosen by the key, so threads
+ * interning different keys rarely contend.  Every method is safe to call from any thread.
+ * @remark Keys are never removed.  `Event::pubkeyHandle` and `Filters::authorHandles` refer to
+ * the pool returned by `global()`.
+ */
+class PublicKeyPool
+{
+public:
+    /**
+     * @brief The process-wide pool.
+     */
+    static PublicKeyPool& global();
+
+    PublicKeyPool();
+
+    ~PublicKeyPool();
+
+    PublicKeyPool(const PublicKeyPool&) = delete;
+
+    PublicKeyPool& operator=(const PublicKeyPool&) = delete;
+
+    /**
+     * @brief Gets the handle of the given key, adding the key to the pool if it is not there.
+     * @throws `std::length_error` if the pool is full.
+     */
+    PublicKeyHandle intern(const PublicKey& key);
+
+    /**
+     * @brief Gets the handle of a hex-encoded key, such as the value of a `p` tag, adding the
+     * key to the pool if it is not there.
+     * @returns The handle, or `std::nullopt` if the string is not a 64-character hex key.
+     */
+    std::optional<PublicKeyHandle> intern(const std::string& hex);
+
+    /**
+     * @brief Gets the handle of the given key without adding it to the pool.
+     * @returns The handle, or `PublicKeyHandle::NONE` if the key has not been interned.
+     */
+    PublicKeyHandle find(const PublicKey& key) const;
+
+    /**
+     * @brief Gets the key with the given handle.
+     * @throws `std::invalid_argument` if the handle was not issued by this pool.
+     */
+    const PublicKey& key(PublicKeyHandle handle) const;
+
+    /**
+     * @brief The number of keys in the pool.
+     */
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t SHARD_COUNT = 16;
+
+    ///< Segment `i` holds `FIRST_SEGMENT_SIZE << i` keys, so 24 segments cover every 32-bit handle.
+    static constexpr std::size_t FIRST_SEGMENT_BITS = 8;
+    static constexpr std::size_t SEGMENT_COUNT = 24;
+
+    struct Shard
+    {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<PublicKey, uint32_t, BytesHash> handles;
+    };
+
+    std::array<Shard, SHARD_COUNT> _shards;
+
+    std::array<std::atomic<PublicKey*>, SEGMENT_COUNT> _segments{};
+
+    std::mutex _segmentMutex; ///< Serializes the allocation of new segments.
+
+    std::atomic<uint32_t> _size{0};
+
+    Shard& _shardFor(const PublicKey& key);
+
+    const Shard& _shardFor(const PublicKey& key) const;
+
+    /**
+     * @brief Locates the slot of the key with the given zero-based index.
+     * @param segment Set to the index of the segment holding the slot.
+     * @param offset Set to the position of the slot within its segment.
+     */
+    static void _locate(uint32_t index, std::size_t& segment, std::size_t& offset);
+
+    PublicKey& _slot(uint32_t index);
+};
+
+/**
+ * @brief The tags of an event, stored contiguously.
+ * @remark Every field of every tag is appended to a single byte buffer, and located through two
+ * offset tables: one giving the end of each field, and one giving the first field of each tag.
+ * Parsing or copying an event therefore costs a few buffer allocations however many tags it
+ * has, rather than one or more per tag.
+ * @remark Tag names of up to 7 bytes, which covers every standard tag, are also packed into a
+ * 64-bit key per tag, so looking tags up by name compares integers rather than strings.
+ * @remark Fields are exposed as `std::string_view`s into the buffer, which remain valid until
+ * the tags are next modified.
+ * @remark The buffer and tables are allocated from the memory resource given on construction,
+ * so tags can live in an `EventArena`.  Copies use the default resource.
+ */
+class Tags
+{
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    /**
+     * @brief A read-only view of one tag, such as `["p", "<pubkey>", "<relay>"]`.
+     */
+    class Tag
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = std::string_view;
+
+            Iterator(const Tag& tag, std::size_t index)
+                : _tags(tag._tags), _tagIndex(tag._index), _index(index) { };
+
+            std::string_view operator*() const { return Tag(*this->_tags, this->_tagIndex)[this->_index]; };
+
+            Iterator& operator++() { this->_index++; return *this; };
+
+            bool operator==(const Iterator& other) const { return this->_index == other._index; };
+
+            bool operator!=(const Iterator& other) const { return this->_index != other._index; };
+
+        private:
+            const Tags* _tags;
+            std::size_t _tagIndex;
+            std::size_t _index;
+        };
+
+        Tag(const Tags& tags, std::size_t index) : _tags(&tags), _index(index) { };
+
+        ///< The number of fields in the tag, including its name.
+        std::size_t size() const;
+
+        bool empty() const { return this->size() == 0; };
+
+        std::string_view operator[](std::size_t index) const;
+
+        ///< The tag's name, which is its first field, or an empty string if it has no fields.
+        std::string_view name() const;
+
+        Iterator begin() const { return Iterator(*this, 0); };
+
+        Iterator end() const { return Iterator(*this, this->size()); };
+
+        std::vector<std::string> toVector() const;
+
+    private:
+        const Tags* _tags;
+        std::size_t _index;
+    };
+
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Tag;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = Tag;
+
+        Iterator(const Tags& tags, std::size_t index) : _tags(&tags), _index(index) { };
+
+        Tag operator*() const { return Tag(*this->_tags, this->_index); };
+
+        Iterator& operator++() { this->_index++; return *this; };
+
+        bool operator==(const Iterator& other) const { return this->_index == other._index; };
+
+        bool operator!=(const Iterator& other) const { return this->_index != other._index; };
+
+    private:
+        const Tags* _tags;
+        std::size_t _index;
+    };
+
+    /**
+     * @brief The first values, that is the second fields, of every tag with a given name, in
+     * order.  Tags with the name but no value are skipped.
+     */
+    class ValueRange
+    {
+    public:
+        class Iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = std::string_view;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = std::string_view;
+
+            Iterator(const ValueRange& range, std::size_t index);
+
+            std::string_view operator*() const;
+
+            Iterator& operator++();
+
+            bool operator==(const Iterator& other) const { return this->_index == other._index; };
+
+            bool operator!=(const Iterator& other) const { return this->_index != other._index; };
+
+        private:
+            const ValueRange* _range;
+            std::size_t _index;
+
+            void _skipToMatch();
+        };
+
+        ValueRange(const Tags& tags, std::string_view name);
+
+        Iterator begin() const { return Iterator(*this, 0); };
+
+        Iterator end() const { return Iterator(*this, this->_tags->size()); };
+
+    private:
+        const Tags* _tags;
+        std::string_view _name;
+        uint64_t _nameKey;
+    };
+
+    Tags() = default;
+
+    explicit Tags(const allocator_type& allocator);
+
+    Tags(const Tags& other, const allocator_type& allocator);
+
+    Tags(const Tags& other) = default;
+
+    /**
+     * @remark The moved-from tags are left empty.
+     */
+    Tags(Tags&& other) noexcept;
+
+    Tags& operator=(const Tags& other) = default;
+
+    Tags& operator=(Tags&& other) noexcept;
+
+    Tags(std::initializer_list<std::vector<std::string>> tags);
+
+    Tags(const std::vector<std::vector<std::string>>& tags);
+
+    ///< The number of tags.
+    std::size_t size() const;
+
+    bool empty() const;
+
+    Tag operator[](std::size_t index) const;
+
+    Iterator begin() const { return Iterator(*this, 0); };
+
+    Iterator end() const { return Iterator(*this, this->size()); };
+
+    /**
+     * @brief Appends a tag with the given fields.
+     */
+    void push_back(std::initializer_list<std::string_view> fields);
+
+    /**
+     * @brief Appends a tag with the given fields.
+     */
+    void push_back(const std::vector<std::string>& fields);
+
+    /**
+     * @brief Appends a tag with no fields, to be filled with `appendToLastTag`.
+     */
+    void beginTag();
+
+    /**
+     * @brief Appends a field to the last tag.
+     * @throws `std::logic_error` if there are no tags.
+     */
+    void appendToLastTag(std::string_view field);
+
+    /**
+     * @brief Reserves space for the given numbers of tags, fields, and bytes of field content.
+     */
+    void reserve(std::size_t tagCount, std::size_t fieldCount, std::size_t byteCount);
+
+    void clear();
+
+    /**
+     * @brief Returns the value of the first tag with the given name, such as the `d` tag of an
+     * addressable event, or nothing if no tag with the name has a value.
+     */
+    std::optional<std::string_view> firstValue(std::string_view name) const;
+
+    /**
+     * @brief Returns a view of the values of every tag with the given name, such as the
+     * followed pubkeys in the `p` tags of a contact list.
+     */
+    ValueRange values(std::string_view name) const;
+
+    /**
+     * @brief Copies the tags into nested vectors.
+     */
+    std::vector<std::vector<std::string>> toVector() const;
+
+    bool operator==(const Tags& other) const;
+
+    bool operator!=(const Tags& other) const { return !(*this == other); };
+
+    /**
+     * @brief A number that changes whenever the tags change, so a cache can tell cheaply
+     * whether they have changed since it was filled.
+     * @remark A copy shares the generation of its source, since it holds the same tags.  Every
+     * change draws a generation no other tags have held.  Tags that have never changed are
+     * empty, and have generation zero.
+     */
+    uint64_t generation() const { return this->_generation; };
+
+private:
+    ///< The content of every field of every tag, back to back.
+    std::pmr::string _bytes;
+
+    ///< The offset in `_bytes` just past the end of each field.
+    std::pmr::vector<uint32_t> _fieldEnds;
+
+    ///< The index in `_fieldEnds` of the first field of each tag.
+    std::pmr::vector<uint32_t> _tagStarts;
+
+    ///< The packed name of each tag.  See `_nameKey`.
+    std::pmr::vector<uint64_t> _nameKeys;
+
+    ///< See `generation`.
+    uint64_t _generation = 0;
+
+    /**
+     * @brief Packs a name of up to 7 bytes, with its length, into a 64-bit key.  Longer names
+     * share a single key, and are told apart by comparing their bytes.
+     */
+    static uint64_t _nameKey(std::string_view name);
+
+    bool _hasName(std::size_t tagIndex, std::string_view name, uint64_t nameKey) const;
+
+    std::size_t _fieldCount(std::size_t tagIndex) const;
+
+    std::string_view _field(std::size_t fieldIndex) const;
+
+    void _appendField(std::string_view field);
+
+    ///< Draws a new generation, after a change.
+    void _touch();
+};
+
 /**
  * @brief A Nostr event.
  * @remark All data transmitted over the Nostr protocol is encoded in JSON blobs.  This struct
  * is common to every Nostr event kind.  The significance of each event is determined by the
  * `tags` and `content` fields.
+ * @remark The `id`, `pubkey`, and `sig` fields are held in binary form, and are hex-encoded only
+ * when the event is converted to or from JSON.  A binary field of all zeroes is unset, and is
+ * represented in JSON as an empty string.
+ * @remark The `tags` and `content` fields allocate from the memory resource the event is
+ * constructed with, which is the default resource unless the event was made by an
+ * `EventArena`.  Copying an event always copies it to the default resource.
 */
 struct Event
 {
-    std::string id; ///< SHA-256 hash of the event data.
-    std::string pubkey; ///< Public key of the event creator.
-    std::time_t createdAt; ///< Unix timestamp of the event creation.
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    EventId id{}; ///< SHA-256 hash of the event data.
+    PublicKey pubkey{}; ///< Public key of the event creator.
+    PublicKeyHandle pubkeyHandle = PublicKeyHandle::NONE; ///< Handle of `pubkey` in the global key pool, if interned.
+    std::time_t createdAt = 0; ///< Unix timestamp of the event creation.
     int kind; ///< Event kind.
-    std::vector<std::vector<std::string>> tags; ///< Arbitrary event metadata.
-    std::string content; ///< Event content.
-    std::string sig; ///< Event signature created with the private key of the event creator.
+    Tags tags; ///< Arbitrary event metadata.
+    std::pmr::string content; ///< Event content.
+    Signature sig{}; ///< Event signature created with the private key of the event creator.
+
+    Event() = default;
+
+    /**
+     * @param allocator The allocator from which the event's tags and content are allocated.
+     */
+    explicit Event(const allocator_type& allocator) : tags(allocator), content(allocator) { };
+
+    Event(const Event& other) = default;
+
+    Event(Event&& other) = default;
+
+    /**
+     * @remark An event in an `EventArena` does not take the serialization cache of the event
+     * assigned to it, since its destructor never runs to release it.
+     */
+    Event& operator=(const Event& other);
+
+    Event& operator=(Event&& other);
 
     /**
      * @brief Serializes the event to a JSON object.
      * @returns A stringified JSON object representing the event.
      * @throws `std::invalid_argument` if the event object is invalid.
+     * @remark Returns a copy of the buffer from `serializeShared`.
      */
     std::string serialize();
 
+    /**
+     * @brief Serializes the event to a JSON object, reusing the result of the last call if the
+     * event has not changed since.
+     * @returns An immutable buffer holding a stringified JSON object representing the event.
+     * @throws `std::invalid_argument` if the event object is invalid.
+     * @remark The event keeps a snapshot of the fields its ID covers, along with the ID and the
+     * JSON last generated from them.  Fields may be changed directly, so each call compares the
+     * fields with the snapshot: if they are unchanged the ID is not rehashed, and if the
+     * signature is also unchanged the same buffer is returned again.  The snapshot holds the
+     * generation of the tags rather than a copy of them, so they are compared in constant time.
+     * The content may be assigned directly, with no counter to tell that it changed, so the
+     * snapshot holds a copy of it, and each call compares the content byte for byte.  A repeat
+     * call thus costs a comparison linear in the size of the content, which is still far less
+     * than hashing and rendering the event again.
+     * @remark Events in an `EventArena` are not cached, since their destructors never run.
+     */
+    std::shared_ptr<const std::string> serializeShared();
+
     /**
      * @brief Deserializes the event from a JSON string.
      * @param jsonString A stringified JSON object representing the event.
@@ -50,11 +542,54 @@ struct Event
      */
     static Event fromJson(nlohmann::json j);
 
+    /**
+     * @brief Interns the event's pubkey in `PublicKeyPool::global()` and records its handle.
+     * @returns The handle, or `PublicKeyHandle::NONE` if the pubkey is unset.
+     * @remark Events parsed from relay messages are interned as they are parsed.  The handle is
+     * not updated automatically; call this again after changing `pubkey`.
+     */
+    PublicKeyHandle internPubkey();
+
+    ///< The largest event kind NIP-01 allows.
+    static constexpr int MAX_KIND = 65535;
+
+    /**
+     * @brief Checks whether relays keep only the newest event of the given kind by each author.
+     * @remark Per NIP-01, these are kinds 0, 3, and 10000 to 19999.
+     */
+    static bool isReplaceableKind(int kind);
+
+    /**
+     * @brief Checks whether relays keep only the newest event of the given kind by each author
+     * for each `d` tag value.
+     * @remark Per NIP-01, these are kinds 30000 to 39999.
+     */
+    static bool isAddressableKind(int kind);
+
+    /**
+     * @brief Checks whether this event replaces the given version of the same replaceable or
+     * addressable event.
+     * @remark Per NIP-01, the newer event wins, and of two created in the same second, the one
+     * with the lower ID wins.  The caller must check that both events have the same address.
+     */
+    bool supersedes(const Event& other) const;
+
+    /**
+     * @brief Checks whether the version of an event with the given creation time and ID replaces
+     * the other given version, by the rule of `supersedes`, for callers that keep only the
+     * creation times and IDs of versions.
+     */
+    static bool supersedes(
+        std::time_t createdAt,
+        const EventId& id,
+        std::time_t otherCreatedAt,
+        const EventId& otherId);
+
     /**
      * @brief Compares two events for equality.
      * @remark Two events are considered equal if they have the same ID, since the ID is uniquely
-     * generated from the event data.  If the `id` field is empty for either event, the comparison
-     * function will throw an exception.
+     * generated from the event data.  If the `id` field is unset (all zeroes) for either event,
+     * the comparison function will throw an exception.
      */
     bool operator==(const Event& other) const;
 
@@ -68,9 +603,93 @@ private:
 
     /**
      * @brief Generates an ID for the event and assigns it to the event's `id` field.
-     * @remark The ID is a 32-bytes lowercase hex-encoded sha256 of the serialized event data.
+     * @remark The ID is the 32-byte sha256 of the serialized event data.  It is hex-encoded only
+     * when the event is converted to JSON.
      */
     void generateId();
+
+    ///< The fields an event ID covers, and the ID generated from them.
+    struct IdSnapshot
+    {
+        PublicKey pubkey;
+        std::time_t createdAt;
+        int kind;
+        uint64_t tagsGeneration;
+        std::string content;
+        EventId id;
+    };
+
+    ///< The JSON serialization of an event with the ID of `_idSnapshot` and the given signature.
+    struct JsonSnapshot
+    {
+        Signature sig;
+        std::string json;
+    };
+
+    std::shared_ptr<const IdSnapshot> _idSnapshot;
+
+    std::shared_ptr<const JsonSnapshot> _jsonSnapshot;
+
+    bool _matchesIdSnapshot() const;
+
+    ///< Whether the event's snapshots are released when it is destroyed.  Events in an arena
+    ///< are never destroyed.
+    bool _isCacheable() const;
+};
+
+class FilterMatcher;
+
+/**
+ * @brief A monotonic arena holding a batch of events that are discarded together, such as the
+ * results of a query.
+ * @remark Each event made by the arena, along with the buffers of its tags and content, is
+ * carved from a few large blocks, rather than allocated piece by piece from the heap.  Events
+ * laid out next to each other are cheap to scan, and the whole batch is freed in one step.
+ * @remark The events are handed out as `std::shared_ptr`s that share ownership of the arena
+ * itself, so the arena lives until the last of its events is released.  Event destructors are
+ * never run; since every allocation an arena event makes comes from the arena, none are needed.
+ * @remark Allocation is serialized by a mutex, so events may be made and filled on several
+ * threads at once.  Moving the tags or content out of an arena event keeps them in the arena;
+ * copy them instead if they must outlive it.
+ */
+class EventArena : public std::pmr::memory_resource, public std::enable_shared_from_this<EventArena>
+{
+public:
+    ///< The size of the first block the arena allocates.  Later blocks grow geometrically.
+    static constexpr std::size_t DEFAULT_INITIAL_SIZE = 64 * 1024;
+
+    static std::shared_ptr<EventArena> create(std::size_t initialSize = DEFAULT_INITIAL_SIZE);
+
+    EventArena(const EventArena&) = delete;
+
+    EventArena& operator=(const EventArena&) = delete;
+
+    /**
+     * @brief Constructs an empty event in the arena.
+     * @returns A pointer to the event, which keeps the arena alive.
+     */
+    std::shared_ptr<Event> makeEvent();
+
+    /**
+     * @brief The total number of bytes allocated from the arena.
+     */
+    std::size_t bytesAllocated() const;
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+    mutable std::mutex _mutex;
+
+    std::pmr::monotonic_buffer_resource _arena;
+
+    std::size_t _bytesAllocated = 0;
+
+    explicit EventArena(std::size_t initialSize);
 };
 
 /**
@@ -83,11 +702,12 @@ struct Filters
 {
     std::vector<std::string> ids; ///< Event IDs.
     std::vector<std::string> authors; ///< Event author npubs.
+    std::vector<PublicKeyHandle> authorHandles; ///< Event authors, as handles in the global key pool.
     std::vector<int> kinds; ///< Kind numbers.
     std::unordered_map<std::string, std::vector<std::string>> tags; ///< Tag names mapped to lists of tag values.
-    std::time_t since; ///< Unix timestamp.  Matching events must be newer than this.
-    std::time_t until; ///< Unix timestamp.  Matching events must be older than this.
-    int limit; ///< The maximum number of events the relay should return on the initial query.
+    std::time_t since = 0; ///< Unix timestamp.  Matching events must be no older than this.
+    std::time_t until = 0; ///< Unix timestamp.  Matching events must be no newer than this.
+    int limit = 0; ///< The maximum number of events the relay should return on the initial query.
 
     /**
      * @brief Serializes the filters to a JSON object.
@@ -99,6 +719,29 @@ struct Filters
      */
     std::string serialize(std::string& subscriptionId);
 
+    /**
+     * @brief Serializes several sets of filters into a single REQ message.
+     * @param filters The filters to include in the request.  An event matches the request if it
+     * matches any one of them.
+     * @param subscriptionId A string up to 64 chars in length that is unique per relay connection.
+     * @returns A stringified JSON array of the form `["REQ", subscriptionId, filter1, filter2, ...]`.
+     * @throws `std::invalid_argument` if no filters are given, or if any filter object is invalid.
+     * @remarks The relay sends a single EOSE message once it has returned the stored events
+     * matching all of the filters.
+     */
+    static std::string serialize(
+        std::vector<std::shared_ptr<Filters>>& filters,
+        std::string& subscriptionId);
+
+    /**
+     * @brief Compiles the filters into a matcher that tests events locally.
+     * @returns An immutable matcher that applies the filters the way a relay does.
+     * @remark The matcher is a snapshot; later changes to the filters do not affect it.  Use it
+     * to check that relays return only matching events, or to route live events to
+     * subscriptions without a round trip to the relay.
+     */
+    FilterMatcher compile() const;
+
 private:
     /**
      * @brief Validates the filters.
@@ -107,11 +750,92 @@ private:
      */
     void validate();
 };
+
+/**
+ * @brief An immutable, compiled form of a set of filters that tests events locally.
+ * @remark Event IDs and authors are held in open-addressed hash tables keyed on their binary
+ * form, kinds in a bitmap covering the full 16-bit kind range, and tag values in one set per
+ * tag name.  Matching an event performs no allocations.
+ * @remark Authors are also interned in `PublicKeyPool::global()` and held in a bitmap indexed by
+ * handle, so the author of an event with a `pubkeyHandle` is checked with a single bit test.
+ * @remark Matching follows NIP-01: an event matches if it satisfies every condition that is
+ * set, where `since <= createdAt <= until`, and each list condition is satisfied by any one of
+ * its entries.  Empty lists and zero timestamps are unset and match every event.  IDs and
+ * authors must be full 64-character hex strings; entries that are not never match.
+ */
+class FilterMatcher
+{
+public:
+    /**
+     * @brief Checks whether the given event satisfies the filters.
+     * @remark The `limit` does not apply here, since relays apply it only to the stored events
+     * returned before EOSE.  Use `select` to apply it to a batch of stored events.
+     */
+    bool matches(const Event& event) const;
+
+    /**
+     * @brief Picks the events a relay would return for the filters from a batch of stored
+     * events.
+     * @param events The candidate events, in any order.
+     * @returns The matching events, newest first, truncated to the filters' `limit` if it is set.
+     * @remark Events with the same `createdAt` are ordered by ID, lowest first, as NIP-01
+     * requires.
+     */
+    std::vector<std::shared_ptr<Event>> select(const std::vector<std::shared_ptr<Event>>& events) const;
+
+    /**
+     * @brief The maximum number of stored events the filters select, or 0 if there is no limit.
+     */
+    int limit() const;
+
+private:
+    friend struct Filters;
+
+    ///< A tag name and the set of values, any one of which satisfies the tag condition.
+    struct TagCondition
+    {
+        std::string name;
+        std::shared_ptr<const std::vector<std::string>> storage; ///< Owns the strings viewed by `values`.
+        std::unordered_set<std::string_view> values;
+    };
+
+    ///< One bit for each kind in the range 0-65535.  All bits are set when no kinds are given.
+    std::vector<uint64_t> _kindBits;
+
+    ///< An open-addressed table of event IDs.  All-zero slots are empty.
+    std::vector<EventId> _idSlots;
+
+    ///< An open-addressed table of authors.  All-zero slots are empty.
+    std::vector<PublicKey> _authorSlots;
+
+    ///< One bit for each author handle, up to the highest handle among the authors.
+    std::vector<uint64_t> _authorHandleBits;
+
+    ///< The tag conditions.  An event must satisfy each of them.
+    std::vector<TagCondition> _tagConditions;
+
+    std::time_t _since = 0;
+    std::time_t _until = 0;
+    int _limit = 0;
+    bool _hasIds = false;
+    bool _hasAuthors = false;
+
+    explicit FilterMatcher(const Filters& filters);
+
+    bool _matchesTags(const Event& event) const;
+};
 } // namespace data
 } // namespace nostr
 
 namespace nlohmann
 {
+template <>
+struct adl_serializer<nostr::data::Tags>
+{
+    static void to_json(json& j, const nostr::data::Tags& tags);
+    static void from_json(const json& j, nostr::data::Tags& tags);
+};
+
 template <>
 struct adl_serializer<nostr::data::Event>
 {
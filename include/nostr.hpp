@@ -2,8 +2,19 @@
 
 #include "data/data.hpp"
 #include "client/web_socket_client.hpp"
+#include "service/cancellation_token.hpp"
+#include "service/event_channel.hpp"
+#include "service/negentropy.hpp"
 #include "service/nostr_service_base.hpp"
+#include "service/relay_latencies.hpp"
+#include "service/relay_router.hpp"
+#include "service/replaceable_event_index.hpp"
+#include "service/request_coalescer.hpp"
+#include "service/seen_event_ids.hpp"
+#include "service/sync_watermarks.hpp"
 #include "signer/signer.hpp"
+#include "store/event_store.hpp"
+#include "store/mmap_event_store.hpp"
 
 // namespace nostr
 // {
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief Lets a caller cancel requests to relays that are still waiting for answers.
+ * @remark A token may be shared by several requests, which are all cancelled together.  Each
+ * request registers a handler while it waits, and removes it once it has finished.
+ * @remark Every method is safe to call from any thread.
+ */
+class CancellationToken
+{
+public:
+    CancellationToken() = default;
+
+    CancellationToken(const CancellationToken&) = delete;
+
+    CancellationToken& operator=(const CancellationToken&) = delete;
+
+    /**
+     * @brief Cancels every request using the token, and invokes their handlers.  Calls after
+     * the first do nothing.
+     */
+    void cancel();
+
+    bool isCancelled() const;
+
+    /**
+     * @brief Registers a handler to invoke when the token is cancelled.  If the token is
+     * already cancelled, the handler is invoked at once.
+     * @returns A handle with which to remove the handler, or 0 if it was invoked at once.
+     */
+    std::size_t onCancel(std::function<void()> cancelHandler);
+
+    /**
+     * @brief Removes the handler with the given handle, if it has not yet been invoked.
+     */
+    void removeHandler(std::size_t handle);
+
+private:
+    bool _isCancelled = false;
+
+    std::size_t _nextHandle = 1;
+
+    std::map<std::size_t, std::function<void()>> _cancelHandlers;
+
+    mutable std::mutex _mutex;
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief A bounded queue through which a query passes events to its consumer as they arrive.
+ * @remark The producer pushes events and marks the channel complete once it has no more.  The
+ * consumer takes events with `next` until it returns `nullptr`, or stops early with `close`.
+ * @remark A producer that finds the channel full waits until the consumer takes an event or
+ * closes the channel, so a slow consumer holds back its producer rather than letting the queue
+ * grow without bound.  A producer that must not wait, such as one shared by many channels,
+ * uses `tryPush` instead, which ends the channel once the consumer falls a full channel behind.
+ * The consumer then takes the events already in the channel, after which `next` throws rather
+ * than returning `nullptr`, so a stream cut short is never mistaken for a complete one.
+ * @remark Every method is safe to call from any thread.
+ */
+class EventChannel
+{
+public:
+    ///< The number of events a new channel holds before its producer must wait.
+    static constexpr std::size_t DEFAULT_CAPACITY = 256;
+
+    /**
+     * @throws `std::invalid_argument` if the capacity is zero.
+     */
+    explicit EventChannel(std::size_t capacity = DEFAULT_CAPACITY);
+
+    EventChannel(const EventChannel&) = delete;
+
+    EventChannel& operator=(const EventChannel&) = delete;
+
+    /**
+     * @brief Adds an event to the channel, waiting while the channel is full.
+     * @returns False if the channel was closed, or marked complete, and the event was dropped.
+     */
+    bool push(std::shared_ptr<data::Event> event);
+
+    /**
+     * @brief Adds an event to the channel without waiting.  If the channel is full, the event is
+     * dropped, and the channel is marked overflowed and complete, so the consumer takes the
+     * events already in it and then learns from `next` that the stream was cut short.
+     * @returns False if the channel was full, closed, or marked complete, and the event was
+     * dropped.
+     */
+    bool tryPush(std::shared_ptr<data::Event> event);
+
+    /**
+     * @brief Marks that no more events will be pushed.  Events already in the channel remain
+     * for the consumer to take.
+     */
+    void complete();
+
+    /**
+     * @brief Stops the channel early, dropping any events not yet taken and waking a waiting
+     * producer.  Invokes the close handler, if one is set, the first time it is called.
+     */
+    void close();
+
+    /**
+     * @brief Takes the next event, waiting until one arrives.
+     * @returns The event, or `nullptr` once the channel is complete and empty, or closed.
+     * @throws `std::overflow_error` once the channel is empty, if it was ended by `tryPush`
+     * finding it full.  Every later call throws as well, until the channel is closed.
+     */
+    std::shared_ptr<data::Event> next();
+
+    /**
+     * @brief Sets a callable invoked when the consumer closes the channel, such as to cancel
+     * the query feeding it.  If the channel is already closed, it is invoked at once.
+     */
+    void onClose(std::function<void()> closeHandler);
+
+    bool isClosed() const;
+
+    bool isComplete() const;
+
+    ///< Whether the channel was completed because an event arrived while it was full.
+    bool isOverflowed() const;
+
+    ///< The number of events waiting to be taken.
+    std::size_t size() const;
+
+    std::size_t capacity() const;
+
+private:
+    std::size_t _capacity;
+
+    std::deque<std::shared_ptr<data::Event>> _events;
+
+    bool _isComplete = false;
+
+    bool _isClosed = false;
+
+    bool _isOverflowed = false;
+
+    std::function<void()> _closeHandler;
+
+    mutable std::mutex _mutex;
+
+    std::condition_variable _notEmpty;
+
+    std::condition_variable _notFull;
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+class VerifiedEventCache;
+class WorkerPool;
+
+/**
+ * @brief Configures an `EventVerifier`.
+ */
+struct EventVerifierOptions
+{
+    ///< The number of threads over which batches are split.  Defaults to a small pool, since
+    ///< each service starts its own verifier; raise it when verifying signatures of busy streams.
+    std::size_t workerCount = std::min<std::size_t>(std::thread::hardware_concurrency(), 2);
+
+    ///< Whether to check each event's BIP-340 signature in addition to its ID.
+    bool verifySignatures = false;
+
+    ///< The number of verified events remembered so that copies of them received from other
+    ///< relays skip the signature check.
+    std::size_t verifiedCacheCapacity = 8192;
+};
+
+/**
+ * @brief A snapshot of the throughput counters of an `EventVerifier`.
+ */
+struct EventVerifierCounters
+{
+    uint64_t eventsVerified = 0; ///< Events that passed every enabled check.
+    uint64_t eventsRejected = 0; ///< Events dropped because they failed a check.
+    uint64_t signaturesChecked = 0; ///< Signatures checked with a full BIP-340 verification.
+    uint64_t signaturesRejected = 0; ///< Events dropped because their signature was invalid.
+    uint64_t signatureCacheHits = 0; ///< Signature checks skipped because the same event was already verified.
+    uint64_t batches = 0; ///< The number of batches the events were verified in.
+    uint64_t busyNanoseconds = 0; ///< Time spent verifying, summed over all workers.
+
+    /**
+     * @brief The number of events checked per second of worker time, which is the throughput of
+     * a single fully busy core.
+     */
+    double eventsPerSecondPerCore() const;
+};
+
+/**
+ * @brief Verifies events received from relays before they are handed to the client.
+ * @remark An event's ID is the SHA-256 hash of its canonical serialization, so recomputing the
+ * hash detects events that were altered or corrupted after they were created.  Events are checked
+ * in batches, which are split across a pool of worker threads and hashed several messages at a
+ * time by `cryptography::Sha256MultiBuffer`.
+ * @remark When signature verification is enabled, events whose IDs match are then checked
+ * against their BIP-340 signatures with noscrypt, in parallel, using one noscrypt context per
+ * worker.  Copies of one event within a batch are checked once, and events already verified in
+ * an earlier batch are found in a bounded cache and not checked again.
+ * @remark Events may be verified either synchronously, with `verify`, or as part of an ordered
+ * ingest stream, with `submit`.  The ingest stream collects whatever events arrive while the
+ * previous batch is being verified into the next batch, so batches grow with the incoming rate
+ * and a lone event is not held back waiting for others.
+ */
+class EventVerifier
+{
+public:
+    explicit EventVerifier(EventVerifierOptions options = EventVerifierOptions());
+
+    ~EventVerifier();
+
+    EventVerifier(const EventVerifier&) = delete;
+
+    EventVerifier& operator=(const EventVerifier&) = delete;
+
+    /**
+     * @brief Checks a batch of events.
+     * @returns For each event, in order, true if its ID matches its content and, when signature
+     * verification is enabled, its signature is valid.
+     */
+    std::vector<bool> verify(const std::vector<std::shared_ptr<data::Event>>& events);
+
+    /**
+     * @brief Queues an event for verification.
+     * @param event The event to verify.
+     * @param onVerified Invoked with the event once it has been verified.  Events that fail
+     * verification are logged and dropped, and the callback is not invoked for them.
+     * @remark Callbacks are invoked on the verifier's dispatch thread, in the order in which the
+     * events and barriers were submitted.
+     */
+    void submit(
+        std::shared_ptr<data::Event> event,
+        std::function<void(std::shared_ptr<data::Event>)> onVerified);
+
+    /**
+     * @brief Queues a barrier, such as the delivery of an EOSE message.
+     * @param onReached Invoked once every event submitted before the barrier has been verified
+     * and delivered.
+     */
+    void submit(std::function<void()> onReached);
+
+    /**
+     * @brief Returns a snapshot of the verifier's throughput counters.
+     */
+    EventVerifierCounters counters() const;
+
+    ///< Whether events must carry valid signatures to pass verification.
+    bool verifiesSignatures() const;
+
+private:
+    struct PendingItem
+    {
+        std::shared_ptr<data::Event> event;
+        std::function<void(std::shared_ptr<data::Event>)> onVerified;
+        std::function<void()> onReached;
+    };
+
+    ///< State owned by a single worker, such as reusable buffers and a noscrypt context.
+    struct WorkerState;
+
+    bool _shouldVerifySignatures;
+
+    std::unique_ptr<WorkerPool> _workers;
+
+    std::vector<std::unique_ptr<WorkerState>> _workerStates;
+
+    std::unique_ptr<VerifiedEventCache> _verifiedCache;
+
+    std::atomic<uint64_t> _eventsVerified{0};
+
+    std::atomic<uint64_t> _eventsRejected{0};
+
+    std::atomic<uint64_t> _signaturesChecked{0};
+
+    std::atomic<uint64_t> _signaturesRejected{0};
+
+    std::atomic<uint64_t> _signatureCacheHits{0};
+
+    std::atomic<uint64_t> _batches{0};
+
+    std::atomic<uint64_t> _busyNanoseconds{0};
+
+    std::mutex _queueMutex;
+
+    std::condition_variable _queueNotEmpty;
+
+    std::deque<PendingItem> _queue;
+
+    bool _isStopping = false;
+
+    std::thread _dispatcher;
+
+    void _dispatch();
+
+    /**
+     * @brief Recomputes the ID of each event, in parallel, and records whether it matches.
+     */
+    void _verifyIds(const std::vector<std::shared_ptr<data::Event>>& events, std::vector<uint8_t>& results);
+
+    /**
+     * @brief Checks the signature of each event that passed the ID check, skipping repeated and
+     * cached events, and clears the result of each event whose signature is invalid.
+     */
+    void _verifySignatures(
+        const std::vector<std::shared_ptr<data::Event>>& events,
+        std::vector<uint8_t>& results);
+};
+} // namespace service
+} // namespace nostr
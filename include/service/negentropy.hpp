@@ -0,0 +1,180 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief The set of events one side of a Negentropy reconciliation holds, as pairs of
+ * `created_at` and ID.
+ * @remark Items are inserted in any order, then the storage is sealed, which sorts them by
+ * `created_at` and then ID, and precomputes running sums of their IDs so the fingerprint of any
+ * range costs a subtraction and one hash.
+ */
+class NegentropyStorage
+{
+public:
+    ///< One event in the set.
+    struct Item
+    {
+        uint64_t timestamp;
+        data::EventId id;
+    };
+
+    ///< A Negentropy fingerprint: the first 16 bytes of a SHA-256 hash.
+    using Fingerprint = std::array<uint8_t, 16>;
+
+    /**
+     * @brief Adds an event to the set.
+     * @throws `std::invalid_argument` if the timestamp is negative.
+     * @throws `std::logic_error` if the storage is sealed.
+     */
+    void insert(std::time_t createdAt, const data::EventId& id);
+
+    /**
+     * @brief Sorts the items and removes duplicates.  No items may be inserted afterward.
+     */
+    void seal();
+
+    bool isSealed() const;
+
+    std::size_t size() const;
+
+    const Item& item(std::size_t index) const;
+
+    /**
+     * @brief Finds the first item in the range `[begin, end)` that is not less than the bound.
+     */
+    std::size_t findLowerBound(std::size_t begin, std::size_t end, const Item& bound) const;
+
+    /**
+     * @brief Computes the fingerprint of the items in the range `[begin, end)`: the hash of the
+     * sum of their IDs, as 256-bit little-endian integers, followed by their count.
+     */
+    Fingerprint fingerprint(std::size_t begin, std::size_t end) const;
+
+private:
+    std::vector<Item> _items;
+
+    ///< The sum of the IDs of the items before each index, as four little-endian words.
+    std::vector<std::array<uint64_t, 4>> _idSums;
+
+    bool _isSealed = false;
+};
+
+/**
+ * @brief One side of a Negentropy (NIP-77) range-based set reconciliation.
+ * @remark Each side describes ranges of its events, ordered by `created_at` and ID, by their
+ * fingerprints.  Ranges whose fingerprints differ are split into smaller ranges, and small
+ * ranges are sent as lists of IDs, until each side knows which IDs only it has.  The exchange
+ * takes a few round trips however large the sets are, and sends data in proportion to their
+ * differences rather than their sizes.
+ * @remark The initiator calls `initiate`, sends the message to the responder, and passes each
+ * reply to `reconcile`, until it returns no message.  The responder passes each message it
+ * receives to `reconcile` and sends back the result.  Messages are binary; NIP-77 carries them
+ * hex-encoded.
+ * @remark This implements version 1 of the protocol, which is identified by the byte 0x61.
+ */
+class Negentropy
+{
+public:
+    static constexpr uint8_t PROTOCOL_VERSION = 0x61;
+
+    /**
+     * @param storage The sealed set of local events.
+     * @param frameSizeLimit The largest message to produce, in bytes, or 0 for no limit.  Ranges
+     * that do not fit are deferred to a later round.
+     * @throws `std::invalid_argument` if the storage is not sealed, or the frame size limit is
+     * nonzero and less than 4096.
+     */
+    explicit Negentropy(
+        std::shared_ptr<const NegentropyStorage> storage,
+        std::size_t frameSizeLimit = 0);
+
+    /**
+     * @brief Begins a reconciliation as the initiator.
+     * @returns The first message to send to the responder.
+     * @throws `std::logic_error` if a reconciliation has already begun.
+     */
+    std::string initiate();
+
+    /**
+     * @brief Processes a reply from the responder.
+     * @param haveIds Receives the IDs of events only this side has.
+     * @param needIds Receives the IDs of events only the responder has.
+     * @returns The next message to send, or nothing once the reconciliation is complete.
+     * @throws `std::invalid_argument` if the message is malformed or of another protocol
+     * version.
+     * @throws `std::logic_error` if `initiate` has not been called.
+     */
+    std::optional<std::string> reconcile(
+        const std::string& message,
+        std::vector<data::EventId>& haveIds,
+        std::vector<data::EventId>& needIds);
+
+    /**
+     * @brief Processes a message from the initiator.
+     * @returns The reply to send.  A message of another protocol version is answered with a
+     * message holding only this side's version.
+     * @throws `std::invalid_argument` if the message is malformed.
+     * @throws `std::logic_error` if this side is the initiator.
+     */
+    std::string reconcile(const std::string& message);
+
+private:
+    ///< A position in the ordered set: a timestamp and a prefix of an ID, zero-padded.
+    struct Bound
+    {
+        NegentropyStorage::Item item;
+        std::size_t idSize;
+    };
+
+    std::shared_ptr<const NegentropyStorage> _storage;
+
+    std::size_t _frameSizeLimit;
+
+    bool _isInitiator = false;
+
+    ///< The last timestamps decoded and encoded.  Timestamps are sent as deltas from these.
+    uint64_t _lastTimestampIn = 0;
+    uint64_t _lastTimestampOut = 0;
+
+    std::optional<std::string> _reconcile(
+        const std::string& message,
+        std::vector<data::EventId>* haveIds,
+        std::vector<data::EventId>* needIds);
+
+    /**
+     * @brief Describes the items in the range `[lower, upper)`, as an ID list if there are few
+     * of them, or else as the fingerprints of 16 subranges.
+     */
+    void _splitRange(std::size_t lower, std::size_t upper, const Bound& upperBound, std::string& output);
+
+    bool _exceedsFrameSizeLimit(std::size_t size) const;
+
+    void _encodeBound(const Bound& bound, std::string& output);
+
+    void _encodeTimestamp(uint64_t timestamp, std::string& output);
+
+    Bound _decodeBound(const uint8_t*& position, const uint8_t* end);
+
+    uint64_t _decodeTimestamp(const uint8_t*& position, const uint8_t* end);
+
+    /**
+     * @brief The shortest bound that sorts after `previous` and not after `current`.
+     */
+    static Bound _minimalBound(const NegentropyStorage::Item& previous, const NegentropyStorage::Item& current);
+};
+} // namespace service
+} // namespace nostr
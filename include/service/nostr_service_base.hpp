@@ -1,11 +1,14 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include <plog/Init.h>
@@ -13,11 +16,133 @@
 
 #include "data/data.hpp"
 #include "client/web_socket_client.hpp"
+#include "service/cancellation_token.hpp"
+#include "service/event_channel.hpp"
+#include "service/event_verifier.hpp"
+#include "service/relay_latencies.hpp"
+#include "service/relay_router.hpp"
+#include "service/replaceable_event_index.hpp"
+#include "service/seen_event_ids.hpp"
+#include "service/sync_watermarks.hpp"
+#include "store/event_store.hpp"
 
 namespace nostr
 {
 namespace service
 {
+/**
+ * @brief How a relay answered a request.
+ */
+enum class RelayRequestStatus
+{
+    COMPLETED, ///< The relay sent EOSE for a query, or accepted a published event.
+    REJECTED, ///< The relay closed a query with CLOSED, or rejected a published event.
+    FAILED, ///< The request could not be sent to the relay.
+    TIMED_OUT, ///< The deadline passed before the relay answered.
+    CANCELLED, ///< The request was cancelled before the relay answered.
+    SUPERSEDED ///< Enough other relays finished before the relay answered.
+};
+
+/**
+ * @brief Decides how many relays must finish a request before it returns.
+ * @remark A request that ends before every relay has answered closes the subscriptions still
+ * open, and reports the relays that had not answered as superseded.
+ */
+struct CompletionPolicy
+{
+    enum class Mode
+    {
+        ALL, ///< Wait for every relay.
+        FIRST_K, ///< Wait for the first `relayCount` relays to finish.
+        FRACTION, ///< Wait for `relayFraction` of the relays to finish.
+        HEDGED ///< Ask the fastest relays first, and more only if they are slow to finish.
+    };
+
+    Mode mode = Mode::ALL;
+
+    ///< The number of relays that must finish, for `FIRST_K` and `HEDGED`.
+    std::size_t relayCount = 1;
+
+    ///< The fraction of the relays that must finish, for `FRACTION`.  Rounded up.
+    double relayFraction = 1.0;
+
+    ///< For `HEDGED`, the percentile of the recent latencies of the relays already asked after
+    ///< which more relays are asked.
+    double hedgePercentile = 0.9;
+
+    ///< For `HEDGED`, the delay after which more relays are asked when those already asked
+    ///< have no recorded latencies.
+    std::chrono::milliseconds defaultHedgeDelay = std::chrono::milliseconds(500);
+
+    static CompletionPolicy all();
+
+    static CompletionPolicy firstK(std::size_t relayCount);
+
+    static CompletionPolicy fractionOf(double relayFraction);
+
+    /**
+     * @brief A policy that asks the `relayCount` fastest relays, and after each hedge delay
+     * asks as many more as are still needed, until `relayCount` relays have finished.
+     * @remark Publishes send to every relay whatever the policy, so for them this waits for
+     * the first `relayCount` relays, as `firstK` does.
+     */
+    static CompletionPolicy hedged(std::size_t relayCount, double hedgePercentile = 0.9);
+
+    /**
+     * @brief The number of relays that must finish a request sent to the given number of
+     * relays.
+     */
+    std::size_t requiredCount(std::size_t targetCount) const;
+};
+
+/**
+ * @brief Bounds how long a request to the relays may wait for their answers.
+ */
+struct RequestOptions
+{
+    ///< The time by which every relay must answer.  Relays that have not answered by then are
+    ///< reported as timed out.  Defaults to no deadline.
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
+    ///< Cancels the request when triggered, if set.  Relays that have not answered by then are
+    ///< reported as cancelled.
+    std::shared_ptr<CancellationToken> cancellationToken;
+
+    ///< How many relays must finish before the request returns.  Defaults to every relay.
+    CompletionPolicy completion;
+
+    ///< For publishes, invoked with the relay, status, and message of each answer that arrives
+    ///< after the publish has returned, such as from the relays still answering once a quorum
+    ///< has accepted the event.  Invoked on the thread that delivers the answer.
+    std::function<void(const std::string&, RelayRequestStatus, const std::string&)> lateAnswerHandler;
+
+    /**
+     * @brief Creates options whose deadline is the given time from now.
+     */
+    static RequestOptions withTimeout(std::chrono::milliseconds timeout);
+};
+
+/**
+ * @brief The events a query received, with how each relay answered it.
+ */
+struct QueryResult
+{
+    std::vector<std::shared_ptr<data::Event>> events;
+    std::unordered_map<std::string, RelayRequestStatus> relayStatuses;
+};
+
+/**
+ * @brief How each relay answered the publication of an event.
+ */
+struct PublishResult
+{
+    std::unordered_map<std::string, RelayRequestStatus> relayStatuses;
+
+    ///< The message each relay sent with its answer, such as its reason for rejecting the event,
+    ///< for the relays that answered with one.
+    std::unordered_map<std::string, std::string> relayMessages;
+};
+
 class INostrServiceBase
 {
 public:
@@ -56,6 +181,21 @@ public:
         std::shared_ptr<data::Event> event
     ) = 0;
 
+    /**
+     * @brief Publishes a Nostr event to all open relay connections, waiting for their answers
+     * no longer than the given options allow.
+     * @returns How each relay answered.  Relays that did not answer before the deadline passed,
+     * the request was cancelled, or the completion policy was met are reported as such.
+     * @remark For a quorum publish, set the completion policy to `CompletionPolicy::firstK` with
+     * the number of relays that must accept the event.  The publish returns once that many
+     * have accepted it, or every relay has answered, and the other relays' answers are passed
+     * to the options' late answer handler as they arrive.
+     */
+    virtual PublishResult publishEvent(
+        std::shared_ptr<data::Event> event,
+        RequestOptions options
+    ) = 0;
+
     /**
      * @brief Queries all open relay connections for events matching the given set of filters, and
      * returns all stored matching events returned by the relays.
@@ -93,6 +233,108 @@ public:
         std::function<void(const std::string&)> eoseHandler,
         std::function<void(const std::string&, const std::string&)> closeHandler
     ) = 0;
+
+    /**
+     * @brief Queries all open relay connections for events matching any of the given sets of
+     * filters, and returns all stored matching events returned by the relays.
+     * @param filters The sets of filters to use for the query.  They are sent together in a
+     * single REQ message, so the query uses one subscription on each relay.
+     * @returns A std::future that will eventually hold a vector of all events matching any of
+     * the filters from all open relay connections.
+     * @remark The method runs until each relay sends a single EOSE message covering all of the
+     * filters.  Each set of filters must have a `limit` in the range 1-64, inclusive, or it will
+     * be defaulted to 16.
+     */
+    virtual std::future<std::vector<std::shared_ptr<data::Event>>> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters
+    ) = 0;
+
+    /**
+     * @brief Queries all open relay connections for events matching any of the given sets of
+     * filters, constructing the returned events in the given arena.
+     * @param filters The sets of filters to use for the query.
+     * @param arena The arena in which received events, with their tags and content, are
+     * allocated.  The returned events keep the arena alive.
+     * @returns A std::future that will eventually hold a vector of all events matching any of
+     * the filters from all open relay connections.
+     * @remark Use this overload for batches of results that are discarded together.  Parsing
+     * the events then makes a few large allocations rather than several per event, and the
+     * batch is freed at once when the last of its events is released.
+     */
+    virtual std::future<std::vector<std::shared_ptr<data::Event>>> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::shared_ptr<data::EventArena> arena
+    ) = 0;
+
+    /**
+     * @brief Queries all open relay connections for events matching any of the given sets of
+     * filters, waiting for the relays no longer than the given options allow.
+     * @param filters The sets of filters to use for the query.
+     * @param options The deadline and cancellation token of the query.
+     * @param arena The arena in which received events are allocated, if any.
+     * @returns A std::future that will eventually hold the events received, and how each relay
+     * answered the query.
+     * @remark The query ends once the relays required by the options' completion policy have
+     * sent EOSE, the deadline passes, or the query is cancelled.  The subscription is then
+     * closed on every relay, and the future holds the events received so far.  The relays that
+     * had not finished are reported as superseded, timed out, or cancelled.
+     * @remark A hedged query records each relay's latency in `relayLatencies`, asks the fastest
+     * relays first, and asks more only when those have not finished in time.
+     */
+    virtual std::future<QueryResult> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        RequestOptions options,
+        std::shared_ptr<data::EventArena> arena = nullptr
+    ) = 0;
+
+    /**
+     * @brief Queries all open relay connections for events matching any of the given sets of
+     * filters, and passes the stored matching events to the caller as they arrive.
+     * @param filters The sets of filters to use for the query.  They are sent together in a
+     * single REQ message, so the query uses one subscription on each relay.
+     * @param capacity The number of received events the channel holds before it stops taking
+     * more.
+     * @returns A channel from which the events may be taken, one at a time, as soon as each is
+     * verified.  Copies of an event received from several relays are passed on once.  The
+     * channel is complete once every relay has sent an EOSE or CLOSED message.
+     * @remark Closing the channel, or releasing the last reference to it, closes the
+     * subscription on every relay, so the caller may stop as soon as it has the events it needs.
+     * @remark Unlike the future-returning overloads, the filters' limits are sent as given,
+     * since the channel bounds the memory a large result set takes.  Received events are
+     * delivered on a thread every subscription of the service shares, so they are never held
+     * back for a slow caller.  If an event arrives while the channel is full, the subscription is
+     * closed, and the channel is marked overflowed.  The caller takes the events already in it,
+     * after which `EventChannel::next` throws `std::overflow_error` rather than returning
+     * `nullptr`.  The caller may then retry the query with a larger capacity, or with the
+     * filters narrowed to the events it has not yet taken.  A caller expecting bursts should
+     * choose a capacity to match.
+     * @remark Events are passed on in the order they are received, so a newer version of a
+     * replaceable event may follow an older version from another relay.
+     */
+    virtual std::shared_ptr<EventChannel> streamRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::size_t capacity = EventChannel::DEFAULT_CAPACITY
+    ) = 0;
+
+    /**
+     * @brief Queries all open relay connections for events matching any of the given sets of
+     * filters.
+     * @param filters The sets of filters to use for the query.  They are sent together in a
+     * single REQ message, so the query uses one subscription on each relay.
+     * @param eventHandler A callable object that will be invoked each time the client receives
+     * an event matching any of the filters.
+     * @param eoseHandler A callable object that will be invoked when a relay sends an EOSE
+     * message, which covers all of the filters.
+     * @param closeHandler A callable object that will be invoked when a relay sends a CLOSE
+     * message.
+     * @returns The ID of the subscription created for the query.
+     */
+    virtual std::string queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::function<void(const std::string&, std::shared_ptr<data::Event>)> eventHandler,
+        std::function<void(const std::string&)> eoseHandler,
+        std::function<void(const std::string&, const std::string&)> closeHandler
+    ) = 0;
     
     /**
      * @brief Closes the subscription with the given ID on all open relay connections.
@@ -119,6 +361,17 @@ public:
     virtual std::vector<std::string> closeSubscriptions() = 0;
 };
 
+/**
+ * @brief The outcome of a Negentropy synchronization with a relay.
+ */
+struct NegentropySyncResult
+{
+    std::vector<data::EventId> haveIds; ///< Events the store holds that the relay lacked.
+    std::vector<data::EventId> needIds; ///< Events the relay holds that the store lacked.
+    std::size_t fetchedCount = 0; ///< The number of needed events received and verified.
+    std::size_t uploadedCount = 0; ///< The number of uploaded events the relay accepted.
+};
+
 class NostrServiceBase : public INostrServiceBase
 {
 public:
@@ -133,6 +386,18 @@ public:
         std::vector<std::string> relays
     );
 
+    /**
+     * @param eventVerifier The verifier through which received events pass before they reach
+     * subscription handlers.  Supply a verifier configured to check signatures to reject
+     * forged events.
+     */
+    NostrServiceBase(
+        std::shared_ptr<plog::IAppender> appender,
+        std::shared_ptr<client::IWebSocketClient> client,
+        std::vector<std::string> relays,
+        std::shared_ptr<EventVerifier> eventVerifier
+    );
+
     ~NostrServiceBase() override;
 
     std::vector<std::string> defaultRelays() const;
@@ -141,6 +406,96 @@ public:
 
     std::unordered_map<std::string, std::vector<std::string>> subscriptions() const;
 
+    /**
+     * @brief The verifier through which events received from relays pass before they reach
+     * subscription handlers.
+     */
+    std::shared_ptr<EventVerifier> eventVerifier() const;
+
+    /**
+     * @brief The index of the newest versions of replaceable and addressable events received.
+     * @remark Once verified, a version of such an event that the index has seen superseded is
+     * dropped, and is neither written to the event store nor passed to handlers.
+     * @remark Versions are folded only when the event verifier checks signatures, since a forged
+     * version could otherwise hide the author's real one.  Queries that name event IDs are not
+     * folded, since they ask for exactly the versions they name.
+     */
+    std::shared_ptr<ReplaceableEventIndex> replaceableEvents() const;
+
+    /**
+     * @brief The recent latencies of the relays, by which hedged queries pick the fastest.
+     */
+    std::shared_ptr<RelayLatencies> relayLatencies() const;
+
+    /**
+     * @brief The router by which queries naming authors are sent to the authors' own relays,
+     * if any.
+     */
+    std::shared_ptr<RelayRouter> relayRouter() const;
+
+    /**
+     * @brief Sets a router by which queries naming authors are sent to the authors' own relays,
+     * or sends every query to every open relay connection if `nullptr` is given.
+     * @remark Each verified relay list received from relays is ingested by the router, but only
+     * if the event verifier checks signatures, so relay lists cannot be forged.  A query
+     * whose filters name authors then asks each author's write relays only for that author,
+     * connecting to those relays as needed, and asks the router's fallback relays for authors
+     * whose relay lists are not known.  Filters naming no authors are still sent to every open
+     * relay connection.
+     * @remark Queries sent with handlers, streamed queries, and queries whose results are
+     * returned in a future are all routed.
+     */
+    void setRelayRouter(std::shared_ptr<RelayRouter> relayRouter);
+
+    /**
+     * @brief The store into which verified events received from relays are written, if any.
+     */
+    std::shared_ptr<store::IEventStore> eventStore() const;
+
+    /**
+     * @brief Sets a store into which every verified event received from relays is written, or
+     * stops writing events if `nullptr` is given.
+     * @remark Each event is appended before it is passed to subscription handlers.  Events the
+     * store already holds are not written again.
+     */
+    void setEventStore(std::shared_ptr<store::IEventStore> eventStore);
+
+    /**
+     * @brief The set of IDs of events written to the event store, if any.
+     */
+    std::shared_ptr<SeenEventIds> seenEventIds() const;
+
+    /**
+     * @brief Sets a set of IDs, shared by every subscription, through which repeat copies of
+     * events are kept from the event store, or stops doing so if `nullptr` is given.
+     * @remark Each verified event whose ID is not in the set is written to the store and then
+     * added to the set, so later copies from any relay or subscription skip the store's own
+     * lookup.  A set backed by a file lets this survive restarts, and should be kept with the
+     * event store.
+     */
+    void setSeenEventIds(std::shared_ptr<SeenEventIds> seenEventIds);
+
+    /**
+     * @brief The watermarks recording how far each relay has been synchronized, if any.
+     */
+    std::shared_ptr<SyncWatermarks> syncWatermarks() const;
+
+    /**
+     * @brief Sets watermarks with which queries ask each relay only for events newer than it
+     * has already returned, or stops doing so if `nullptr` is given.
+     * @remark The watermarks are used only while an event store is also set.  A query whose
+     * results are returned in a future then asks each relay for events since its watermark for
+     * each filter, and adds the matching events from the store to what the relays return.
+     * Each relay's watermarks are advanced when it sends EOSE, to the newest event it returned
+     * but no later than the time of the request, and saved once the query ends.  A watermark is
+     * not advanced for a filter whose limit the relay reached, since the relay may have held
+     * older events it did not send.  The merged results are cut back to the newest events
+     * within each filter's limit.
+     * @remark Queries whose filters set `until`, such as pages of older events, and queries
+     * whose results are passed to handlers are sent unchanged.
+     */
+    void setSyncWatermarks(std::shared_ptr<SyncWatermarks> syncWatermarks);
+
     std::vector<std::string> openRelayConnections() override;
 
     std::vector<std::string> openRelayConnections(std::vector<std::string> relays) override;
@@ -153,7 +508,10 @@ public:
     std::tuple<std::vector<std::string>, std::vector<std::string>> publishEvent(
         std::shared_ptr<data::Event> event) override;
 
-    // TODO: Add a timeout to this method to prevent hanging while waiting for the relay.
+    PublishResult publishEvent(
+        std::shared_ptr<data::Event> event,
+        RequestOptions options) override;
+
     std::future<std::vector<std::shared_ptr<data::Event>>> queryRelays(
         std::shared_ptr<data::Filters> filters) override;
 
@@ -164,6 +522,29 @@ public:
         std::function<void(const std::string&, const std::string&)> closeHandler
     ) override;
 
+    std::future<std::vector<std::shared_ptr<data::Event>>> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters) override;
+
+    std::future<std::vector<std::shared_ptr<data::Event>>> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::shared_ptr<data::EventArena> arena) override;
+
+    std::future<QueryResult> queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        RequestOptions options,
+        std::shared_ptr<data::EventArena> arena = nullptr) override;
+
+    std::shared_ptr<EventChannel> streamRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::size_t capacity = EventChannel::DEFAULT_CAPACITY) override;
+
+    std::string queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        std::function<void(const std::string&, std::shared_ptr<data::Event>)> eventHandler,
+        std::function<void(const std::string&)> eoseHandler,
+        std::function<void(const std::string&, const std::string&)> closeHandler
+    ) override;
+
     std::tuple<std::vector<std::string>, std::vector<std::string>> closeSubscription(
         std::string subscriptionId
     ) override;
@@ -172,10 +553,60 @@ public:
 
     std::vector<std::string> closeSubscriptions() override;
 
+    /**
+     * @brief Synchronizes the events matching the given filters between the event store and the
+     * given relay, using Negentropy (NIP-77) set reconciliation.
+     * @returns A future that will eventually hold the IDs each side lacked and how many events
+     * were transferred.
+     * @throws The future throws `std::logic_error` if no event store is set,
+     * `std::invalid_argument` if the relay is not connected, and `std::runtime_error` if the
+     * relay rejects or abandons the reconciliation.
+     * @remark The store and the relay first exchange fingerprints of ranges of their matching
+     * events, narrowing down to the IDs only one side holds, so the cost of the exchange grows
+     * with the difference between the two sets rather than their size.  Only the events the
+     * store lacks are then requested from the relay, and they are written to the store once
+     * verified.  Only the events the relay lacks are uploaded to it.
+     * @remark The filters' `limit` is ignored, since every matching event takes part.  If the
+     * `until` is not set, it is set to the present, so both sides compare the same range.
+     * @remark The relay connection's message handler is replaced while the synchronization runs,
+     * so it should not share the connection with open subscriptions.
+     * @remark The synchronization must finish within `NEGENTROPY_SYNC_TIMEOUT`.
+     */
+    std::future<NegentropySyncResult> syncWithRelay(
+        std::string relay,
+        std::shared_ptr<data::Filters> filters);
+
+    /**
+     * @brief Synchronizes the events matching the given filters between the event store and the
+     * given relay, as above, finishing by the deadline of the given options.
+     * @throws The future also throws `std::runtime_error` if the reconciliation has not finished
+     * by the deadline.
+     * @remark If the deadline passes while missing events are fetched or uploaded events are
+     * acknowledged, the synchronization returns with the events transferred so far.
+     * @remark Only the deadline of the options is used.
+     */
+    std::future<NegentropySyncResult> syncWithRelay(
+        std::string relay,
+        std::shared_ptr<data::Filters> filters,
+        RequestOptions options);
+
 private:
     ///< The maximum number of events the service will store for each subscription.
     const int MAX_EVENTS_PER_SUBSCRIPTION = 128;
 
+    ///< The maximum size, in bytes, of a message the service will accept from a relay.
+    const std::size_t MAX_RELAY_MESSAGE_SIZE = 512 * 1024;
+
+    ///< The largest Negentropy message the service will send, in bytes before hex encoding.
+    const std::size_t NEGENTROPY_FRAME_SIZE_LIMIT = 128 * 1024;
+
+    ///< The number of IDs the service asks a relay for in each request for missing events.
+    const std::size_t NEGENTROPY_FETCH_BATCH_SIZE = 256;
+
+    ///< The time within which a synchronization with a relay must finish, unless another
+    ///< deadline is given.
+    const std::chrono::milliseconds NEGENTROPY_SYNC_TIMEOUT = std::chrono::seconds(60);
+
     ///< The WebSocket client used to communicate with relays.
     std::shared_ptr<client::IWebSocketClient> _client;
 
@@ -191,6 +622,42 @@ private:
     ///< A map from subscription IDs to the relays on which each subscription is open.
     std::unordered_map<std::string, std::vector<std::string>> _subscriptions;
 
+    ///< Receives a copy of every verified event, if set.  Accessed atomically, since it is read
+    ///< on the verifier's threads.
+    std::shared_ptr<store::IEventStore> _eventStore;
+
+    ///< The IDs of events written to the event store, if set.  Accessed atomically, like the
+    ///< event store.
+    std::shared_ptr<SeenEventIds> _seenEventIds;
+
+    ///< Records how far each relay has been synchronized for each filter, if set.  Accessed
+    ///< atomically, like the event store.
+    std::shared_ptr<SyncWatermarks> _syncWatermarks;
+
+    ///< Records the newest version seen of each replaceable and addressable event.
+    std::shared_ptr<ReplaceableEventIndex> _replaceableEvents;
+
+    ///< Records how long each relay takes to finish a query.
+    std::shared_ptr<RelayLatencies> _relayLatencies;
+
+    ///< Routes queries naming authors to the authors' relays, if set.  Accessed atomically,
+    ///< like the event store.
+    std::shared_ptr<RelayRouter> _relayRouter;
+
+    ///< Whether the service still exists.  Callbacks queued on the verifier hold it, and do
+    ///< nothing once the service has been destroyed.
+    struct Lifetime
+    {
+        std::recursive_mutex mutex; ///< Held while a callback runs, and while the service is destroyed.
+        bool isAlive = true;
+    };
+
+    std::shared_ptr<Lifetime> _lifetime;
+
+    ///< Checks the IDs of received events before they are passed to handlers.  The verifier may
+    ///< be shared with other services and outlive this one, so its callbacks check `_lifetime`.
+    std::shared_ptr<EventVerifier> _eventVerifier;
+
     std::vector<std::string> _getConnectedRelays(std::vector<std::string> relays);
 
     std::vector<std::string> _getUnconnectedRelays(std::vector<std::string> relays);
@@ -205,20 +672,96 @@ private:
 
     std::string _generateSubscriptionId();
 
+    /**
+     * @brief Serializes a REQ message asking the given relay for the events matching the
+     * filters that are no older than its watermark for each of them.
+     */
+    std::string _generateIncrementalRequest(
+        const std::vector<std::shared_ptr<data::Filters>>& filters,
+        const std::vector<std::string>& filterKeys,
+        const SyncWatermarks& syncWatermarks,
+        const std::string& relay,
+        std::string& subscriptionId);
+
     std::string _generateCloseRequest(std::string subscriptionId);
 
+    /**
+     * @brief Chooses the relays to ask for the given filters, and the filters to send each.
+     * @returns Every open relay connection mapped to the filters unchanged, if no router is set.
+     * Otherwise, the relays chosen by the router, to each of which a connection is opened if
+     * there is none yet.
+     */
+    std::map<std::string, std::vector<std::shared_ptr<data::Filters>>> _routeFilters(
+        const std::vector<std::shared_ptr<data::Filters>>& filters);
+
+    /**
+     * @brief Serializes a NEG-OPEN message carrying the given filters and initial Negentropy
+     * message.  The filters are sent without a limit or unset fields.
+     */
+    std::string _generateNegentropyOpenRequest(
+        const data::Filters& filters,
+        const std::string& subscriptionId,
+        const std::string& initialMessage);
+
+    /**
+     * @brief Sends a query to the relays chosen by `_routeFilters`, and waits until each relay
+     * has finished, the deadline passes, or the query is cancelled.
+     */
+    QueryResult _queryRelays(
+        std::vector<std::shared_ptr<data::Filters>> filters,
+        RequestOptions options,
+        std::shared_ptr<data::EventArena> arena);
+
+    /**
+     * @brief Requests the events with the given IDs from the given relay, in batches, and waits
+     * for the relay to return them.
+     * @returns The number of events received and verified.  Batches the relay has not finished
+     * by the deadline are abandoned.
+     */
+    std::size_t _fetchEvents(
+        const std::string& relay,
+        const std::vector<data::EventId>& ids,
+        std::chrono::steady_clock::time_point deadline);
+
+    /**
+     * @brief Sends the stored events with the given IDs to the given relay, and waits until the
+     * deadline for the relay to acknowledge them.
+     * @returns The number of the uploaded events the relay accepted.  Answers for other events
+     * are ignored.
+     */
+    std::size_t _uploadEvents(
+        const std::string& relay,
+        store::IEventStore& eventStore,
+        const std::vector<data::EventId>& ids,
+        std::chrono::steady_clock::time_point deadline);
+
     bool _hasSubscription(std::string subscriptionId);
 
     bool _hasSubscription(std::string subscriptionId, std::string relay);
 
+    /**
+     * @param arena If set, events in the message are constructed in this arena.
+     * @param foldsVersions Whether versions of replaceable events superseded by one already
+     * received are dropped.
+     */
     void _onSubscriptionMessage(
         std::string message,
         std::function<void(const std::string&, std::shared_ptr<data::Event>)> eventHandler,
         std::function<void(const std::string&)> eoseHandler,
-        std::function<void(const std::string&, const std::string&)> closeHandler
+        std::function<void(const std::string&, const std::string&)> closeHandler,
+        std::shared_ptr<data::EventArena> arena = nullptr,
+        bool foldsVersions = true
     );
 
-    void _onAcceptance(std::string message, std::function<void(const bool)> acceptanceHandler);
+    /**
+     * @brief Passes the ID of the event a relay answered for, in hex, whether it accepted the
+     * event, and the message it sent with its answer, to the given handler.
+     * @remark A connection carries the answers for every event sent on it, so handlers must
+     * check that the ID is one they sent.
+     */
+    void _onAcceptance(
+        std::string message,
+        std::function<void(const std::string&, const bool, const std::string&)> acceptanceHandler);
 };
 } // namespace service
 } // namespace nostr
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief Records how long each relay has recently taken to answer queries, so the fastest
+ * relays can be asked first.
+ * @remark Each relay keeps a window of its most recent latencies, so the record follows
+ * changes in a relay's load or route.  Percentiles are computed over the window on request.
+ * @remark Every method is safe to call from any thread.
+ */
+class RelayLatencies
+{
+public:
+    ///< The number of recent latencies kept for each relay.
+    static constexpr std::size_t DEFAULT_WINDOW_SIZE = 64;
+
+    /**
+     * @throws `std::invalid_argument` if the window size is zero.
+     */
+    explicit RelayLatencies(std::size_t windowSize = DEFAULT_WINDOW_SIZE);
+
+    /**
+     * @brief Records the time a relay took to finish a query, from the REQ to its EOSE.
+     */
+    void record(const std::string& relay, std::chrono::milliseconds latency);
+
+    /**
+     * @brief The given percentile, from 0 to 1, of the recent latencies of the given relays
+     * taken together.
+     * @returns The percentile, or nothing if none of the relays has a recorded latency.
+     */
+    std::optional<std::chrono::milliseconds> percentile(
+        const std::vector<std::string>& relays,
+        double percentile) const;
+
+    /**
+     * @brief Orders the given relays from the fastest to the slowest by their median latency.
+     * @remark Relays with no recorded latency follow all the others, in their given order.
+     */
+    std::vector<std::string> rankFastest(std::vector<std::string> relays) const;
+
+private:
+    std::size_t _windowSize;
+
+    std::unordered_map<std::string, std::deque<std::chrono::milliseconds>> _latencies;
+
+    mutable std::mutex _mutex;
+
+    /**
+     * @brief Must be called with the mutex held.
+     */
+    std::optional<std::chrono::milliseconds> _percentile(
+        const std::vector<std::string>& relays,
+        double percentile) const;
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+struct RelayRouterOptions
+{
+    ///< The number of each author's write relays asked for the author's events.
+    std::size_t redundancy = 2;
+
+    ///< The relays asked for the events of authors whose relay lists are not known.  If empty,
+    ///< those authors are asked of every open relay connection.
+    std::vector<std::string> fallbackRelays;
+
+    ///< The number of write relays, beyond the open relay connections, to which a single query
+    ///< may be routed, and so the number of connections it may open besides the fallback relays.
+    std::size_t maxNewRelays = 8;
+};
+
+/**
+ * @brief Routes queries for the events of given authors to the relays to which those authors
+ * write, following the outbox model of NIP-65.
+ * @remark The router learns each author's write relays from the newest relay list, an event of
+ * kind 10002, that it has ingested for the author.  A relay list marks each of its relays for
+ * reading, writing, or both.
+ * @remark Rather than asking every relay for every author, each filter naming authors is split
+ * so that each relay is asked only for the authors that write to it.  Each author is routed to
+ * a few of its write relays, preferring those shared by the most authors in the query, so a
+ * large follow list is served by few connections, and each event is downloaded few times.
+ * @remark A query is routed to at most `maxNewRelays` write relays that are not already open.
+ * Authors whose write relays are all beyond that budget are treated as authors with no known
+ * relay list.
+ * @remark Every method is safe to call from any thread.
+ */
+class RelayRouter
+{
+public:
+    ///< The kind of the replaceable event in which an author lists its relays.
+    static constexpr int RELAY_LIST_KIND = 10002;
+
+    /**
+     * @throws `std::invalid_argument` if the redundancy is zero.
+     */
+    explicit RelayRouter(RelayRouterOptions options = RelayRouterOptions());
+
+    /**
+     * @brief Records the write relays of the event's author, if the event is a relay list newer
+     * than any ingested for the author so far.
+     * @returns True if the event was recorded.  Other kinds, and older relay lists, are ignored.
+     */
+    bool ingest(const data::Event& event);
+
+    /**
+     * @brief The write relays of the given author, in the order of the author's relay list.
+     * @param author The author's public key, in hex.
+     * @returns The relays, or an empty vector if no relay list is known for the author.
+     */
+    std::vector<std::string> writeRelays(const std::string& author) const;
+
+    /**
+     * @brief Splits the given filters among the relays that should be asked for them.
+     * @param filters The filters of a query.
+     * @param defaultRelays The relays asked for filters that name no authors, and for authors
+     * with no known relay list when there are no fallback relays.  These are the open relay
+     * connections; other write relays count against `maxNewRelays`.
+     * @returns Each relay to ask, mapped to the filters to send it.  A filter naming authors is
+     * sent to each relay as a copy naming only the authors routed there.  Other filters are
+     * sent unchanged.
+     */
+    std::map<std::string, std::vector<std::shared_ptr<data::Filters>>> route(
+        const std::vector<std::shared_ptr<data::Filters>>& filters,
+        const std::vector<std::string>& defaultRelays) const;
+
+    ///< The number of authors with a known relay list.
+    std::size_t size() const;
+
+private:
+    ///< The newest relay list ingested for an author.
+    struct RelayList
+    {
+        std::time_t createdAt;
+        std::vector<std::string> writeRelays;
+    };
+
+    RelayRouterOptions _options;
+
+    mutable std::mutex _mutex;
+
+    ///< Authors' public keys, in hex, mapped to their relay lists.
+    std::unordered_map<std::string, RelayList> _relayLists;
+};
+} // namespace service
+} // namespace nostr
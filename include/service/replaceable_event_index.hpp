@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief Identifies the versions of one replaceable or addressable event: its author, its kind,
+ * and, for addressable events, the value of its `d` tag.
+ */
+struct EventAddress
+{
+    data::PublicKey pubkey;
+    int kind;
+    std::string identifier; ///< The `d` tag value of an addressable event, or empty.
+
+    /**
+     * @brief The address of the given event, or nothing if the event is neither replaceable
+     * nor addressable, and so has no other versions.
+     */
+    static std::optional<EventAddress> of(const data::Event& event);
+
+    bool operator==(const EventAddress& other) const;
+};
+
+struct EventAddressHash
+{
+    std::size_t operator()(const EventAddress& address) const noexcept;
+};
+
+/**
+ * @brief Folds the versions of replaceable and addressable events received from relays, so
+ * only the newest version of each is kept.
+ * @remark Relays often return old versions of profiles, contact lists, and other replaceable
+ * events, and each relay may hold a different version.  The index records the creation time and
+ * ID of the newest version seen at each address, and rejects any version it supersedes, using
+ * the NIP-01 rule that the newer version wins, and the lower ID breaks ties.
+ * @remark A version dated further ahead than the allowed clock skew is rejected, since once
+ * recorded it would hide every version published until its date.
+ * @remark The index holds one small entry per address, however many versions of it arrive.
+ * When it is full, the address recorded earliest is forgotten.
+ * @remark Every method is safe to call from any thread.
+ */
+class ReplaceableEventIndex
+{
+public:
+    static constexpr std::size_t DEFAULT_CAPACITY = 65536;
+
+    ///< How far ahead of the present a version may be dated, to allow for authors' clocks.
+    static constexpr std::chrono::seconds DEFAULT_MAX_CLOCK_SKEW = std::chrono::minutes(15);
+
+    explicit ReplaceableEventIndex(
+        std::size_t capacity = DEFAULT_CAPACITY,
+        std::chrono::seconds maxClockSkew = DEFAULT_MAX_CLOCK_SKEW);
+
+    /**
+     * @brief Records the event if it is the newest version of its address seen so far.
+     * @returns False if a version that supersedes the event has been seen, or if the event is
+     * dated further ahead than the allowed clock skew, or true otherwise.  Events with no
+     * address, and repeat copies of the newest version, are always admitted.
+     */
+    bool admit(const data::Event& event);
+
+    ///< The number of addresses recorded.
+    std::size_t size() const;
+
+private:
+    ///< The newest version seen at an address.
+    struct Version
+    {
+        std::time_t createdAt;
+        data::EventId id;
+    };
+
+    std::size_t _capacity;
+
+    std::chrono::seconds _maxClockSkew;
+
+    mutable std::mutex _mutex;
+
+    std::unordered_map<EventAddress, Version, EventAddressHash> _versions;
+
+    ///< Recorded addresses in the order they were first seen, oldest first.
+    std::deque<EventAddress> _insertionOrder;
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "data/data.hpp"
+#include "service/nostr_service_base.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief Configures a `RequestCoalescer`.
+ */
+struct RequestCoalescerOptions
+{
+    ///< How long the coalescer waits after the first request of a batch for others to arrive.
+    std::chrono::milliseconds window = std::chrono::milliseconds(20);
+
+    ///< The largest number of IDs or authors placed in one merged filter.  Many relays reject
+    ///< filters with more entries than a few hundred.
+    std::size_t maxKeysPerFilter = 256;
+};
+
+/**
+ * @brief Merges many small queries into a few relay subscriptions.
+ * @remark Relays cap the number of concurrent subscriptions per connection, so issuing a
+ * separate REQ for each of hundreds of small lookups, such as one profile per author, quickly
+ * exhausts them.  The coalescer holds each query for a short window, then merges the queries of
+ * the batch that differ only in their `ids` or `authors` into one filter with the union of those
+ * lists, and sends one query for each merged filter.
+ * @remark Each event received on a merged subscription is tested against every original query
+ * with a `data::FilterMatcher`, and passed only to the handlers of the queries it matches.  EOSE
+ * and CLOSED messages are passed to the handlers of every query in the merged subscription.
+ * @remark Queries are merged only if they set the same kinds, tags, `since`, and `until`, and
+ * select events by exactly one of `ids` or `authors`, with no `authorHandles`.  They must also
+ * match a bounded number of events per entry: queries by `ids` always do, and queries by
+ * `authors` do if they ask only for replaceable kinds, of which each author has one event per
+ * kind.  The merged filter's `limit` covers every event the merged queries can match, so no
+ * author can crowd out another.  Other queries, such as for an author's notes, are sent unchanged.
+ * @remark A query sharing a subscription is passed no more distinct events than its own limit,
+ * as a relay would return for it alone.
+ */
+class RequestCoalescer
+{
+public:
+    RequestCoalescer(
+        std::shared_ptr<INostrServiceBase> service,
+        RequestCoalescerOptions options = RequestCoalescerOptions());
+
+    ~RequestCoalescer();
+
+    RequestCoalescer(const RequestCoalescer&) = delete;
+
+    RequestCoalescer& operator=(const RequestCoalescer&) = delete;
+
+    /**
+     * @brief Queues a query to be sent to the service's relays with the next batch.
+     * @param filters The filters to use for the query.
+     * @param eventHandler Invoked each time an event matching the filters is received.
+     * @param eoseHandler Invoked each time a relay sends an EOSE message for the query.
+     * @param closeHandler Invoked each time a relay sends a CLOSED message for the query.
+     * @returns An ID for the query, which is passed to the handlers and may be given to
+     * `closeQuery`.  It is not the ID of any relay subscription.
+     * @throws `std::invalid_argument` if the filters are invalid.
+     */
+    std::string queryRelays(
+        std::shared_ptr<data::Filters> filters,
+        std::function<void(const std::string&, std::shared_ptr<data::Event>)> eventHandler,
+        std::function<void(const std::string&)> eoseHandler,
+        std::function<void(const std::string&, const std::string&)> closeHandler);
+
+    /**
+     * @brief Stops delivering events to the given query.
+     * @remark The merged subscription carrying the query is closed once none of its queries
+     * remain open.  A query that has not yet been sent is simply dropped.
+     */
+    void closeQuery(const std::string& queryId);
+
+    /**
+     * @brief Sends every queued query now, without waiting for the rest of the window.
+     */
+    void flush();
+
+private:
+    struct Query
+    {
+        std::string id;
+        std::shared_ptr<data::Filters> filters;
+        std::shared_ptr<const data::FilterMatcher> matcher;
+        std::function<void(const std::string&, std::shared_ptr<data::Event>)> eventHandler;
+        std::function<void(const std::string&)> eoseHandler;
+        std::function<void(const std::string&, const std::string&)> closeHandler;
+
+        ///< The distinct events passed to the query, counted against its limit when it shares a
+        ///< subscription.  Guarded by the subscription's mutex.
+        std::unordered_set<data::EventId, data::BytesHash> deliveredIds;
+    };
+
+    ///< A relay subscription carrying one or more queries.
+    struct MergedSubscription
+    {
+        std::mutex mutex;
+        std::string subscriptionId;
+        std::vector<std::shared_ptr<Query>> queries;
+        bool isShared = false; ///< Whether the subscription was sent for more than one query.
+    };
+
+    std::shared_ptr<INostrServiceBase> _service;
+
+    RequestCoalescerOptions _options;
+
+    std::mutex _mutex;
+
+    std::condition_variable _queueChanged;
+
+    ///< Queries waiting for the current window to close.
+    std::vector<std::shared_ptr<Query>> _pending;
+
+    ///< The merged subscription carrying each sent query, by query ID.
+    std::unordered_map<std::string, std::shared_ptr<MergedSubscription>> _subscriptionsByQuery;
+
+    bool _isStopping = false;
+
+    std::thread _dispatcher;
+
+    void _dispatch();
+
+    /**
+     * @brief Merges the given queries and sends one query to the service for each merged filter.
+     */
+    void _send(std::vector<std::shared_ptr<Query>> queries);
+
+    void _sendMerged(std::shared_ptr<data::Filters> filters, std::vector<std::shared_ptr<Query>> queries);
+};
+} // namespace service
+} // namespace nostr
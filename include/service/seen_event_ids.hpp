@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief A compact set of the IDs of events already received, for dropping repeat copies.
+ * @remark IDs are held in an open-addressed hash table of 16-byte slots.  Each slot holds the
+ * first 64 bits of an ID, which picks the slot, and the next 64 bits, which confirm the match.
+ * Event IDs are SHA-256 hashes, so two distinct IDs agree in these 128 bits with negligible
+ * probability, and a match is treated as the same ID.  The table doubles once it is three
+ * quarters full.
+ * @remark The set may be kept in memory, or in a file that is mapped and updated in place, so
+ * it survives restarts.  A file-backed set is only meaningful alongside the events it
+ * describes, so it should be kept with the event store that holds them.
+ * @remark An optional Bloom filter, of one byte per slot, is checked before the table, so most
+ * lookups of unseen IDs do not touch the table at all, which helps when a file-backed table is
+ * larger than memory.  It is held in memory and rebuilt whenever the table is opened or grown.
+ * @remark Every method is safe to call from any thread.
+ */
+class SeenEventIds
+{
+public:
+    ///< The number of IDs a new set holds before it first grows.
+    static constexpr std::size_t DEFAULT_EXPECTED_COUNT = 1024;
+
+    /**
+     * @brief Creates an empty set that is kept in memory only.
+     * @param expectedCount The number of IDs to size the table for.
+     * @param hasBloomFilter Whether to check a Bloom filter before the table.
+     */
+    explicit SeenEventIds(
+        std::size_t expectedCount = DEFAULT_EXPECTED_COUNT,
+        bool hasBloomFilter = false);
+
+    /**
+     * @brief Opens the set stored in the given file, creating the file if it does not exist.
+     * @throws `std::system_error` if the file cannot be opened or mapped.
+     * @throws `std::invalid_argument` if the file is not a set of seen IDs.
+     */
+    explicit SeenEventIds(std::string path, bool hasBloomFilter = false);
+
+    ~SeenEventIds();
+
+    SeenEventIds(const SeenEventIds&) = delete;
+
+    SeenEventIds& operator=(const SeenEventIds&) = delete;
+
+    /**
+     * @brief Adds an ID to the set.
+     * @returns True if the ID was not already in the set.
+     * @throws `std::system_error` if a file-backed table cannot be grown.
+     */
+    bool insert(const data::EventId& id);
+
+    bool contains(const data::EventId& id) const;
+
+    std::size_t size() const;
+
+    /**
+     * @brief Writes a file-backed set through to durable storage.  Does nothing for a set kept
+     * in memory.
+     * @throws `std::system_error` if the file cannot be synchronized.
+     */
+    void flush();
+
+private:
+    ///< A slot in the table.  A slot of all zeroes is empty.
+    struct Slot
+    {
+        uint64_t prefix;
+        uint64_t check;
+    };
+
+    ///< The file the set is kept in, or empty if it is kept in memory only.
+    std::string _path;
+
+    int _descriptor = -1;
+
+    ///< The mapping of the file, including its header.
+    uint8_t* _data = nullptr;
+
+    std::size_t _size = 0;
+
+    ///< The slots of a set kept in memory.
+    std::vector<Slot> _memorySlots;
+
+    Slot* _slots = nullptr;
+
+    ///< The number of slots, a power of two.
+    uint64_t _capacity = 0;
+
+    uint64_t _count = 0;
+
+    bool _hasBloomFilter;
+
+    std::vector<uint64_t> _bloomBits;
+
+    mutable std::mutex _mutex;
+
+    static Slot _slotFor(const data::EventId& id);
+
+    /**
+     * @brief Finds the slot holding the given entry, or the empty slot where it belongs.
+     */
+    Slot* _find(const Slot& entry) const;
+
+    bool _mayContain(const Slot& entry) const;
+
+    void _addToBloomFilter(const Slot& entry);
+
+    void _rebuildBloomFilter();
+
+    /**
+     * @brief Doubles the table, rehashing every entry into it.
+     */
+    void _grow();
+
+    /**
+     * @brief Maps the file, initializing it with a table of the given capacity if it is empty.
+     */
+    void _openFile(uint64_t initialCapacity);
+
+    void _closeFile();
+
+    void _writeCount();
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief Records how far each relay has been synchronized for each filter, so repeat queries
+ * need ask only for events newer than those already received.
+ * @remark A watermark is the newest `created_at` among the events a relay returned for a filter
+ * in a query that the relay completed with EOSE, having sent fewer events than the filter's
+ * limit.  Since relays return the newest events first, and such a relay had no more to send,
+ * every event the filter would select from the relay up to that time has been received.
+ * @remark Filters are identified by a normalized key that ignores the order of their entries
+ * and their `until`, so the same filter built anew for each query maps to the same watermark.
+ * Watermarks therefore describe queries that reach to the present; a query bounded by an
+ * earlier `until` should not use them.
+ * The `since` and `limit` are part of the key, since a query with an earlier `since` or a
+ * larger `limit` asks for events an earlier query did not.
+ * @remark Watermarks may be kept in memory only, or saved to a file and loaded from it when
+ * next constructed.  They are only meaningful alongside the events they describe, so a file of
+ * watermarks should be kept with the event store holding those events.
+ * @remark Every method is safe to call from any thread.
+ */
+class SyncWatermarks
+{
+public:
+    /**
+     * @brief Creates an empty set of watermarks that is kept in memory only.
+     */
+    SyncWatermarks() = default;
+
+    /**
+     * @brief Loads the watermarks saved in the given file, if it exists, and saves them there
+     * when `save` is called.
+     * @remark A file that cannot be read is logged and ignored, so every relay is synchronized
+     * from scratch.
+     */
+    explicit SyncWatermarks(std::string path);
+
+    /**
+     * @brief Computes the normalized key identifying the given filters.
+     */
+    static std::string filterKey(const data::Filters& filters);
+
+    /**
+     * @brief The watermark of the given relay for the filter with the given key, or 0 if the
+     * relay has not been synchronized for the filter.
+     */
+    std::time_t get(const std::string& relay, const std::string& filterKey) const;
+
+    /**
+     * @brief Raises the watermark of the given relay for the filter with the given key to the
+     * given time.  Watermarks never move back.
+     */
+    void advance(const std::string& relay, const std::string& filterKey, std::time_t createdAt);
+
+    /**
+     * @brief Writes the watermarks to their file, if they have one and have changed since they
+     * were last saved.
+     * @throws `std::runtime_error` if the file cannot be written.
+     */
+    void save();
+
+    ///< The number of relay and filter pairs with a watermark.
+    std::size_t size() const;
+
+private:
+    ///< The file the watermarks are saved to, or empty if they are kept in memory only.
+    std::string _path;
+
+    mutable std::mutex _mutex;
+
+    ///< Watermarks by relay, then by filter key.
+    std::unordered_map<std::string, std::unordered_map<std::string, std::time_t>> _watermarks;
+
+    bool _isDirty = false;
+};
+} // namespace service
+} // namespace nostr
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace store
+{
+/**
+ * @brief An interface for a local store of Nostr events.
+ */
+class IEventStore
+{
+public:
+    virtual ~IEventStore() = default;
+
+    /**
+     * @brief Adds the given event to the store.
+     * @returns True if the event was added, false if an event with the same ID is already stored.
+     * @remark The event's `id` field must already be set.
+     */
+    virtual bool append(const data::Event& event) = 0;
+
+    /**
+     * @brief Looks up the event with the given ID.
+     * @returns The event, or `nullptr` if it is not stored.
+     */
+    virtual std::shared_ptr<data::Event> find(const data::EventId& id) = 0;
+
+    /**
+     * @brief Finds the stored events that match the given filters.
+     * @returns The matching events, newest first, truncated to the filters' `limit` if it is
+     * set.  Events with the same `createdAt` are ordered by ID, lowest first, as NIP-01
+     * requires.
+     */
+    virtual std::vector<std::shared_ptr<data::Event>> query(const data::Filters& filters) = 0;
+
+    /**
+     * @brief Visits every stored event, in the order the events were added.
+     * @param visitor Invoked with each event.  Return false to stop the scan.
+     * @remark Events added during the scan may or may not be visited.
+     */
+    virtual void scan(std::function<bool(std::shared_ptr<data::Event>)> visitor) = 0;
+
+    /**
+     * @brief The number of events in the store.
+     */
+    virtual std::size_t size() = 0;
+
+    /**
+     * @brief Writes every added event through to durable storage.
+     */
+    virtual void flush() = 0;
+};
+} // namespace store
+} // namespace nostr
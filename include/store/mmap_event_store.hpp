@@ -0,0 +1,209 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "data/data.hpp"
+#include "store/event_store.hpp"
+
+namespace nostr
+{
+namespace store
+{
+class PostingIndex;
+
+/**
+ * @brief Configures a `MmapEventStore`.
+ */
+struct MmapEventStoreOptions
+{
+    ///< How much the log file grows by each time it fills.  Space is reserved ahead of use, so
+    ///< the log is remapped only once per increment.
+    std::size_t growthSize = 64 * 1024 * 1024;
+
+    ///< Whether each append is written through to durable storage before it returns.  When
+    ///< false, appends survive a crash of the process but not of the system, unless `flush` is
+    ///< called.
+    bool syncOnAppend = false;
+};
+
+/**
+ * @brief An append-only event store backed by two memory-mapped files in one directory.
+ * @remark `events.log` holds the events as binary records, each carrying its length and a
+ * CRC-32C checksum of its contents.  A record is written in full before it counts as part of
+ * the log, so an append cut short by a crash leaves a record that fails its checksum, and is
+ * discarded along with everything after it when the store is next opened.
+ * @remark `events.idx` is an open-addressed hash table from event IDs to record offsets, used
+ * in place through its mapping.  Its header records how far into the log it is complete, so
+ * opening the store reads only the records appended after the last flush, however large the
+ * log is.  If the index is missing or unreadable, it is rebuilt from the whole log.
+ * @remark Three more indexes, `authors.pst`, `kinds.pst`, and `tags.pst`, file each event's log
+ * offset under its author, its kind, and the first value of each of its tags, sorted newest
+ * first within each key.  `query` answers filters from whichever of these is most selective.
+ * Each is rewritten once enough new postings accumulate in memory, and the postings of events
+ * appended since then are rebuilt from the log when the store is opened.
+ * @remark Every method is safe to call from any thread.  Lookups and scans run concurrently
+ * with each other; appends are serialized.
+ */
+class MmapEventStore : public IEventStore
+{
+public:
+    /**
+     * @brief Opens the store in the given directory, creating the directory and store files if
+     * they do not exist.
+     * @throws `std::system_error` if the store files cannot be opened or mapped.
+     * @throws `std::invalid_argument` if the directory holds a file that is not an event log.
+     */
+    explicit MmapEventStore(
+        std::string directory,
+        MmapEventStoreOptions options = MmapEventStoreOptions());
+
+    ~MmapEventStore() override;
+
+    MmapEventStore(const MmapEventStore&) = delete;
+
+    MmapEventStore& operator=(const MmapEventStore&) = delete;
+
+    /**
+     * @throws `std::invalid_argument` if the event has no ID.
+     * @throws `std::system_error` if the log cannot be extended.
+     */
+    bool append(const data::Event& event) override;
+
+    std::shared_ptr<data::Event> find(const data::EventId& id) override;
+
+    /**
+     * @remark Filters with IDs are answered from the ID index.  Otherwise, the author, kind,
+     * and tag conditions are each costed by counting their postings in the time range, and the
+     * cheapest is used: its postings for each of the condition's values are merged newest
+     * first, and each event is decoded and checked against the full filters until the limit
+     * is reached.  Filters with none of these conditions scan the whole log.
+     */
+    std::vector<std::shared_ptr<data::Event>> query(const data::Filters& filters) override;
+
+    void scan(std::function<bool(std::shared_ptr<data::Event>)> visitor) override;
+
+    std::size_t size() override;
+
+    /**
+     * @throws `std::system_error` if the files cannot be synchronized.
+     */
+    void flush() override;
+
+private:
+    ///< An open file and its shared, read-write mapping.
+    struct MappedFile
+    {
+        int descriptor = -1;
+        uint8_t* data = nullptr;
+        std::size_t size = 0;
+    };
+
+    std::string _directory;
+
+    MmapEventStoreOptions _options;
+
+    ///< Held shared to read the mappings, and exclusively to append or remap.
+    std::shared_mutex _mutex;
+
+    MappedFile _log;
+
+    MappedFile _index;
+
+    ///< The offset one past the last record in the log.
+    uint64_t _logEnd = 0;
+
+    ///< Event log offsets by author, keyed on the first 8 bytes of the pubkey.
+    std::unique_ptr<PostingIndex> _authorIndex;
+
+    ///< Event log offsets by kind.
+    std::unique_ptr<PostingIndex> _kindIndex;
+
+    ///< Event log offsets by tag, keyed on a hash of the tag name and first value.
+    std::unique_ptr<PostingIndex> _tagIndex;
+
+    /**
+     * @returns True if the log was created, false if it already existed.
+     */
+    bool _openLog();
+
+    /**
+     * @param isNewLog Whether the log was just created, in which case a new index has nothing
+     * to recover.
+     */
+    void _openIndex(bool isNewLog);
+
+    /**
+     * @brief Indexes the records after the point the index is known to cover, and discards the
+     * log from the first record that is incomplete or corrupt.
+     */
+    void _recover();
+
+    /**
+     * @brief Opens the posting indexes, and adds the postings of any records they do not yet
+     * cover.
+     */
+    void _openPostingIndexes();
+
+    /**
+     * @brief Files the event's postings in each posting index that does not already cover the
+     * given offset.
+     */
+    void _addPostings(const data::Event& event, uint64_t offset);
+
+    /**
+     * @brief Writes out each posting index that needs compacting.
+     * @param isClosing Whether the store is closing, in which case smaller backlogs are also
+     * written out, to bound the work of the next open.
+     */
+    void _compactPostingIndexes(bool isClosing);
+
+    /**
+     * @brief Decodes the records at the offsets produced by `nextOffset`, newest first, and
+     * collects those that match, stopping once the limit is reached.
+     * @param nextOffset Returns the offset of the next candidate record, or 0 when there are no
+     * more.
+     */
+    std::vector<std::shared_ptr<data::Event>> _collect(
+        const data::FilterMatcher& matcher,
+        std::function<uint64_t()> nextOffset) const;
+
+    void _growLog(std::size_t minimumSize);
+
+    /**
+     * @brief Replaces the index with one of the given capacity holding the same entries.
+     */
+    void _rebuildIndex(uint64_t capacity);
+
+    /**
+     * @brief Finds the offset of the record with the given ID, or 0 if there is none.
+     */
+    uint64_t _findOffset(const data::EventId& id) const;
+
+    void _insertIndexEntry(const data::EventId& id, uint64_t offset);
+
+    /**
+     * @brief Checks the record at the given offset.
+     * @returns The size of the record, including its header and padding, or 0 if there is no
+     * complete, uncorrupted record at the offset.
+     */
+    std::size_t _validRecordSize(uint64_t offset, uint64_t end) const;
+
+    std::shared_ptr<data::Event> _decode(uint64_t offset) const;
+
+    void _writeIndexHeader(uint64_t indexedEnd, bool isClean);
+
+    /**
+     * @brief Resizes the file to the given size and maps it, replacing any existing mapping.
+     */
+    static void _mapFile(MappedFile& file, std::size_t size);
+
+    static void _closeFile(MappedFile& file);
+};
+} // namespace store
+} // namespace nostr
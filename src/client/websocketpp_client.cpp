@@ -79,6 +79,37 @@ tuple<string, bool> WebsocketppClient::send(
     return successes;
 };
 
+tuple<string, bool> WebsocketppClient::send(
+    shared_ptr<const string> message,
+    string uri,
+    function<void(const string&)> messageHandler
+)
+{
+    error_code error;
+
+    {
+        // The frame is rendered once and shared across relays, rather than serialized for
+        // each.  websocketpp still copies the payload into its own message buffer for every
+        // connection.
+        lock_guard<mutex> lock(this->_propertyMutex);
+        this->_client.send(
+            this->_connectionHandles[uri],
+            message->data(),
+            message->size(),
+            websocketpp::frame::opcode::text,
+            error);
+    }
+
+    this->receive(uri, messageHandler);
+
+    if (error.value() == -1)
+    {
+        return make_tuple(uri, false);
+    }
+
+    return make_tuple(uri, true);
+};
+
 void WebsocketppClient::receive(
     string uri,
     function<void(const string&)> messageHandler
@@ -0,0 +1,31 @@
+/*
+ * The EVP digest interface allocates a provider context each time a digest is initialized, which
+ * is a measurable cost when hashing millions of small messages.  The low-level SHA-256 functions
+ * keep all of their state in a caller-owned struct and use the same accelerated implementations,
+ * so they are used here despite being deprecated in OpenSSL 3.
+ */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
+#include "sha256_context.hpp"
+
+using namespace nostr::cryptography;
+
+Sha256Context::Sha256Context()
+{
+    this->reset();
+};
+
+void Sha256Context::reset()
+{
+    SHA256_Init(&this->_context);
+};
+
+void Sha256Context::update(const void* data, std::size_t length)
+{
+    SHA256_Update(&this->_context, data, length);
+};
+
+void Sha256Context::finalize(uint8_t* digest)
+{
+    SHA256_Final(digest, &this->_context);
+};
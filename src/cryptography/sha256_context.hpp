@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <openssl/sha.h>
+
+namespace nostr
+{
+namespace cryptography
+{
+/**
+ * @brief An incrementally updated SHA-256 hash context.
+ * @remark The context lives entirely in the object, so an instance may be reused for any number
+ * of digests without allocating.
+ */
+class Sha256Context
+{
+public:
+    static constexpr std::size_t DIGEST_SIZE = SHA256_DIGEST_LENGTH;
+
+    Sha256Context();
+
+    /**
+     * @brief Discards any data hashed so far and prepares the context for a new digest.
+     */
+    void reset();
+
+    /**
+     * @brief Feeds the given bytes into the digest.
+     * @param data A pointer to the bytes to hash.
+     * @param length The number of bytes to hash.
+     */
+    void update(const void* data, std::size_t length);
+
+    /**
+     * @brief Completes the digest and writes it to the given buffer.
+     * @param digest A buffer of at least `DIGEST_SIZE` bytes.
+     * @remark The context must be reset before it is used for another digest.
+     */
+    void finalize(uint8_t* digest);
+
+private:
+    SHA256_CTX _context;
+};
+} // namespace cryptography
+} // namespace nostr
@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "sha256_context.hpp"
+#include "sha256_multi_buffer.hpp"
+
+using namespace nostr::cryptography;
+using namespace std;
+
+#pragma region Local Statics
+
+#ifdef __AVX2__
+
+static const uint32_t roundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t initialState[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/**
+ * @brief Returns the number of 64-byte blocks in a message of the given length once padded.
+ */
+static inline size_t paddedBlockCount(size_t length)
+{
+    return (length + 9 + 63) / 64;
+};
+
+/**
+ * @brief Copies block `index` of the padded form of a message into the given buffer.
+ */
+static void loadPaddedBlock(const uint8_t* message, size_t length, size_t index, uint8_t* block)
+{
+    size_t offset = index * 64;
+    size_t available = offset < length ? min<size_t>(64, length - offset) : 0;
+
+    if (available > 0)
+    {
+        memcpy(block, message + offset, available);
+    }
+    memset(block + available, 0, 64 - available);
+
+    if (offset + available == length && available < 64)
+    {
+        block[available] = 0x80;
+    }
+
+    if (index == paddedBlockCount(length) - 1)
+    {
+        uint64_t bitLength = static_cast<uint64_t>(length) * 8;
+        for (int i = 0; i < 8; i++)
+        {
+            block[63 - i] = static_cast<uint8_t>(bitLength >> (8 * i));
+        }
+    }
+};
+
+template <int N>
+static inline __m256i rotr(__m256i x)
+{
+    return _mm256_or_si256(_mm256_srli_epi32(x, N), _mm256_slli_epi32(x, 32 - N));
+};
+
+static inline __m256i add(__m256i a, __m256i b)
+{
+    return _mm256_add_epi32(a, b);
+};
+
+static inline __m256i xor3(__m256i a, __m256i b, __m256i c)
+{
+    return _mm256_xor_si256(_mm256_xor_si256(a, b), c);
+};
+
+/**
+ * @brief Runs the SHA-256 compression function on one block in each lane.
+ * @param state The eight working variables, each holding one lane per message.
+ * @param blocks `LANES` consecutive 64-byte blocks, one for each lane.
+ */
+static void compress(__m256i* state, const uint8_t* blocks)
+{
+    // Transpose the blocks so that vector `t` holds word `t` of every lane's block, swapping each
+    // word to big-endian order on the way.
+    alignas(32) uint32_t words[16][Sha256MultiBuffer::LANES];
+    for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+    {
+        const uint8_t* block = blocks + 64 * lane;
+        for (int t = 0; t < 16; t++)
+        {
+            words[t][lane] = (static_cast<uint32_t>(block[4 * t]) << 24)
+                | (static_cast<uint32_t>(block[4 * t + 1]) << 16)
+                | (static_cast<uint32_t>(block[4 * t + 2]) << 8)
+                | static_cast<uint32_t>(block[4 * t + 3]);
+        }
+    }
+
+    __m256i w[16];
+    for (int t = 0; t < 16; t++)
+    {
+        w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[t]));
+    }
+
+    __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+    __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int t = 0; t < 64; t++)
+    {
+        __m256i wt;
+        if (t < 16)
+        {
+            wt = w[t];
+        }
+        else
+        {
+            // The schedule is kept in a 16-word ring: w[t] = s1(w[t-2]) + w[t-7] + s0(w[t-15]) + w[t-16].
+            __m256i w2 = w[(t - 2) & 15];
+            __m256i w15 = w[(t - 15) & 15];
+            __m256i s0 = xor3(rotr<7>(w15), rotr<18>(w15), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = xor3(rotr<17>(w2), rotr<19>(w2), _mm256_srli_epi32(w2, 10));
+            wt = add(add(s1, w[(t - 7) & 15]), add(s0, w[t & 15]));
+            w[t & 15] = wt;
+        }
+
+        __m256i bigSigma1 = xor3(rotr<6>(e), rotr<11>(e), rotr<25>(e));
+        __m256i choose = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i temp1 = add(add(h, bigSigma1), add(choose, add(wt, _mm256_set1_epi32(roundConstants[t]))));
+
+        __m256i bigSigma0 = xor3(rotr<2>(a), rotr<13>(a), rotr<22>(a));
+        __m256i majority = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i temp2 = add(bigSigma0, majority);
+
+        h = g;
+        g = f;
+        f = e;
+        e = add(d, temp1);
+        d = c;
+        c = b;
+        b = a;
+        a = add(temp1, temp2);
+    }
+
+    state[0] = add(state[0], a);
+    state[1] = add(state[1], b);
+    state[2] = add(state[2], c);
+    state[3] = add(state[3], d);
+    state[4] = add(state[4], e);
+    state[5] = add(state[5], f);
+    state[6] = add(state[6], g);
+    state[7] = add(state[7], h);
+};
+
+/**
+ * @brief Hashes up to `LANES` messages together, one in each lane of the AVX2 registers.
+ */
+static void hashLanes(
+    const uint8_t* const* messages,
+    const size_t* lengths,
+    size_t count,
+    uint8_t* const* digests)
+{
+    size_t blockCounts[Sha256MultiBuffer::LANES] = { 0 };
+    size_t maxBlockCount = 0;
+    for (size_t lane = 0; lane < count; lane++)
+    {
+        blockCounts[lane] = paddedBlockCount(lengths[lane]);
+        maxBlockCount = max(maxBlockCount, blockCounts[lane]);
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; i++)
+    {
+        state[i] = _mm256_set1_epi32(static_cast<int>(initialState[i]));
+    }
+
+    alignas(32) uint8_t blocks[Sha256MultiBuffer::LANES * 64];
+    alignas(32) int32_t active[Sha256MultiBuffer::LANES];
+
+    for (size_t index = 0; index < maxBlockCount; index++)
+    {
+        for (size_t lane = 0; lane < Sha256MultiBuffer::LANES; lane++)
+        {
+            bool isActive = lane < count && index < blockCounts[lane];
+            active[lane] = isActive ? -1 : 0;
+            if (isActive)
+            {
+                loadPaddedBlock(messages[lane], lengths[lane], index, blocks + 64 * lane);
+            }
+            else
+            {
+                memset(blocks + 64 * lane, 0, 64);
+            }
+        }
+
+        // Lanes whose messages have already ended keep their finished state.
+        __m256i previous[8];
+        memcpy(previous, state, sizeof(state));
+        compress(state, blocks);
+
+        __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(active));
+        for (int i = 0; i < 8; i++)
+        {
+            state[i] = _mm256_blendv_epi8(previous[i], state[i], mask);
+        }
+    }
+
+    alignas(32) uint32_t words[8][Sha256MultiBuffer::LANES];
+    for (int i = 0; i < 8; i++)
+    {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(words[i]), state[i]);
+    }
+
+    for (size_t lane = 0; lane < count; lane++)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            uint32_t word = words[i][lane];
+            digests[lane][4 * i] = static_cast<uint8_t>(word >> 24);
+            digests[lane][4 * i + 1] = static_cast<uint8_t>(word >> 16);
+            digests[lane][4 * i + 2] = static_cast<uint8_t>(word >> 8);
+            digests[lane][4 * i + 3] = static_cast<uint8_t>(word);
+        }
+    }
+};
+
+
+/**
+ * @brief Checks whether the processor implements the SHA extensions.
+ * @remark With the SHA extensions, OpenSSL hashes a single message faster than the AVX2 kernel
+ * hashes eight, so the kernel is only used on processors without them.
+ */
+static bool hasShaExtensions()
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        return false;
+    }
+
+    return (ebx & bit_SHA) != 0;
+};
+
+#endif
+
+static void hashSequential(
+    const uint8_t* const* messages,
+    const size_t* lengths,
+    size_t count,
+    uint8_t* const* digests)
+{
+    Sha256Context context;
+    for (size_t i = 0; i < count; i++)
+    {
+        context.reset();
+        context.update(messages[i], lengths[i]);
+        context.finalize(digests[i]);
+    }
+};
+
+#pragma endregion
+
+void Sha256MultiBuffer::hash(
+    const uint8_t* const* messages,
+    const size_t* lengths,
+    size_t count,
+    uint8_t* const* digests)
+{
+#ifdef __AVX2__
+    static const bool useLanes = !hasShaExtensions();
+    if (useLanes)
+    {
+        hashLanes(messages, lengths, count, digests);
+        return;
+    }
+#endif
+
+    hashSequential(messages, lengths, count, digests);
+};
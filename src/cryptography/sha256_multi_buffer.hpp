@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nostr
+{
+namespace cryptography
+{
+/**
+ * @brief Computes SHA-256 digests of several independent messages at once.
+ * @remark On targets with AVX2, up to `LANES` messages are hashed together, one message in each
+ * 32-bit lane of the vector registers.  Messages of different lengths share the rounds for as
+ * many blocks as they have in common, and shorter messages simply stop updating their lanes.  On
+ * other targets, the messages are hashed one after another with `Sha256Context`.
+ */
+class Sha256MultiBuffer
+{
+public:
+    ///< The number of messages hashed together by one call to `hash`.
+    static constexpr std::size_t LANES = 8;
+
+    static constexpr std::size_t DIGEST_SIZE = 32;
+
+    /**
+     * @brief Hashes up to `LANES` messages.
+     * @param messages Pointers to the messages to hash.
+     * @param lengths The length, in bytes, of each message.
+     * @param count The number of messages, at most `LANES`.
+     * @param digests Buffers of at least `DIGEST_SIZE` bytes, one for each message, into which
+     * the digests are written.
+     */
+    static void hash(
+        const uint8_t* const* messages,
+        const std::size_t* lengths,
+        std::size_t count,
+        uint8_t* const* digests);
+};
+} // namespace cryptography
+} // namespace nostr
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "data/data.hpp"
+#include "../encoding/hex_codec.hpp"
+
+namespace nostr
+{
+namespace data
+{
+/**
+ * @brief Writes the canonical NIP-01 serialization of an event, `[0,pubkey,created_at,kind,
+ * tags,content]`, to a byte sink.
+ * @tparam TSink A type exposing `void update(const void* data, std::size_t length)`, such as
+ * `cryptography::Sha256Context`.
+ * @remark Output is staged in a fixed-size buffer owned by the writer and flushed to the sink
+ * whenever the buffer fills, so writing an event performs no heap allocation.  Strings are
+ * escaped exactly as `nlohmann::json::dump` escapes them, so the output is byte-for-byte
+ * identical to dumping the equivalent JSON array.
+ */
+template <class TSink>
+class CanonicalEventWriter
+{
+public:
+    explicit CanonicalEventWriter(TSink& sink) : _sink(sink), _length(0) { };
+
+    ~CanonicalEventWriter()
+    {
+        this->_flush();
+    };
+
+    CanonicalEventWriter(const CanonicalEventWriter&) = delete;
+
+    CanonicalEventWriter& operator=(const CanonicalEventWriter&) = delete;
+
+    /**
+     * @brief Writes the canonical serialization of the given event and flushes it to the sink.
+     */
+    void write(const Event& event)
+    {
+        this->_put("[0,", 3);
+        this->_putHexString(event.pubkey.data(), event.pubkey.size());
+        this->_put(',');
+        this->_putInteger(static_cast<int64_t>(event.createdAt));
+        this->_put(',');
+        this->_putInteger(static_cast<int64_t>(event.kind));
+        this->_put(",[", 2);
+
+        for (std::size_t i = 0; i < event.tags.size(); i++)
+        {
+            if (i > 0)
+            {
+                this->_put(',');
+            }
+
+            this->_put('[');
+            Tags::Tag tag = event.tags[i];
+            for (std::size_t j = 0; j < tag.size(); j++)
+            {
+                if (j > 0)
+                {
+                    this->_put(',');
+                }
+                this->_putString(tag[j]);
+            }
+            this->_put(']');
+        }
+
+        this->_put("],", 2);
+        this->_putString(event.content);
+        this->_put(']');
+
+        this->_flush();
+    };
+
+private:
+    static constexpr std::size_t BUFFER_SIZE = 1024;
+
+    TSink& _sink;
+    char _buffer[BUFFER_SIZE];
+    std::size_t _length;
+
+    /**
+     * @brief Maps each byte to the character that follows the backslash in its escape sequence,
+     * `'u'` for bytes written as `\u00XX`, or 0 for bytes written verbatim.
+     */
+    static char _escapeFor(unsigned char c)
+    {
+        switch (c)
+        {
+        case '\b': return 'b';
+        case '\t': return 't';
+        case '\n': return 'n';
+        case '\f': return 'f';
+        case '\r': return 'r';
+        case '"': return '"';
+        case '\\': return '\\';
+        default: return c < 0x20 ? 'u' : 0;
+        }
+    };
+
+    void _flush()
+    {
+        if (this->_length > 0)
+        {
+            this->_sink.update(this->_buffer, this->_length);
+            this->_length = 0;
+        }
+    };
+
+    void _put(char c)
+    {
+        if (this->_length == BUFFER_SIZE)
+        {
+            this->_flush();
+        }
+        this->_buffer[this->_length++] = c;
+    };
+
+    void _put(const char* data, std::size_t length)
+    {
+        if (length > BUFFER_SIZE - this->_length)
+        {
+            this->_flush();
+
+            // Pass long runs straight through to the sink rather than copying them.
+            if (length > BUFFER_SIZE)
+            {
+                this->_sink.update(data, length);
+                return;
+            }
+        }
+
+        std::memcpy(this->_buffer + this->_length, data, length);
+        this->_length += length;
+    };
+
+    void _putHexString(const uint8_t* bytes, std::size_t length)
+    {
+        static constexpr std::size_t CHUNK_SIZE = 64;
+
+        char hex[2 * CHUNK_SIZE];
+
+        this->_put('"');
+        for (std::size_t i = 0; i < length; i += CHUNK_SIZE)
+        {
+            std::size_t count = std::min(CHUNK_SIZE, length - i);
+            encoding::HexCodec::encode(bytes + i, count, hex);
+            this->_put(hex, 2 * count);
+        }
+        this->_put('"');
+    };
+
+    void _putString(std::string_view value)
+    {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        this->_put('"');
+
+        const char* data = value.data();
+        std::size_t runStart = 0;
+        for (std::size_t i = 0; i < value.size(); i++)
+        {
+            char escape = _escapeFor(static_cast<unsigned char>(data[i]));
+            if (escape == 0)
+            {
+                continue;
+            }
+
+            this->_put(data + runStart, i - runStart);
+            runStart = i + 1;
+
+            if (escape == 'u')
+            {
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                char sequence[6] = { '\\', 'u', '0', '0', hexDigits[c >> 4], hexDigits[c & 0x0F] };
+                this->_put(sequence, sizeof(sequence));
+            }
+            else
+            {
+                char sequence[2] = { '\\', escape };
+                this->_put(sequence, sizeof(sequence));
+            }
+        }
+        this->_put(data + runStart, value.size() - runStart);
+
+        this->_put('"');
+    };
+
+    void _putInteger(int64_t value)
+    {
+        char digits[20];
+        std::size_t count = 0;
+
+        // Negate through an unsigned type so the minimum value does not overflow.
+        uint64_t magnitude = value < 0
+            ? ~static_cast<uint64_t>(value) + 1
+            : static_cast<uint64_t>(value);
+
+        do
+        {
+            digits[count++] = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+
+        if (value < 0)
+        {
+            this->_put('-');
+        }
+
+        while (count > 0)
+        {
+            this->_put(digits[--count]);
+        }
+    };
+};
+} // namespace data
+} // namespace nostr
@@ -1,13 +1,98 @@
-#include <sstream>
+#include <cstdint>
 #include <stdexcept>
+#include <string_view>
 
 #include "data/data.hpp"
+#include "canonical_event_writer.hpp"
+#include "../cryptography/sha256_context.hpp"
 
 using namespace nlohmann;
+using namespace nostr::cryptography;
 using namespace nostr::data;
 using namespace std;
 
+#pragma region Local Statics
+
+template <size_t N>
+static bool isUnset(const array<uint8_t, N>& bytes)
+{
+    for (uint8_t byte : bytes)
+    {
+        if (byte != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+};
+
+template <size_t N>
+static string encodeField(const array<uint8_t, N>& bytes)
+{
+    return isUnset(bytes) ? string() : toHex(bytes);
+};
+
+template <size_t N>
+static void decodeField(const json& j, const char* key, array<uint8_t, N>& bytes)
+{
+    const string& hex = j.at(key).get_ref<const string&>();
+    if (hex.empty())
+    {
+        bytes.fill(0);
+        return;
+    }
+
+    if (!fromHex(hex, bytes.data(), N))
+    {
+        throw invalid_argument(
+            string("Event::fromJson: The '") + key + "' field must be " + to_string(2 * N)
+            + " hex characters.");
+    }
+};
+
+#pragma endregion
+
+Event& Event::operator=(const Event& other)
+{
+    this->id = other.id;
+    this->pubkey = other.pubkey;
+    this->pubkeyHandle = other.pubkeyHandle;
+    this->createdAt = other.createdAt;
+    this->kind = other.kind;
+    this->tags = other.tags;
+    this->content = other.content;
+    this->sig = other.sig;
+    this->_idSnapshot = this->_isCacheable() ? other._idSnapshot : nullptr;
+    this->_jsonSnapshot = this->_isCacheable() ? other._jsonSnapshot : nullptr;
+
+    return *this;
+};
+
+Event& Event::operator=(Event&& other)
+{
+    this->id = other.id;
+    this->pubkey = other.pubkey;
+    this->pubkeyHandle = other.pubkeyHandle;
+    this->createdAt = other.createdAt;
+    this->kind = other.kind;
+    this->tags = move(other.tags);
+    this->content = move(other.content);
+    this->sig = other.sig;
+    this->_idSnapshot = this->_isCacheable() ? move(other._idSnapshot) : nullptr;
+    this->_jsonSnapshot = this->_isCacheable() ? move(other._jsonSnapshot) : nullptr;
+    other._idSnapshot = nullptr;
+    other._jsonSnapshot = nullptr;
+
+    return *this;
+};
+
 string Event::serialize()
+{
+    return *this->serializeShared();
+};
+
+shared_ptr<const string> Event::serializeShared()
 {
     try
     {
@@ -18,11 +103,44 @@ string Event::serialize()
         throw e;
     }
 
-    // Generate the event ID from the serialized data.
-    this->generateId();
+    if (this->_matchesIdSnapshot())
+    {
+        this->id = this->_idSnapshot->id;
+        if (this->_jsonSnapshot && this->_jsonSnapshot->sig == this->sig)
+        {
+            return shared_ptr<const string>(this->_jsonSnapshot, &this->_jsonSnapshot->json);
+        }
+    }
+    else
+    {
+        // Generate the event ID from the serialized data.
+        this->generateId();
+        this->_idSnapshot = nullptr;
+        this->_jsonSnapshot = nullptr;
+    }
 
     json j = *this;
-    return j.dump();
+    auto jsonSnapshot = make_shared<JsonSnapshot>();
+    jsonSnapshot->sig = this->sig;
+    jsonSnapshot->json = j.dump();
+
+    if (this->_isCacheable())
+    {
+        if (this->_idSnapshot == nullptr)
+        {
+            this->_idSnapshot = make_shared<IdSnapshot>(IdSnapshot{
+                this->pubkey,
+                this->createdAt,
+                this->kind,
+                this->tags.generation(),
+                string(this->content),
+                this->id
+            });
+        }
+        this->_jsonSnapshot = jsonSnapshot;
+    }
+
+    return shared_ptr<const string>(jsonSnapshot, &jsonSnapshot->json);
 };
 
 Event Event::fromString(string jstr)
@@ -50,7 +168,7 @@ Event Event::fromJson(json j)
 
 void Event::validate()
 {
-    bool hasPubkey = this->pubkey.length() > 0;
+    bool hasPubkey = !isUnset(this->pubkey);
     if (!hasPubkey)
     {
         throw invalid_argument("Event::validate: The pubkey of the event author is required.");
@@ -62,7 +180,7 @@ void Event::validate()
         this->createdAt = time(nullptr);
     }
 
-    bool hasKind = this->kind >= 0 && this->kind < 40000;
+    bool hasKind = this->kind >= 0 && this->kind <= Event::MAX_KIND;
     if (!hasKind)
     {
         throw std::invalid_argument("Event::validate: A valid event kind is required.");
@@ -71,29 +189,77 @@ void Event::validate()
 
 void Event::generateId()
 {
-    // Create a JSON array of values used to generate the event ID.
-    json arr = { 0, this->pubkey, this->createdAt, this->kind, this->tags, this->content };
-    string serializedData = arr.dump();
+    // Stream the canonical serialization `[0,pubkey,created_at,kind,tags,content]` straight into
+    // the hash, rather than building it as a string first.
+    Sha256Context sha256;
+    CanonicalEventWriter<Sha256Context> writer(sha256);
+    writer.write(*this);
+
+    sha256.finalize(this->id.data());
+};
+
+bool Event::_matchesIdSnapshot() const
+{
+    const IdSnapshot* snapshot = this->_idSnapshot.get();
+
+    // The tags are compared by generation, in constant time.  The content has no such
+    // counter, since it may be assigned directly, so it is compared in full.
+    return snapshot != nullptr
+        && snapshot->createdAt == this->createdAt
+        && snapshot->kind == this->kind
+        && snapshot->pubkey == this->pubkey
+        && snapshot->tagsGeneration == this->tags.generation()
+        && string_view(snapshot->content) == string_view(this->content);
+};
+
+bool Event::_isCacheable() const
+{
+    // Snapshots are heap allocated, so events in an arena, whose destructors never run, do not
+    // hold them.
+    return this->content.get_allocator().resource() == pmr::get_default_resource();
+};
+
+PublicKeyHandle Event::internPubkey()
+{
+    this->pubkeyHandle = isUnset(this->pubkey)
+        ? PublicKeyHandle::NONE
+        : PublicKeyPool::global().intern(this->pubkey);
 
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    EVP_Digest(serializedData.c_str(), serializedData.length(), hash, NULL, EVP_sha256(), NULL);
+    return this->pubkeyHandle;
+};
+
+bool Event::isReplaceableKind(int kind)
+{
+    return kind == 0 || kind == 3 || (kind >= 10000 && kind < 20000);
+};
 
-    stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+bool Event::isAddressableKind(int kind)
+{
+    return kind >= 30000 && kind < 40000;
+};
+
+bool Event::supersedes(const Event& other) const
+{
+    return Event::supersedes(this->createdAt, this->id, other.createdAt, other.id);
+};
+
+bool Event::supersedes(time_t createdAt, const EventId& id, time_t otherCreatedAt, const EventId& otherId)
+{
+    if (createdAt != otherCreatedAt)
     {
-        ss << hex << setw(2) << setfill('0') << (int)hash[i];
+        return createdAt > otherCreatedAt;
     }
 
-    this->id = ss.str();
+    return id < otherId;
 };
 
 bool Event::operator==(const Event& other) const
 {
-    if (this->id.empty())
+    if (isUnset(this->id))
     {
         throw invalid_argument("Event::operator==: Cannot check equality, the left-side argument is undefined.");
     }
-    if (other.id.empty())
+    if (isUnset(other.id))
     {
         throw invalid_argument("Event::operator==: Cannot check equality, the right-side argument is undefined.");
     }
@@ -105,13 +271,13 @@ void adl_serializer<Event>::to_json(json& j, const Event& event)
 {
     // Serialize the event to a JSON object.
     j = {
-        { "id", event.id },
-        { "pubkey", event.pubkey },
+        { "id", encodeField(event.id) },
+        { "pubkey", encodeField(event.pubkey) },
         { "created_at", event.createdAt },
         { "kind", event.kind },
         { "tags", event.tags },
         { "content", event.content },
-        { "sig", event.sig },
+        { "sig", encodeField(event.sig) },
     };
 }
 
@@ -120,15 +286,16 @@ void adl_serializer<Event>::from_json(const json& j, Event& event)
     // TODO: Set up custom exception types for improved exception handling.
     try
     {
-        event.id = j.at("id");
-        event.pubkey = j.at("pubkey");
+        decodeField(j, "id", event.id);
+        decodeField(j, "pubkey", event.pubkey);
         event.createdAt = j.at("created_at");
         event.kind = j.at("kind");
         event.tags = j.at("tags");
-        event.content = j.at("content");
-        event.sig = j.at("sig");
+        event.content = j.at("content").get_ref<const string&>();
+        decodeField(j, "sig", event.sig);
 
-        // TODO: Validate the event against its signature.
+        // Received events are checked against their IDs and signatures by the service's
+        // `EventVerifier` before they reach subscription handlers.
     }
     catch (const json::type_error& te)
     {
@@ -0,0 +1,46 @@
+#include <new>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+EventArena::EventArena(size_t initialSize) : _arena(initialSize) { };
+
+shared_ptr<EventArena> EventArena::create(size_t initialSize)
+{
+    return shared_ptr<EventArena>(new EventArena(initialSize));
+};
+
+shared_ptr<Event> EventArena::makeEvent()
+{
+    void* memory = this->allocate(sizeof(Event), alignof(Event));
+    Event* event = new (memory) Event(Event::allocator_type(this));
+
+    // The pointer shares ownership of the arena rather than of the event, so releasing it never
+    // runs the event's destructor, and the event's memory is reclaimed with the arena.
+    return shared_ptr<Event>(this->shared_from_this(), event);
+};
+
+size_t EventArena::bytesAllocated() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_bytesAllocated;
+};
+
+void* EventArena::do_allocate(size_t bytes, size_t alignment)
+{
+    lock_guard<mutex> lock(this->_mutex);
+    this->_bytesAllocated += bytes;
+    return this->_arena.allocate(bytes, alignment);
+};
+
+void EventArena::do_deallocate(void*, size_t, size_t)
+{
+    // Memory is reclaimed only when the arena is destroyed.
+};
+
+bool EventArena::do_is_equal(const pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+};
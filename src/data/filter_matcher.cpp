@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+#pragma region Local Statics
+
+static const size_t KIND_COUNT = 1 << 16;
+
+template <size_t N>
+static inline bool isUnset(const array<uint8_t, N>& bytes)
+{
+    static const array<uint8_t, N> unset{};
+    return memcmp(bytes.data(), unset.data(), N) == 0;
+};
+
+/**
+ * @brief Builds an open-addressed hash table from a list of hex-encoded keys.
+ * @remark The table size is a power of two at least twice the number of keys, so probe
+ * sequences stay short.  Keys that are not valid hex, or that decode to all zeroes, are left
+ * out, since no event can match them.
+ */
+template <class TKey>
+static vector<TKey> buildSlots(const vector<string>& hexKeys)
+{
+    size_t capacity = 8;
+    while (capacity < 2 * hexKeys.size())
+    {
+        capacity <<= 1;
+    }
+
+    vector<TKey> slots(capacity, TKey{});
+    size_t mask = capacity - 1;
+    for (const string& hex : hexKeys)
+    {
+        TKey key;
+        if (!fromHex(hex, key.data(), key.size()) || isUnset(key))
+        {
+            continue;
+        }
+
+        size_t slot = BytesHash()(key) & mask;
+        while (!isUnset(slots[slot]) && slots[slot] != key)
+        {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = key;
+    }
+
+    return slots;
+};
+
+template <class TKey>
+static inline bool containsKey(const vector<TKey>& slots, const TKey& key)
+{
+    if (isUnset(key))
+    {
+        return false;
+    }
+
+    size_t mask = slots.size() - 1;
+    size_t slot = BytesHash()(key) & mask;
+    while (true)
+    {
+        const TKey& candidate = slots[slot];
+        if (memcmp(candidate.data(), key.data(), key.size()) == 0)
+        {
+            return true;
+        }
+        if (isUnset(candidate))
+        {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+};
+
+#pragma endregion
+
+FilterMatcher::FilterMatcher(const Filters& filters)
+{
+    this->_hasIds = !filters.ids.empty();
+    if (this->_hasIds)
+    {
+        this->_idSlots = buildSlots<EventId>(filters.ids);
+    }
+
+    this->_hasAuthors = !filters.authors.empty() || !filters.authorHandles.empty();
+    if (this->_hasAuthors)
+    {
+        PublicKeyPool& pool = PublicKeyPool::global();
+        vector<string> authors = filters.authors;
+        for (PublicKeyHandle handle : filters.authorHandles)
+        {
+            authors.push_back(toHex(pool.key(handle)));
+        }
+        this->_authorSlots = buildSlots<PublicKey>(authors);
+
+        vector<uint32_t> handles;
+        for (const PublicKey& key : this->_authorSlots)
+        {
+            if (!isUnset(key))
+            {
+                handles.push_back(static_cast<uint32_t>(pool.intern(key)));
+            }
+        }
+        uint32_t maxHandle = handles.empty() ? 0 : *max_element(handles.begin(), handles.end());
+        this->_authorHandleBits.assign(maxHandle / 64 + 1, 0);
+        for (uint32_t handle : handles)
+        {
+            this->_authorHandleBits[handle >> 6] |= uint64_t(1) << (handle & 63);
+        }
+    }
+
+    if (filters.kinds.empty())
+    {
+        this->_kindBits.assign(KIND_COUNT / 64, ~uint64_t(0));
+    }
+    else
+    {
+        this->_kindBits.assign(KIND_COUNT / 64, 0);
+        for (int kind : filters.kinds)
+        {
+            if (kind >= 0 && static_cast<size_t>(kind) < KIND_COUNT)
+            {
+                this->_kindBits[kind >> 6] |= uint64_t(1) << (kind & 63);
+            }
+        }
+    }
+
+    for (const auto& tag : filters.tags)
+    {
+        if (tag.second.empty())
+        {
+            continue;
+        }
+
+        TagCondition condition;
+        condition.name = !tag.first.empty() && tag.first[0] == '#'
+            ? tag.first.substr(1)
+            : tag.first;
+        condition.storage = make_shared<const vector<string>>(tag.second);
+        condition.values.insert(condition.storage->begin(), condition.storage->end());
+        this->_tagConditions.push_back(move(condition));
+    }
+
+    this->_since = filters.since;
+    this->_until = filters.until > 0 ? filters.until : numeric_limits<time_t>::max();
+    this->_limit = filters.limit > 0 ? filters.limit : 0;
+};
+
+bool FilterMatcher::matches(const Event& event) const
+{
+    // The timestamp and kind checks are combined without short-circuiting, so the common
+    // rejections cost no unpredictable branches.
+    uint32_t kind = static_cast<uint32_t>(event.kind);
+    bool inRange = (event.createdAt >= this->_since) & (event.createdAt <= this->_until);
+    bool kindMatches = ((kind >> 16) == 0)
+        & static_cast<bool>((this->_kindBits[(kind & 0xffff) >> 6] >> (kind & 63)) & 1);
+
+    if (!(inRange & kindMatches))
+    {
+        return false;
+    }
+
+    if (this->_hasAuthors)
+    {
+        uint32_t handle = static_cast<uint32_t>(event.pubkeyHandle);
+        bool authorMatches = handle != 0
+            ? (handle >> 6) < this->_authorHandleBits.size()
+                && ((this->_authorHandleBits[handle >> 6] >> (handle & 63)) & 1)
+            : containsKey(this->_authorSlots, event.pubkey);
+        if (!authorMatches)
+        {
+            return false;
+        }
+    }
+
+    if (this->_hasIds && !containsKey(this->_idSlots, event.id))
+    {
+        return false;
+    }
+
+    return this->_tagConditions.empty() || this->_matchesTags(event);
+};
+
+vector<shared_ptr<Event>> FilterMatcher::select(const vector<shared_ptr<Event>>& events) const
+{
+    vector<shared_ptr<Event>> selected;
+    for (const auto& event : events)
+    {
+        if (event && this->matches(*event))
+        {
+            selected.push_back(event);
+        }
+    }
+
+    auto newestFirst = [](const shared_ptr<Event>& a, const shared_ptr<Event>& b)
+    {
+        if (a->createdAt != b->createdAt)
+        {
+            return a->createdAt > b->createdAt;
+        }
+        return a->id < b->id;
+    };
+
+    if (this->_limit > 0 && selected.size() > static_cast<size_t>(this->_limit))
+    {
+        partial_sort(selected.begin(), selected.begin() + this->_limit, selected.end(), newestFirst);
+        selected.resize(this->_limit);
+    }
+    else
+    {
+        sort(selected.begin(), selected.end(), newestFirst);
+    }
+
+    return selected;
+};
+
+int FilterMatcher::limit() const
+{
+    return this->_limit;
+};
+
+bool FilterMatcher::_matchesTags(const Event& event) const
+{
+    for (const TagCondition& condition : this->_tagConditions)
+    {
+        bool satisfied = false;
+        for (string_view value : event.tags.values(condition.name))
+        {
+            if (condition.values.count(value) > 0)
+            {
+                satisfied = true;
+                break;
+            }
+        }
+
+        if (!satisfied)
+        {
+            return false;
+        }
+    }
+
+    return true;
+};
@@ -23,6 +23,33 @@ string Filters::serialize(string& subscriptionId)
     return jarr.dump();
 };
 
+string Filters::serialize(vector<shared_ptr<Filters>>& filters, string& subscriptionId)
+{
+    if (filters.empty())
+    {
+        throw invalid_argument("Filters::serialize: At least one set of filters must be given.");
+    }
+
+    json jarr = json::array({ "REQ", subscriptionId });
+    for (auto& filter : filters)
+    {
+        if (filter == nullptr)
+        {
+            throw invalid_argument("Filters::serialize: The filters must not be null.");
+        }
+
+        filter->validate();
+        jarr.push_back(*filter);
+    }
+
+    return jarr.dump();
+};
+
+FilterMatcher Filters::compile() const
+{
+    return FilterMatcher(*this);
+};
+
 void Filters::validate()
 {
     bool hasLimit = this->limit > 0;
@@ -38,7 +65,7 @@ void Filters::validate()
     }
 
     bool hasIds = this->ids.size() > 0;
-    bool hasAuthors = this->authors.size() > 0;
+    bool hasAuthors = this->authors.size() > 0 || this->authorHandles.size() > 0;
     bool hasKinds = this->kinds.size() > 0;
     bool hasTags = this->tags.size() > 0;
 
@@ -52,9 +79,15 @@ void Filters::validate()
 
 void adl_serializer<Filters>::to_json(json& j, const Filters& filters)
 {
+    vector<string> authors = filters.authors;
+    for (PublicKeyHandle handle : filters.authorHandles)
+    {
+        authors.push_back(toHex(PublicKeyPool::global().key(handle)));
+    }
+
     j = {
         { "ids", filters.ids },
-        { "authors", filters.authors },
+        { "authors", authors },
         { "kinds", filters.kinds },
         { "since", filters.since },
         { "until", filters.until },
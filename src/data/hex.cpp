@@ -0,0 +1,24 @@
+#include "data/data.hpp"
+#include "../encoding/hex_codec.hpp"
+
+using namespace nostr::data;
+using namespace nostr::encoding;
+using namespace std;
+
+string nostr::data::toHex(const uint8_t* bytes, size_t length)
+{
+    string hex(2 * length, '\0');
+    HexCodec::encode(bytes, length, &hex[0]);
+
+    return hex;
+};
+
+bool nostr::data::fromHex(const string& hex, uint8_t* bytes, size_t length)
+{
+    if (hex.length() != 2 * length)
+    {
+        return false;
+    }
+
+    return HexCodec::decode(hex.data(), length, bytes);
+};
@@ -0,0 +1,151 @@
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+
+PublicKeyPool& PublicKeyPool::global()
+{
+    static PublicKeyPool pool;
+    return pool;
+};
+
+PublicKeyPool::PublicKeyPool() { };
+
+PublicKeyPool::~PublicKeyPool()
+{
+    for (auto& segment : this->_segments)
+    {
+        delete[] segment.load(memory_order_relaxed);
+    }
+};
+
+PublicKeyHandle PublicKeyPool::intern(const PublicKey& key)
+{
+    Shard& shard = this->_shardFor(key);
+
+    shared_lock<shared_mutex> readLock(shard.mutex);
+    auto it = shard.handles.find(key);
+    if (it != shard.handles.end())
+    {
+        return static_cast<PublicKeyHandle>(it->second);
+    }
+    readLock.unlock();
+
+    unique_lock<shared_mutex> writeLock(shard.mutex);
+    it = shard.handles.find(key);
+    if (it != shard.handles.end())
+    {
+        return static_cast<PublicKeyHandle>(it->second);
+    }
+
+    uint32_t index = this->_size.load(memory_order_relaxed);
+    do
+    {
+        if (index == numeric_limits<uint32_t>::max() - 1)
+        {
+            throw length_error("PublicKeyPool::intern: The pool is full.");
+        }
+    } while (!this->_size.compare_exchange_weak(index, index + 1, memory_order_relaxed));
+
+    // The key is written before the handle is published through the shard, so any thread that
+    // obtains the handle can read the key.
+    this->_slot(index) = key;
+    uint32_t handle = index + 1;
+    shard.handles.emplace(key, handle);
+
+    return static_cast<PublicKeyHandle>(handle);
+};
+
+optional<PublicKeyHandle> PublicKeyPool::intern(const string& hex)
+{
+    PublicKey key;
+    if (!fromHex(hex, key.data(), key.size()))
+    {
+        return nullopt;
+    }
+
+    return this->intern(key);
+};
+
+PublicKeyHandle PublicKeyPool::find(const PublicKey& key) const
+{
+    const Shard& shard = this->_shardFor(key);
+
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.handles.find(key);
+
+    return it == shard.handles.end() ? PublicKeyHandle::NONE : static_cast<PublicKeyHandle>(it->second);
+};
+
+const PublicKey& PublicKeyPool::key(PublicKeyHandle handle) const
+{
+    uint32_t value = static_cast<uint32_t>(handle);
+    if (value == 0)
+    {
+        throw invalid_argument("PublicKeyPool::key: The handle does not refer to a key.");
+    }
+
+    size_t segment, offset;
+    _locate(value - 1, segment, offset);
+    const PublicKey* keys = this->_segments[segment].load(memory_order_acquire);
+    if (keys == nullptr || value > this->_size.load(memory_order_relaxed))
+    {
+        throw invalid_argument("PublicKeyPool::key: The handle was not issued by this pool.");
+    }
+
+    return keys[offset];
+};
+
+size_t PublicKeyPool::size() const
+{
+    return this->_size.load(memory_order_relaxed);
+};
+
+PublicKeyPool::Shard& PublicKeyPool::_shardFor(const PublicKey& key)
+{
+    // The map hashes the leading bytes, so the shard is chosen from a trailing one.
+    return this->_shards[key[key.size() - 1] % SHARD_COUNT];
+};
+
+const PublicKeyPool::Shard& PublicKeyPool::_shardFor(const PublicKey& key) const
+{
+    return this->_shards[key[key.size() - 1] % SHARD_COUNT];
+};
+
+void PublicKeyPool::_locate(uint32_t index, size_t& segment, size_t& offset)
+{
+    // Segment `i` starts at index `FIRST_SEGMENT_SIZE * (2^i - 1)`.
+    size_t position = (static_cast<size_t>(index) >> FIRST_SEGMENT_BITS) + 1;
+    segment = 0;
+    while (position >>= 1)
+    {
+        segment++;
+    }
+
+    size_t segmentStart = ((size_t(1) << segment) - 1) << FIRST_SEGMENT_BITS;
+    offset = index - segmentStart;
+};
+
+PublicKey& PublicKeyPool::_slot(uint32_t index)
+{
+    size_t segment, offset;
+    _locate(index, segment, offset);
+
+    PublicKey* keys = this->_segments[segment].load(memory_order_acquire);
+    if (keys == nullptr)
+    {
+        lock_guard<mutex> lock(this->_segmentMutex);
+        keys = this->_segments[segment].load(memory_order_relaxed);
+        if (keys == nullptr)
+        {
+            keys = new PublicKey[(size_t(1) << FIRST_SEGMENT_BITS) << segment];
+            this->_segments[segment].store(keys, memory_order_release);
+        }
+    }
+
+    return keys[offset];
+};
@@ -0,0 +1,603 @@
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "relay_message_parser.hpp"
+
+using namespace nlohmann;
+using namespace nostr::data;
+using namespace std;
+
+#pragma region Local Statics
+
+/**
+ * @brief The fields of a NIP-01 event object.
+ */
+enum class EventField : uint8_t
+{
+    ID = 1 << 0,
+    PUBKEY = 1 << 1,
+    CREATED_AT = 1 << 2,
+    KIND = 1 << 3,
+    TAGS = 1 << 4,
+    CONTENT = 1 << 5,
+    SIG = 1 << 6,
+    OTHER = 0
+};
+
+static constexpr uint8_t allEventFields = 0x7F;
+
+static EventField eventFieldFromKey(const string& key)
+{
+    if (key == "id") return EventField::ID;
+    if (key == "pubkey") return EventField::PUBKEY;
+    if (key == "created_at") return EventField::CREATED_AT;
+    if (key == "kind") return EventField::KIND;
+    if (key == "tags") return EventField::TAGS;
+    if (key == "content") return EventField::CONTENT;
+    if (key == "sig") return EventField::SIG;
+    return EventField::OTHER;
+};
+
+static RelayMessageType messageTypeFromLabel(const string& label)
+{
+    if (label == "EVENT") return RelayMessageType::EVENT;
+    if (label == "EOSE") return RelayMessageType::EOSE;
+    // Older relays send "CLOSE" in place of the "CLOSED" label specified by NIP-01.
+    if (label == "CLOSED" || label == "CLOSE") return RelayMessageType::CLOSED;
+    if (label == "OK") return RelayMessageType::OK;
+    if (label == "NOTICE") return RelayMessageType::NOTICE;
+    if (label == "NEG-MSG") return RelayMessageType::NEG_MSG;
+    if (label == "NEG-ERR") return RelayMessageType::NEG_ERR;
+    return RelayMessageType::UNKNOWN;
+};
+
+/**
+ * @brief A SAX handler that decodes a relay message as the JSON tokens stream in.
+ * @remark Container depth is tracked as follows: the message array is depth 1, an event object
+ * within the message is depth 2, the event's tag list is depth 3, and each tag is depth 4.
+ * Values the handler does not recognize are skipped in their entirety.  Returning `false` from
+ * any callback stops the parse immediately.
+ */
+class RelayMessageSaxHandler : public json_sax<json>
+{
+public:
+    RelayMessage result;
+    std::string error;
+
+    /**
+     * @param arena The arena in which to construct the embedded event, or null to allocate it
+     * from the heap.
+     */
+    explicit RelayMessageSaxHandler(EventArena* arena) : _arena(arena) { };
+
+    bool null() override
+    {
+        return this->_onScalar("null");
+    };
+
+    bool boolean(bool value) override
+    {
+        if (this->_isSkipping())
+        {
+            return true;
+        }
+
+        if (this->_depth == 1 && this->result.type == RelayMessageType::OK && this->_index == 2)
+        {
+            this->result.accepted = value;
+            return this->_completeValue();
+        }
+
+        return this->_onScalar("boolean");
+    };
+
+    bool number_integer(number_integer_t value) override
+    {
+        return this->_onNumber(value);
+    };
+
+    bool number_unsigned(number_unsigned_t value) override
+    {
+        if (!this->_isSkipping() && value > static_cast<number_unsigned_t>(INT64_MAX))
+        {
+            return this->_fail("An integer in the message is out of range.");
+        }
+
+        return this->_onNumber(static_cast<int64_t>(value));
+    };
+
+    bool number_float(number_float_t, const string_t&) override
+    {
+        return this->_onScalar("floating-point number");
+    };
+
+    bool string(string_t& value) override
+    {
+        if (this->_isSkipping())
+        {
+            return true;
+        }
+
+        switch (this->_depth)
+        {
+        case 1:
+            return this->_onMessageString(value);
+
+        case 2:
+            return this->_onEventString(value);
+
+        case 4:
+            this->_event->tags.appendToLastTag(value);
+            return true;
+
+        default:
+            return this->_onScalar("string");
+        }
+    };
+
+    bool binary(binary_t&) override
+    {
+        return this->_onScalar("binary data");
+    };
+
+    bool start_object(size_t) override
+    {
+        if (this->_isSkipping())
+        {
+            this->_depth++;
+            return true;
+        }
+
+        if (this->_depth == 1 && this->result.type == RelayMessageType::EVENT && this->_index == 2)
+        {
+            this->_depth++;
+            this->_event = this->_arena != nullptr ? this->_arena->makeEvent() : make_shared<Event>();
+            return true;
+        }
+
+        if (this->_depth == 0)
+        {
+            return this->_fail("A relay message must be a JSON array.");
+        }
+
+        return this->_startContainer("object");
+    };
+
+    bool key(string_t& key) override
+    {
+        if (!this->_isSkipping())
+        {
+            this->_field = eventFieldFromKey(key);
+        }
+
+        return true;
+    };
+
+    bool end_object() override
+    {
+        this->_depth--;
+
+        if (this->_isSkipping())
+        {
+            return this->_endSkippedContainer();
+        }
+
+        // The only object that is not skipped is the event object.
+        if ((this->_seenFields & allEventFields) != allEventFields)
+        {
+            return this->_fail("The event object is missing one or more required fields.");
+        }
+
+        this->result.event = move(this->_event);
+        return this->_completeValue();
+    };
+
+    bool start_array(size_t) override
+    {
+        if (this->_isSkipping())
+        {
+            this->_depth++;
+            return true;
+        }
+
+        switch (this->_depth)
+        {
+        case 0:
+            this->_depth++;
+            return true;
+
+        case 2:
+            if (this->_field != EventField::TAGS)
+            {
+                return this->_startContainer("array");
+            }
+            this->_depth++;
+            return true;
+
+        case 3:
+            this->_depth++;
+            this->_event->tags.beginTag();
+            return true;
+
+        default:
+            return this->_startContainer("array");
+        }
+    };
+
+    bool end_array() override
+    {
+        this->_depth--;
+
+        if (this->_isSkipping())
+        {
+            return this->_endSkippedContainer();
+        }
+
+        switch (this->_depth)
+        {
+        case 0:
+            return this->_completeMessage();
+
+        case 2:
+            return this->_completeValue();
+
+        default:
+            return true;
+        }
+    };
+
+    bool parse_error(size_t position, const std::string&, const detail::exception& ex) override
+    {
+        return this->_fail(
+            "The message is not valid JSON (byte " + to_string(position) + "): " + ex.what());
+    };
+
+private:
+    int _depth = 0; ///< The number of containers currently open.
+    int _index = 0; ///< The index of the current element in the message array.
+    int _skipDepth = 0; ///< The depth at which a skipped value began, or 0 if not skipping.
+    EventField _field = EventField::OTHER; ///< The event field whose value is being decoded.
+    uint8_t _seenFields = 0; ///< A bitmask of the event fields decoded so far.
+    shared_ptr<Event> _event; ///< The event being decoded.
+    EventArena* _arena; ///< The arena in which events are constructed, or null for the heap.
+
+    bool _isSkipping() const
+    {
+        return this->_skipDepth > 0;
+    };
+
+    bool _fail(std::string reason)
+    {
+        this->error = move(reason);
+        return false;
+    };
+
+    /**
+     * @brief Marks the end of a value that is a direct child of the message array or the event
+     * object.
+     */
+    bool _completeValue()
+    {
+        if (this->_depth == 1)
+        {
+            this->_index++;
+        }
+        else if (this->_depth == 2)
+        {
+            uint8_t field = static_cast<uint8_t>(this->_field);
+            if (this->_seenFields & field)
+            {
+                return this->_fail("The event object contains a duplicate field.");
+            }
+            this->_seenFields |= field;
+        }
+
+        return true;
+    };
+
+    /**
+     * @brief Handles a container the message layout does not call for at the current position.
+     * @remark Unrecognized elements and event fields are skipped, but a container in place of
+     * a required scalar is an error.
+     */
+    bool _startContainer(const char* description)
+    {
+        bool isUnrecognized = (this->_depth == 1 && this->_isExtraElement())
+            || (this->_depth == 2 && this->_field == EventField::OTHER);
+
+        if (!isUnrecognized)
+        {
+            return this->_fail(std::string("Unexpected ") + description + " in the message.");
+        }
+
+        this->_depth++;
+        this->_skipDepth = this->_depth;
+        return true;
+    };
+
+    bool _endSkippedContainer()
+    {
+        if (this->_depth < this->_skipDepth)
+        {
+            this->_skipDepth = 0;
+            return this->_completeValue();
+        }
+
+        return true;
+    };
+
+    /**
+     * @brief Indicates whether the current element of the message array lies beyond those
+     * specified for the message type.
+     */
+    bool _isExtraElement() const
+    {
+        switch (this->result.type)
+        {
+        case RelayMessageType::EVENT:
+        case RelayMessageType::CLOSED:
+        case RelayMessageType::NEG_MSG:
+        case RelayMessageType::NEG_ERR:
+            return this->_index > 2;
+
+        case RelayMessageType::EOSE:
+        case RelayMessageType::NOTICE:
+            return this->_index > 1;
+
+        case RelayMessageType::OK:
+            return this->_index > 3;
+
+        default:
+            return this->_index > 0;
+        }
+    };
+
+    bool _onScalar(const char* description)
+    {
+        if (this->_isSkipping())
+        {
+            return true;
+        }
+
+        bool isUnrecognized = (this->_depth == 1 && this->_isExtraElement())
+            || (this->_depth == 2 && this->_field == EventField::OTHER);
+
+        if (!isUnrecognized)
+        {
+            return this->_fail(std::string("Unexpected ") + description + " in the message.");
+        }
+
+        return this->_completeValue();
+    };
+
+    bool _onNumber(int64_t value)
+    {
+        if (this->_isSkipping())
+        {
+            return true;
+        }
+
+        if (this->_depth == 2 && this->_field == EventField::CREATED_AT)
+        {
+            this->_event->createdAt = static_cast<time_t>(value);
+            return this->_completeValue();
+        }
+
+        if (this->_depth == 2 && this->_field == EventField::KIND)
+        {
+            if (value < INT32_MIN || value > INT32_MAX)
+            {
+                return this->_fail("The event kind is out of range.");
+            }
+            this->_event->kind = static_cast<int>(value);
+            return this->_completeValue();
+        }
+
+        return this->_onScalar("number");
+    };
+
+    bool _onMessageString(std::string& value)
+    {
+        if (this->_index == 0)
+        {
+            this->result.type = messageTypeFromLabel(value);
+            return this->_completeValue();
+        }
+
+        switch (this->result.type)
+        {
+        case RelayMessageType::EVENT:
+            if (this->_index == 1)
+            {
+                this->result.subscriptionId = move(value);
+            }
+            else if (this->_index == 2)
+            {
+                // Fall back to a second parse for events embedded as stringified JSON.
+                try
+                {
+                    this->result.event = make_shared<Event>(Event::fromString(value));
+                    this->result.event->internPubkey();
+                }
+                catch (const json::exception& je)
+                {
+                    return this->_fail(std::string("The embedded event is invalid: ") + je.what());
+                }
+                catch (const invalid_argument& ia)
+                {
+                    return this->_fail(std::string("The embedded event is invalid: ") + ia.what());
+                }
+            }
+            break;
+
+        case RelayMessageType::EOSE:
+            if (this->_index == 1)
+            {
+                this->result.subscriptionId = move(value);
+            }
+            break;
+
+        case RelayMessageType::CLOSED:
+        case RelayMessageType::NEG_MSG:
+        case RelayMessageType::NEG_ERR:
+            if (this->_index == 1)
+            {
+                this->result.subscriptionId = move(value);
+            }
+            else if (this->_index == 2)
+            {
+                this->result.message = move(value);
+            }
+            break;
+
+        case RelayMessageType::OK:
+            if (this->_index == 1)
+            {
+                this->result.eventId = move(value);
+            }
+            else if (this->_index == 2)
+            {
+                return this->_fail("The acceptance flag of an OK message must be a boolean.");
+            }
+            else if (this->_index == 3)
+            {
+                this->result.message = move(value);
+            }
+            break;
+
+        case RelayMessageType::NOTICE:
+            if (this->_index == 1)
+            {
+                this->result.message = move(value);
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        return this->_completeValue();
+    };
+
+    bool _onEventString(std::string& value)
+    {
+        switch (this->_field)
+        {
+        case EventField::ID:
+            if (!this->_decodeHex(value, this->_event->id.data(), this->_event->id.size()))
+            {
+                return this->_fail("The event ID must be 64 hex characters.");
+            }
+            break;
+
+        case EventField::PUBKEY:
+            if (!this->_decodeHex(value, this->_event->pubkey.data(), this->_event->pubkey.size()))
+            {
+                return this->_fail("The event pubkey must be 64 hex characters.");
+            }
+            this->_event->internPubkey();
+            break;
+
+        case EventField::CONTENT:
+            this->_event->content = value;
+            break;
+
+        case EventField::SIG:
+            if (!this->_decodeHex(value, this->_event->sig.data(), this->_event->sig.size()))
+            {
+                return this->_fail("The event signature must be 128 hex characters.");
+            }
+            break;
+
+        case EventField::OTHER:
+            break;
+
+        default:
+            return this->_fail("The event field '" + this->_fieldName() + "' must not be a string.");
+        }
+
+        return this->_completeValue();
+    };
+
+    /**
+     * @brief Decodes a hex-encoded binary event field.  An empty string leaves the field unset.
+     */
+    bool _decodeHex(const std::string& value, uint8_t* bytes, size_t length)
+    {
+        return value.empty() || fromHex(value, bytes, length);
+    };
+
+    std::string _fieldName() const
+    {
+        switch (this->_field)
+        {
+        case EventField::CREATED_AT: return "created_at";
+        case EventField::KIND: return "kind";
+        case EventField::TAGS: return "tags";
+        default: return "unknown";
+        }
+    };
+
+    /**
+     * @brief Checks that the message array contained every element its type requires.
+     */
+    bool _completeMessage()
+    {
+        int requiredElements;
+        switch (this->result.type)
+        {
+        case RelayMessageType::EVENT:
+        case RelayMessageType::CLOSED:
+        case RelayMessageType::NEG_MSG:
+        case RelayMessageType::NEG_ERR:
+            requiredElements = 3;
+            break;
+
+        case RelayMessageType::EOSE:
+        case RelayMessageType::NOTICE:
+            requiredElements = 2;
+            break;
+
+        case RelayMessageType::OK:
+            requiredElements = 3;
+            break;
+
+        default:
+            requiredElements = 1;
+            break;
+        }
+
+        if (this->_index < requiredElements)
+        {
+            return this->_fail("The message is missing one or more required elements.");
+        }
+
+        return true;
+    };
+};
+
+#pragma endregion
+
+RelayMessageParser::RelayMessageParser(size_t maxMessageSize, shared_ptr<EventArena> arena)
+    : _maxMessageSize(maxMessageSize), _arena(arena) { };
+
+RelayMessage RelayMessageParser::parse(const std::string& message) const
+{
+    if (message.size() > this->_maxMessageSize)
+    {
+        throw invalid_argument(
+            "RelayMessageParser::parse: The message exceeds the maximum size of "
+            + to_string(this->_maxMessageSize) + " bytes.");
+    }
+
+    RelayMessageSaxHandler handler(this->_arena.get());
+    bool isParsed = json::sax_parse(message, &handler);
+
+    if (!isParsed)
+    {
+        throw invalid_argument("RelayMessageParser::parse: " + handler.error);
+    }
+
+    return move(handler.result);
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace data
+{
+/**
+ * @brief The kinds of messages a relay may send to a client, as specified in NIP-01, and the
+ * Negentropy reconciliation messages specified in NIP-77.
+ */
+enum class RelayMessageType
+{
+    UNKNOWN,
+    EVENT,
+    EOSE,
+    CLOSED,
+    OK,
+    NOTICE,
+    NEG_MSG,
+    NEG_ERR
+};
+
+/**
+ * @brief A relay-to-client message decoded by the `RelayMessageParser`.
+ * @remark Only the fields relevant to the message type are populated.
+ */
+struct RelayMessage
+{
+    RelayMessageType type = RelayMessageType::UNKNOWN;
+    std::string subscriptionId; ///< Set on EVENT, EOSE, CLOSED, NEG-MSG, and NEG-ERR messages.
+    std::shared_ptr<Event> event; ///< Set on EVENT messages.
+    std::string eventId; ///< Set on OK messages.
+    bool accepted = false; ///< Set on OK messages.
+    std::string message; ///< The text of CLOSED, OK, NOTICE, and NEG-ERR messages, or the hex payload of NEG-MSG messages.
+};
+
+/**
+ * @brief A single-pass parser for messages received from Nostr relays.
+ * @remark The parser walks the message with a SAX-style handler, decoding the message envelope
+ * and any embedded event directly into their final data structures without first building a
+ * JSON DOM.  Parsing stops at the first token that does not fit the expected message layout.
+ */
+class RelayMessageParser
+{
+public:
+    ///< The default upper bound on the size of a relay message, in bytes.
+    static constexpr std::size_t DEFAULT_MAX_MESSAGE_SIZE = 512 * 1024;
+
+    /**
+     * @param maxMessageSize Messages longer than this many bytes are rejected without being
+     * parsed.
+     * @param arena If set, events are constructed in this arena rather than on the heap.
+     */
+    explicit RelayMessageParser(
+        std::size_t maxMessageSize = DEFAULT_MAX_MESSAGE_SIZE,
+        std::shared_ptr<EventArena> arena = nullptr);
+
+    /**
+     * @brief Parses a message received from a relay.
+     * @param message The raw text of the message.
+     * @returns The decoded message.  Messages of an unrecognized type are returned with the
+     * type `RelayMessageType::UNKNOWN`.
+     * @throws `std::invalid_argument` if the message is oversized, is not valid JSON, or does not
+     * match the layout specified by NIP-01 for its message type.
+     * @remark For compatibility with peers that embed the event in an EVENT message as a
+     * stringified JSON object, rather than as a JSON object, the parser accepts both forms.
+     */
+    RelayMessage parse(const std::string& message) const;
+
+private:
+    std::size_t _maxMessageSize;
+
+    std::shared_ptr<EventArena> _arena;
+};
+} // namespace data
+} // namespace nostr
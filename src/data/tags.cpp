@@ -0,0 +1,337 @@
+#include <atomic>
+#include <limits>
+#include <stdexcept>
+
+#include "data/data.hpp"
+
+using namespace nlohmann;
+using namespace nostr::data;
+using namespace std;
+
+#pragma region Local Statics
+
+///< The key of every tag name longer than 7 bytes.
+static const uint64_t LONG_NAME_KEY = numeric_limits<uint64_t>::max();
+
+///< The key of a tag with no fields, which has no name and matches no lookup.
+static const uint64_t NO_NAME_KEY = numeric_limits<uint64_t>::max() - 1;
+
+///< The last generation drawn by any tags.
+static atomic<uint64_t> lastGeneration{0};
+
+#pragma endregion
+
+#pragma region Tag
+
+size_t Tags::Tag::size() const
+{
+    return this->_tags->_fieldCount(this->_index);
+};
+
+string_view Tags::Tag::operator[](size_t index) const
+{
+    return this->_tags->_field(this->_tags->_tagStarts[this->_index] + index);
+};
+
+string_view Tags::Tag::name() const
+{
+    return this->empty() ? string_view() : (*this)[0];
+};
+
+vector<string> Tags::Tag::toVector() const
+{
+    vector<string> fields;
+    fields.reserve(this->size());
+    for (string_view field : *this)
+    {
+        fields.emplace_back(field);
+    }
+
+    return fields;
+};
+
+#pragma endregion
+
+#pragma region ValueRange
+
+Tags::ValueRange::ValueRange(const Tags& tags, string_view name)
+    : _tags(&tags), _name(name), _nameKey(Tags::_nameKey(name)) { };
+
+Tags::ValueRange::Iterator::Iterator(const ValueRange& range, size_t index)
+    : _range(&range), _index(index)
+{
+    this->_skipToMatch();
+};
+
+string_view Tags::ValueRange::Iterator::operator*() const
+{
+    return (*this->_range->_tags)[this->_index][1];
+};
+
+Tags::ValueRange::Iterator& Tags::ValueRange::Iterator::operator++()
+{
+    this->_index++;
+    this->_skipToMatch();
+    return *this;
+};
+
+void Tags::ValueRange::Iterator::_skipToMatch()
+{
+    const Tags& tags = *this->_range->_tags;
+    while (this->_index < tags.size()
+        && !(tags._hasName(this->_index, this->_range->_name, this->_range->_nameKey)
+            && tags._fieldCount(this->_index) >= 2))
+    {
+        this->_index++;
+    }
+};
+
+#pragma endregion
+
+Tags::Tags(const allocator_type& allocator)
+    : _bytes(allocator), _fieldEnds(allocator), _tagStarts(allocator), _nameKeys(allocator) { };
+
+Tags::Tags(const Tags& other, const allocator_type& allocator)
+    : _bytes(other._bytes, allocator),
+    _fieldEnds(other._fieldEnds, allocator),
+    _tagStarts(other._tagStarts, allocator),
+    _nameKeys(other._nameKeys, allocator),
+    _generation(other._generation) { };
+
+Tags::Tags(Tags&& other) noexcept
+    : _bytes(move(other._bytes)),
+    _fieldEnds(move(other._fieldEnds)),
+    _tagStarts(move(other._tagStarts)),
+    _nameKeys(move(other._nameKeys)),
+    _generation(other._generation)
+{
+    other.clear();
+};
+
+Tags& Tags::operator=(Tags&& other) noexcept
+{
+    if (this != &other)
+    {
+        this->_bytes = move(other._bytes);
+        this->_fieldEnds = move(other._fieldEnds);
+        this->_tagStarts = move(other._tagStarts);
+        this->_nameKeys = move(other._nameKeys);
+        this->_generation = other._generation;
+        other.clear();
+    }
+
+    return *this;
+};
+
+Tags::Tags(initializer_list<vector<string>> tags)
+{
+    for (const auto& tag : tags)
+    {
+        this->push_back(tag);
+    }
+};
+
+Tags::Tags(const vector<vector<string>>& tags)
+{
+    for (const auto& tag : tags)
+    {
+        this->push_back(tag);
+    }
+};
+
+size_t Tags::size() const
+{
+    return this->_tagStarts.size();
+};
+
+bool Tags::empty() const
+{
+    return this->_tagStarts.empty();
+};
+
+Tags::Tag Tags::operator[](size_t index) const
+{
+    return Tag(*this, index);
+};
+
+void Tags::push_back(initializer_list<string_view> fields)
+{
+    this->beginTag();
+    for (string_view field : fields)
+    {
+        this->_appendField(field);
+    }
+};
+
+void Tags::push_back(const vector<string>& fields)
+{
+    this->beginTag();
+    for (const string& field : fields)
+    {
+        this->_appendField(field);
+    }
+};
+
+void Tags::beginTag()
+{
+    this->_touch();
+    this->_tagStarts.push_back(static_cast<uint32_t>(this->_fieldEnds.size()));
+    this->_nameKeys.push_back(NO_NAME_KEY);
+};
+
+void Tags::appendToLastTag(string_view field)
+{
+    if (this->_tagStarts.empty())
+    {
+        throw logic_error("Tags::appendToLastTag: There is no tag to append to.");
+    }
+
+    this->_appendField(field);
+};
+
+void Tags::reserve(size_t tagCount, size_t fieldCount, size_t byteCount)
+{
+    this->_tagStarts.reserve(tagCount);
+    this->_nameKeys.reserve(tagCount);
+    this->_fieldEnds.reserve(fieldCount);
+    this->_bytes.reserve(byteCount);
+};
+
+void Tags::clear()
+{
+    this->_touch();
+    this->_bytes.clear();
+    this->_fieldEnds.clear();
+    this->_tagStarts.clear();
+    this->_nameKeys.clear();
+};
+
+optional<string_view> Tags::firstValue(string_view name) const
+{
+    uint64_t nameKey = _nameKey(name);
+    for (size_t i = 0; i < this->size(); i++)
+    {
+        if (this->_hasName(i, name, nameKey) && this->_fieldCount(i) >= 2)
+        {
+            return this->_field(this->_tagStarts[i] + 1);
+        }
+    }
+
+    return nullopt;
+};
+
+Tags::ValueRange Tags::values(string_view name) const
+{
+    return ValueRange(*this, name);
+};
+
+vector<vector<string>> Tags::toVector() const
+{
+    vector<vector<string>> tags;
+    tags.reserve(this->size());
+    for (Tag tag : *this)
+    {
+        tags.push_back(tag.toVector());
+    }
+
+    return tags;
+};
+
+bool Tags::operator==(const Tags& other) const
+{
+    return this->_bytes == other._bytes
+        && this->_fieldEnds == other._fieldEnds
+        && this->_tagStarts == other._tagStarts;
+};
+
+uint64_t Tags::_nameKey(string_view name)
+{
+    if (name.size() > 7)
+    {
+        return LONG_NAME_KEY;
+    }
+
+    uint64_t key = static_cast<uint64_t>(name.size()) << 56;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        key |= static_cast<uint64_t>(static_cast<uint8_t>(name[i])) << (8 * i);
+    }
+
+    return key;
+};
+
+bool Tags::_hasName(size_t tagIndex, string_view name, uint64_t nameKey) const
+{
+    uint64_t key = this->_nameKeys[tagIndex];
+    if (key != nameKey)
+    {
+        return false;
+    }
+
+    return key != LONG_NAME_KEY || this->_field(this->_tagStarts[tagIndex]) == name;
+};
+
+size_t Tags::_fieldCount(size_t tagIndex) const
+{
+    size_t end = tagIndex + 1 < this->_tagStarts.size()
+        ? this->_tagStarts[tagIndex + 1]
+        : this->_fieldEnds.size();
+
+    return end - this->_tagStarts[tagIndex];
+};
+
+string_view Tags::_field(size_t fieldIndex) const
+{
+    size_t start = fieldIndex == 0 ? 0 : this->_fieldEnds[fieldIndex - 1];
+    return string_view(this->_bytes.data() + start, this->_fieldEnds[fieldIndex] - start);
+};
+
+void Tags::_appendField(string_view field)
+{
+    if (this->_bytes.size() + field.size() > numeric_limits<uint32_t>::max())
+    {
+        throw length_error("Tags::_appendField: The tags exceed 4 GiB.");
+    }
+
+    // The first field of a tag is its name.
+    if (this->_fieldEnds.size() == this->_tagStarts.back())
+    {
+        this->_nameKeys.back() = _nameKey(field);
+    }
+
+    this->_touch();
+    this->_bytes.append(field.data(), field.size());
+    this->_fieldEnds.push_back(static_cast<uint32_t>(this->_bytes.size()));
+};
+
+void Tags::_touch()
+{
+    this->_generation = ++lastGeneration;
+};
+
+void adl_serializer<Tags>::to_json(json& j, const Tags& tags)
+{
+    j = json::array();
+    for (Tags::Tag tag : tags)
+    {
+        json fields = json::array();
+        for (string_view field : tag)
+        {
+            fields.push_back(string(field));
+        }
+        j.push_back(move(fields));
+    }
+};
+
+void adl_serializer<Tags>::from_json(const json& j, Tags& tags)
+{
+    tags.clear();
+    for (const json& tag : j.get_ref<const json::array_t&>())
+    {
+        tags.beginTag();
+        for (const json& field : tag.get_ref<const json::array_t&>())
+        {
+            tags.appendToLastTag(field.get_ref<const string&>());
+        }
+    }
+};
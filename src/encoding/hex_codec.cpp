@@ -0,0 +1,244 @@
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+#include "hex_codec.hpp"
+
+using namespace nostr::encoding;
+using namespace std;
+
+#pragma region Local Statics
+
+static const char hexDigits[] = "0123456789abcdef";
+
+/**
+ * @brief Maps each character to the value of the hex digit it represents, or -1 if the
+ * character is not a hex digit.
+ */
+struct NibbleTable
+{
+    int8_t values[256];
+
+    NibbleTable()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            this->values[c] = -1;
+        }
+        for (int i = 0; i < 10; i++)
+        {
+            this->values['0' + i] = static_cast<int8_t>(i);
+        }
+        for (int i = 0; i < 6; i++)
+        {
+            this->values['a' + i] = static_cast<int8_t>(10 + i);
+            this->values['A' + i] = static_cast<int8_t>(10 + i);
+        }
+    };
+};
+
+static const NibbleTable nibbles;
+
+static void encodeScalar(const uint8_t* bytes, size_t length, char* hex)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        hex[2 * i] = hexDigits[bytes[i] >> 4];
+        hex[2 * i + 1] = hexDigits[bytes[i] & 0x0F];
+    }
+};
+
+static bool decodeScalar(const char* hex, size_t length, uint8_t* bytes)
+{
+    // Accumulate the high bits of every lookup so the loop has no data-dependent branches.
+    int8_t invalid = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        int8_t high = nibbles.values[static_cast<unsigned char>(hex[2 * i])];
+        int8_t low = nibbles.values[static_cast<unsigned char>(hex[2 * i + 1])];
+        invalid |= high | low;
+        bytes[i] = static_cast<uint8_t>((static_cast<uint8_t>(high) << 4) | (low & 0x0F));
+    }
+
+    return invalid >= 0;
+};
+
+#ifdef __SSSE3__
+/**
+ * @brief Encodes 16 bytes as 32 hex characters.
+ */
+static void encode16(const uint8_t* bytes, char* hex)
+{
+    const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hexDigits));
+    const __m128i lowMask = _mm_set1_epi8(0x0F);
+
+    __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(input, 4), lowMask);
+    __m128i low = _mm_and_si128(input, lowMask);
+
+    // Interleave the nibbles so each byte's high digit precedes its low digit.
+    __m128i first = _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(high, low));
+    __m128i second = _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(high, low));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(hex), first);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(hex + 16), second);
+};
+
+/**
+ * @brief Converts 16 hex characters to their digit values, flagging any non-digit characters.
+ */
+static __m128i nibbles16(__m128i chars, __m128i& invalid)
+{
+    // Characters are classified by unsigned range checks: c - '0' < 10 for decimal digits, and
+    // (c | 0x20) - 'a' < 6 for letters, where the OR folds uppercase onto lowercase.
+    __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+
+    __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+
+    invalid = _mm_or_si128(invalid, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+
+    return _mm_or_si128(
+        _mm_and_si128(isDigit, digit),
+        _mm_andnot_si128(isDigit, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+};
+
+/**
+ * @brief Decodes 32 hex characters into 16 bytes.
+ * @returns False if any of the characters is not a hex digit.
+ */
+static bool decode16(const char* hex, uint8_t* bytes)
+{
+    __m128i invalid = _mm_setzero_si128();
+    __m128i first = nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex)), invalid);
+    __m128i second = nibbles16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hex + 16)), invalid);
+
+    // Each pair of digits is combined as high * 16 + low into a 16-bit lane, then narrowed.
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i packed = _mm_packus_epi16(
+        _mm_maddubs_epi16(first, weights),
+        _mm_maddubs_epi16(second, weights));
+
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), packed);
+
+    return _mm_movemask_epi8(invalid) == 0;
+};
+#endif
+
+#ifdef __AVX2__
+/**
+ * @brief Encodes 32 bytes as 64 hex characters.
+ */
+static void encode32(const uint8_t* bytes, char* hex)
+{
+    const __m256i digits = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hexDigits)));
+    const __m256i lowMask = _mm256_set1_epi8(0x0F);
+
+    __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes));
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(input, 4), lowMask);
+    __m256i low = _mm256_and_si256(input, lowMask);
+
+    // Unpacking works within each 128-bit lane, so the halves are reordered before storing.
+    __m256i unpackedLow = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(high, low));
+    __m256i unpackedHigh = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(high, low));
+
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(hex),
+        _mm256_permute2x128_si256(unpackedLow, unpackedHigh, 0x20));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(hex + 32),
+        _mm256_permute2x128_si256(unpackedLow, unpackedHigh, 0x31));
+};
+
+/**
+ * @brief Converts 32 hex characters to their digit values, flagging any non-digit characters.
+ */
+static __m256i nibbles32(__m256i chars, __m256i& invalid)
+{
+    __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(
+        _mm256_or_si256(chars, _mm256_set1_epi8(0x20)),
+        _mm256_set1_epi8('a'));
+
+    __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+
+    invalid = _mm256_or_si256(
+        invalid,
+        _mm256_andnot_si256(_mm256_or_si256(isDigit, isLetter), _mm256_set1_epi8(-1)));
+
+    return _mm256_blendv_epi8(_mm256_add_epi8(letter, _mm256_set1_epi8(10)), digit, isDigit);
+};
+
+/**
+ * @brief Decodes 64 hex characters into 32 bytes.
+ * @returns False if any of the characters is not a hex digit.
+ */
+static bool decode32(const char* hex, uint8_t* bytes)
+{
+    __m256i invalid = _mm256_setzero_si256();
+    __m256i first = nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex)), invalid);
+    __m256i second = nibbles32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(hex + 32)), invalid);
+
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    __m256i packed = _mm256_packus_epi16(
+        _mm256_maddubs_epi16(first, weights),
+        _mm256_maddubs_epi16(second, weights));
+
+    // Packing interleaves the 64-bit quarters of its inputs by lane; restore their order.
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(bytes),
+        _mm256_permute4x64_epi64(packed, 0xD8));
+
+    return _mm256_movemask_epi8(invalid) == 0;
+};
+#endif
+
+#pragma endregion
+
+void HexCodec::encode(const uint8_t* bytes, size_t length, char* hex)
+{
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 32 <= length; i += 32)
+    {
+        encode32(bytes + i, hex + 2 * i);
+    }
+#endif
+
+#ifdef __SSSE3__
+    for (; i + 16 <= length; i += 16)
+    {
+        encode16(bytes + i, hex + 2 * i);
+    }
+#endif
+
+    encodeScalar(bytes + i, length - i, hex + 2 * i);
+};
+
+bool HexCodec::decode(const char* hex, size_t length, uint8_t* bytes)
+{
+    bool valid = true;
+    size_t i = 0;
+
+#ifdef __AVX2__
+    for (; i + 32 <= length; i += 32)
+    {
+        valid &= decode32(hex + 2 * i, bytes + i);
+    }
+#endif
+
+#ifdef __SSSE3__
+    for (; i + 16 <= length; i += 16)
+    {
+        valid &= decode16(hex + 2 * i, bytes + i);
+    }
+#endif
+
+    valid &= decodeScalar(hex + 2 * i, length - i, bytes + i);
+
+    return valid;
+};
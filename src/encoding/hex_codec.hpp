@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace nostr
+{
+namespace encoding
+{
+/**
+ * @brief Converts between binary data and lowercase hex text.
+ * @remark Both directions write into caller-owned buffers and never allocate.  When the library
+ * is compiled for a target with AVX2 or SSSE3, the bulk of each buffer is converted 32 or 16 bytes
+ * at a time with vector instructions; any remainder is converted by a table-driven scalar loop.
+ */
+class HexCodec
+{
+public:
+    /**
+     * @brief Encodes the given bytes as lowercase hex.
+     * @param bytes A pointer to the bytes to encode.
+     * @param length The number of bytes to encode.
+     * @param hex A buffer of at least `2 * length` characters.  No null terminator is written.
+     */
+    static void encode(const uint8_t* bytes, std::size_t length, char* hex);
+
+    /**
+     * @brief Decodes hex text into the given buffer.
+     * @param hex A pointer to the hex characters.  Upper- and lowercase digits are accepted.
+     * @param length The number of bytes to decode, which is half the number of hex characters.
+     * @param bytes A buffer of at least `length` bytes.
+     * @returns True if every character was a hex digit, false otherwise.  The contents of `bytes`
+     * are unspecified when decoding fails.
+     */
+    static bool decode(const char* hex, std::size_t length, uint8_t* bytes);
+};
+} // namespace encoding
+} // namespace nostr
@@ -0,0 +1,57 @@
+#include "service/cancellation_token.hpp"
+
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Public Interface
+
+void CancellationToken::cancel()
+{
+    map<size_t, function<void()>> cancelHandlers;
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        if (this->_isCancelled)
+        {
+            return;
+        }
+
+        this->_isCancelled = true;
+        cancelHandlers.swap(this->_cancelHandlers);
+    }
+
+    // Handlers run outside the lock, so they may use the token themselves.
+    for (auto& [handle, cancelHandler] : cancelHandlers)
+    {
+        cancelHandler();
+    }
+};
+
+bool CancellationToken::isCancelled() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_isCancelled;
+};
+
+size_t CancellationToken::onCancel(function<void()> cancelHandler)
+{
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        if (!this->_isCancelled)
+        {
+            size_t handle = this->_nextHandle++;
+            this->_cancelHandlers.emplace(handle, move(cancelHandler));
+            return handle;
+        }
+    }
+
+    cancelHandler();
+    return 0;
+};
+
+void CancellationToken::removeHandler(size_t handle)
+{
+    lock_guard<mutex> lock(this->_mutex);
+    this->_cancelHandlers.erase(handle);
+};
+
+#pragma endregion
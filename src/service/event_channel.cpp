@@ -0,0 +1,177 @@
+#include <stdexcept>
+
+#include "service/event_channel.hpp"
+
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Constructors
+
+EventChannel::EventChannel(size_t capacity) : _capacity(capacity)
+{
+    if (capacity == 0)
+    {
+        throw invalid_argument("EventChannel::EventChannel: The capacity must be at least 1.");
+    }
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+bool EventChannel::push(shared_ptr<nostr::data::Event> event)
+{
+    unique_lock<mutex> lock(this->_mutex);
+    this->_notFull.wait(lock, [this]()
+    {
+        return this->_isClosed || this->_isComplete || this->_events.size() < this->_capacity;
+    });
+
+    if (this->_isClosed || this->_isComplete)
+    {
+        return false;
+    }
+
+    this->_events.push_back(move(event));
+    lock.unlock();
+    this->_notEmpty.notify_one();
+
+    return true;
+};
+
+bool EventChannel::tryPush(shared_ptr<nostr::data::Event> event)
+{
+    unique_lock<mutex> lock(this->_mutex);
+    if (this->_isClosed || this->_isComplete)
+    {
+        return false;
+    }
+
+    if (this->_events.size() >= this->_capacity)
+    {
+        this->_isOverflowed = true;
+        this->_isComplete = true;
+        lock.unlock();
+        this->_notEmpty.notify_all();
+        this->_notFull.notify_all();
+
+        return false;
+    }
+
+    this->_events.push_back(move(event));
+    lock.unlock();
+    this->_notEmpty.notify_one();
+
+    return true;
+};
+
+void EventChannel::complete()
+{
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        this->_isComplete = true;
+    }
+
+    this->_notEmpty.notify_all();
+    this->_notFull.notify_all();
+};
+
+void EventChannel::close()
+{
+    function<void()> closeHandler;
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        if (this->_isClosed)
+        {
+            return;
+        }
+
+        this->_isClosed = true;
+        this->_events.clear();
+        closeHandler = move(this->_closeHandler);
+    }
+
+    this->_notEmpty.notify_all();
+    this->_notFull.notify_all();
+
+    // The handler runs outside the lock, since it may well wait on the producer.
+    if (closeHandler)
+    {
+        closeHandler();
+    }
+};
+
+shared_ptr<nostr::data::Event> EventChannel::next()
+{
+    unique_lock<mutex> lock(this->_mutex);
+    this->_notEmpty.wait(lock, [this]()
+    {
+        return this->_isClosed || this->_isComplete || !this->_events.empty();
+    });
+
+    if (this->_isClosed)
+    {
+        return nullptr;
+    }
+
+    if (this->_events.empty())
+    {
+        if (this->_isOverflowed)
+        {
+            throw overflow_error("EventChannel::next: The channel overflowed, and events were dropped.");
+        }
+        return nullptr;
+    }
+
+    shared_ptr<nostr::data::Event> event = move(this->_events.front());
+    this->_events.pop_front();
+    lock.unlock();
+    this->_notFull.notify_one();
+
+    return event;
+};
+
+void EventChannel::onClose(function<void()> closeHandler)
+{
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        if (!this->_isClosed)
+        {
+            this->_closeHandler = move(closeHandler);
+            return;
+        }
+    }
+
+    closeHandler();
+};
+
+bool EventChannel::isClosed() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_isClosed;
+};
+
+bool EventChannel::isComplete() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_isComplete;
+};
+
+bool EventChannel::isOverflowed() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_isOverflowed;
+};
+
+size_t EventChannel::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_events.size();
+};
+
+size_t EventChannel::capacity() const
+{
+    return this->_capacity;
+};
+
+#pragma endregion
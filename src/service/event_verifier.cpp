@@ -0,0 +1,365 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+#include <unordered_map>
+
+#include <noscrypt.h>
+#include <noscryptutil.h>
+#include <plog/Init.h>
+#include <plog/Log.h>
+
+#include "service/event_verifier.hpp"
+#include "verified_event_cache.hpp"
+#include "worker_pool.hpp"
+#include "../cryptography/nostr_secure_rng.hpp"
+#include "../cryptography/sha256_multi_buffer.hpp"
+#include "../data/canonical_event_writer.hpp"
+#include "../internal/noscrypt_logger.hpp"
+
+using namespace nostr::cryptography;
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+///< The number of events each worker task hashes.  One task fills every lane of the hasher.
+static constexpr size_t EVENTS_PER_TASK = Sha256MultiBuffer::LANES;
+
+///< The number of signatures each worker task checks.  A signature check costs far more than a
+///< task claim, so small tasks are used to spread the work evenly.
+static constexpr size_t SIGNATURES_PER_TASK = 4;
+
+/**
+ * @brief A `CanonicalEventWriter` sink that appends to a reusable string.
+ */
+struct StringSink
+{
+    string& buffer;
+
+    void update(const void* data, size_t length)
+    {
+        this->buffer.append(static_cast<const char*>(data), length);
+    };
+};
+
+static shared_ptr<NCContext> initNoscryptContext()
+{
+    auto context = shared_ptr<NCContext>(NCUtilContextAlloc(), &NCUtilContextFree);
+
+    uint8_t entropy[NC_CONTEXT_ENTROPY_SIZE];
+    NostrSecureRng::fill(entropy, sizeof(entropy));
+    NCResult initResult = NCInitContext(context.get(), entropy);
+    NostrSecureRng::zero(entropy, sizeof(entropy));
+
+    if (initResult != NC_SUCCESS)
+    {
+        NC_LOG_ERROR(initResult);
+        throw runtime_error("EventVerifier: Failed to initialize a noscrypt context.");
+    }
+
+    return context;
+};
+
+#pragma endregion
+
+struct EventVerifier::WorkerState
+{
+    ///< Reusable buffers holding the canonical serializations of the events being hashed.
+    vector<string> buffers = vector<string>(EVENTS_PER_TASK);
+
+    ///< A noscrypt context used only by this worker.  Unset if signatures are not verified.
+    shared_ptr<NCContext> noscryptContext;
+};
+
+double EventVerifierCounters::eventsPerSecondPerCore() const
+{
+    if (this->busyNanoseconds == 0)
+    {
+        return 0.0;
+    }
+
+    return (this->eventsVerified + this->eventsRejected) * 1e9 / this->busyNanoseconds;
+};
+
+EventVerifier::EventVerifier(EventVerifierOptions options)
+    : _shouldVerifySignatures(options.verifySignatures),
+      _workers(make_unique<WorkerPool>(options.workerCount)),
+      _verifiedCache(make_unique<VerifiedEventCache>(options.verifiedCacheCapacity))
+{
+    for (size_t i = 0; i < this->_workers->size(); i++)
+    {
+        auto state = make_unique<WorkerState>();
+        if (this->_shouldVerifySignatures)
+        {
+            state->noscryptContext = initNoscryptContext();
+        }
+        this->_workerStates.push_back(move(state));
+    }
+
+    this->_dispatcher = thread([this]() { this->_dispatch(); });
+};
+
+EventVerifier::~EventVerifier()
+{
+    {
+        lock_guard<mutex> lock(this->_queueMutex);
+        this->_isStopping = true;
+    }
+    this->_queueNotEmpty.notify_all();
+    this->_dispatcher.join();
+};
+
+vector<bool> EventVerifier::verify(const vector<shared_ptr<Event>>& events)
+{
+    if (events.empty())
+    {
+        return {};
+    }
+
+    // Workers write to separate bytes; `vector<bool>` would pack their results into shared words.
+    vector<uint8_t> results(events.size(), 0);
+
+    this->_verifyIds(events, results);
+    if (this->_shouldVerifySignatures)
+    {
+        this->_verifySignatures(events, results);
+    }
+
+    uint64_t verifiedCount = 0;
+    for (uint8_t result : results)
+    {
+        verifiedCount += result;
+    }
+
+    this->_eventsVerified += verifiedCount;
+    this->_eventsRejected += events.size() - verifiedCount;
+    this->_batches++;
+
+    return vector<bool>(results.begin(), results.end());
+};
+
+void EventVerifier::submit(shared_ptr<Event> event, function<void(shared_ptr<Event>)> onVerified)
+{
+    {
+        lock_guard<mutex> lock(this->_queueMutex);
+        this->_queue.push_back({ move(event), move(onVerified), nullptr });
+    }
+    this->_queueNotEmpty.notify_one();
+};
+
+void EventVerifier::submit(function<void()> onReached)
+{
+    {
+        lock_guard<mutex> lock(this->_queueMutex);
+        this->_queue.push_back({ nullptr, nullptr, move(onReached) });
+    }
+    this->_queueNotEmpty.notify_one();
+};
+
+EventVerifierCounters EventVerifier::counters() const
+{
+    EventVerifierCounters counters;
+    counters.eventsVerified = this->_eventsVerified;
+    counters.eventsRejected = this->_eventsRejected;
+    counters.signaturesChecked = this->_signaturesChecked;
+    counters.signaturesRejected = this->_signaturesRejected;
+    counters.signatureCacheHits = this->_signatureCacheHits;
+    counters.batches = this->_batches;
+    counters.busyNanoseconds = this->_busyNanoseconds;
+
+    return counters;
+};
+
+bool EventVerifier::verifiesSignatures() const
+{
+    return this->_shouldVerifySignatures;
+};
+
+void EventVerifier::_dispatch()
+{
+    while (true)
+    {
+        deque<PendingItem> items;
+        {
+            unique_lock<mutex> lock(this->_queueMutex);
+            this->_queueNotEmpty.wait(lock, [this]()
+            {
+                return this->_isStopping || !this->_queue.empty();
+            });
+
+            // Anything still queued at shutdown is dropped; its handlers may no longer be valid.
+            if (this->_isStopping)
+            {
+                return;
+            }
+
+            items.swap(this->_queue);
+        }
+
+        vector<shared_ptr<Event>> events;
+        for (const PendingItem& item : items)
+        {
+            if (item.event)
+            {
+                events.push_back(item.event);
+            }
+        }
+
+        vector<bool> results = this->verify(events);
+
+        size_t eventIndex = 0;
+        for (PendingItem& item : items)
+        {
+            try
+            {
+                if (!item.event)
+                {
+                    item.onReached();
+                }
+                else if (results[eventIndex++])
+                {
+                    item.onVerified(item.event);
+                }
+                else
+                {
+                    PLOG_WARNING << "Dropping event " << toHex(item.event->id)
+                        << " - its ID or signature is invalid.";
+                }
+            }
+            catch (const exception& e)
+            {
+                PLOG_ERROR << "Event handler threw an exception: " << e.what();
+            }
+        }
+    }
+};
+
+void EventVerifier::_verifyIds(const vector<shared_ptr<Event>>& events, vector<uint8_t>& results)
+{
+    size_t taskCount = (events.size() + EVENTS_PER_TASK - 1) / EVENTS_PER_TASK;
+
+    this->_workers->parallelFor(taskCount, [this, &events, &results](size_t worker, size_t task)
+    {
+        auto start = chrono::steady_clock::now();
+
+        vector<string>& buffers = this->_workerStates[worker]->buffers;
+        size_t first = task * EVENTS_PER_TASK;
+        size_t count = min(EVENTS_PER_TASK, events.size() - first);
+
+        const uint8_t* messages[EVENTS_PER_TASK];
+        size_t lengths[EVENTS_PER_TASK];
+        uint8_t digests[EVENTS_PER_TASK][Sha256MultiBuffer::DIGEST_SIZE];
+        uint8_t* digestPointers[EVENTS_PER_TASK];
+
+        for (size_t i = 0; i < count; i++)
+        {
+            buffers[i].clear();
+            StringSink sink{ buffers[i] };
+            CanonicalEventWriter<StringSink> writer(sink);
+            writer.write(*events[first + i]);
+
+            messages[i] = reinterpret_cast<const uint8_t*>(buffers[i].data());
+            lengths[i] = buffers[i].length();
+            digestPointers[i] = digests[i];
+        }
+
+        Sha256MultiBuffer::hash(messages, lengths, count, digestPointers);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const EventId& id = events[first + i]->id;
+            results[first + i] = memcmp(digests[i], id.data(), id.size()) == 0 ? 1 : 0;
+        }
+
+        auto elapsed = chrono::steady_clock::now() - start;
+        this->_busyNanoseconds += chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+    });
+};
+
+void EventVerifier::_verifySignatures(const vector<shared_ptr<Event>>& events, vector<uint8_t>& results)
+{
+    // Pick out one copy of each event that still needs a full check.  Later copies in the batch
+    // take the verdict of the first; copies already in the cache need no check at all.
+    vector<size_t> pending;
+    vector<size_t> verdictSource(events.size());
+    unordered_map<EventId, size_t, BytesHash> firstCopies;
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        verdictSource[i] = i;
+        if (!results[i])
+        {
+            continue;
+        }
+
+        const Event& event = *events[i];
+        if (this->_verifiedCache->contains(event.id, event.sig))
+        {
+            this->_signatureCacheHits++;
+            continue;
+        }
+
+        auto [it, isFirst] = firstCopies.emplace(event.id, i);
+        if (isFirst || events[it->second]->sig != event.sig)
+        {
+            pending.push_back(i);
+        }
+        else
+        {
+            verdictSource[i] = it->second;
+            this->_signatureCacheHits++;
+        }
+    }
+
+    size_t taskCount = (pending.size() + SIGNATURES_PER_TASK - 1) / SIGNATURES_PER_TASK;
+    this->_workers->parallelFor(taskCount, [this, &events, &results, &pending](size_t worker, size_t task)
+    {
+        auto start = chrono::steady_clock::now();
+
+        const NCContext* context = this->_workerStates[worker]->noscryptContext.get();
+        size_t first = task * SIGNATURES_PER_TASK;
+        size_t last = min(first + SIGNATURES_PER_TASK, pending.size());
+
+        for (size_t p = first; p < last; p++)
+        {
+            const Event& event = *events[pending[p]];
+
+            NCPublicKey pubkey;
+            memcpy(pubkey.key, event.pubkey.data(), sizeof(pubkey.key));
+
+            // The ID, already checked against the event's content, is the signed digest.
+            NCResult result = NCVerifyDigest(context, &pubkey, event.id.data(), event.sig.data());
+            results[pending[p]] = result == NC_SUCCESS ? 1 : 0;
+        }
+
+        auto elapsed = chrono::steady_clock::now() - start;
+        this->_busyNanoseconds += chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+    });
+
+    this->_signaturesChecked += pending.size();
+
+    for (size_t p : pending)
+    {
+        if (results[p])
+        {
+            this->_verifiedCache->insert(events[p]->id, events[p]->sig);
+        }
+        else
+        {
+            this->_signaturesRejected++;
+        }
+    }
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        if (verdictSource[i] != i)
+        {
+            results[i] = results[verdictSource[i]];
+            this->_signaturesRejected += results[i] ? 0 : 1;
+        }
+    }
+};
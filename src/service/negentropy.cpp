@@ -0,0 +1,566 @@
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "service/negentropy.hpp"
+#include "../cryptography/sha256_context.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+static const uint64_t INFINITE_TIMESTAMP = numeric_limits<uint64_t>::max();
+
+///< The number of subranges a range whose fingerprints differ is split into.
+static const size_t BUCKET_COUNT = 16;
+
+///< Ranges with fewer items than this are sent as ID lists rather than split further.
+static const size_t ID_LIST_THRESHOLD = BUCKET_COUNT * 2;
+
+///< The room left in a frame for the fingerprint of the ranges deferred to a later round.
+static const size_t FRAME_SIZE_MARGIN = 200;
+
+enum class Mode : uint64_t
+{
+    SKIP = 0,
+    FINGERPRINT = 1,
+    ID_LIST = 2
+};
+
+static bool itemLess(const NegentropyStorage::Item& left, const NegentropyStorage::Item& right)
+{
+    if (left.timestamp != right.timestamp)
+    {
+        return left.timestamp < right.timestamp;
+    }
+    return left.id < right.id;
+};
+
+/**
+ * @brief Appends a variable-length integer: seven bits per byte, most significant first, with
+ * the high bit set on every byte but the last.
+ */
+static void encodeVarInt(uint64_t value, string& output)
+{
+    uint8_t bytes[10];
+    size_t count = 0;
+    do
+    {
+        bytes[count++] = static_cast<uint8_t>(value & 0x7f);
+        value >>= 7;
+    } while (value != 0);
+
+    while (count > 1)
+    {
+        output.push_back(static_cast<char>(bytes[--count] | 0x80));
+    }
+    output.push_back(static_cast<char>(bytes[0]));
+};
+
+static uint64_t decodeVarInt(const uint8_t*& position, const uint8_t* end)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < 10; i++)
+    {
+        if (position == end)
+        {
+            throw invalid_argument("Negentropy::reconcile: The message ends within an integer.");
+        }
+
+        uint8_t byte = *position++;
+        value = (value << 7) | (byte & 0x7f);
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+
+    throw invalid_argument("Negentropy::reconcile: The message holds an integer that is too long.");
+};
+
+static const uint8_t* readBytes(const uint8_t*& position, const uint8_t* end, size_t count)
+{
+    if (static_cast<size_t>(end - position) < count)
+    {
+        throw invalid_argument("Negentropy::reconcile: The message ends within a field.");
+    }
+
+    const uint8_t* bytes = position;
+    position += count;
+    return bytes;
+};
+
+#pragma endregion
+
+#pragma region Negentropy Storage
+
+void NegentropyStorage::insert(time_t createdAt, const EventId& id)
+{
+    if (this->_isSealed)
+    {
+        throw logic_error("NegentropyStorage::insert: The storage is sealed.");
+    }
+    if (createdAt < 0)
+    {
+        throw invalid_argument("NegentropyStorage::insert: The timestamp must not be negative.");
+    }
+
+    this->_items.push_back({ static_cast<uint64_t>(createdAt), id });
+};
+
+void NegentropyStorage::seal()
+{
+    if (this->_isSealed)
+    {
+        return;
+    }
+
+    sort(this->_items.begin(), this->_items.end(), itemLess);
+    this->_items.erase(
+        unique(
+            this->_items.begin(),
+            this->_items.end(),
+            [](const Item& left, const Item& right)
+            {
+                return left.timestamp == right.timestamp && left.id == right.id;
+            }),
+        this->_items.end());
+
+    // Running sums of the IDs, as 256-bit little-endian integers, wrapping on overflow.
+    this->_idSums.assign(this->_items.size() + 1, { 0, 0, 0, 0 });
+    for (size_t i = 0; i < this->_items.size(); i++)
+    {
+        const auto& previous = this->_idSums[i];
+        auto& sum = this->_idSums[i + 1];
+        uint64_t carry = 0;
+        for (size_t word = 0; word < 4; word++)
+        {
+            uint64_t value = 0;
+            for (size_t byte = 0; byte < 8; byte++)
+            {
+                value |= static_cast<uint64_t>(this->_items[i].id[word * 8 + byte]) << (byte * 8);
+            }
+
+            uint64_t partial = previous[word] + value;
+            uint64_t total = partial + carry;
+            carry = (partial < value || total < partial) ? 1 : 0;
+            sum[word] = total;
+        }
+    }
+
+    this->_isSealed = true;
+};
+
+bool NegentropyStorage::isSealed() const
+{
+    return this->_isSealed;
+};
+
+size_t NegentropyStorage::size() const
+{
+    return this->_items.size();
+};
+
+const NegentropyStorage::Item& NegentropyStorage::item(size_t index) const
+{
+    return this->_items.at(index);
+};
+
+size_t NegentropyStorage::findLowerBound(size_t begin, size_t end, const Item& bound) const
+{
+    auto found = lower_bound(this->_items.begin() + begin, this->_items.begin() + end, bound, itemLess);
+    return static_cast<size_t>(found - this->_items.begin());
+};
+
+NegentropyStorage::Fingerprint NegentropyStorage::fingerprint(size_t begin, size_t end) const
+{
+    const auto& high = this->_idSums[end];
+    const auto& low = this->_idSums[begin];
+
+    uint8_t sum[32];
+    uint64_t borrow = 0;
+    for (size_t word = 0; word < 4; word++)
+    {
+        uint64_t partial = high[word] - low[word];
+        uint64_t difference = partial - borrow;
+        borrow = (high[word] < low[word] || partial < borrow) ? 1 : 0;
+        for (size_t byte = 0; byte < 8; byte++)
+        {
+            sum[word * 8 + byte] = static_cast<uint8_t>(difference >> (byte * 8));
+        }
+    }
+
+    string count;
+    encodeVarInt(end - begin, count);
+
+    uint8_t digest[nostr::cryptography::Sha256Context::DIGEST_SIZE];
+    nostr::cryptography::Sha256Context context;
+    context.update(sum, sizeof(sum));
+    context.update(count.data(), count.size());
+    context.finalize(digest);
+
+    Fingerprint fingerprint;
+    copy(digest, digest + fingerprint.size(), fingerprint.begin());
+    return fingerprint;
+};
+
+#pragma endregion
+
+#pragma region Constructors
+
+Negentropy::Negentropy(shared_ptr<const NegentropyStorage> storage, size_t frameSizeLimit)
+    : _storage(storage), _frameSizeLimit(frameSizeLimit)
+{
+    if (this->_storage == nullptr || !this->_storage->isSealed())
+    {
+        throw invalid_argument("Negentropy::Negentropy: The storage must be sealed.");
+    }
+    if (this->_frameSizeLimit != 0 && this->_frameSizeLimit < 4096)
+    {
+        throw invalid_argument("Negentropy::Negentropy: The frame size limit must be at least 4096 bytes.");
+    }
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+string Negentropy::initiate()
+{
+    if (this->_isInitiator)
+    {
+        throw logic_error("Negentropy::initiate: The reconciliation has already begun.");
+    }
+    this->_isInitiator = true;
+    this->_lastTimestampOut = 0;
+
+    string output(1, static_cast<char>(PROTOCOL_VERSION));
+    Bound infinity{ { INFINITE_TIMESTAMP, {} }, 0 };
+    this->_splitRange(0, this->_storage->size(), infinity, output);
+
+    return output;
+};
+
+optional<string> Negentropy::reconcile(
+    const string& message,
+    vector<EventId>& haveIds,
+    vector<EventId>& needIds)
+{
+    if (!this->_isInitiator)
+    {
+        throw logic_error("Negentropy::reconcile: The reconciliation has not been initiated.");
+    }
+
+    return this->_reconcile(message, &haveIds, &needIds);
+};
+
+string Negentropy::reconcile(const string& message)
+{
+    if (this->_isInitiator)
+    {
+        throw logic_error("Negentropy::reconcile: The initiator must collect the IDs each side lacks.");
+    }
+
+    return *this->_reconcile(message, nullptr, nullptr);
+};
+
+#pragma endregion
+
+#pragma region Private Methods
+
+optional<string> Negentropy::_reconcile(
+    const string& message,
+    vector<EventId>* haveIds,
+    vector<EventId>* needIds)
+{
+    const uint8_t* position = reinterpret_cast<const uint8_t*>(message.data());
+    const uint8_t* end = position + message.size();
+
+    // Timestamps are delta-encoded from the start of each message.
+    this->_lastTimestampIn = 0;
+    this->_lastTimestampOut = 0;
+
+    string fullOutput(1, static_cast<char>(PROTOCOL_VERSION));
+
+    uint8_t version = *readBytes(position, end, 1);
+    if (version < 0x60 || version > 0x6f)
+    {
+        throw invalid_argument("Negentropy::reconcile: The message is not a Negentropy message.");
+    }
+    if (version != PROTOCOL_VERSION)
+    {
+        if (this->_isInitiator)
+        {
+            throw invalid_argument(
+                "Negentropy::reconcile: The responder requested unsupported protocol version "
+                + to_string(version - 0x60) + ".");
+        }
+
+        // Answering with only our version tells the initiator which version we speak.
+        return fullOutput;
+    }
+
+    const size_t storageSize = this->_storage->size();
+    Bound previousBound{ { 0, {} }, 0 };
+    size_t previousIndex = 0;
+    bool isSkipping = false;
+
+    while (position != end)
+    {
+        string output;
+
+        // Consecutive ranges that need no reply are coalesced into one skip.
+        auto flushSkip = [&]()
+        {
+            if (isSkipping)
+            {
+                isSkipping = false;
+                this->_encodeBound(previousBound, output);
+                encodeVarInt(static_cast<uint64_t>(Mode::SKIP), output);
+            }
+        };
+
+        Bound currentBound = this->_decodeBound(position, end);
+        uint64_t mode = decodeVarInt(position, end);
+
+        size_t lower = previousIndex;
+        size_t upper = this->_storage->findLowerBound(previousIndex, storageSize, currentBound.item);
+
+        if (mode == static_cast<uint64_t>(Mode::SKIP))
+        {
+            isSkipping = true;
+        }
+        else if (mode == static_cast<uint64_t>(Mode::FINGERPRINT))
+        {
+            NegentropyStorage::Fingerprint theirFingerprint;
+            const uint8_t* bytes = readBytes(position, end, theirFingerprint.size());
+            copy(bytes, bytes + theirFingerprint.size(), theirFingerprint.begin());
+
+            if (theirFingerprint != this->_storage->fingerprint(lower, upper))
+            {
+                flushSkip();
+                this->_splitRange(lower, upper, currentBound, output);
+            }
+            else
+            {
+                isSkipping = true;
+            }
+        }
+        else if (mode == static_cast<uint64_t>(Mode::ID_LIST))
+        {
+            uint64_t idCount = decodeVarInt(position, end);
+            if (idCount > static_cast<uint64_t>(end - position) / sizeof(EventId))
+            {
+                throw invalid_argument("Negentropy::reconcile: The message ends within an ID list.");
+            }
+
+            vector<EventId> theirIds(idCount);
+            for (auto& id : theirIds)
+            {
+                const uint8_t* bytes = readBytes(position, end, id.size());
+                copy(bytes, bytes + id.size(), id.begin());
+            }
+            sort(theirIds.begin(), theirIds.end());
+            theirIds.erase(unique(theirIds.begin(), theirIds.end()), theirIds.end());
+
+            vector<bool> isShared(theirIds.size(), false);
+            for (size_t i = lower; i < upper; i++)
+            {
+                const EventId& id = this->_storage->item(i).id;
+                auto found = lower_bound(theirIds.begin(), theirIds.end(), id);
+                if (found != theirIds.end() && *found == id)
+                {
+                    isShared[found - theirIds.begin()] = true;
+                }
+                else if (this->_isInitiator)
+                {
+                    haveIds->push_back(id);
+                }
+            }
+
+            if (this->_isInitiator)
+            {
+                isSkipping = true;
+                for (size_t i = 0; i < theirIds.size(); i++)
+                {
+                    if (!isShared[i])
+                    {
+                        needIds->push_back(theirIds[i]);
+                    }
+                }
+            }
+            else
+            {
+                flushSkip();
+
+                // Reply with our IDs for the range, as many as fit in the frame.
+                string responseIds;
+                uint64_t responseCount = 0;
+                Bound endBound = currentBound;
+                for (size_t i = lower; i < upper; i++)
+                {
+                    if (this->_exceedsFrameSizeLimit(fullOutput.size() + responseIds.size()))
+                    {
+                        endBound = { this->_storage->item(i), sizeof(EventId) };
+                        upper = i;
+                        break;
+                    }
+
+                    const EventId& id = this->_storage->item(i).id;
+                    responseIds.append(reinterpret_cast<const char*>(id.data()), id.size());
+                    responseCount++;
+                }
+
+                this->_encodeBound(endBound, output);
+                encodeVarInt(static_cast<uint64_t>(Mode::ID_LIST), output);
+                encodeVarInt(responseCount, output);
+                output += responseIds;
+            }
+        }
+        else
+        {
+            throw invalid_argument("Negentropy::reconcile: The message holds an unknown range mode.");
+        }
+
+        if (this->_exceedsFrameSizeLimit(fullOutput.size() + output.size()))
+        {
+            // Defer the remaining ranges to the next round by sending their combined fingerprint.
+            NegentropyStorage::Fingerprint remaining = this->_storage->fingerprint(upper, storageSize);
+            Bound infinity{ { INFINITE_TIMESTAMP, {} }, 0 };
+            this->_encodeBound(infinity, fullOutput);
+            encodeVarInt(static_cast<uint64_t>(Mode::FINGERPRINT), fullOutput);
+            fullOutput.append(reinterpret_cast<const char*>(remaining.data()), remaining.size());
+            break;
+        }
+
+        fullOutput += output;
+        previousIndex = upper;
+        previousBound = currentBound;
+    }
+
+    if (this->_isInitiator && fullOutput.size() == 1)
+    {
+        return nullopt;
+    }
+    return fullOutput;
+};
+
+void Negentropy::_splitRange(size_t lower, size_t upper, const Bound& upperBound, string& output)
+{
+    size_t itemCount = upper - lower;
+
+    if (itemCount < ID_LIST_THRESHOLD)
+    {
+        this->_encodeBound(upperBound, output);
+        encodeVarInt(static_cast<uint64_t>(Mode::ID_LIST), output);
+        encodeVarInt(itemCount, output);
+        for (size_t i = lower; i < upper; i++)
+        {
+            const EventId& id = this->_storage->item(i).id;
+            output.append(reinterpret_cast<const char*>(id.data()), id.size());
+        }
+        return;
+    }
+
+    size_t itemsPerBucket = itemCount / BUCKET_COUNT;
+    size_t bucketsWithExtra = itemCount % BUCKET_COUNT;
+    size_t current = lower;
+
+    for (size_t i = 0; i < BUCKET_COUNT; i++)
+    {
+        size_t bucketSize = itemsPerBucket + (i < bucketsWithExtra ? 1 : 0);
+        NegentropyStorage::Fingerprint fingerprint = this->_storage->fingerprint(current, current + bucketSize);
+        current += bucketSize;
+
+        Bound nextBound = current == upper
+            ? upperBound
+            : _minimalBound(this->_storage->item(current - 1), this->_storage->item(current));
+
+        this->_encodeBound(nextBound, output);
+        encodeVarInt(static_cast<uint64_t>(Mode::FINGERPRINT), output);
+        output.append(reinterpret_cast<const char*>(fingerprint.data()), fingerprint.size());
+    }
+};
+
+bool Negentropy::_exceedsFrameSizeLimit(size_t size) const
+{
+    return this->_frameSizeLimit != 0 && size > this->_frameSizeLimit - FRAME_SIZE_MARGIN;
+};
+
+void Negentropy::_encodeBound(const Bound& bound, string& output)
+{
+    this->_encodeTimestamp(bound.item.timestamp, output);
+    encodeVarInt(bound.idSize, output);
+    output.append(reinterpret_cast<const char*>(bound.item.id.data()), bound.idSize);
+};
+
+void Negentropy::_encodeTimestamp(uint64_t timestamp, string& output)
+{
+    // Zero stands for infinity; other timestamps are sent as one more than their delta.
+    if (timestamp == INFINITE_TIMESTAMP)
+    {
+        this->_lastTimestampOut = INFINITE_TIMESTAMP;
+        encodeVarInt(0, output);
+        return;
+    }
+
+    uint64_t delta = timestamp - this->_lastTimestampOut;
+    this->_lastTimestampOut = timestamp;
+    encodeVarInt(delta + 1, output);
+};
+
+Negentropy::Bound Negentropy::_decodeBound(const uint8_t*& position, const uint8_t* end)
+{
+    Bound bound{ { this->_decodeTimestamp(position, end), {} }, 0 };
+
+    uint64_t idSize = decodeVarInt(position, end);
+    if (idSize > sizeof(EventId))
+    {
+        throw invalid_argument("Negentropy::reconcile: The message holds a bound with an ID prefix that is too long.");
+    }
+
+    const uint8_t* bytes = readBytes(position, end, idSize);
+    copy(bytes, bytes + idSize, bound.item.id.begin());
+    bound.idSize = idSize;
+
+    return bound;
+};
+
+uint64_t Negentropy::_decodeTimestamp(const uint8_t*& position, const uint8_t* end)
+{
+    uint64_t encoded = decodeVarInt(position, end);
+    uint64_t delta = encoded == 0 ? INFINITE_TIMESTAMP : encoded - 1;
+    if (this->_lastTimestampIn == INFINITE_TIMESTAMP || delta == INFINITE_TIMESTAMP)
+    {
+        this->_lastTimestampIn = INFINITE_TIMESTAMP;
+        return INFINITE_TIMESTAMP;
+    }
+
+    this->_lastTimestampIn += delta;
+    return this->_lastTimestampIn;
+};
+
+Negentropy::Bound Negentropy::_minimalBound(
+    const NegentropyStorage::Item& previous,
+    const NegentropyStorage::Item& current)
+{
+    if (current.timestamp != previous.timestamp)
+    {
+        return { { current.timestamp, {} }, 0 };
+    }
+
+    // The shortest prefix of the current ID that differs from the previous one.
+    size_t sharedPrefixSize = 0;
+    while (sharedPrefixSize < sizeof(EventId) && current.id[sharedPrefixSize] == previous.id[sharedPrefixSize])
+    {
+        sharedPrefixSize++;
+    }
+
+    Bound bound{ { current.timestamp, {} }, min(sharedPrefixSize + 1, sizeof(EventId)) };
+    copy(current.id.begin(), current.id.begin() + bound.idSize, bound.item.id.begin());
+    return bound;
+};
+
+#pragma endregion
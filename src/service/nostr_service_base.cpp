@@ -1,17 +1,234 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <ctime>
 #include <exception>
 #include <future>
+#include <optional>
 #include <stdexcept>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <uuid_v4.h>
 
+#include "service/negentropy.hpp"
 #include "service/nostr_service_base.hpp"
+#include "../data/relay_message_parser.hpp"
 
 using namespace nlohmann;
 using namespace nostr::service;
 using namespace std;
 
+#pragma region Local Statics
+
+/**
+ * @brief Records how each relay has answered a request, until the request has finished.
+ */
+struct RelayProgress
+{
+    mutex progressMutex;
+    condition_variable answered;
+    unordered_map<string, RelayRequestStatus> relayStatuses;
+    unordered_map<string, string> relayMessages;
+    size_t completedCount = 0;
+    bool isCancelled = false;
+    bool hasFinished = false;
+
+    ///< Invoked with each answer that arrives after the request has finished, if set.
+    function<void(const string&, RelayRequestStatus, const string&)> lateAnswerHandler;
+
+    /**
+     * @brief Records the relay's answer, unless it has already answered.  An answer that
+     * arrives after the request has finished is passed to the late answer handler instead.
+     * @returns True if the answer was recorded before the request finished.
+     */
+    bool settle(const string& relay, RelayRequestStatus status, const string& message = "")
+    {
+        bool isLate;
+        {
+            lock_guard<mutex> lock(this->progressMutex);
+            if (!this->relayStatuses.try_emplace(relay, status).second)
+            {
+                return false;
+            }
+            if (!message.empty())
+            {
+                this->relayMessages[relay] = message;
+            }
+
+            isLate = this->hasFinished;
+            if (!isLate && status == RelayRequestStatus::COMPLETED)
+            {
+                this->completedCount++;
+            }
+        }
+
+        if (isLate)
+        {
+            if (this->lateAnswerHandler)
+            {
+                this->lateAnswerHandler(relay, status, message);
+            }
+            return false;
+        }
+
+        this->answered.notify_all();
+        return true;
+    };
+
+    bool isFinished()
+    {
+        lock_guard<mutex> lock(this->progressMutex);
+        return this->hasFinished;
+    };
+
+    /**
+     * @brief Waits until the request may end, or the given time passes.
+     * @param requiredCount The number of relays that must complete the request.
+     * @param askedCount The number of relays the request has been sent to.
+     * @returns True if the request was cancelled, enough relays completed it, or every relay
+     * asked has answered.
+     */
+    bool waitUntil(chrono::steady_clock::time_point time, size_t requiredCount, size_t askedCount)
+    {
+        unique_lock<mutex> lock(this->progressMutex);
+        auto hasEnded = [this, requiredCount, askedCount]()
+        {
+            return this->isCancelled
+                || this->completedCount >= requiredCount
+                || this->relayStatuses.size() >= askedCount;
+        };
+
+        if (time == chrono::steady_clock::time_point::max())
+        {
+            this->answered.wait(lock, hasEnded);
+            return true;
+        }
+        return this->answered.wait_until(lock, time, hasEnded);
+    };
+};
+
+/**
+ * @brief Marks the request as cancelled when the token, if any, is cancelled.
+ * @returns The handle of the handler registered with the token.
+ */
+static size_t watchCancellation(shared_ptr<RelayProgress> progress, const RequestOptions& options)
+{
+    if (options.cancellationToken == nullptr)
+    {
+        return 0;
+    }
+
+    return options.cancellationToken->onCancel([progress]()
+    {
+        {
+            lock_guard<mutex> lock(progress->progressMutex);
+            progress->isCancelled = true;
+        }
+        progress->answered.notify_all();
+    });
+};
+
+/**
+ * @brief Finishes the request, so later answers are ignored.
+ * @returns The status of each of the given relays.  Relays that had not answered are marked
+ * cancelled, superseded if enough other relays completed the request, or otherwise timed out.
+ */
+static unordered_map<string, RelayRequestStatus> finishRelays(
+    shared_ptr<RelayProgress> progress,
+    const vector<string>& relays,
+    const RequestOptions& options,
+    size_t requiredCount,
+    size_t cancelHandle)
+{
+    unique_lock<mutex> lock(progress->progressMutex);
+    progress->hasFinished = true;
+
+    RelayRequestStatus unansweredStatus = RelayRequestStatus::TIMED_OUT;
+    if (progress->isCancelled)
+    {
+        unansweredStatus = RelayRequestStatus::CANCELLED;
+    }
+    else if (progress->completedCount >= requiredCount)
+    {
+        unansweredStatus = RelayRequestStatus::SUPERSEDED;
+    }
+
+    // The progress keeps only real answers, so answers that arrive later are still recognized.
+    unordered_map<string, RelayRequestStatus> relayStatuses = progress->relayStatuses;
+    for (const string& relay : relays)
+    {
+        relayStatuses.try_emplace(relay, unansweredStatus);
+    }
+    lock.unlock();
+
+    if (options.cancellationToken != nullptr)
+    {
+        options.cancellationToken->removeHandler(cancelHandle);
+    }
+
+    return relayStatuses;
+};
+
+/**
+ * @brief Keeps, newest first, only the events within the limit of some filter they match, as a
+ * single relay would return them for the filters.
+ */
+static vector<shared_ptr<nostr::data::Event>> keepWithinLimits(
+    vector<shared_ptr<nostr::data::Event>> events,
+    const vector<shared_ptr<nostr::data::Filters>>& filters)
+{
+    sort(events.begin(), events.end(), [](const auto& a, const auto& b)
+    {
+        return a->createdAt != b->createdAt ? a->createdAt > b->createdAt : a->id < b->id;
+    });
+
+    vector<nostr::data::FilterMatcher> matchers;
+    for (const auto& filter : filters)
+    {
+        matchers.push_back(filter->compile());
+    }
+
+    vector<int> keptCounts(filters.size(), 0);
+    vector<shared_ptr<nostr::data::Event>> keptEvents;
+    for (auto& event : events)
+    {
+        bool isKept = false;
+        for (size_t i = 0; i < filters.size(); i++)
+        {
+            if (keptCounts[i] < filters[i]->limit && matchers[i].matches(*event))
+            {
+                keptCounts[i]++;
+                isKept = true;
+            }
+        }
+
+        if (isKept)
+        {
+            keptEvents.push_back(move(event));
+        }
+    }
+
+    return keptEvents;
+};
+
+/**
+ * @brief Checks whether any of the filters names event IDs, and so asks for exact versions of
+ * replaceable events rather than the newest.
+ */
+static bool namesIds(const vector<shared_ptr<nostr::data::Filters>>& filters)
+{
+    return any_of(filters.begin(), filters.end(), [](const auto& filter)
+    {
+        return filter != nullptr && !filter->ids.empty();
+    });
+};
+
+#pragma endregion
+
 NostrServiceBase::NostrServiceBase(
     shared_ptr<plog::IAppender> appender,
     shared_ptr<client::IWebSocketClient> client
@@ -21,7 +238,19 @@ NostrServiceBase::NostrServiceBase(
     shared_ptr<plog::IAppender> appender,
     shared_ptr<client::IWebSocketClient> client,
     vector<string> relays
-) : _defaultRelays(relays), _client(client)
+) : NostrServiceBase(appender, client, relays, make_shared<EventVerifier>()) { };
+
+NostrServiceBase::NostrServiceBase(
+    shared_ptr<plog::IAppender> appender,
+    shared_ptr<client::IWebSocketClient> client,
+    vector<string> relays,
+    shared_ptr<EventVerifier> eventVerifier
+) : _defaultRelays(relays),
+    _client(client),
+    _replaceableEvents(make_shared<ReplaceableEventIndex>()),
+    _relayLatencies(make_shared<RelayLatencies>()),
+    _lifetime(make_shared<Lifetime>()),
+    _eventVerifier(eventVerifier)
 {
     plog::init(plog::debug, appender.get());
     client->start();
@@ -29,6 +258,12 @@ NostrServiceBase::NostrServiceBase(
 
 NostrServiceBase::~NostrServiceBase()
 {
+    // Waits for a callback running on the verifier's thread, and stops any still queued.
+    {
+        lock_guard<recursive_mutex> lock(this->_lifetime->mutex);
+        this->_lifetime->isAlive = false;
+    }
+
     this->_client->stop();
 };
 
@@ -41,6 +276,39 @@ vector<string> NostrServiceBase::activeRelays() const
 unordered_map<string, vector<string>> NostrServiceBase::subscriptions() const
 { return this->_subscriptions; };
 
+shared_ptr<EventVerifier> NostrServiceBase::eventVerifier() const
+{ return this->_eventVerifier; };
+
+shared_ptr<ReplaceableEventIndex> NostrServiceBase::replaceableEvents() const
+{ return this->_replaceableEvents; };
+
+shared_ptr<RelayLatencies> NostrServiceBase::relayLatencies() const
+{ return this->_relayLatencies; };
+
+shared_ptr<RelayRouter> NostrServiceBase::relayRouter() const
+{ return atomic_load(&this->_relayRouter); };
+
+void NostrServiceBase::setRelayRouter(shared_ptr<RelayRouter> relayRouter)
+{ atomic_store(&this->_relayRouter, relayRouter); };
+
+shared_ptr<nostr::store::IEventStore> NostrServiceBase::eventStore() const
+{ return atomic_load(&this->_eventStore); };
+
+void NostrServiceBase::setEventStore(shared_ptr<nostr::store::IEventStore> eventStore)
+{ atomic_store(&this->_eventStore, eventStore); };
+
+shared_ptr<SeenEventIds> NostrServiceBase::seenEventIds() const
+{ return atomic_load(&this->_seenEventIds); };
+
+void NostrServiceBase::setSeenEventIds(shared_ptr<SeenEventIds> seenEventIds)
+{ atomic_store(&this->_seenEventIds, seenEventIds); };
+
+shared_ptr<SyncWatermarks> NostrServiceBase::syncWatermarks() const
+{ return atomic_load(&this->_syncWatermarks); };
+
+void NostrServiceBase::setSyncWatermarks(shared_ptr<SyncWatermarks> syncWatermarks)
+{ atomic_store(&this->_syncWatermarks, syncWatermarks); };
+
 vector<string> NostrServiceBase::openRelayConnections()
 {
     return this->openRelayConnections(this->_defaultRelays);
@@ -108,7 +376,62 @@ void NostrServiceBase::closeRelayConnections(vector<string> relays)
     }
 };
 
-// TODO: Make this method return a promise.
+CompletionPolicy CompletionPolicy::all()
+{
+    return CompletionPolicy();
+};
+
+CompletionPolicy CompletionPolicy::firstK(size_t relayCount)
+{
+    CompletionPolicy policy;
+    policy.mode = Mode::FIRST_K;
+    policy.relayCount = relayCount;
+    return policy;
+};
+
+CompletionPolicy CompletionPolicy::fractionOf(double relayFraction)
+{
+    CompletionPolicy policy;
+    policy.mode = Mode::FRACTION;
+    policy.relayFraction = relayFraction;
+    return policy;
+};
+
+CompletionPolicy CompletionPolicy::hedged(size_t relayCount, double hedgePercentile)
+{
+    CompletionPolicy policy;
+    policy.mode = Mode::HEDGED;
+    policy.relayCount = relayCount;
+    policy.hedgePercentile = hedgePercentile;
+    return policy;
+};
+
+size_t CompletionPolicy::requiredCount(size_t targetCount) const
+{
+    switch (this->mode)
+    {
+    case Mode::FIRST_K:
+    case Mode::HEDGED:
+        return min(this->relayCount, targetCount);
+
+    case Mode::FRACTION:
+    {
+        double fraction = clamp(this->relayFraction, 0.0, 1.0);
+        return min(static_cast<size_t>(ceil(fraction * targetCount)), targetCount);
+    }
+
+    default:
+        return targetCount;
+    }
+};
+
+RequestOptions RequestOptions::withTimeout(chrono::milliseconds timeout)
+{
+    RequestOptions options;
+    options.deadline = chrono::steady_clock::now() + timeout;
+    return options;
+};
+
 tuple<vector<string>, vector<string>> NostrServiceBase::publishEvent(
     shared_ptr<nostr::data::Event> event
 )
@@ -116,12 +439,38 @@ tuple<vector<string>, vector<string>> NostrServiceBase::publishEvent(
     vector<string> successfulRelays;
     vector<string> failedRelays;
 
+    PublishResult result = this->publishEvent(event, RequestOptions());
+    for (const auto& [relay, status] : result.relayStatuses)
+    {
+        if (status == RelayRequestStatus::COMPLETED)
+        {
+            successfulRelays.push_back(relay);
+        }
+        else
+        {
+            failedRelays.push_back(relay);
+        }
+    }
+
+    return make_tuple(successfulRelays, failedRelays);
+};
+
+PublishResult NostrServiceBase::publishEvent(
+    shared_ptr<nostr::data::Event> event,
+    RequestOptions options
+)
+{
     PLOG_INFO << "Attempting to publish event to Nostr relays.";
 
-    json message;
+    // Render the frame once, and send the same buffer to every relay.
+    shared_ptr<const string> message;
     try
     {
-        message = json::array({ "EVENT", event->serialize() });
+        shared_ptr<const string> serializedEvent = event->serializeShared();
+        auto frame = make_shared<string>();
+        frame->reserve(serializedEvent->size() + 10);
+        frame->append("[\"EVENT\",").append(*serializedEvent).append("]");
+        message = move(frame);
     }
     catch (const std::invalid_argument& e)
     {
@@ -134,32 +483,45 @@ tuple<vector<string>, vector<string>> NostrServiceBase::publishEvent(
         throw je;
     }
 
-    lock_guard<mutex> lock(this->_propertyMutex);
-    vector<string> targetRelays = this->_activeRelays;
-    vector<future<tuple<string, bool>>> publishFutures;
-    for (const string& relay : targetRelays)
+    vector<string> targetRelays;
     {
-        promise<tuple<string, bool>> publishPromise;
-        publishFutures.push_back(move(publishPromise.get_future()));
+        lock_guard<mutex> lock(this->_propertyMutex);
+        targetRelays = this->_activeRelays;
+    }
 
+    // Responses may arrive after this method returns, such as once a quorum of relays has
+    // accepted the event, so the handlers share the progress.
+    auto progress = make_shared<RelayProgress>();
+    progress->lateAnswerHandler = options.lateAnswerHandler;
+    string eventId = nostr::data::toHex(event->id);
+    for (const string& relay : targetRelays)
+    {
         auto [uri, success] = this->_client->send(
-            message.dump(),
+            message,
             relay,
-            [this, &relay, &event, &publishPromise](string response)
+            [this, relay, event, eventId, progress](const string& response)
             {
                 this->_onAcceptance(
                     response,
-                    [this, &relay, &event, &publishPromise](bool isAccepted)
+                    [relay, event, eventId, progress](const string& answeredId, bool isAccepted, const string& reason)
                     {
+                        // Answers for other events published on the same connection are not
+                        // this event's result.
+                        if (answeredId != eventId)
+                        {
+                            PLOG_DEBUG << "Ignoring answer from relay " << relay << " for event " << answeredId;
+                            return;
+                        }
+
                         if (isAccepted)
                         {
-                            PLOG_INFO << "Relay " << relay << " accepted event: " << event->id;
-                            publishPromise.set_value(make_tuple(relay, true));
+                            PLOG_INFO << "Relay " << relay << " accepted event: " << nostr::data::toHex(event->id);
+                            progress->settle(relay, RelayRequestStatus::COMPLETED, reason);
                         }
                         else
                         {
-                            PLOG_WARNING << "Relay " << relay << " rejected event: " << event->id;
-                            publishPromise.set_value(make_tuple(relay, false));
+                            PLOG_WARNING << "Relay " << relay << " rejected event " << nostr::data::toHex(event->id) << ": " << reason;
+                            progress->settle(relay, RelayRequestStatus::REJECTED, reason);
                         }
                     }
                 );
@@ -168,133 +530,229 @@ tuple<vector<string>, vector<string>> NostrServiceBase::publishEvent(
         if (!success)
         {
             PLOG_WARNING << "Failed to send event to relay " << relay;
-            publishPromise.set_value(make_tuple(relay, false));
+            progress->settle(relay, RelayRequestStatus::FAILED);
         }
     }
 
-    for (auto& publishFuture : publishFutures)
+    size_t requiredCount = options.completion.requiredCount(targetRelays.size());
+    size_t cancelHandle = watchCancellation(progress, options);
+    progress->waitUntil(options.deadline, requiredCount, targetRelays.size());
+
+    PublishResult result;
+    result.relayStatuses = finishRelays(progress, targetRelays, options, requiredCount, cancelHandle);
     {
-        auto [relay, isSuccess] = publishFuture.get();
-        if (isSuccess)
-        {
-            successfulRelays.push_back(relay);
-        }
-        else
+        lock_guard<mutex> lock(progress->progressMutex);
+        for (const auto& [relay, status] : result.relayStatuses)
         {
-            failedRelays.push_back(relay);
+            auto relayMessage = progress->relayMessages.find(relay);
+            bool isAnswered = status == RelayRequestStatus::COMPLETED || status == RelayRequestStatus::REJECTED;
+            if (isAnswered && relayMessage != progress->relayMessages.end())
+            {
+                result.relayMessages.emplace(relay, relayMessage->second);
+            }
         }
     }
 
     std::size_t targetCount = targetRelays.size();
-    std::size_t successfulCount = successfulRelays.size();
+    std::size_t successfulCount = count_if(
+        result.relayStatuses.begin(),
+        result.relayStatuses.end(),
+        [](const auto& relayStatus) { return relayStatus.second == RelayRequestStatus::COMPLETED; });
     PLOG_INFO << "Published event to " << successfulCount << "/" << targetCount << " target relays.";
 
-    return make_tuple(successfulRelays, failedRelays);
+    return result;
 };
 
-// TODO: Add a timeout to this method to prevent hanging while waiting for the relay.
 future<vector<shared_ptr<nostr::data::Event>>> NostrServiceBase::queryRelays(
     shared_ptr<nostr::data::Filters> filters)
 {
-    return async(launch::async, [this, filters]() -> vector<shared_ptr<nostr::data::Event>>
+    return this->queryRelays(vector<shared_ptr<nostr::data::Filters>>{ filters });
+};
+
+future<vector<shared_ptr<nostr::data::Event>>> NostrServiceBase::queryRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters)
+{
+    return this->queryRelays(filters, nullptr);
+};
+
+future<vector<shared_ptr<nostr::data::Event>>> NostrServiceBase::queryRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters,
+    shared_ptr<nostr::data::EventArena> arena)
+{
+    return async(launch::async, [this, filters, arena]() -> vector<shared_ptr<nostr::data::Event>>
     {
-        if (filters->limit > 64 || filters->limit < 1)
-        {
-            PLOG_WARNING << "Filters limit must be between 1 and 64, inclusive.  Setting limit to 16.";
-            filters->limit = 16;
-        }
+        return this->_queryRelays(filters, RequestOptions(), arena).events;
+    });
+};
 
-        vector<shared_ptr<nostr::data::Event>> events;
+future<QueryResult> NostrServiceBase::queryRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters,
+    RequestOptions options,
+    shared_ptr<nostr::data::EventArena> arena)
+{
+    return async(launch::async, [this, filters, options, arena]() -> QueryResult
+    {
+        return this->_queryRelays(filters, options, arena);
+    });
+};
 
-        string subscriptionId = this->_generateSubscriptionId();
-        string request;
+shared_ptr<EventChannel> NostrServiceBase::streamRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters,
+    size_t capacity)
+{
+    auto channel = make_shared<EventChannel>(capacity);
 
-        try
+    string subscriptionId = this->_generateSubscriptionId();
+    string request;
+
+    try
+    {
+        request = nostr::data::Filters::serialize(filters, subscriptionId);
+    }
+    catch (const invalid_argument& e)
+    {
+        PLOG_ERROR << "Failed to serialize filters - invalid object: " << e.what();
+        throw e;
+    }
+    catch (const json::exception& je)
+    {
+        PLOG_ERROR << "Failed to serialize filters - JSON exception: " << je.what();
+        throw je;
+    }
+
+    auto routes = this->_routeFilters(filters);
+    bool foldsVersions = !namesIds(filters);
+    vector<string> relays;
+    for (const auto& [relay, relayFilters] : routes)
+    {
+        relays.push_back(relay);
+    }
+    {
+        lock_guard<mutex> lock(this->_propertyMutex);
+        this->_subscriptions[subscriptionId] = relays;
+    }
+
+    // The handlers of every relay share this state.  They run on the verifier's dispatch
+    // thread, but the subscription may also be closed from the consumer's thread.
+    struct StreamState
+    {
+        explicit StreamState(size_t expectedCount) : uniqueEventIds(expectedCount) { };
+
+        SeenEventIds uniqueEventIds;
+        atomic<size_t> pendingRelayCount{0};
+        atomic<bool> isSubscriptionClosed{false};
+    };
+    auto state = make_shared<StreamState>(capacity);
+    state->pendingRelayCount = relays.size();
+
+    // The subscription is closed once, when either every relay has finished or the consumer
+    // has stopped early.  The consumer may close the channel after the service is destroyed, by
+    // which time its subscriptions are gone.
+    auto closeStream = [this, lifetime = this->_lifetime, subscriptionId, state]()
+    {
+        if (state->isSubscriptionClosed.exchange(true))
         {
-            request = filters->serialize(subscriptionId);
+            return;
         }
-        catch (const invalid_argument& e)
+
+        lock_guard<recursive_mutex> lock(lifetime->mutex);
+        if (lifetime->isAlive)
         {
-            PLOG_ERROR << "Failed to serialize filters - invalid object: " << e.what();
-            throw e;
+            this->closeSubscription(subscriptionId);
         }
-        catch (const json::exception& je)
+    };
+    auto finishRelay = [channel, state, closeStream]()
+    {
+        if (--state->pendingRelayCount == 0)
         {
-            PLOG_ERROR << "Failed to serialize filters - JSON exception: " << je.what();
-            throw je;
+            closeStream();
+            channel->complete();
         }
+    };
 
-        vector<future<tuple<string, bool>>> requestFutures;
-
-        unordered_set<string> uniqueEventIds;
+    if (relays.empty())
+    {
+        PLOG_WARNING << "No open relay connections to stream query " << subscriptionId << " from.";
+        closeStream();
+        channel->complete();
+    }
+    channel->onClose(closeStream);
 
-        // Send the same query to each relay.  As events trickle in from each relay, they will be added
-        // to the events vector.  Duplicate copies of the same event will be ignored, as events are
-        // stored on multiple relays.  The function will block until all of the relays send an EOSE or
-        // CLOSE message.
-        for (const string relay : this->_activeRelays)
+    for (const string& relay : relays)
+    {
+        // A relay that sends CLOSED after its EOSE is counted only once.
+        auto isRelayFinished = make_shared<atomic<bool>>(false);
+        auto finishOnce = [relay, isRelayFinished, finishRelay]()
         {
-            promise<tuple<string, bool>> eosePromise;
-            requestFutures.push_back(move(eosePromise.get_future()));
-
-            auto [uri, success] = this->_client->send(
-                request,
-                relay,
-                [this, &relay, &events, &eosePromise, &uniqueEventIds](string payload)
-                {
-                    this->_onSubscriptionMessage(
-                        payload,
-                        [&events, &uniqueEventIds](const string&, shared_ptr<nostr::data::Event> event)
-                        {
-                            // Check if the event is unique before adding.
-                            if (uniqueEventIds.insert(event->id).second)
-                            {
-                                events.push_back(event);
-                            }
-                        },
-                        [relay, &eosePromise](const string&)
-                        {
-                            eosePromise.set_value(make_tuple(relay, true));
-                        },
-                        [relay, &eosePromise](const string&, const string&)
-                        {
-                            eosePromise.set_value(make_tuple(relay, false));
-                        });
-                }
-            );
-
-            if (success)
+            if (!isRelayFinished->exchange(true))
             {
-                PLOG_INFO << "Sent query to relay " << relay;
-                lock_guard<mutex> lock(this->_propertyMutex);
-                this->_subscriptions[subscriptionId].push_back(relay);
-            }
-            else
-            {
-                PLOG_WARNING << "Failed to send query to relay " << relay;
-                eosePromise.set_value(make_tuple(uri, false));
+                finishRelay();
             }
-        }
+        };
 
+        vector<shared_ptr<nostr::data::Filters>>& relayFilters = routes.at(relay);
+        string relayRequest = relayFilters == filters
+            ? request
+            : nostr::data::Filters::serialize(relayFilters, subscriptionId);
 
-        // Close open subscriptions and disconnect from relays after events are received.
+        auto [uri, success] = this->_client->send(
+            relayRequest,
+            relay,
+            [this, channel, state, closeStream, finishOnce, foldsVersions](string payload)
+            {
+                this->_onSubscriptionMessage(
+                    payload,
+                    [channel, state, closeStream](const string& subscriptionId, shared_ptr<nostr::data::Event> event)
+                    {
+                        // Events are delivered on the verifier's dispatch thread, which every
+                        // subscription of the service shares, so a consumer that falls a full
+                        // channel behind ends its stream rather than holding back the others.
+                        if (!state->uniqueEventIds.insert(event->id) || channel->tryPush(move(event)))
+                        {
+                            return;
+                        }
+                        if (channel->isOverflowed() && !state->isSubscriptionClosed)
+                        {
+                            PLOG_WARNING << "Consumer of streamed query " << subscriptionId << " fell behind; ending the stream.";
+                            closeStream();
+                        }
+                    },
+                    [finishOnce](const string&)
+                    {
+                        finishOnce();
+                    },
+                    [finishOnce](const string& subscriptionId, const string& reason)
+                    {
+                        PLOG_WARNING << "Relay closed streamed query " << subscriptionId << ": " << reason;
+                        finishOnce();
+                    },
+                    nullptr,
+                    foldsVersions);
+            });
 
-        for (auto& publishFuture : requestFutures)
+        if (success)
         {
-            auto [relay, isEose] = publishFuture.get();
-            if (isEose)
-            {
-                PLOG_INFO << "Received EOSE message from relay " << relay;
-            }
-            else
+            PLOG_INFO << "Sent streamed query to relay " << relay;
+        }
+        else
+        {
+            PLOG_WARNING << "Failed to send streamed query to relay " << relay;
             {
-                PLOG_WARNING << "Received CLOSE message from relay " << relay;
-                this->closeRelayConnections({ relay });
+                lock_guard<mutex> lock(this->_propertyMutex);
+                auto& subscriptionRelays = this->_subscriptions[subscriptionId];
+                subscriptionRelays.erase(
+                    remove(subscriptionRelays.begin(), subscriptionRelays.end(), relay),
+                    subscriptionRelays.end());
             }
+            finishOnce();
         }
-        this->closeSubscription(subscriptionId);
+    }
 
-        return events;
+    // The caller's references share a deleter that closes the channel once the last of them is
+    // released.  The handlers hold the channel itself, so it outlives them.
+    return shared_ptr<EventChannel>(channel.get(), [channel](EventChannel*)
+    {
+        channel->close();
     });
 };
 
@@ -304,28 +762,50 @@ string NostrServiceBase::queryRelays(
     function<void(const string&)> eoseHandler,
     function<void(const string&, const string&)> closeHandler
 )
+{
+    return this->queryRelays(
+        vector<shared_ptr<nostr::data::Filters>>{ filters },
+        eventHandler,
+        eoseHandler,
+        closeHandler);
+};
+
+string NostrServiceBase::queryRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters,
+    function<void(const string&, shared_ptr<nostr::data::Event>)> eventHandler,
+    function<void(const string&)> eoseHandler,
+    function<void(const string&, const string&)> closeHandler
+)
 {
     vector<string> successfulRelays;
     vector<string> failedRelays;
 
     string subscriptionId = this->_generateSubscriptionId();
-    string request = filters->serialize(subscriptionId);
+    string request = nostr::data::Filters::serialize(filters, subscriptionId);
+    auto routes = this->_routeFilters(filters);
+    bool foldsVersions = !namesIds(filters);
     vector<future<tuple<string, bool>>> requestFutures;
-    for (const string relay : this->_activeRelays)
+    for (auto& route : routes)
     {
+        string relay = route.first;
         unique_lock<mutex> lock(this->_propertyMutex);
         this->_subscriptions[subscriptionId].push_back(relay);
         lock.unlock();
 
+        string relayRequest = route.second == filters
+            ? request
+            : nostr::data::Filters::serialize(route.second, subscriptionId);
         future<tuple<string, bool>> requestFuture = async(
-            [this, &relay, &request, &eventHandler, &eoseHandler, &closeHandler]()
+            [this, relay, relayRequest, foldsVersions, eventHandler, eoseHandler, closeHandler]()
             {
+                // The handlers outlive this call, since the connection keeps the message handler
+                // for every later message, so they are held by value.
                 return this->_client->send(
-                    request,
+                    relayRequest,
                     relay,
-                    [this, &eventHandler, &eoseHandler, &closeHandler](string payload)
+                    [this, foldsVersions, eventHandler, eoseHandler, closeHandler](string payload)
                     {
-                        this->_onSubscriptionMessage(payload, eventHandler, eoseHandler, closeHandler);
+                        this->_onSubscriptionMessage(payload, eventHandler, eoseHandler, closeHandler, nullptr, foldsVersions);
                     });
             }
         );
@@ -345,7 +825,7 @@ string NostrServiceBase::queryRelays(
         }
     }
 
-    std::size_t targetCount = this->_activeRelays.size();
+    std::size_t targetCount = routes.size();
     std::size_t successfulCount = successfulRelays.size();
     PLOG_INFO << "Sent query to " << successfulCount << "/" << targetCount << " open relay connections.";
 
@@ -475,14 +955,196 @@ vector<string> NostrServiceBase::closeSubscriptions()
     return remainingSubscriptions;
 };
 
-vector<string> NostrServiceBase::_getConnectedRelays(vector<string> relays)
+future<NegentropySyncResult> NostrServiceBase::syncWithRelay(
+    string relay,
+    shared_ptr<nostr::data::Filters> filters)
 {
-    PLOG_VERBOSE << "Identifying connected relays.";
-    vector<string> connectedRelays;
-    for (string relay : relays)
-    {
-        bool isActive = find(this->_activeRelays.begin(), this->_activeRelays.end(), relay)
-            != this->_activeRelays.end();
+    return this->syncWithRelay(relay, filters, RequestOptions::withTimeout(this->NEGENTROPY_SYNC_TIMEOUT));
+};
+
+future<NegentropySyncResult> NostrServiceBase::syncWithRelay(
+    string relay,
+    shared_ptr<nostr::data::Filters> filters,
+    RequestOptions options)
+{
+    auto deadline = options.deadline;
+    return async(launch::async, [this, relay, filters, deadline]() -> NegentropySyncResult
+    {
+        auto eventStore = atomic_load(&this->_eventStore);
+        if (eventStore == nullptr)
+        {
+            throw logic_error("NostrServiceBase::syncWithRelay: An event store must be set.");
+        }
+        if (filters == nullptr)
+        {
+            throw invalid_argument("NostrServiceBase::syncWithRelay: Filters must be given.");
+        }
+        {
+            lock_guard<mutex> lock(this->_propertyMutex);
+            if (!this->_isConnected(relay))
+            {
+                throw invalid_argument("NostrServiceBase::syncWithRelay: The relay " + relay + " is not connected.");
+            }
+        }
+
+        // Both sides must compare the same range, so an open-ended range is closed at the
+        // present, and every matching event takes part whatever the limit.
+        nostr::data::Filters syncFilters = *filters;
+        if (syncFilters.until == 0)
+        {
+            syncFilters.until = time(nullptr);
+        }
+        syncFilters.limit = 0;
+
+        auto storage = make_shared<NegentropyStorage>();
+        for (const auto& event : eventStore->query(syncFilters))
+        {
+            storage->insert(event->createdAt, event->id);
+        }
+        storage->seal();
+        PLOG_INFO << "Reconciling " << storage->size() << " stored events with relay " << relay;
+
+        // The reconciliation runs in the connection's message handler, which replies to each
+        // NEG-MSG until the initiator has nothing left to ask.
+        struct ReconciliationState
+        {
+            explicit ReconciliationState(Negentropy negentropy) : negentropy(move(negentropy)) { };
+
+            mutex stateMutex;
+            Negentropy negentropy;
+            vector<nostr::data::EventId> haveIds;
+            vector<nostr::data::EventId> needIds;
+            promise<void> completion;
+            bool isSettled = false;
+        };
+        auto state = make_shared<ReconciliationState>(Negentropy(storage, this->NEGENTROPY_FRAME_SIZE_LIMIT));
+
+        string subscriptionId = this->_generateSubscriptionId();
+        string request = this->_generateNegentropyOpenRequest(
+            syncFilters,
+            subscriptionId,
+            state->negentropy.initiate());
+        future<void> completion = state->completion.get_future();
+
+        auto [uri, success] = this->_client->send(
+            request,
+            relay,
+            [this, relay, subscriptionId, state](const string& payload)
+            {
+                lock_guard<mutex> lock(state->stateMutex);
+                if (state->isSettled)
+                {
+                    return;
+                }
+
+                try
+                {
+                    nostr::data::RelayMessageParser parser(this->MAX_RELAY_MESSAGE_SIZE);
+                    nostr::data::RelayMessage relayMessage = parser.parse(payload);
+                    if (relayMessage.subscriptionId != subscriptionId)
+                    {
+                        return;
+                    }
+
+                    switch (relayMessage.type)
+                    {
+                    case nostr::data::RelayMessageType::NEG_MSG:
+                    {
+                        string message(relayMessage.message.size() / 2, '\0');
+                        bool isHex = relayMessage.message.size() % 2 == 0 && nostr::data::fromHex(
+                            relayMessage.message,
+                            reinterpret_cast<uint8_t*>(message.data()),
+                            message.size());
+                        if (!isHex)
+                        {
+                            throw invalid_argument("NostrServiceBase::syncWithRelay: The relay sent a NEG-MSG that is not hex.");
+                        }
+
+                        auto reply = state->negentropy.reconcile(message, state->haveIds, state->needIds);
+                        if (!reply.has_value())
+                        {
+                            state->isSettled = true;
+                            state->completion.set_value();
+                            return;
+                        }
+
+                        json negentropyMessage = json::array({
+                            "NEG-MSG",
+                            subscriptionId,
+                            nostr::data::toHex(reinterpret_cast<const uint8_t*>(reply->data()), reply->size())
+                        });
+                        auto [uri, success] = this->_client->send(negentropyMessage.dump(), relay);
+                        if (!success)
+                        {
+                            throw runtime_error("NostrServiceBase::syncWithRelay: Failed to send NEG-MSG to relay " + relay);
+                        }
+                        break;
+                    }
+
+                    case nostr::data::RelayMessageType::NEG_ERR:
+                    case nostr::data::RelayMessageType::CLOSED:
+                        throw runtime_error(
+                            "NostrServiceBase::syncWithRelay: Relay " + relay
+                            + " ended the reconciliation: " + relayMessage.message);
+
+                    default:
+                        break;
+                    }
+                }
+                catch (const exception& e)
+                {
+                    PLOG_ERROR << "Failed to reconcile with relay " << relay << ": " << e.what();
+                    state->isSettled = true;
+                    state->completion.set_exception(current_exception());
+                }
+            });
+
+        if (!success)
+        {
+            throw runtime_error("NostrServiceBase::syncWithRelay: Failed to send NEG-OPEN to relay " + relay);
+        }
+
+        // A relay that stops answering abandons the reconciliation once the deadline passes, so
+        // its late messages are ignored.
+        if (completion.wait_until(deadline) == future_status::timeout)
+        {
+            lock_guard<mutex> lock(state->stateMutex);
+            if (!state->isSettled)
+            {
+                state->isSettled = true;
+                this->_client->send(json::array({ "NEG-CLOSE", subscriptionId }).dump(), relay);
+                throw runtime_error(
+                    "NostrServiceBase::syncWithRelay: Relay " + relay
+                    + " did not finish the reconciliation before the deadline.");
+            }
+        }
+        completion.get();
+        this->_client->send(json::array({ "NEG-CLOSE", subscriptionId }).dump(), relay);
+
+        NegentropySyncResult result;
+        {
+            lock_guard<mutex> lock(state->stateMutex);
+            result.haveIds = move(state->haveIds);
+            result.needIds = move(state->needIds);
+        }
+        PLOG_INFO << "Relay " << relay << " lacks " << result.haveIds.size() << " events, and holds "
+                  << result.needIds.size() << " events the store lacks.";
+
+        result.fetchedCount = this->_fetchEvents(relay, result.needIds, deadline);
+        result.uploadedCount = this->_uploadEvents(relay, *eventStore, result.haveIds, deadline);
+
+        return result;
+    });
+};
+
+vector<string> NostrServiceBase::_getConnectedRelays(vector<string> relays)
+{
+    PLOG_VERBOSE << "Identifying connected relays.";
+    vector<string> connectedRelays;
+    for (string relay : relays)
+    {
+        bool isActive = find(this->_activeRelays.begin(), this->_activeRelays.end(), relay)
+            != this->_activeRelays.end();
         bool isConnected = this->_client->isConnected(relay);
         PLOG_VERBOSE << "Relay " << relay << " is active: " << isActive << ", is connected: " << isConnected;
 
@@ -587,12 +1249,595 @@ string NostrServiceBase::_generateSubscriptionId()
     return uuid.str();
 };
 
+string NostrServiceBase::_generateIncrementalRequest(
+    const vector<shared_ptr<nostr::data::Filters>>& filters,
+    const vector<string>& filterKeys,
+    const SyncWatermarks& syncWatermarks,
+    const string& relay,
+    string& subscriptionId)
+{
+    vector<shared_ptr<nostr::data::Filters>> relayFilters;
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        auto relayFilter = make_shared<nostr::data::Filters>(*filters[i]);
+        relayFilter->since = max(relayFilter->since, syncWatermarks.get(relay, filterKeys[i]));
+        relayFilters.push_back(relayFilter);
+    }
+
+    return nostr::data::Filters::serialize(relayFilters, subscriptionId);
+};
+
 string NostrServiceBase::_generateCloseRequest(string subscriptionId)
 {
     json jarr = json::array({ "CLOSE", subscriptionId });
     return jarr.dump();
 };
 
+map<string, vector<shared_ptr<nostr::data::Filters>>> NostrServiceBase::_routeFilters(
+    const vector<shared_ptr<nostr::data::Filters>>& filters)
+{
+    vector<string> activeRelays;
+    {
+        lock_guard<mutex> lock(this->_propertyMutex);
+        activeRelays = this->_activeRelays;
+    }
+
+    map<string, vector<shared_ptr<nostr::data::Filters>>> routes;
+    auto relayRouter = atomic_load(&this->_relayRouter);
+    if (relayRouter == nullptr)
+    {
+        for (const string& relay : activeRelays)
+        {
+            routes[relay] = filters;
+        }
+        return routes;
+    }
+
+    routes = relayRouter->route(filters, activeRelays);
+
+    // Relays that cannot be reached are still asked, and report the query as failed.
+    vector<string> newRelays;
+    for (const auto& [relay, relayFilters] : routes)
+    {
+        if (find(activeRelays.begin(), activeRelays.end(), relay) == activeRelays.end())
+        {
+            newRelays.push_back(relay);
+        }
+    }
+    if (!newRelays.empty())
+    {
+        PLOG_INFO << "Connecting to " << newRelays.size() << " relays to which the queried authors write.";
+        this->openRelayConnections(newRelays);
+    }
+
+    PLOG_INFO << "Routed query to " << routes.size() << " relays.";
+    return routes;
+};
+
+string NostrServiceBase::_generateNegentropyOpenRequest(
+    const nostr::data::Filters& filters,
+    const string& subscriptionId,
+    const string& initialMessage)
+{
+    json filter = filters;
+    filter.erase("limit");
+    for (auto it = filter.begin(); it != filter.end();)
+    {
+        bool isUnset = (it->is_array() && it->empty()) || (it->is_number() && *it == 0);
+        it = isUnset ? filter.erase(it) : next(it);
+    }
+
+    json jarr = json::array({
+        "NEG-OPEN",
+        subscriptionId,
+        filter,
+        nostr::data::toHex(reinterpret_cast<const uint8_t*>(initialMessage.data()), initialMessage.size())
+    });
+    return jarr.dump();
+};
+
+QueryResult NostrServiceBase::_queryRelays(
+    vector<shared_ptr<nostr::data::Filters>> filters,
+    RequestOptions options,
+    shared_ptr<nostr::data::EventArena> arena)
+{
+    for (auto& filter : filters)
+    {
+        if (filter != nullptr && (filter->limit > 64 || filter->limit < 1))
+        {
+            PLOG_WARNING << "Filters limit must be between 1 and 64, inclusive.  Setting limit to 16.";
+            filter->limit = 16;
+        }
+    }
+
+    // Serializing the filters sets an unset `until` to the present, so a query bounded by its
+    // caller, such as a page of older events, is told apart first.
+    bool isBounded = any_of(filters.begin(), filters.end(), [](const auto& filter)
+    {
+        return filter != nullptr && filter->until > 0;
+    });
+
+    string subscriptionId = this->_generateSubscriptionId();
+    string request;
+
+    try
+    {
+        request = nostr::data::Filters::serialize(filters, subscriptionId);
+    }
+    catch (const invalid_argument& e)
+    {
+        PLOG_ERROR << "Failed to serialize filters - invalid object: " << e.what();
+        throw e;
+    }
+    catch (const json::exception& je)
+    {
+        PLOG_ERROR << "Failed to serialize filters - JSON exception: " << je.what();
+        throw je;
+    }
+
+    // With both a store and watermarks, each relay is asked only for the events newer than
+    // it has already returned for each filter, and older events are read from the store.  A
+    // bounded query may end below a watermark, where the store need not hold every event, so
+    // it is sent unchanged.
+    auto eventStore = atomic_load(&this->_eventStore);
+    auto syncWatermarks = atomic_load(&this->_syncWatermarks);
+    bool isIncremental = eventStore != nullptr && syncWatermarks != nullptr && !isBounded;
+
+    // Each relay returns at most the limit of each filter, so the set is sized for that.
+    size_t expectedCount = 0;
+    for (const auto& filter : filters)
+    {
+        expectedCount += filter != nullptr ? filter->limit : 0;
+    }
+
+    // Events may still arrive after the deadline, once this method has returned, so the
+    // handlers share the results, and drop events once the query has finished.
+    struct QueryState
+    {
+        QueryState(size_t expectedCount, bool foldsVersions)
+            : uniqueEventIds(expectedCount), foldsVersions(foldsVersions) { };
+
+        mutex stateMutex;
+        vector<shared_ptr<nostr::data::Event>> events;
+        SeenEventIds uniqueEventIds;
+        unordered_map<EventAddress, size_t, EventAddressHash> addressPositions;
+        bool foldsVersions;
+
+        // Relays may each return a different version of a replaceable event, so unless the
+        // query names IDs, only the newest version of each is kept, in the position of the first
+        // version received.
+        void collect(shared_ptr<nostr::data::Event> event)
+        {
+            if (!this->uniqueEventIds.insert(event->id))
+            {
+                return;
+            }
+
+            optional<EventAddress> address = this->foldsVersions ? EventAddress::of(*event) : nullopt;
+            if (address.has_value())
+            {
+                auto [position, isInserted] = this->addressPositions.try_emplace(move(*address), this->events.size());
+                if (!isInserted)
+                {
+                    shared_ptr<nostr::data::Event>& current = this->events[position->second];
+                    if (event->supersedes(*current))
+                    {
+                        current = event;
+                    }
+                    return;
+                }
+            }
+
+            this->events.push_back(event);
+        };
+    };
+    bool foldsVersions = !namesIds(filters);
+    auto state = make_shared<QueryState>(expectedCount, foldsVersions);
+    auto progress = make_shared<RelayProgress>();
+
+    auto routes = this->_routeFilters(filters);
+    vector<string> relays;
+    for (const auto& [relay, relayFilters] : routes)
+    {
+        relays.push_back(relay);
+    }
+
+    const CompletionPolicy& completion = options.completion;
+    size_t requiredCount = completion.requiredCount(relays.size());
+    size_t cancelHandle = watchCancellation(progress, options);
+    vector<string> askedRelays;
+
+    // Send each relay asked the filters routed to it.  As events trickle in from each relay, they
+    // will be added to the results.  Duplicate copies of the same event will be ignored, as events
+    // are stored on multiple relays.
+    auto askRelay = [&](const string& relay)
+    {
+        askedRelays.push_back(relay);
+        auto sentAt = chrono::steady_clock::now();
+        time_t requestedAt = time(nullptr);
+
+        // Watermarks are kept for the filters the relay is actually sent, so a relay asked for
+        // only some of a filter's authors is not taken to hold the others.
+        vector<shared_ptr<nostr::data::Filters>>& relayFilters = routes.at(relay);
+        auto filterKeys = make_shared<vector<string>>();
+        auto matchers = make_shared<vector<nostr::data::FilterMatcher>>();
+        auto limits = make_shared<vector<size_t>>();
+        if (isIncremental)
+        {
+            for (const auto& filter : relayFilters)
+            {
+                filterKeys->push_back(SyncWatermarks::filterKey(*filter));
+                matchers->push_back(filter->compile());
+                limits->push_back(static_cast<size_t>(filter->limit));
+            }
+        }
+
+        // The newest event the relay has returned for each filter, and how many it returned.
+        auto newestCreatedAts = make_shared<vector<time_t>>(matchers->size(), 0);
+        auto returnedCounts = make_shared<vector<size_t>>(matchers->size(), 0);
+        string relayRequest;
+        if (isIncremental)
+        {
+            relayRequest = this->_generateIncrementalRequest(relayFilters, *filterKeys, *syncWatermarks, relay, subscriptionId);
+        }
+        else
+        {
+            relayRequest = relayFilters == filters
+                ? request
+                : nostr::data::Filters::serialize(relayFilters, subscriptionId);
+        }
+
+        auto [uri, success] = this->_client->send(
+            relayRequest,
+            relay,
+            [this, relay, sentAt, requestedAt, state, progress, arena, foldsVersions, matchers, limits, newestCreatedAts, returnedCounts, filterKeys, syncWatermarks](string payload)
+            {
+                this->_onSubscriptionMessage(
+                    payload,
+                    [state, progress, matchers, newestCreatedAts, returnedCounts](const string&, shared_ptr<nostr::data::Event> event)
+                    {
+                        for (size_t i = 0; i < matchers->size(); i++)
+                        {
+                            if (!(*matchers)[i].matches(*event))
+                            {
+                                continue;
+                            }
+                            (*returnedCounts)[i]++;
+                            (*newestCreatedAts)[i] = max((*newestCreatedAts)[i], event->createdAt);
+                        }
+
+                        // The results are handed over under the same lock once the query has
+                        // finished, so later events are dropped.
+                        lock_guard<mutex> lock(state->stateMutex);
+                        if (!progress->isFinished())
+                        {
+                            state->collect(event);
+                        }
+                    },
+                    [this, relay, sentAt, requestedAt, progress, limits, newestCreatedAts, returnedCounts, filterKeys, syncWatermarks](const string&)
+                    {
+                        this->_relayLatencies->record(
+                            relay,
+                            chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - sentAt));
+
+                        // A relay that returned fewer events than a filter's limit had no more
+                        // to send, so it has returned everything it holds for the filter up to
+                        // the newest event it sent.  One that reached the limit may have stopped
+                        // short of older events, so its watermark stays.  The watermark goes no
+                        // further than the time of the request, so a future-dated event cannot
+                        // push it past events not yet published.  The watermarks are advanced
+                        // before the relay is counted, so they are in place once the query wakes.
+                        for (size_t i = 0; i < filterKeys->size(); i++)
+                        {
+                            if ((*returnedCounts)[i] < (*limits)[i])
+                            {
+                                syncWatermarks->advance(relay, (*filterKeys)[i], min((*newestCreatedAts)[i], requestedAt));
+                            }
+                        }
+                        progress->settle(relay, RelayRequestStatus::COMPLETED);
+                    },
+                    [relay, progress](const string&, const string&)
+                    {
+                        progress->settle(relay, RelayRequestStatus::REJECTED);
+                    },
+                    arena,
+                    foldsVersions);
+            }
+        );
+
+        if (success)
+        {
+            PLOG_INFO << "Sent query to relay " << relay;
+            lock_guard<mutex> lock(this->_propertyMutex);
+            this->_subscriptions[subscriptionId].push_back(relay);
+        }
+        else
+        {
+            PLOG_WARNING << "Failed to send query to relay " << relay;
+            progress->settle(relay, RelayRequestStatus::FAILED);
+        }
+    };
+
+    // A hedged query asks the fastest relays first.  Whenever those asked have not finished
+    // within the given percentile of their recent latencies, it asks as many more as are still
+    // needed.  Other queries ask every relay at once.
+    if (completion.mode == CompletionPolicy::Mode::HEDGED)
+    {
+        vector<string> rankedRelays = this->_relayLatencies->rankFastest(relays);
+        size_t nextRelay = 0;
+        while (nextRelay < rankedRelays.size())
+        {
+            size_t neededCount;
+            {
+                lock_guard<mutex> lock(progress->progressMutex);
+                size_t pendingCount = askedRelays.size() - progress->relayStatuses.size();
+                size_t missingCount = requiredCount - min(progress->completedCount, requiredCount);
+                neededCount = missingCount > pendingCount ? missingCount - pendingCount : 0;
+            }
+
+            // Until enough relays have finished, at least one more is asked each round.
+            size_t batchSize = max<size_t>(neededCount, askedRelays.empty() ? requiredCount : 1);
+            for (size_t i = 0; i < batchSize && nextRelay < rankedRelays.size(); i++)
+            {
+                askRelay(rankedRelays[nextRelay++]);
+            }
+            if (nextRelay >= rankedRelays.size())
+            {
+                break;
+            }
+
+            auto hedgeDelay = this->_relayLatencies->percentile(askedRelays, completion.hedgePercentile)
+                .value_or(completion.defaultHedgeDelay);
+            auto hedgeAt = min(chrono::steady_clock::now() + hedgeDelay, options.deadline);
+            progress->waitUntil(hedgeAt, requiredCount, askedRelays.size());
+
+            // Whether the hedge delay passed or every relay asked answered without enough
+            // finishing, more relays are asked, unless the query has ended.
+            lock_guard<mutex> lock(progress->progressMutex);
+            bool hasEnded = progress->isCancelled
+                || progress->completedCount >= requiredCount
+                || chrono::steady_clock::now() >= options.deadline;
+            if (hasEnded)
+            {
+                break;
+            }
+        }
+
+        PLOG_INFO << "Hedged query " << subscriptionId << " asked " << askedRelays.size() << "/" << relays.size() << " relays.";
+    }
+    else
+    {
+        for (const string& relay : relays)
+        {
+            askRelay(relay);
+        }
+    }
+
+    // The query waits until enough of the relays send an EOSE or CLOSE message, or until the
+    // deadline passes or the query is cancelled.
+    progress->waitUntil(options.deadline, requiredCount, askedRelays.size());
+
+    QueryResult result;
+    result.relayStatuses = finishRelays(progress, askedRelays, options, requiredCount, cancelHandle);
+
+    // Close open subscriptions and disconnect from relays after events are received.
+    for (const auto& [relay, status] : result.relayStatuses)
+    {
+        switch (status)
+        {
+        case RelayRequestStatus::COMPLETED:
+            PLOG_INFO << "Received EOSE message from relay " << relay;
+            break;
+
+        case RelayRequestStatus::TIMED_OUT:
+            PLOG_WARNING << "Relay " << relay << " did not answer query " << subscriptionId << " before the deadline.";
+            break;
+
+        case RelayRequestStatus::CANCELLED:
+        case RelayRequestStatus::SUPERSEDED:
+            break;
+
+        default:
+            PLOG_WARNING << "Received CLOSE message from relay " << relay;
+            this->closeRelayConnections({ relay });
+            break;
+        }
+    }
+    this->closeSubscription(subscriptionId);
+
+    {
+        lock_guard<mutex> lock(state->stateMutex);
+        if (isIncremental)
+        {
+            try
+            {
+                for (const auto& filter : filters)
+                {
+                    for (const auto& event : eventStore->query(*filter))
+                    {
+                        state->collect(event);
+                    }
+                }
+                syncWatermarks->save();
+            }
+            catch (const exception& e)
+            {
+                PLOG_ERROR << "Failed to merge stored events into the query results: " << e.what();
+            }
+
+            // The relays and the store may each return up to the limit of every filter.
+            state->events = keepWithinLimits(move(state->events), filters);
+        }
+        result.events = move(state->events);
+    }
+
+    return result;
+};
+
+size_t NostrServiceBase::_fetchEvents(
+    const string& relay,
+    const vector<nostr::data::EventId>& ids,
+    chrono::steady_clock::time_point deadline)
+{
+    size_t fetchedCount = 0;
+    for (size_t begin = 0; begin < ids.size(); begin += this->NEGENTROPY_FETCH_BATCH_SIZE)
+    {
+        size_t end = min(ids.size(), begin + this->NEGENTROPY_FETCH_BATCH_SIZE);
+        auto batch = make_shared<nostr::data::Filters>();
+        for (size_t i = begin; i < end; i++)
+        {
+            batch->ids.push_back(nostr::data::toHex(ids[i]));
+        }
+        batch->limit = static_cast<int>(end - begin);
+
+        string subscriptionId = this->_generateSubscriptionId();
+        string request = batch->serialize(subscriptionId);
+
+        // Received events are written to the event store once verified, like any others.  A
+        // relay may end the request with both an EOSE and a CLOSED message, so only the first
+        // of them answers it.
+        struct BatchState
+        {
+            promise<bool> answer;
+            atomic<bool> isAnswered{false};
+            atomic<size_t> fetchedCount{0};
+
+            void settle(bool isComplete)
+            {
+                if (!this->isAnswered.exchange(true))
+                {
+                    this->answer.set_value(isComplete);
+                }
+            };
+        };
+        auto batchState = make_shared<BatchState>();
+        future<bool> answer = batchState->answer.get_future();
+        auto [uri, success] = this->_client->send(
+            request,
+            relay,
+            [this, batchState](const string& payload)
+            {
+                this->_onSubscriptionMessage(
+                    payload,
+                    [batchState](const string&, shared_ptr<nostr::data::Event>)
+                    {
+                        batchState->fetchedCount++;
+                    },
+                    [batchState](const string&)
+                    {
+                        batchState->settle(true);
+                    },
+                    [batchState](const string&, const string&)
+                    {
+                        batchState->settle(false);
+                    },
+                    nullptr,
+                    false);
+            });
+
+        if (!success)
+        {
+            PLOG_WARNING << "Failed to request missing events from relay " << relay;
+            break;
+        }
+
+        bool isAnswered = answer.wait_until(deadline) == future_status::ready;
+        if (isAnswered && !answer.get())
+        {
+            PLOG_WARNING << "Relay " << relay << " closed the request for missing events.";
+        }
+        this->_client->send(this->_generateCloseRequest(subscriptionId), relay);
+        fetchedCount += batchState->fetchedCount;
+
+        if (!isAnswered)
+        {
+            PLOG_WARNING << "Relay " << relay << " did not return the missing events before the deadline.";
+            break;
+        }
+    }
+
+    return fetchedCount;
+};
+
+size_t NostrServiceBase::_uploadEvents(
+    const string& relay,
+    nostr::store::IEventStore& eventStore,
+    const vector<nostr::data::EventId>& ids,
+    chrono::steady_clock::time_point deadline)
+{
+    // One handler counts the acknowledgments of every upload, since each send replaces it.  Only
+    // the first answer for each uploaded event counts, so answers for other events, or repeated
+    // answers, cannot stand in for those still awaited.
+    struct UploadState
+    {
+        mutex stateMutex;
+        condition_variable acknowledged;
+        unordered_set<string> pendingIds;
+        size_t acceptedCount = 0;
+    };
+    auto state = make_shared<UploadState>();
+    auto onResponse = [this, state](const string& response)
+    {
+        this->_onAcceptance(response, [state](const string& eventId, bool isAccepted, const string&)
+        {
+            lock_guard<mutex> lock(state->stateMutex);
+            if (state->pendingIds.erase(eventId) == 0)
+            {
+                return;
+            }
+            state->acceptedCount += isAccepted ? 1 : 0;
+            state->acknowledged.notify_all();
+        });
+    };
+
+    size_t sentCount = 0;
+    for (const auto& id : ids)
+    {
+        shared_ptr<nostr::data::Event> event = eventStore.find(id);
+        if (event == nullptr)
+        {
+            continue;
+        }
+
+        string message;
+        try
+        {
+            message = "[\"EVENT\"," + *event->serializeShared() + "]";
+        }
+        catch (const invalid_argument& e)
+        {
+            PLOG_WARNING << "Skipping upload of invalid stored event " << nostr::data::toHex(id) << ": " << e.what();
+            continue;
+        }
+
+        // The relay may answer before the send returns, so the event is awaited first.
+        string eventId = nostr::data::toHex(id);
+        {
+            lock_guard<mutex> lock(state->stateMutex);
+            state->pendingIds.insert(eventId);
+        }
+        auto [uri, success] = this->_client->send(message, relay, onResponse);
+        if (!success)
+        {
+            PLOG_WARNING << "Failed to upload events to relay " << relay;
+            lock_guard<mutex> lock(state->stateMutex);
+            state->pendingIds.erase(eventId);
+            break;
+        }
+        sentCount++;
+    }
+
+    unique_lock<mutex> lock(state->stateMutex);
+    bool isAcknowledged = state->acknowledged.wait_until(lock, deadline, [state]() { return state->pendingIds.empty(); });
+    if (!isAcknowledged)
+    {
+        PLOG_WARNING << "Relay " << relay << " did not acknowledge " << state->pendingIds.size() << " uploaded events before the deadline.";
+    }
+    PLOG_INFO << "Relay " << relay << " accepted " << state->acceptedCount << "/" << sentCount << " uploaded events.";
+
+    return state->acceptedCount;
+};
+
 bool NostrServiceBase::_hasSubscription(string subscriptionId)
 {
     lock_guard<mutex> lock(this->_propertyMutex);
@@ -621,66 +1866,125 @@ void NostrServiceBase::_onSubscriptionMessage(
     string message,
     function<void(const string&, shared_ptr<nostr::data::Event>)> eventHandler,
     function<void(const string&)> eoseHandler,
-    function<void(const string&, const string&)> closeHandler
+    function<void(const string&, const string&)> closeHandler,
+    shared_ptr<nostr::data::EventArena> arena,
+    bool foldsVersions
 )
 {
     try
     {
-        json jMessage = json::parse(message);
-        string messageType = jMessage.at(0);
-        if (messageType == "EVENT")
-        {
-            string subscriptionId = jMessage.at(1);
-            nostr::data::Event event = nostr::data::Event::fromString(jMessage.at(2));
-            eventHandler(subscriptionId, make_shared<nostr::data::Event>(event));
-        }
-        else if (messageType == "EOSE")
-        {
-            string subscriptionId = jMessage.at(1);
-            eoseHandler(subscriptionId);
-        }
-        else if (messageType == "CLOSE")
+        nostr::data::RelayMessageParser parser(this->MAX_RELAY_MESSAGE_SIZE, arena);
+        nostr::data::RelayMessage relayMessage = parser.parse(message);
+
+        // Events are delivered only once verified.  EOSE and CLOSED messages queue behind them,
+        // so their handlers still run after the handlers of every preceding event.
+        string subscriptionId = relayMessage.subscriptionId;
+        switch (relayMessage.type)
         {
-            string subscriptionId = jMessage.at(1);
-            string reason = jMessage.at(2);
-            closeHandler(subscriptionId, reason);
+        case nostr::data::RelayMessageType::EVENT:
+            this->_eventVerifier->submit(
+                relayMessage.event,
+                [this, lifetime = this->_lifetime, subscriptionId, eventHandler, foldsVersions](shared_ptr<nostr::data::Event> event)
+                {
+                    lock_guard<recursive_mutex> lock(lifetime->mutex);
+                    if (!lifetime->isAlive)
+                    {
+                        return;
+                    }
+
+                    // Unsigned versions could be forged to hide the real ones, so only verified
+                    // signatures are trusted to fold versions.
+                    bool isFolded = foldsVersions && this->_eventVerifier->verifiesSignatures();
+                    if (isFolded && !this->_replaceableEvents->admit(*event))
+                    {
+                        PLOG_DEBUG << "Dropping superseded or future-dated version of event " << nostr::data::toHex(event->id);
+                        return;
+                    }
+
+                    // Every relay list received teaches the router, whichever query asked for it, as
+                    // long as its signature was checked, since a forged list would send the
+                    // author's readers to relays of the forger's choosing.
+                    auto relayRouter = atomic_load(&this->_relayRouter);
+                    if (relayRouter != nullptr && this->_eventVerifier->verifiesSignatures())
+                    {
+                        relayRouter->ingest(*event);
+                    }
+
+                    // Events already written to the store are not offered to it again.
+                    auto eventStore = atomic_load(&this->_eventStore);
+                    auto seenEventIds = atomic_load(&this->_seenEventIds);
+                    bool isSeen = seenEventIds != nullptr && seenEventIds->contains(event->id);
+                    if (eventStore != nullptr && !isSeen)
+                    {
+                        try
+                        {
+                            eventStore->append(*event);
+                            if (seenEventIds != nullptr)
+                            {
+                                seenEventIds->insert(event->id);
+                            }
+                        }
+                        catch (const exception& e)
+                        {
+                            PLOG_ERROR << "Failed to store event " << nostr::data::toHex(event->id) << ": " << e.what();
+                        }
+                    }
+
+                    eventHandler(subscriptionId, event);
+                });
+            break;
+
+        case nostr::data::RelayMessageType::EOSE:
+            this->_eventVerifier->submit([lifetime = this->_lifetime, subscriptionId, eoseHandler]()
+            {
+                lock_guard<recursive_mutex> lock(lifetime->mutex);
+                if (lifetime->isAlive)
+                {
+                    eoseHandler(subscriptionId);
+                }
+            });
+            break;
+
+        case nostr::data::RelayMessageType::CLOSED:
+            this->_eventVerifier->submit([lifetime = this->_lifetime, subscriptionId, closeHandler, reason = relayMessage.message]()
+            {
+                lock_guard<recursive_mutex> lock(lifetime->mutex);
+                if (lifetime->isAlive)
+                {
+                    closeHandler(subscriptionId, reason);
+                }
+            });
+            break;
+
+        default:
+            break;
         }
     }
-    catch (const json::out_of_range& joor)
-    {
-        PLOG_ERROR << "JSON out-of-range exception: " << joor.what();
-        throw joor;
-    }
-    catch (const json::exception& je)
-    {
-        PLOG_ERROR << "JSON handling exception: " << je.what();
-        throw je;
-    }
     catch (const invalid_argument& ia)
     {
-        PLOG_ERROR << "Invalid argument exception: " << ia.what();
+        PLOG_ERROR << "Invalid relay message: " << ia.what();
         throw ia;
     }
 };
 
 void NostrServiceBase::_onAcceptance(
     string message,
-    function<void(const bool)> acceptanceHandler
+    function<void(const string&, const bool, const string&)> acceptanceHandler
 )
 {
     try
     {
-        json jMessage = json::parse(message);
-        string messageType = jMessage[0];
-        if (messageType == "OK")
+        nostr::data::RelayMessageParser parser(this->MAX_RELAY_MESSAGE_SIZE);
+        nostr::data::RelayMessage relayMessage = parser.parse(message);
+
+        if (relayMessage.type == nostr::data::RelayMessageType::OK)
         {
-            bool isAccepted = jMessage[2];
-            acceptanceHandler(isAccepted);
+            acceptanceHandler(relayMessage.eventId, relayMessage.accepted, relayMessage.message);
         }
     }
-    catch (const json::exception& je)
+    catch (const invalid_argument& ia)
     {
-        PLOG_ERROR << "JSON handling exception: " << je.what();
-        throw je;
+        PLOG_ERROR << "Invalid relay message: " << ia.what();
+        throw ia;
     }
 };
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "service/relay_latencies.hpp"
+
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Constructors
+
+RelayLatencies::RelayLatencies(size_t windowSize) : _windowSize(windowSize)
+{
+    if (windowSize == 0)
+    {
+        throw invalid_argument("RelayLatencies::RelayLatencies: The window size must be at least 1.");
+    }
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+void RelayLatencies::record(const string& relay, chrono::milliseconds latency)
+{
+    lock_guard<mutex> lock(this->_mutex);
+    auto& window = this->_latencies[relay];
+    window.push_back(latency);
+    if (window.size() > this->_windowSize)
+    {
+        window.pop_front();
+    }
+};
+
+optional<chrono::milliseconds> RelayLatencies::percentile(
+    const vector<string>& relays,
+    double percentile) const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_percentile(relays, percentile);
+};
+
+vector<string> RelayLatencies::rankFastest(vector<string> relays) const
+{
+    lock_guard<mutex> lock(this->_mutex);
+
+    vector<pair<optional<chrono::milliseconds>, size_t>> medians;
+    for (size_t i = 0; i < relays.size(); i++)
+    {
+        medians.emplace_back(this->_percentile({ relays[i] }, 0.5), i);
+    }
+
+    // Relays with no latency sort last, and ties keep their given order.
+    stable_sort(medians.begin(), medians.end(), [](const auto& left, const auto& right)
+    {
+        if (left.first.has_value() != right.first.has_value())
+        {
+            return left.first.has_value();
+        }
+        return left.first.has_value() && *left.first < *right.first;
+    });
+
+    vector<string> ranked;
+    for (const auto& [median, index] : medians)
+    {
+        ranked.push_back(relays[index]);
+    }
+    return ranked;
+};
+
+#pragma endregion
+
+#pragma region Private Methods
+
+optional<chrono::milliseconds> RelayLatencies::_percentile(
+    const vector<string>& relays,
+    double percentile) const
+{
+    vector<chrono::milliseconds> samples;
+    for (const string& relay : relays)
+    {
+        auto window = this->_latencies.find(relay);
+        if (window != this->_latencies.end())
+        {
+            samples.insert(samples.end(), window->second.begin(), window->second.end());
+        }
+    }
+
+    if (samples.empty())
+    {
+        return nullopt;
+    }
+
+    // The nearest-rank percentile.
+    double clamped = clamp(percentile, 0.0, 1.0);
+    size_t rank = static_cast<size_t>(ceil(clamped * samples.size()));
+    size_t index = rank == 0 ? 0 : rank - 1;
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+};
+
+#pragma endregion
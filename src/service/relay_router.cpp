@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "service/relay_router.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+/**
+ * @brief The authors named by the filters, in hex, including those given as handles.
+ */
+static vector<string> authorsOf(const Filters& filters)
+{
+    vector<string> authors = filters.authors;
+    for (PublicKeyHandle handle : filters.authorHandles)
+    {
+        authors.push_back(toHex(PublicKeyPool::global().key(handle)));
+    }
+
+    return authors;
+};
+
+#pragma endregion
+
+#pragma region Constructors
+
+RelayRouter::RelayRouter(RelayRouterOptions options) : _options(move(options))
+{
+    if (this->_options.redundancy == 0)
+    {
+        throw invalid_argument("RelayRouter::RelayRouter: The redundancy must be at least 1.");
+    }
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+bool RelayRouter::ingest(const Event& event)
+{
+    if (event.kind != RELAY_LIST_KIND)
+    {
+        return false;
+    }
+
+    // NIP-65: a relay with no marker is used for both reading and writing.
+    vector<string> writeRelays;
+    for (Tags::Tag tag : event.tags)
+    {
+        if (tag.name() != "r" || tag.size() < 2)
+        {
+            continue;
+        }
+
+        string_view marker = tag.size() > 2 ? tag[2] : string_view();
+        string relay(tag[1]);
+        bool isWrite = marker.empty() || marker == "write";
+        if (isWrite && find(writeRelays.begin(), writeRelays.end(), relay) == writeRelays.end())
+        {
+            writeRelays.push_back(move(relay));
+        }
+    }
+
+    string author = toHex(event.pubkey);
+    lock_guard<mutex> lock(this->_mutex);
+    auto [it, isInserted] = this->_relayLists.try_emplace(author, RelayList{ event.createdAt, {} });
+    if (!isInserted && event.createdAt <= it->second.createdAt)
+    {
+        return false;
+    }
+
+    it->second = { event.createdAt, move(writeRelays) };
+    return true;
+};
+
+vector<string> RelayRouter::writeRelays(const string& author) const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    auto it = this->_relayLists.find(author);
+    return it != this->_relayLists.end() ? it->second.writeRelays : vector<string>();
+};
+
+map<string, vector<shared_ptr<Filters>>> RelayRouter::route(
+    const vector<shared_ptr<Filters>>& filters,
+    const vector<string>& defaultRelays) const
+{
+    const vector<string>& fallbackRelays = this->_options.fallbackRelays.empty()
+        ? defaultRelays
+        : this->_options.fallbackRelays;
+
+    vector<vector<string>> filterAuthors;
+    for (const auto& filter : filters)
+    {
+        filterAuthors.push_back(authorsOf(*filter));
+    }
+
+    map<string, vector<shared_ptr<Filters>>> routes;
+    lock_guard<mutex> lock(this->_mutex);
+
+    // The number of the query's authors that write to each relay.  Relays shared by many
+    // authors are preferred, so the query needs fewer connections.
+    unordered_map<string, size_t> authorCounts;
+    for (const auto& authors : filterAuthors)
+    {
+        for (const string& author : authors)
+        {
+            auto it = this->_relayLists.find(author);
+            if (it == this->_relayLists.end())
+            {
+                continue;
+            }
+            for (const string& relay : it->second.writeRelays)
+            {
+                authorCounts[relay]++;
+            }
+        }
+    }
+
+    // Write relays beyond the default relays chosen for the query so far, each of which needs a
+    // new connection.  A relay is chosen only while the query can afford its connection.
+    unordered_set<string> newRelays;
+    auto chooseRelay = [this, &defaultRelays, &newRelays](const string& relay)
+    {
+        bool isOpen = find(defaultRelays.begin(), defaultRelays.end(), relay) != defaultRelays.end();
+        if (isOpen || newRelays.count(relay) > 0)
+        {
+            return true;
+        }
+        if (newRelays.size() >= this->_options.maxNewRelays)
+        {
+            return false;
+        }
+
+        newRelays.insert(relay);
+        return true;
+    };
+
+    for (size_t i = 0; i < filters.size(); i++)
+    {
+        if (filterAuthors[i].empty())
+        {
+            for (const string& relay : defaultRelays)
+            {
+                routes[relay].push_back(filters[i]);
+            }
+            continue;
+        }
+
+        // The authors each relay is asked for, in the order the filter names them.
+        map<string, vector<string>> relayAuthors;
+        for (const string& author : filterAuthors[i])
+        {
+            // Ties keep the order of the author's own relay list.
+            auto it = this->_relayLists.find(author);
+            vector<string> candidates = it != this->_relayLists.end() ? it->second.writeRelays : vector<string>();
+            stable_sort(candidates.begin(), candidates.end(), [&authorCounts](const string& a, const string& b)
+            {
+                return authorCounts[a] > authorCounts[b];
+            });
+
+            size_t routedCount = 0;
+            for (size_t j = 0; j < candidates.size() && routedCount < this->_options.redundancy; j++)
+            {
+                if (chooseRelay(candidates[j]))
+                {
+                    relayAuthors[candidates[j]].push_back(author);
+                    routedCount++;
+                }
+            }
+
+            if (routedCount == 0)
+            {
+                for (const string& relay : fallbackRelays)
+                {
+                    relayAuthors[relay].push_back(author);
+                }
+            }
+        }
+
+        for (auto& [relay, authors] : relayAuthors)
+        {
+            auto relayFilter = make_shared<Filters>(*filters[i]);
+            relayFilter->authors = move(authors);
+            relayFilter->authorHandles.clear();
+            routes[relay].push_back(relayFilter);
+        }
+    }
+
+    return routes;
+};
+
+size_t RelayRouter::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_relayLists.size();
+};
+
+#pragma endregion
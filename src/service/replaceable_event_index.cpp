@@ -0,0 +1,93 @@
+#include <ctime>
+#include <functional>
+
+#include "service/replaceable_event_index.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Event Address
+
+optional<EventAddress> EventAddress::of(const Event& event)
+{
+    if (Event::isReplaceableKind(event.kind))
+    {
+        return EventAddress{ event.pubkey, event.kind, "" };
+    }
+    if (Event::isAddressableKind(event.kind))
+    {
+        return EventAddress{ event.pubkey, event.kind, string(event.tags.firstValue("d").value_or("")) };
+    }
+
+    return nullopt;
+};
+
+bool EventAddress::operator==(const EventAddress& other) const
+{
+    return this->kind == other.kind && this->pubkey == other.pubkey && this->identifier == other.identifier;
+};
+
+size_t EventAddressHash::operator()(const EventAddress& address) const noexcept
+{
+    size_t hash = BytesHash()(address.pubkey);
+    hash ^= std::hash<int>()(address.kind) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    hash ^= std::hash<string>()(address.identifier) + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+    return hash;
+};
+
+#pragma endregion
+
+#pragma region Replaceable Event Index
+
+ReplaceableEventIndex::ReplaceableEventIndex(size_t capacity, chrono::seconds maxClockSkew)
+    : _capacity(capacity), _maxClockSkew(maxClockSkew) { };
+
+bool ReplaceableEventIndex::admit(const Event& event)
+{
+    optional<EventAddress> address = EventAddress::of(event);
+    if (!address.has_value() || this->_capacity == 0)
+    {
+        return true;
+    }
+    if (event.createdAt > time(nullptr) + this->_maxClockSkew.count())
+    {
+        return false;
+    }
+
+    lock_guard<mutex> lock(this->_mutex);
+    auto [it, isInserted] = this->_versions.try_emplace(*address, Version{ event.createdAt, event.id });
+    if (!isInserted)
+    {
+        Version& newest = it->second;
+        if (newest.id == event.id)
+        {
+            return true;
+        }
+
+        if (!Event::supersedes(event.createdAt, event.id, newest.createdAt, newest.id))
+        {
+            return false;
+        }
+
+        newest = { event.createdAt, event.id };
+        return true;
+    }
+
+    this->_insertionOrder.push_back(*address);
+    if (this->_insertionOrder.size() > this->_capacity)
+    {
+        this->_versions.erase(this->_insertionOrder.front());
+        this->_insertionOrder.pop_front();
+    }
+
+    return true;
+};
+
+size_t ReplaceableEventIndex::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_versions.size();
+};
+
+#pragma endregion
@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <unordered_set>
+
+#include <plog/Log.h>
+#include <uuid_v4.h>
+
+#include "service/request_coalescer.hpp"
+
+using namespace nlohmann;
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+/**
+ * @brief Checks whether a query selects events by exactly one of `ids` or `authors`, which is
+ * the list merged queries are combined on, and matches a bounded number of events per entry.
+ * @remark Each ID matches one event, and each author has one event of each replaceable kind.
+ * An author's notes are unbounded, so merging them would let one author crowd out the rest.
+ */
+static bool isMergeable(const Filters& filters)
+{
+    if (filters.ids.empty() == filters.authors.empty() || !filters.authorHandles.empty())
+    {
+        return false;
+    }
+
+    return !filters.ids.empty()
+        || (!filters.kinds.empty() && all_of(filters.kinds.begin(), filters.kinds.end(), Event::isReplaceableKind));
+};
+
+/**
+ * @brief Builds a key that is equal for two mergeable queries if and only if they differ only in
+ * the entries of their `ids` or `authors` lists and their `limit`.
+ */
+static string mergeKey(const Filters& filters)
+{
+    vector<int> kinds = filters.kinds;
+    sort(kinds.begin(), kinds.end());
+    kinds.erase(unique(kinds.begin(), kinds.end()), kinds.end());
+
+    map<string, vector<string>> tags;
+    for (const auto& [name, values] : filters.tags)
+    {
+        vector<string> sortedValues = values;
+        sort(sortedValues.begin(), sortedValues.end());
+        tags[!name.empty() && name[0] == '#' ? name.substr(1) : name] = sortedValues;
+    }
+
+    json key = {
+        { "field", filters.ids.empty() ? "authors" : "ids" },
+        { "kinds", kinds },
+        { "tags", tags },
+        { "since", filters.since },
+        { "until", filters.until }
+    };
+
+    return key.dump();
+};
+
+static vector<string>& keyList(Filters& filters)
+{
+    return filters.ids.empty() ? filters.authors : filters.ids;
+};
+
+#pragma endregion
+
+RequestCoalescer::RequestCoalescer(
+    shared_ptr<INostrServiceBase> service,
+    RequestCoalescerOptions options
+) : _service(service), _options(options)
+{
+    this->_dispatcher = thread(&RequestCoalescer::_dispatch, this);
+};
+
+RequestCoalescer::~RequestCoalescer()
+{
+    unique_lock<mutex> lock(this->_mutex);
+    this->_isStopping = true;
+    if (!this->_pending.empty())
+    {
+        PLOG_WARNING << "Dropping " << this->_pending.size() << " queries that were never sent.";
+    }
+    lock.unlock();
+
+    this->_queueChanged.notify_all();
+    this->_dispatcher.join();
+};
+
+string RequestCoalescer::queryRelays(
+    shared_ptr<Filters> filters,
+    function<void(const string&, shared_ptr<Event>)> eventHandler,
+    function<void(const string&)> eoseHandler,
+    function<void(const string&, const string&)> closeHandler)
+{
+    if (filters == nullptr)
+    {
+        throw invalid_argument("RequestCoalescer::queryRelays: The filters must not be null.");
+    }
+
+    if (filters->limit <= 0)
+    {
+        throw invalid_argument("RequestCoalescer::queryRelays: The limit must be greater than 0.");
+    }
+
+    bool hasFilter = !filters->ids.empty() || !filters->authors.empty() || !filters->authorHandles.empty()
+        || !filters->kinds.empty() || !filters->tags.empty();
+    if (!hasFilter)
+    {
+        throw invalid_argument("RequestCoalescer::queryRelays: At least one filter must be set.");
+    }
+
+    UUIDv4::UUIDGenerator<std::mt19937_64> uuidGenerator;
+
+    auto query = make_shared<Query>();
+    query->id = uuidGenerator.getUUID().str();
+    query->filters = make_shared<Filters>(*filters);
+    query->matcher = make_shared<const FilterMatcher>(query->filters->compile());
+    query->eventHandler = eventHandler;
+    query->eoseHandler = eoseHandler;
+    query->closeHandler = closeHandler;
+
+    unique_lock<mutex> lock(this->_mutex);
+    this->_pending.push_back(query);
+    lock.unlock();
+    this->_queueChanged.notify_all();
+
+    return query->id;
+};
+
+void RequestCoalescer::closeQuery(const string& queryId)
+{
+    unique_lock<mutex> lock(this->_mutex);
+    auto pendingIt = find_if(
+        this->_pending.begin(),
+        this->_pending.end(),
+        [&queryId](const shared_ptr<Query>& query) { return query->id == queryId; });
+    if (pendingIt != this->_pending.end())
+    {
+        this->_pending.erase(pendingIt);
+        return;
+    }
+
+    auto subscriptionIt = this->_subscriptionsByQuery.find(queryId);
+    if (subscriptionIt == this->_subscriptionsByQuery.end())
+    {
+        PLOG_WARNING << "Query " << queryId << " not found.";
+        return;
+    }
+    shared_ptr<MergedSubscription> merged = subscriptionIt->second;
+    this->_subscriptionsByQuery.erase(subscriptionIt);
+    lock.unlock();
+
+    unique_lock<mutex> mergedLock(merged->mutex);
+    merged->queries.erase(
+        remove_if(
+            merged->queries.begin(),
+            merged->queries.end(),
+            [&queryId](const shared_ptr<Query>& query) { return query->id == queryId; }),
+        merged->queries.end());
+
+    // If the subscription ID is not yet known, the subscription is closed once it is.
+    bool shouldClose = merged->queries.empty() && !merged->subscriptionId.empty();
+    string subscriptionId = merged->subscriptionId;
+    mergedLock.unlock();
+
+    if (shouldClose)
+    {
+        this->_service->closeSubscription(subscriptionId);
+    }
+};
+
+void RequestCoalescer::flush()
+{
+    unique_lock<mutex> lock(this->_mutex);
+    vector<shared_ptr<Query>> batch = move(this->_pending);
+    this->_pending.clear();
+    lock.unlock();
+    this->_queueChanged.notify_all();
+
+    if (!batch.empty())
+    {
+        this->_send(move(batch));
+    }
+};
+
+void RequestCoalescer::_dispatch()
+{
+    unique_lock<mutex> lock(this->_mutex);
+    while (true)
+    {
+        this->_queueChanged.wait(lock, [this]() { return this->_isStopping || !this->_pending.empty(); });
+        if (this->_isStopping)
+        {
+            return;
+        }
+
+        // Hold the batch open for the window, unless it is flushed in the meantime.
+        auto deadline = chrono::steady_clock::now() + this->_options.window;
+        this->_queueChanged.wait_until(
+            lock,
+            deadline,
+            [this]() { return this->_isStopping || this->_pending.empty(); });
+        if (this->_isStopping)
+        {
+            return;
+        }
+
+        vector<shared_ptr<Query>> batch = move(this->_pending);
+        this->_pending.clear();
+        if (batch.empty())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        this->_send(move(batch));
+        lock.lock();
+    }
+};
+
+void RequestCoalescer::_send(vector<shared_ptr<Query>> queries)
+{
+    // Group the queries that can share a filter, keeping the groups in the order of their first
+    // query so that earlier requests are sent first.
+    vector<vector<shared_ptr<Query>>> groups;
+    unordered_map<string, size_t> groupIndices;
+    for (auto& query : queries)
+    {
+        if (!isMergeable(*query->filters))
+        {
+            groups.push_back({ query });
+            continue;
+        }
+
+        string key = mergeKey(*query->filters);
+        auto it = groupIndices.find(key);
+        if (it == groupIndices.end())
+        {
+            groupIndices[key] = groups.size();
+            groups.push_back({ query });
+        }
+        else
+        {
+            groups[it->second].push_back(query);
+        }
+    }
+
+    size_t mergedCount = 0;
+    for (auto& group : groups)
+    {
+        size_t index = 0;
+        while (index < group.size())
+        {
+            // Fill the merged filter with whole queries until the next would exceed the key cap.
+            // A single query over the cap is sent on its own.
+            auto merged = make_shared<Filters>(*group[index]->filters);
+            vector<string>& keys = keyList(*merged);
+            unordered_set<string> seenKeys(keys.begin(), keys.end());
+            vector<shared_ptr<Query>> members = { group[index] };
+
+            for (index++; index < group.size(); index++)
+            {
+                const vector<string>& queryKeys = keyList(*group[index]->filters);
+                size_t newKeyCount = 0;
+                for (const string& key : queryKeys)
+                {
+                    newKeyCount += seenKeys.count(key) == 0;
+                }
+                if (seenKeys.size() + newKeyCount > this->_options.maxKeysPerFilter)
+                {
+                    break;
+                }
+
+                for (const string& key : queryKeys)
+                {
+                    if (seenKeys.insert(key).second)
+                    {
+                        keys.push_back(key);
+                    }
+                }
+                members.push_back(group[index]);
+            }
+
+            // The relay may then return every event the members can match.
+            if (members.size() > 1)
+            {
+                size_t perKeyCount = merged->ids.empty() ? set<int>(merged->kinds.begin(), merged->kinds.end()).size() : 1;
+                merged->limit = static_cast<int>(keys.size() * perKeyCount);
+            }
+
+            this->_sendMerged(merged, move(members));
+            mergedCount++;
+        }
+    }
+
+    PLOG_INFO << "Sent " << queries.size() << " queries as " << mergedCount << " relay subscriptions.";
+};
+
+void RequestCoalescer::_sendMerged(shared_ptr<Filters> filters, vector<shared_ptr<Query>> queries)
+{
+    auto merged = make_shared<MergedSubscription>();
+    merged->queries = queries;
+    merged->isShared = queries.size() > 1;
+
+    unique_lock<mutex> lock(this->_mutex);
+    for (auto& query : queries)
+    {
+        this->_subscriptionsByQuery[query->id] = merged;
+    }
+    lock.unlock();
+
+    // Handlers copy the query list before invoking the callers' handlers, so that a handler may
+    // close its own query.
+    auto snapshot = [merged]()
+    {
+        lock_guard<mutex> mergedLock(merged->mutex);
+        return merged->queries;
+    };
+
+    string subscriptionId;
+    try
+    {
+        subscriptionId = this->_service->queryRelays(
+            filters,
+            [merged](const string&, shared_ptr<Event> event)
+            {
+                vector<shared_ptr<Query>> recipients;
+                {
+                    lock_guard<mutex> mergedLock(merged->mutex);
+                    for (auto& query : merged->queries)
+                    {
+                        if (!query->matcher->matches(*event))
+                        {
+                            continue;
+                        }
+
+                        // Repeat copies from other relays are passed on, but not counted again.
+                        bool isNew = query->deliveredIds.count(event->id) == 0;
+                        if (merged->isShared && isNew && query->deliveredIds.size() >= static_cast<size_t>(query->filters->limit))
+                        {
+                            continue;
+                        }
+                        if (merged->isShared)
+                        {
+                            query->deliveredIds.insert(event->id);
+                        }
+                        recipients.push_back(query);
+                    }
+                }
+
+                for (auto& query : recipients)
+                {
+                    query->eventHandler(query->id, event);
+                }
+            },
+            [snapshot](const string&)
+            {
+                for (auto& query : snapshot())
+                {
+                    query->eoseHandler(query->id);
+                }
+            },
+            [snapshot](const string&, const string& reason)
+            {
+                for (auto& query : snapshot())
+                {
+                    query->closeHandler(query->id, reason);
+                }
+            });
+    }
+    catch (const exception& e)
+    {
+        PLOG_ERROR << "Failed to send merged query: " << e.what();
+
+        lock.lock();
+        for (auto& query : queries)
+        {
+            this->_subscriptionsByQuery.erase(query->id);
+        }
+        lock.unlock();
+
+        for (auto& query : queries)
+        {
+            query->closeHandler(query->id, e.what());
+        }
+        return;
+    }
+
+    unique_lock<mutex> mergedLock(merged->mutex);
+    merged->subscriptionId = subscriptionId;
+    bool shouldClose = merged->queries.empty();
+    mergedLock.unlock();
+
+    if (shouldClose)
+    {
+        this->_service->closeSubscription(subscriptionId);
+    }
+};
@@ -0,0 +1,400 @@
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "service/seen_event_ids.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+static const char SEEN_MAGIC[8] = { 'A', 'E', 'D', 'S', 'E', 'E', 'N', '1' };
+
+///< The file begins with a header of this size.  The table follows it.
+static const size_t SEEN_HEADER_SIZE = 64;
+
+static const uint64_t MIN_CAPACITY = 64;
+
+struct SeenHeader
+{
+    char magic[8];
+    uint64_t capacity; ///< The number of slots, a power of two.
+    uint64_t count; ///< The number of used slots.
+};
+
+///< The number of Bloom filter bits set for each ID.
+static const int BLOOM_HASH_COUNT = 3;
+
+///< The number of Bloom filter bits for each slot of the table.
+static const uint64_t BLOOM_BITS_PER_SLOT = 8;
+
+static void throwSystemError(const string& message)
+{
+    throw system_error(errno, generic_category(), message);
+};
+
+static uint64_t capacityFor(size_t expectedCount)
+{
+    // The table is kept at most three quarters full.
+    uint64_t capacity = MIN_CAPACITY;
+    while (capacity * 3 / 4 < expectedCount)
+    {
+        capacity *= 2;
+    }
+    return capacity;
+};
+
+template <class TSlot>
+static void placeSlots(const TSlot* from, uint64_t fromCapacity, TSlot* to, uint64_t toCapacity)
+{
+    uint64_t mask = toCapacity - 1;
+    for (uint64_t i = 0; i < fromCapacity; i++)
+    {
+        const TSlot& entry = from[i];
+        if (entry.prefix == 0 && entry.check == 0)
+        {
+            continue;
+        }
+
+        uint64_t slot = entry.prefix & mask;
+        while (to[slot].prefix != 0 || to[slot].check != 0)
+        {
+            slot = (slot + 1) & mask;
+        }
+        to[slot] = entry;
+    }
+};
+
+#pragma endregion
+
+#pragma region Constructors and Destructors
+
+SeenEventIds::SeenEventIds(size_t expectedCount, bool hasBloomFilter) : _hasBloomFilter(hasBloomFilter)
+{
+    this->_capacity = capacityFor(expectedCount);
+    this->_memorySlots.assign(this->_capacity, Slot{ 0, 0 });
+    this->_slots = this->_memorySlots.data();
+    this->_rebuildBloomFilter();
+};
+
+SeenEventIds::SeenEventIds(string path, bool hasBloomFilter) : _path(path), _hasBloomFilter(hasBloomFilter)
+{
+    this->_openFile(capacityFor(DEFAULT_EXPECTED_COUNT));
+    this->_rebuildBloomFilter();
+};
+
+SeenEventIds::~SeenEventIds()
+{
+    this->_closeFile();
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+bool SeenEventIds::insert(const EventId& id)
+{
+    Slot entry = _slotFor(id);
+
+    lock_guard<mutex> lock(this->_mutex);
+    if (this->_mayContain(entry))
+    {
+        Slot* slot = this->_find(entry);
+        if (slot->prefix != 0 || slot->check != 0)
+        {
+            return false;
+        }
+    }
+
+    if ((this->_count + 1) * 4 > this->_capacity * 3)
+    {
+        this->_grow();
+    }
+
+    *this->_find(entry) = entry;
+    this->_count++;
+    this->_addToBloomFilter(entry);
+    this->_writeCount();
+
+    return true;
+};
+
+bool SeenEventIds::contains(const EventId& id) const
+{
+    Slot entry = _slotFor(id);
+
+    lock_guard<mutex> lock(this->_mutex);
+    if (!this->_mayContain(entry))
+    {
+        return false;
+    }
+
+    Slot* slot = this->_find(entry);
+    return slot->prefix != 0 || slot->check != 0;
+};
+
+size_t SeenEventIds::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_count;
+};
+
+void SeenEventIds::flush()
+{
+    lock_guard<mutex> lock(this->_mutex);
+    if (this->_data != nullptr && msync(this->_data, this->_size, MS_SYNC) != 0)
+    {
+        throwSystemError("SeenEventIds::flush: Failed to sync " + this->_path);
+    }
+};
+
+#pragma endregion
+
+#pragma region Private Methods
+
+SeenEventIds::Slot SeenEventIds::_slotFor(const EventId& id)
+{
+    Slot entry;
+    memcpy(&entry.prefix, id.data(), sizeof(entry.prefix));
+    memcpy(&entry.check, id.data() + sizeof(entry.prefix), sizeof(entry.check));
+
+    // An all-zero slot marks an empty one, so the one ID prefix that would produce it is moved.
+    if (entry.prefix == 0 && entry.check == 0)
+    {
+        entry.check = 1;
+    }
+
+    return entry;
+};
+
+SeenEventIds::Slot* SeenEventIds::_find(const Slot& entry) const
+{
+    uint64_t mask = this->_capacity - 1;
+    uint64_t slot = entry.prefix & mask;
+    while (true)
+    {
+        Slot& candidate = this->_slots[slot];
+        bool isEmpty = candidate.prefix == 0 && candidate.check == 0;
+        if (isEmpty || (candidate.prefix == entry.prefix && candidate.check == entry.check))
+        {
+            return &candidate;
+        }
+        slot = (slot + 1) & mask;
+    }
+};
+
+bool SeenEventIds::_mayContain(const Slot& entry) const
+{
+    if (!this->_hasBloomFilter)
+    {
+        return true;
+    }
+
+    // Bits are picked by double hashing on the check word, which is independent of the prefix
+    // bits that pick the slot.
+    uint64_t mask = this->_bloomBits.size() * 64 - 1;
+    uint64_t step = (entry.prefix >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASH_COUNT; i++)
+    {
+        uint64_t bit = (entry.check + i * step) & mask;
+        if ((this->_bloomBits[bit / 64] & (uint64_t(1) << (bit % 64))) == 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+};
+
+void SeenEventIds::_addToBloomFilter(const Slot& entry)
+{
+    if (!this->_hasBloomFilter)
+    {
+        return;
+    }
+
+    uint64_t mask = this->_bloomBits.size() * 64 - 1;
+    uint64_t step = (entry.prefix >> 32) | 1;
+    for (int i = 0; i < BLOOM_HASH_COUNT; i++)
+    {
+        uint64_t bit = (entry.check + i * step) & mask;
+        this->_bloomBits[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+};
+
+void SeenEventIds::_rebuildBloomFilter()
+{
+    if (!this->_hasBloomFilter)
+    {
+        return;
+    }
+
+    this->_bloomBits.assign(this->_capacity * BLOOM_BITS_PER_SLOT / 64, 0);
+    for (uint64_t i = 0; i < this->_capacity; i++)
+    {
+        const Slot& entry = this->_slots[i];
+        if (entry.prefix != 0 || entry.check != 0)
+        {
+            this->_addToBloomFilter(entry);
+        }
+    }
+};
+
+void SeenEventIds::_grow()
+{
+    uint64_t capacity = this->_capacity * 2;
+
+    if (this->_path.empty())
+    {
+        vector<Slot> slots(capacity, Slot{ 0, 0 });
+        placeSlots(this->_slots, this->_capacity, slots.data(), capacity);
+        this->_memorySlots = move(slots);
+        this->_slots = this->_memorySlots.data();
+        this->_capacity = capacity;
+        this->_rebuildBloomFilter();
+        return;
+    }
+
+    // Build the larger table in a new file and rename it over the old, so a crash cannot leave
+    // a partial table.
+    string temporaryPath = this->_path + ".tmp";
+    int descriptor = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0)
+    {
+        throwSystemError("SeenEventIds::_grow: Failed to open " + temporaryPath);
+    }
+
+    size_t size = SEEN_HEADER_SIZE + capacity * sizeof(Slot);
+    if (ftruncate(descriptor, size) != 0)
+    {
+        close(descriptor);
+        throwSystemError("SeenEventIds::_grow: Failed to resize " + temporaryPath);
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        close(descriptor);
+        throwSystemError("SeenEventIds::_grow: Failed to map " + temporaryPath);
+    }
+
+    auto header = static_cast<SeenHeader*>(data);
+    memcpy(header->magic, SEEN_MAGIC, sizeof(SEEN_MAGIC));
+    header->capacity = capacity;
+    header->count = this->_count;
+    auto slots = reinterpret_cast<Slot*>(static_cast<uint8_t*>(data) + SEEN_HEADER_SIZE);
+    placeSlots(this->_slots, this->_capacity, slots, capacity);
+
+    if (msync(data, size, MS_SYNC) != 0 || rename(temporaryPath.c_str(), this->_path.c_str()) != 0)
+    {
+        munmap(data, size);
+        close(descriptor);
+        throwSystemError("SeenEventIds::_grow: Failed to replace " + this->_path);
+    }
+
+    this->_closeFile();
+    this->_descriptor = descriptor;
+    this->_data = static_cast<uint8_t*>(data);
+    this->_size = size;
+    this->_slots = slots;
+    this->_capacity = capacity;
+    this->_rebuildBloomFilter();
+};
+
+void SeenEventIds::_openFile(uint64_t initialCapacity)
+{
+    this->_descriptor = open(this->_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (this->_descriptor < 0)
+    {
+        throwSystemError("SeenEventIds::SeenEventIds: Failed to open " + this->_path);
+    }
+
+    try
+    {
+        struct stat status;
+        if (fstat(this->_descriptor, &status) != 0)
+        {
+            throwSystemError("SeenEventIds::SeenEventIds: Failed to read the size of " + this->_path);
+        }
+
+        bool isNew = status.st_size == 0;
+        size_t size = isNew
+            ? SEEN_HEADER_SIZE + initialCapacity * sizeof(Slot)
+            : static_cast<size_t>(status.st_size);
+        if (size < SEEN_HEADER_SIZE)
+        {
+            throw invalid_argument("SeenEventIds::SeenEventIds: " + this->_path + " is not a set of seen event IDs.");
+        }
+        if (isNew && ftruncate(this->_descriptor, size) != 0)
+        {
+            throwSystemError("SeenEventIds::SeenEventIds: Failed to resize " + this->_path);
+        }
+
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->_descriptor, 0);
+        if (data == MAP_FAILED)
+        {
+            throwSystemError("SeenEventIds::SeenEventIds: Failed to map " + this->_path);
+        }
+        this->_data = static_cast<uint8_t*>(data);
+        this->_size = size;
+
+        auto header = reinterpret_cast<SeenHeader*>(this->_data);
+        if (isNew)
+        {
+            memcpy(header->magic, SEEN_MAGIC, sizeof(SEEN_MAGIC));
+            header->capacity = initialCapacity;
+            header->count = 0;
+        }
+
+        bool isValid = memcmp(header->magic, SEEN_MAGIC, sizeof(SEEN_MAGIC)) == 0
+            && header->capacity >= MIN_CAPACITY
+            && (header->capacity & (header->capacity - 1)) == 0
+            && size == SEEN_HEADER_SIZE + header->capacity * sizeof(Slot);
+        if (!isValid)
+        {
+            throw invalid_argument("SeenEventIds::SeenEventIds: " + this->_path + " is not a set of seen event IDs.");
+        }
+
+        this->_slots = reinterpret_cast<Slot*>(this->_data + SEEN_HEADER_SIZE);
+        this->_capacity = header->capacity;
+        this->_count = min(header->count, header->capacity);
+    }
+    catch (...)
+    {
+        this->_closeFile();
+        throw;
+    }
+};
+
+void SeenEventIds::_closeFile()
+{
+    if (this->_data != nullptr)
+    {
+        munmap(this->_data, this->_size);
+        this->_data = nullptr;
+        this->_size = 0;
+    }
+    if (this->_descriptor >= 0)
+    {
+        close(this->_descriptor);
+        this->_descriptor = -1;
+    }
+};
+
+void SeenEventIds::_writeCount()
+{
+    if (this->_data != nullptr)
+    {
+        reinterpret_cast<SeenHeader*>(this->_data)->count = this->_count;
+    }
+};
+
+#pragma endregion
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <plog/Log.h>
+
+#include "service/sync_watermarks.hpp"
+#include "../cryptography/sha256_context.hpp"
+
+using namespace nlohmann;
+using namespace nostr::service;
+using namespace std;
+
+#pragma region Local Statics
+
+template <class T>
+static vector<T> sortedUnique(vector<T> values)
+{
+    sort(values.begin(), values.end());
+    values.erase(unique(values.begin(), values.end()), values.end());
+    return values;
+};
+
+#pragma endregion
+
+#pragma region Constructors
+
+SyncWatermarks::SyncWatermarks(string path) : _path(path)
+{
+    ifstream file(this->_path);
+    if (!file.is_open())
+    {
+        return;
+    }
+
+    try
+    {
+        json saved = json::parse(file);
+        for (const auto& [relay, watermarks] : saved.at("watermarks").items())
+        {
+            for (const auto& [filterKey, createdAt] : watermarks.items())
+            {
+                this->_watermarks[relay][filterKey] = createdAt.get<time_t>();
+            }
+        }
+    }
+    catch (const json::exception& je)
+    {
+        PLOG_WARNING << "Ignoring unreadable sync watermarks in " << this->_path << ": " << je.what();
+        this->_watermarks.clear();
+    }
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+string SyncWatermarks::filterKey(const nostr::data::Filters& filters)
+{
+    vector<string> authors = filters.authors;
+    for (nostr::data::PublicKeyHandle handle : filters.authorHandles)
+    {
+        authors.push_back(nostr::data::toHex(nostr::data::PublicKeyPool::global().key(handle)));
+    }
+
+    // Tag names are keyed without their '#' prefix, which filters may or may not include.
+    map<string, vector<string>> tags;
+    for (const auto& [name, values] : filters.tags)
+    {
+        if (values.empty())
+        {
+            continue;
+        }
+
+        string bareName = !name.empty() && name[0] == '#' ? name.substr(1) : name;
+        vector<string>& tagValues = tags[bareName];
+        tagValues.insert(tagValues.end(), values.begin(), values.end());
+    }
+    for (auto& [name, values] : tags)
+    {
+        values = sortedUnique(values);
+    }
+
+    // JSON objects are serialized with sorted keys, so equal filters give equal strings.
+    json normalized = {
+        { "ids", sortedUnique(filters.ids) },
+        { "authors", sortedUnique(authors) },
+        { "kinds", sortedUnique(filters.kinds) },
+        { "tags", tags },
+        { "since", filters.since },
+        { "limit", filters.limit }
+    };
+    string serialized = normalized.dump();
+
+    array<uint8_t, nostr::cryptography::Sha256Context::DIGEST_SIZE> digest;
+    nostr::cryptography::Sha256Context context;
+    context.update(serialized.data(), serialized.size());
+    context.finalize(digest.data());
+
+    return nostr::data::toHex(digest);
+};
+
+time_t SyncWatermarks::get(const string& relay, const string& filterKey) const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    auto relayWatermarks = this->_watermarks.find(relay);
+    if (relayWatermarks == this->_watermarks.end())
+    {
+        return 0;
+    }
+
+    auto watermark = relayWatermarks->second.find(filterKey);
+    return watermark != relayWatermarks->second.end() ? watermark->second : 0;
+};
+
+void SyncWatermarks::advance(const string& relay, const string& filterKey, time_t createdAt)
+{
+    if (createdAt <= 0)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(this->_mutex);
+    time_t& watermark = this->_watermarks[relay][filterKey];
+    if (createdAt > watermark)
+    {
+        watermark = createdAt;
+        this->_isDirty = true;
+    }
+};
+
+void SyncWatermarks::save()
+{
+    lock_guard<mutex> lock(this->_mutex);
+    if (this->_path.empty() || !this->_isDirty)
+    {
+        return;
+    }
+
+    json saved = { { "watermarks", json::object() } };
+    for (const auto& [relay, watermarks] : this->_watermarks)
+    {
+        saved["watermarks"][relay] = watermarks;
+    }
+
+    // Write a new file and rename it over the old, so a crash cannot leave a partial file.
+    string temporaryPath = this->_path + ".tmp";
+    {
+        ofstream file(temporaryPath, ios::trunc);
+        file << saved.dump();
+        file.flush();
+        if (!file)
+        {
+            throw runtime_error("SyncWatermarks::save: Failed to write " + temporaryPath);
+        }
+    }
+
+    error_code error;
+    filesystem::rename(temporaryPath, this->_path, error);
+    if (error)
+    {
+        throw runtime_error("SyncWatermarks::save: Failed to replace " + this->_path + ": " + error.message());
+    }
+
+    this->_isDirty = false;
+};
+
+size_t SyncWatermarks::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    size_t count = 0;
+    for (const auto& [relay, watermarks] : this->_watermarks)
+    {
+        count += watermarks.size();
+    }
+
+    return count;
+};
+
+#pragma endregion
@@ -0,0 +1,47 @@
+#include "verified_event_cache.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+VerifiedEventCache::VerifiedEventCache(size_t capacity) : _capacity(capacity)
+{
+    this->_entries.reserve(capacity);
+};
+
+bool VerifiedEventCache::contains(const EventId& id, const Signature& sig) const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    auto it = this->_entries.find(id);
+
+    return it != this->_entries.end() && it->second == sig;
+};
+
+void VerifiedEventCache::insert(const EventId& id, const Signature& sig)
+{
+    if (this->_capacity == 0)
+    {
+        return;
+    }
+
+    lock_guard<mutex> lock(this->_mutex);
+    auto [it, isInserted] = this->_entries.emplace(id, sig);
+    if (!isInserted)
+    {
+        it->second = sig;
+        return;
+    }
+
+    this->_insertionOrder.push_back(id);
+    if (this->_insertionOrder.size() > this->_capacity)
+    {
+        this->_entries.erase(this->_insertionOrder.front());
+        this->_insertionOrder.pop_front();
+    }
+};
+
+size_t VerifiedEventCache::size() const
+{
+    lock_guard<mutex> lock(this->_mutex);
+    return this->_entries.size();
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "data/data.hpp"
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief A bounded record of events whose signatures have already been verified.
+ * @remark The same event is commonly received from several relays.  Remembering the ID and
+ * signature of each verified event lets later copies skip the signature check.  A copy hits the
+ * cache only if its signature is byte-for-byte the one that was verified, so a copy with a
+ * substituted signature is still checked.
+ * @remark When the cache is full, the oldest entry is evicted.
+ */
+class VerifiedEventCache
+{
+public:
+    explicit VerifiedEventCache(std::size_t capacity);
+
+    /**
+     * @brief Checks whether an event with the given ID and signature has been verified.
+     */
+    bool contains(const data::EventId& id, const data::Signature& sig) const;
+
+    /**
+     * @brief Records that the event with the given ID and signature has been verified.
+     */
+    void insert(const data::EventId& id, const data::Signature& sig);
+
+    std::size_t size() const;
+
+private:
+    std::size_t _capacity;
+
+    mutable std::mutex _mutex;
+
+    std::unordered_map<data::EventId, data::Signature, data::BytesHash> _entries;
+
+    ///< Cached IDs in the order they were inserted, oldest first.
+    std::deque<data::EventId> _insertionOrder;
+};
+} // namespace service
+} // namespace nostr
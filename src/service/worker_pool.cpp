@@ -0,0 +1,106 @@
+#include <algorithm>
+
+#include "worker_pool.hpp"
+
+using namespace nostr::service;
+using namespace std;
+
+WorkerPool::WorkerPool(size_t workerCount)
+{
+    workerCount = max<size_t>(1, workerCount);
+    for (size_t i = 0; i < workerCount; i++)
+    {
+        this->_workers.emplace_back([this, i]() { this->_run(i); });
+    }
+};
+
+WorkerPool::~WorkerPool()
+{
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        this->_isStopping = true;
+    }
+    this->_workAvailable.notify_all();
+
+    for (thread& worker : this->_workers)
+    {
+        worker.join();
+    }
+};
+
+size_t WorkerPool::size() const
+{
+    return this->_workers.size();
+};
+
+void WorkerPool::parallelFor(size_t taskCount, const function<void(size_t, size_t)>& task)
+{
+    if (taskCount == 0)
+    {
+        return;
+    }
+
+    lock_guard<mutex> callLock(this->_callMutex);
+
+    unique_lock<mutex> lock(this->_mutex);
+    this->_task = &task;
+    this->_taskCount = taskCount;
+    this->_nextTask = 0;
+    this->_pendingTasks = taskCount;
+    this->_error = nullptr;
+    this->_workAvailable.notify_all();
+
+    this->_workFinished.wait(lock, [this]() { return this->_pendingTasks == 0; });
+
+    this->_task = nullptr;
+    exception_ptr error = this->_error;
+    this->_error = nullptr;
+    lock.unlock();
+
+    if (error)
+    {
+        rethrow_exception(error);
+    }
+};
+
+void WorkerPool::_run(size_t workerIndex)
+{
+    unique_lock<mutex> lock(this->_mutex);
+    while (true)
+    {
+        this->_workAvailable.wait(lock, [this]()
+        {
+            return this->_isStopping || this->_nextTask < this->_taskCount;
+        });
+
+        if (this->_isStopping)
+        {
+            return;
+        }
+
+        const function<void(size_t, size_t)>* task = this->_task;
+        size_t taskIndex = this->_nextTask++;
+        lock.unlock();
+
+        exception_ptr error;
+        try
+        {
+            (*task)(workerIndex, taskIndex);
+        }
+        catch (...)
+        {
+            error = current_exception();
+        }
+
+        lock.lock();
+        if (error && !this->_error)
+        {
+            this->_error = error;
+        }
+
+        if (--this->_pendingTasks == 0)
+        {
+            this->_workFinished.notify_all();
+        }
+    }
+};
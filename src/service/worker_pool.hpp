@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace nostr
+{
+namespace service
+{
+/**
+ * @brief A fixed set of threads that run the tasks of a parallel loop.
+ * @remark Each worker is identified by an index in the range `[0, size())`, so callers can give
+ * every worker its own scratch state, such as reusable buffers or cryptographic contexts, without
+ * any locking.
+ */
+class WorkerPool
+{
+public:
+    /**
+     * @param workerCount The number of worker threads to start.  At least one thread is always
+     * started.
+     */
+    explicit WorkerPool(std::size_t workerCount);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief The number of worker threads in the pool.
+     */
+    std::size_t size() const;
+
+    /**
+     * @brief Runs `task(workerIndex, taskIndex)` once for each task index in `[0, taskCount)`,
+     * and blocks until every task has finished.
+     * @remark Workers claim tasks one at a time, so tasks should be coarse enough to outweigh the
+     * cost of claiming them.  Concurrent calls are run one after another.
+     * @throws Rethrows the first exception thrown by any task, once all tasks have finished.
+     */
+    void parallelFor(
+        std::size_t taskCount,
+        const std::function<void(std::size_t, std::size_t)>& task);
+
+private:
+    std::vector<std::thread> _workers;
+
+    ///< Serializes calls to `parallelFor`.
+    std::mutex _callMutex;
+
+    ///< Protects the state of the loop in progress.
+    std::mutex _mutex;
+
+    std::condition_variable _workAvailable;
+
+    std::condition_variable _workFinished;
+
+    const std::function<void(std::size_t, std::size_t)>* _task = nullptr;
+
+    std::size_t _taskCount = 0;
+
+    std::size_t _nextTask = 0;
+
+    std::size_t _pendingTasks = 0;
+
+    std::exception_ptr _error;
+
+    bool _isStopping = false;
+
+    void _run(std::size_t workerIndex);
+};
+} // namespace service
+} // namespace nostr
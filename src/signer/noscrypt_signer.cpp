@@ -3,6 +3,7 @@
 #include <cstring>
 #include <memory>
 #include <sstream>
+#include <stdexcept>
 #include <tuple>
 
 #include <nlohmann/json.hpp>
@@ -11,6 +12,7 @@
 #include "signer/noscrypt_signer.hpp"
 #include "../cryptography/nostr_secure_rng.hpp"
 #include "../cryptography/noscrypt_cipher.hpp"
+#include "../encoding/hex_codec.hpp"
 #include "../internal/noscrypt_logger.hpp"
 
 using namespace std;
@@ -18,6 +20,7 @@ using namespace nostr::data;
 using namespace nostr::service;
 using namespace nostr::signer;
 using namespace nostr::cryptography;
+using namespace nostr::encoding;
 
 #pragma region Local Statics
 
@@ -161,7 +164,7 @@ string NoscryptSigner::generateConnectionToken(
 
     // Generate the connection token.
     stringstream ss;
-    ss << "nostrconnect://" << this->_localPublicKey;
+    ss << "nostrconnect://" << this->_getLocalPublicKey();
     for (int i = 0; i < relays.size(); i++)
     {
         ss << (i == 0 ? "?" : "&");
@@ -282,26 +285,22 @@ shared_ptr<promise<bool>> NoscryptSigner::sign(shared_ptr<Event> event)
 
 inline string NoscryptSigner::_getLocalPrivateKey() const
 {
-    stringstream privkeyStream;
-    for (int i = 0; i < sizeof(NCSecretKey); i++)
-    {
-        privkeyStream << hex << setw(2) << setfill('0') << static_cast<int>(this->_localPrivateKey->key[i]);
-    }
+    string hex(2 * sizeof(NCSecretKey), '\0');
+    HexCodec::encode(this->_localPrivateKey->key, sizeof(NCSecretKey), &hex[0]);
 
-    return privkeyStream.str();
+    return hex;
 };
 
 inline void NoscryptSigner::_setLocalPrivateKey(const string value)
 {
     auto seckey = make_unique<NCSecretKey>();
 
-    for (auto i = 0; i < sizeof(NCSecretKey); i++)
+    if (value.length() != 2 * sizeof(NCSecretKey)
+        || !HexCodec::decode(value.data(), sizeof(NCSecretKey), seckey->key))
     {
-        stringstream ss;
-        ss << hex << value.substr(i * 2, 2);
-        uint8_t byte;
-        ss >> byte;
-        seckey->key[i] = byte;
+        // Don't leave a partially decoded secret behind.
+        NostrSecureRng::zero(seckey->key, sizeof(NCSecretKey));
+        throw invalid_argument("NoscryptSigner::_setLocalPrivateKey: The private key must be 64 hex characters.");
     }
 
     this->_localPrivateKey = move(seckey);
@@ -309,26 +308,20 @@ inline void NoscryptSigner::_setLocalPrivateKey(const string value)
 
 inline string NoscryptSigner::_getLocalPublicKey() const
 {
-    stringstream pubkeyStream;
-    for (int i = 0; i < sizeof(NCPublicKey); i++)
-    {
-        pubkeyStream << hex << setw(2) << setfill('0') << static_cast<int>(this->_localPublicKey->key[i]);
-    }
+    string hex(2 * sizeof(NCPublicKey), '\0');
+    HexCodec::encode(this->_localPublicKey->key, sizeof(NCPublicKey), &hex[0]);
 
-    return pubkeyStream.str();
+    return hex;
 };
 
 inline void NoscryptSigner::_setLocalPublicKey(const string value)
 {
     auto pubkey = make_unique<NCPublicKey>();
 
-    for (auto i = 0; i < sizeof(NCPublicKey); i++)
+    if (value.length() != 2 * sizeof(NCPublicKey)
+        || !HexCodec::decode(value.data(), sizeof(NCPublicKey), pubkey->key))
     {
-        stringstream ss;
-        ss << hex << value.substr(i * 2, 2);
-        uint8_t byte;
-        ss >> byte;
-        pubkey->key[i] = byte;
+        throw invalid_argument("NoscryptSigner::_setLocalPublicKey: The public key must be 64 hex characters.");
     }
 
     this->_localPublicKey = move(pubkey);
@@ -336,26 +329,20 @@ inline void NoscryptSigner::_setLocalPublicKey(const string value)
 
 inline string NoscryptSigner::_getRemotePublicKey() const
 {
-    stringstream pubkeyStream;
-    for (int i = 0; i < sizeof(NCPublicKey); i++)
-    {
-        pubkeyStream << hex << setw(2) << setfill('0') << static_cast<int>(this->_remotePublicKey->key[i]);
-    }
+    string hex(2 * sizeof(NCPublicKey), '\0');
+    HexCodec::encode(this->_remotePublicKey->key, sizeof(NCPublicKey), &hex[0]);
 
-    return pubkeyStream.str();
+    return hex;
 };
 
 inline void NoscryptSigner::_setRemotePublicKey(const string value)
 {
     auto pubkey = make_unique<NCPublicKey>();
 
-    for (auto i = 0; i < sizeof(NCPublicKey); i++)
+    if (value.length() != 2 * sizeof(NCPublicKey)
+        || !HexCodec::decode(value.data(), sizeof(NCPublicKey), pubkey->key))
     {
-        stringstream ss;
-        ss << hex << value.substr(i * 2, 2);
-        uint8_t byte;
-        ss >> byte;
-        pubkey->key[i] = byte;
+        throw invalid_argument("NoscryptSigner::_setRemotePublicKey: The public key must be 64 hex characters.");
     }
 
     this->_remotePublicKey = move(pubkey);
@@ -382,8 +369,16 @@ int NoscryptSigner::_parseRemotePublicKey(string connectionToken)
         return -1;
     }
 
-    string remotePubkey = connectionToken.substr(pubkeyStart, queryStart);
-    this->_setRemotePublicKey(remotePubkey);
+    string remotePubkey = connectionToken.substr(pubkeyStart, queryStart - pubkeyStart);
+    try
+    {
+        this->_setRemotePublicKey(remotePubkey);
+    }
+    catch (const invalid_argument& e)
+    {
+        PLOG_ERROR << "The connection token is invalid - the remote public key is not a valid hex string.";
+        return -1;
+    }
 
     return queryStart + 1;
 };
@@ -444,7 +439,7 @@ shared_ptr<Event> NoscryptSigner::_wrapSignerMessage(nlohmann::json jrpc)
 
     // Wrap the event to be signed in a signing request event.
     auto wrapperEvent = make_shared<Event>();
-    wrapperEvent->pubkey = this->_getLocalPublicKey();
+    memcpy(wrapperEvent->pubkey.data(), this->_localPublicKey->key, sizeof(NCPublicKey));
     wrapperEvent->kind = this->_nostrConnectKind;
     wrapperEvent->tags.push_back({ "p", this->_getRemotePublicKey() });
     wrapperEvent->content = encryptedContent;
@@ -478,10 +473,7 @@ shared_ptr<Event> NoscryptSigner::_wrapSignerMessage(nlohmann::json jrpc)
     }
 
     // Add the signature to the event.
-    wrapperEvent->sig = string(
-        reinterpret_cast<char*>(schnorrSig), 
-        sizeof(schnorrSig)
-    );
+    memcpy(wrapperEvent->sig.data(), schnorrSig, sizeof(schnorrSig));
 
     return wrapperEvent;
 };
@@ -491,7 +483,7 @@ string NoscryptSigner::_unwrapSignerMessage(shared_ptr<Event> event)
     // TODO: Verify the incoming event.
 
     // Extract and decrypt the event payload.
-    string encryptedContent = event->content;
+    string encryptedContent(event->content);
     string decryptedContent;
 
     // NIP-04 encrypted strings include `?iv=` near the end (source: hodlbod).
@@ -0,0 +1,1116 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
+#include <plog/Log.h>
+
+#include "store/mmap_event_store.hpp"
+#include "store/posting_index.hpp"
+
+using namespace nostr::data;
+using namespace nostr::store;
+using namespace std;
+
+#pragma region Local Statics
+
+static const char LOG_MAGIC[8] = { 'A', 'E', 'D', 'L', 'O', 'G', '0', '1' };
+static const char INDEX_MAGIC[8] = { 'A', 'E', 'D', 'I', 'D', 'X', '0', '1' };
+
+///< Marks the start of each record in the log.
+static const uint32_t RECORD_MAGIC = 0x564e5452;
+
+///< Both files begin with a header of this size.  The first log record follows it.
+static const size_t FILE_HEADER_SIZE = 64;
+
+static const uint64_t INITIAL_INDEX_CAPACITY = 1024;
+
+///< The index is doubled once more than this fraction of its slots are used.
+static const double MAX_INDEX_LOAD = 0.7;
+
+struct IndexHeader
+{
+    char magic[8];
+    uint64_t capacity; ///< The number of slots, a power of two.
+    uint64_t count; ///< The number of used slots, which is the number of stored events.
+    uint64_t indexedEnd; ///< Every record before this log offset is indexed and durable.
+    uint64_t isClean; ///< 1 if the store was closed cleanly, 0 while it is open.
+};
+
+///< A slot in the index.  A slot with offset 0 is empty, since no record starts there.
+struct IndexSlot
+{
+    uint64_t idPrefix;
+    uint64_t offset;
+};
+
+///< The header of a log record.  The payload follows, padded to a multiple of 8 bytes.
+struct RecordHeader
+{
+    uint32_t magic;
+    uint32_t size; ///< The size of the payload.
+    uint32_t checksum; ///< The CRC-32C of the payload.
+    uint32_t reserved;
+};
+
+///< When the store is closed, each posting index that covers less than this many bytes of the
+///< log is written out, so opening the store never rebuilds postings from more of the log.
+static const uint64_t MAX_POSTING_REPLAY_SIZE = 8 * 1024 * 1024;
+
+///< The fixed part of a record payload: the ID, pubkey, signature, `created_at`, kind, tag count,
+///< and content size.  The tags follow, each as a field count and length-prefixed fields, and
+///< then the content.
+static const size_t FIXED_PAYLOAD_SIZE = 32 + 32 + 64 + 8 + 4 + 4 + 4;
+
+static uint32_t crc32c(const uint8_t* data, size_t length)
+{
+    uint32_t crc = 0xffffffff;
+
+#ifdef __SSE4_2__
+    uint64_t wideCrc = crc;
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        wideCrc = _mm_crc32_u64(wideCrc, word);
+    }
+    crc = static_cast<uint32_t>(wideCrc);
+    for (; length > 0; data++, length--)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+#else
+    static const array<uint32_t, 256> table = []()
+    {
+        array<uint32_t, 256> entries;
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t entry = i;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                entry = (entry >> 1) ^ (0x82f63b78 & (0 - (entry & 1)));
+            }
+            entries[i] = entry;
+        }
+        return entries;
+    }();
+
+    for (; length > 0; data++, length--)
+    {
+        crc = table[(crc ^ *data) & 0xff] ^ (crc >> 8);
+    }
+#endif
+
+    return ~crc;
+};
+
+static inline size_t alignRecord(size_t size)
+{
+    return (size + 7) & ~size_t(7);
+};
+
+static inline uint64_t idPrefix(const uint8_t* id)
+{
+    uint64_t prefix;
+    memcpy(&prefix, id, sizeof(prefix));
+    return prefix;
+};
+
+static inline bool isUnset(const EventId& id)
+{
+    static const EventId unset{};
+    return id == unset;
+};
+
+static inline uint64_t authorKey(const PublicKey& pubkey)
+{
+    return idPrefix(pubkey.data());
+};
+
+static inline uint64_t kindKey(int kind)
+{
+    return static_cast<uint32_t>(kind);
+};
+
+/**
+ * @brief Hashes a tag name and value with 64-bit FNV-1a.  The hash is stored on disk, so it
+ * must not vary between builds, as `std::hash` may.
+ */
+static uint64_t tagKey(string_view name, string_view value)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+    auto mix = [&hash](uint8_t byte)
+    {
+        hash ^= byte;
+        hash *= 0x100000001b3;
+    };
+
+    for (char c : name)
+    {
+        mix(static_cast<uint8_t>(c));
+    }
+    mix(0xff); // Cannot occur in UTF-8, so the name and value cannot run together.
+    for (char c : value)
+    {
+        mix(static_cast<uint8_t>(c));
+    }
+
+    return hash;
+};
+
+static size_t payloadSize(const Event& event)
+{
+    size_t size = FIXED_PAYLOAD_SIZE + event.content.size();
+    for (Tags::Tag tag : event.tags)
+    {
+        size += sizeof(uint32_t);
+        for (string_view field : tag)
+        {
+            size += sizeof(uint32_t) + field.size();
+        }
+    }
+
+    return size;
+};
+
+static inline uint8_t* put(uint8_t* out, const void* bytes, size_t length)
+{
+    memcpy(out, bytes, length);
+    return out + length;
+};
+
+static inline uint8_t* putU32(uint8_t* out, size_t value)
+{
+    uint32_t narrowed = static_cast<uint32_t>(value);
+    return put(out, &narrowed, sizeof(narrowed));
+};
+
+static void encodePayload(const Event& event, uint8_t* out)
+{
+    int64_t createdAt = event.createdAt;
+    int32_t kind = event.kind;
+
+    out = put(out, event.id.data(), event.id.size());
+    out = put(out, event.pubkey.data(), event.pubkey.size());
+    out = put(out, event.sig.data(), event.sig.size());
+    out = put(out, &createdAt, sizeof(createdAt));
+    out = put(out, &kind, sizeof(kind));
+    out = putU32(out, event.tags.size());
+    out = putU32(out, event.content.size());
+
+    for (Tags::Tag tag : event.tags)
+    {
+        out = putU32(out, tag.size());
+        for (string_view field : tag)
+        {
+            out = putU32(out, field.size());
+            out = put(out, field.data(), field.size());
+        }
+    }
+
+    put(out, event.content.data(), event.content.size());
+};
+
+/**
+ * @brief Reads a record payload, failing rather than reading past its end.
+ */
+struct PayloadReader
+{
+    const uint8_t* position;
+    const uint8_t* end;
+
+    bool read(void* out, size_t length)
+    {
+        if (static_cast<size_t>(this->end - this->position) < length)
+        {
+            return false;
+        }
+        memcpy(out, this->position, length);
+        this->position += length;
+        return true;
+    };
+
+    bool view(size_t length, string_view& out)
+    {
+        if (static_cast<size_t>(this->end - this->position) < length)
+        {
+            return false;
+        }
+        out = string_view(reinterpret_cast<const char*>(this->position), length);
+        this->position += length;
+        return true;
+    };
+};
+
+static void throwSystemError(const string& message)
+{
+    throw system_error(errno, generic_category(), message);
+};
+
+#pragma endregion
+
+#pragma region Constructors and Destructors
+
+MmapEventStore::MmapEventStore(string directory, MmapEventStoreOptions options)
+    : _directory(directory), _options(options)
+{
+    if (this->_options.growthSize < FILE_HEADER_SIZE)
+    {
+        throw invalid_argument("MmapEventStore::MmapEventStore: The growth size is too small.");
+    }
+
+    filesystem::create_directories(this->_directory);
+
+    try
+    {
+        bool isNewLog = this->_openLog();
+        this->_openIndex(isNewLog);
+        this->_recover();
+        this->_openPostingIndexes();
+    }
+    catch (...)
+    {
+        _closeFile(this->_index);
+        _closeFile(this->_log);
+        throw;
+    }
+};
+
+MmapEventStore::~MmapEventStore()
+{
+    try
+    {
+        this->_compactPostingIndexes(true);
+        this->flush();
+        this->_writeIndexHeader(this->_logEnd, true);
+    }
+    catch (const exception& e)
+    {
+        PLOG_ERROR << "Failed to close the event store cleanly: " << e.what();
+    }
+
+    _closeFile(this->_index);
+    _closeFile(this->_log);
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+bool MmapEventStore::append(const Event& event)
+{
+    if (isUnset(event.id))
+    {
+        throw invalid_argument("MmapEventStore::append: The event must have an ID.");
+    }
+
+    size_t size = payloadSize(event);
+    if (size > numeric_limits<uint32_t>::max())
+    {
+        throw invalid_argument("MmapEventStore::append: The event exceeds 4 GiB.");
+    }
+    size_t recordSize = alignRecord(sizeof(RecordHeader) + size);
+
+    unique_lock<shared_mutex> lock(this->_mutex);
+    if (this->_findOffset(event.id) != 0)
+    {
+        return false;
+    }
+
+    if (this->_logEnd + recordSize > this->_log.size)
+    {
+        this->_growLog(this->_logEnd + recordSize);
+    }
+
+    // The header is written after the payload, and the record counts as part of the log only
+    // once both are complete and the checksum matches.
+    uint64_t offset = this->_logEnd;
+    uint8_t* record = this->_log.data + offset;
+    encodePayload(event, record + sizeof(RecordHeader));
+    RecordHeader header = {
+        RECORD_MAGIC,
+        static_cast<uint32_t>(size),
+        crc32c(record + sizeof(RecordHeader), size),
+        0
+    };
+    memcpy(record, &header, sizeof(header));
+
+    this->_logEnd += recordSize;
+    this->_insertIndexEntry(event.id, offset);
+    this->_addPostings(event, offset);
+    this->_compactPostingIndexes(false);
+
+    if (this->_options.syncOnAppend)
+    {
+        uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        uint64_t syncStart = offset & ~(pageSize - 1);
+        if (msync(this->_log.data + syncStart, this->_logEnd - syncStart, MS_SYNC) != 0)
+        {
+            throwSystemError("MmapEventStore::append: Failed to sync the log");
+        }
+    }
+
+    return true;
+};
+
+shared_ptr<Event> MmapEventStore::find(const EventId& id)
+{
+    shared_lock<shared_mutex> lock(this->_mutex);
+    uint64_t offset = this->_findOffset(id);
+    if (offset == 0)
+    {
+        return nullptr;
+    }
+
+    if (this->_validRecordSize(offset, this->_logEnd) == 0)
+    {
+        PLOG_WARNING << "The stored record of event " << toHex(id) << " is corrupt.";
+        return nullptr;
+    }
+
+    return this->_decode(offset);
+};
+
+vector<shared_ptr<Event>> MmapEventStore::query(const Filters& filters)
+{
+    FilterMatcher matcher = filters.compile();
+    int64_t since = filters.since != 0 ? filters.since : numeric_limits<int64_t>::min();
+    int64_t until = filters.until != 0 ? filters.until : numeric_limits<int64_t>::max();
+
+    shared_lock<shared_mutex> lock(this->_mutex);
+
+    if (!filters.ids.empty())
+    {
+        vector<shared_ptr<Event>> events;
+        for (const string& hex : filters.ids)
+        {
+            EventId id;
+            uint64_t offset = fromHex(hex, id.data(), id.size()) ? this->_findOffset(id) : 0;
+            if (offset == 0 || this->_validRecordSize(offset, this->_logEnd) == 0)
+            {
+                continue;
+            }
+
+            auto event = this->_decode(offset);
+            if (event != nullptr && matcher.matches(*event))
+            {
+                events.push_back(event);
+            }
+        }
+
+        return matcher.select(events);
+    }
+
+    // Each indexed condition can be answered from its postings alone, since an event must
+    // satisfy every condition.  The condition with the fewest postings in range is used.
+    struct IndexPlan
+    {
+        const PostingIndex* index;
+        vector<uint64_t> keys;
+    };
+
+    vector<IndexPlan> plans;
+    if (!filters.authors.empty() || !filters.authorHandles.empty())
+    {
+        IndexPlan plan = { this->_authorIndex.get(), {} };
+        for (const string& hex : filters.authors)
+        {
+            PublicKey pubkey;
+            if (fromHex(hex, pubkey.data(), pubkey.size()))
+            {
+                plan.keys.push_back(authorKey(pubkey));
+            }
+        }
+        for (PublicKeyHandle handle : filters.authorHandles)
+        {
+            plan.keys.push_back(authorKey(PublicKeyPool::global().key(handle)));
+        }
+        plans.push_back(move(plan));
+    }
+    if (!filters.kinds.empty())
+    {
+        IndexPlan plan = { this->_kindIndex.get(), {} };
+        for (int kind : filters.kinds)
+        {
+            plan.keys.push_back(kindKey(kind));
+        }
+        plans.push_back(move(plan));
+    }
+    for (const auto& tag : filters.tags)
+    {
+        if (tag.second.empty())
+        {
+            continue;
+        }
+
+        string_view name = !tag.first.empty() && tag.first[0] == '#'
+            ? string_view(tag.first).substr(1)
+            : string_view(tag.first);
+        IndexPlan plan = { this->_tagIndex.get(), {} };
+        for (const string& value : tag.second)
+        {
+            plan.keys.push_back(tagKey(name, value));
+        }
+        plans.push_back(move(plan));
+    }
+
+    if (plans.empty())
+    {
+        vector<shared_ptr<Event>> events;
+        uint64_t offset = FILE_HEADER_SIZE;
+        while (size_t recordSize = this->_validRecordSize(offset, this->_logEnd))
+        {
+            auto event = this->_decode(offset);
+            if (event != nullptr && matcher.matches(*event))
+            {
+                events.push_back(event);
+            }
+            offset += recordSize;
+        }
+
+        return matcher.select(events);
+    }
+
+    const IndexPlan* bestPlan = nullptr;
+    size_t bestCost = numeric_limits<size_t>::max();
+    for (IndexPlan& plan : plans)
+    {
+        sort(plan.keys.begin(), plan.keys.end());
+        plan.keys.erase(unique(plan.keys.begin(), plan.keys.end()), plan.keys.end());
+
+        // Counting stops once a plan costs more than the best so far.
+        size_t cost = 0;
+        for (size_t i = 0; i < plan.keys.size() && cost < bestCost; i++)
+        {
+            cost += plan.index->count(plan.keys[i], since, until, bestCost - cost);
+        }
+        if (cost < bestCost || bestPlan == nullptr)
+        {
+            bestPlan = &plan;
+            bestCost = cost;
+        }
+    }
+
+    // Merge the postings for each of the plan's keys, newest first.  An event filed under
+    // several of the keys appears once for each, and the copies are adjacent in the merge.
+    vector<PostingIndex::Cursor> cursors;
+    for (uint64_t key : bestPlan->keys)
+    {
+        PostingIndex::Cursor cursor = bestPlan->index->find(key, since, until);
+        if (cursor.isValid())
+        {
+            cursors.push_back(cursor);
+        }
+    }
+
+    auto isOlder = [&cursors](size_t left, size_t right)
+    {
+        const Posting& leftPosting = cursors[left].current();
+        const Posting& rightPosting = cursors[right].current();
+        return leftPosting.createdAt != rightPosting.createdAt
+            ? leftPosting.createdAt < rightPosting.createdAt
+            : leftPosting.offset < rightPosting.offset;
+    };
+    priority_queue<size_t, vector<size_t>, decltype(isOlder)> newest(isOlder);
+    for (size_t i = 0; i < cursors.size(); i++)
+    {
+        newest.push(i);
+    }
+
+    uint64_t lastOffset = 0;
+    return this->_collect(matcher, [&cursors, &newest, &lastOffset]() -> uint64_t
+    {
+        while (!newest.empty())
+        {
+            size_t i = newest.top();
+            newest.pop();
+            uint64_t offset = cursors[i].current().offset;
+            cursors[i].advance();
+            if (cursors[i].isValid())
+            {
+                newest.push(i);
+            }
+
+            if (offset != lastOffset)
+            {
+                lastOffset = offset;
+                return offset;
+            }
+        }
+
+        return 0;
+    });
+};
+
+void MmapEventStore::scan(function<bool(shared_ptr<Event>)> visitor)
+{
+    uint64_t offset = FILE_HEADER_SIZE;
+    while (true)
+    {
+        // The lock is released while the visitor runs, so it may use the store.
+        shared_ptr<Event> event;
+        {
+            shared_lock<shared_mutex> lock(this->_mutex);
+            if (offset >= this->_logEnd)
+            {
+                return;
+            }
+
+            size_t recordSize = this->_validRecordSize(offset, this->_logEnd);
+            if (recordSize == 0)
+            {
+                PLOG_WARNING << "Stopping the scan at a corrupt record at offset " << offset << ".";
+                return;
+            }
+
+            event = this->_decode(offset);
+            offset += recordSize;
+        }
+
+        if (event != nullptr && !visitor(event))
+        {
+            return;
+        }
+    }
+};
+
+size_t MmapEventStore::size()
+{
+    shared_lock<shared_mutex> lock(this->_mutex);
+    return reinterpret_cast<const IndexHeader*>(this->_index.data)->count;
+};
+
+void MmapEventStore::flush()
+{
+    unique_lock<shared_mutex> lock(this->_mutex);
+
+    // The log must be durable before the index claims to cover it.
+    if (msync(this->_log.data, this->_logEnd, MS_SYNC) != 0)
+    {
+        throwSystemError("MmapEventStore::flush: Failed to sync the log");
+    }
+
+    auto header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    header->indexedEnd = this->_logEnd;
+    if (msync(this->_index.data, this->_index.size, MS_SYNC) != 0)
+    {
+        throwSystemError("MmapEventStore::flush: Failed to sync the index");
+    }
+};
+
+#pragma endregion
+
+#pragma region Private Methods
+
+bool MmapEventStore::_openLog()
+{
+    string path = this->_directory + "/events.log";
+    this->_log.descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (this->_log.descriptor < 0)
+    {
+        throwSystemError("MmapEventStore::_openLog: Failed to open " + path);
+    }
+
+    struct stat status;
+    if (fstat(this->_log.descriptor, &status) != 0)
+    {
+        throwSystemError("MmapEventStore::_openLog: Failed to read the size of " + path);
+    }
+
+    size_t size = static_cast<size_t>(status.st_size);
+    bool isNew = size == 0;
+    if (!isNew && size < FILE_HEADER_SIZE)
+    {
+        throw invalid_argument("MmapEventStore::_openLog: " + path + " is not an event log.");
+    }
+
+    _mapFile(this->_log, isNew ? this->_options.growthSize : size);
+    if (isNew)
+    {
+        memcpy(this->_log.data, LOG_MAGIC, sizeof(LOG_MAGIC));
+    }
+    else if (memcmp(this->_log.data, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+    {
+        throw invalid_argument("MmapEventStore::_openLog: " + path + " is not an event log.");
+    }
+
+    return isNew;
+};
+
+void MmapEventStore::_openIndex(bool isNewLog)
+{
+    string path = this->_directory + "/events.idx";
+    this->_index.descriptor = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (this->_index.descriptor < 0)
+    {
+        throwSystemError("MmapEventStore::_openIndex: Failed to open " + path);
+    }
+
+    struct stat status;
+    if (fstat(this->_index.descriptor, &status) != 0)
+    {
+        throwSystemError("MmapEventStore::_openIndex: Failed to read the size of " + path);
+    }
+
+    size_t size = static_cast<size_t>(status.st_size);
+    bool isValid = false;
+    if (size >= FILE_HEADER_SIZE)
+    {
+        _mapFile(this->_index, size);
+        auto header = reinterpret_cast<const IndexHeader*>(this->_index.data);
+        isValid = memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0
+            && header->capacity > 0
+            && (header->capacity & (header->capacity - 1)) == 0
+            && size == FILE_HEADER_SIZE + header->capacity * sizeof(IndexSlot)
+            && header->indexedEnd >= FILE_HEADER_SIZE
+            && header->indexedEnd <= this->_log.size;
+    }
+
+    if (isValid)
+    {
+        return;
+    }
+
+    if (size > 0)
+    {
+        PLOG_WARNING << "The event index is unreadable, and will be rebuilt from the log.";
+    }
+
+    // Truncating first zeroes every slot.
+    if (ftruncate(this->_index.descriptor, 0) != 0)
+    {
+        throwSystemError("MmapEventStore::_openIndex: Failed to reset " + path);
+    }
+    _mapFile(this->_index, FILE_HEADER_SIZE + INITIAL_INDEX_CAPACITY * sizeof(IndexSlot));
+
+    auto header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header->capacity = INITIAL_INDEX_CAPACITY;
+    header->count = 0;
+    header->indexedEnd = FILE_HEADER_SIZE;
+    header->isClean = isNewLog ? 1 : 0;
+};
+
+void MmapEventStore::_recover()
+{
+    auto header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    bool wasClean = header->isClean == 1;
+
+    // Mark the store as open, so a crash before it is closed is detected.
+    this->_writeIndexHeader(header->indexedEnd, false);
+
+    uint64_t offset = header->indexedEnd;
+    size_t recoveredCount = 0;
+    this->_logEnd = offset;
+    while (size_t recordSize = this->_validRecordSize(offset, this->_log.size))
+    {
+        EventId id;
+        memcpy(id.data(), this->_log.data + offset + sizeof(RecordHeader), id.size());
+
+        this->_logEnd = offset + recordSize;
+        if (this->_findOffset(id) == 0)
+        {
+            this->_insertIndexEntry(id, offset);
+        }
+        offset += recordSize;
+        recoveredCount++;
+    }
+
+    header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    if (!wasClean)
+    {
+        // The index may hold entries for records the log lost, and the log may hold the remains
+        // of a torn record.  Drop the first and zero the second, so later appends cannot be
+        // confused with either.
+        this->_rebuildIndex(header->capacity);
+        memset(this->_log.data + this->_logEnd, 0, this->_log.size - this->_logEnd);
+        PLOG_WARNING << "The event store was not closed cleanly; recovered " << recoveredCount
+            << " events appended since the last flush.";
+    }
+    else if (recoveredCount > 0)
+    {
+        PLOG_INFO << "Indexed " << recoveredCount << " events appended since the last flush.";
+    }
+};
+
+void MmapEventStore::_openPostingIndexes()
+{
+    this->_authorIndex = make_unique<PostingIndex>(this->_directory + "/authors.pst");
+    this->_kindIndex = make_unique<PostingIndex>(this->_directory + "/kinds.pst");
+    this->_tagIndex = make_unique<PostingIndex>(this->_directory + "/tags.pst");
+
+    uint64_t replayStart = this->_logEnd;
+    for (PostingIndex* index : { this->_authorIndex.get(), this->_kindIndex.get(), this->_tagIndex.get() })
+    {
+        if (index->indexedEnd() > this->_logEnd)
+        {
+            // The index holds postings for records the log lost in a crash.
+            PLOG_WARNING << "A posting index is ahead of the event log, and will be rebuilt.";
+            index->clear();
+        }
+        replayStart = min(replayStart, max<uint64_t>(index->indexedEnd(), FILE_HEADER_SIZE));
+    }
+
+    size_t replayedCount = 0;
+    uint64_t offset = replayStart;
+    while (size_t recordSize = this->_validRecordSize(offset, this->_logEnd))
+    {
+        auto event = this->_decode(offset);
+        if (event != nullptr)
+        {
+            this->_addPostings(*event, offset);
+        }
+        offset += recordSize;
+        replayedCount++;
+    }
+
+    if (replayedCount > 0)
+    {
+        PLOG_INFO << "Rebuilt the postings of " << replayedCount << " events from the log.";
+    }
+    this->_compactPostingIndexes(false);
+};
+
+void MmapEventStore::_addPostings(const Event& event, uint64_t offset)
+{
+    int64_t createdAt = event.createdAt;
+    if (offset >= this->_authorIndex->indexedEnd())
+    {
+        this->_authorIndex->add({ authorKey(event.pubkey), createdAt, offset });
+    }
+    if (offset >= this->_kindIndex->indexedEnd())
+    {
+        this->_kindIndex->add({ kindKey(event.kind), createdAt, offset });
+    }
+    if (offset >= this->_tagIndex->indexedEnd())
+    {
+        for (Tags::Tag tag : event.tags)
+        {
+            if (tag.size() >= 2)
+            {
+                this->_tagIndex->add({ tagKey(tag.name(), tag[1]), createdAt, offset });
+            }
+        }
+    }
+};
+
+void MmapEventStore::_compactPostingIndexes(bool isClosing)
+{
+    bool isLogSynced = false;
+    for (PostingIndex* index : { this->_authorIndex.get(), this->_kindIndex.get(), this->_tagIndex.get() })
+    {
+        bool shouldCompact = isClosing
+            ? this->_logEnd - max<uint64_t>(index->indexedEnd(), FILE_HEADER_SIZE) > MAX_POSTING_REPLAY_SIZE
+            : index->needsCompaction();
+        if (!shouldCompact)
+        {
+            continue;
+        }
+
+        // An index must never cover records that could still be lost from the log.
+        if (!isLogSynced && msync(this->_log.data, this->_logEnd, MS_SYNC) != 0)
+        {
+            throwSystemError("MmapEventStore::_compactPostingIndexes: Failed to sync the log");
+        }
+        isLogSynced = true;
+
+        index->compact(this->_logEnd);
+    }
+};
+
+vector<shared_ptr<Event>> MmapEventStore::_collect(
+    const FilterMatcher& matcher,
+    function<uint64_t()> nextOffset) const
+{
+    size_t limit = matcher.limit() > 0 ? static_cast<size_t>(matcher.limit()) : numeric_limits<size_t>::max();
+    vector<shared_ptr<Event>> events;
+    for (uint64_t offset = nextOffset(); offset != 0; offset = nextOffset())
+    {
+        if (this->_validRecordSize(offset, this->_logEnd) == 0)
+        {
+            PLOG_WARNING << "Skipping a corrupt record at offset " << offset << ".";
+            continue;
+        }
+
+        auto event = this->_decode(offset);
+        if (event == nullptr || !matcher.matches(*event))
+        {
+            continue;
+        }
+
+        // Past the limit, only events as new as the oldest one kept can still be selected,
+        // since events with the same timestamp are ordered by ID.
+        if (events.size() >= limit && event->createdAt < events.back()->createdAt)
+        {
+            break;
+        }
+        events.push_back(event);
+    }
+
+    return matcher.select(events);
+};
+
+void MmapEventStore::_growLog(size_t minimumSize)
+{
+    size_t size = max(minimumSize, this->_log.size + this->_options.growthSize);
+    _mapFile(this->_log, size);
+};
+
+void MmapEventStore::_rebuildIndex(uint64_t capacity)
+{
+    string path = this->_directory + "/events.idx";
+    string temporaryPath = path + ".tmp";
+
+    MappedFile rebuilt;
+    rebuilt.descriptor = open(temporaryPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (rebuilt.descriptor < 0)
+    {
+        throwSystemError("MmapEventStore::_rebuildIndex: Failed to open " + temporaryPath);
+    }
+
+    try
+    {
+        _mapFile(rebuilt, FILE_HEADER_SIZE + capacity * sizeof(IndexSlot));
+
+        auto oldHeader = reinterpret_cast<const IndexHeader*>(this->_index.data);
+        auto oldSlots = reinterpret_cast<const IndexSlot*>(this->_index.data + FILE_HEADER_SIZE);
+        auto header = reinterpret_cast<IndexHeader*>(rebuilt.data);
+        auto slots = reinterpret_cast<IndexSlot*>(rebuilt.data + FILE_HEADER_SIZE);
+
+        memcpy(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+        header->capacity = capacity;
+        header->count = 0;
+        header->indexedEnd = min(oldHeader->indexedEnd, this->_logEnd);
+        header->isClean = 0;
+
+        uint64_t mask = capacity - 1;
+        for (uint64_t i = 0; i < oldHeader->capacity; i++)
+        {
+            const IndexSlot& entry = oldSlots[i];
+            if (entry.offset == 0 || entry.offset >= this->_logEnd)
+            {
+                continue;
+            }
+
+            uint64_t slot = entry.idPrefix & mask;
+            while (slots[slot].offset != 0)
+            {
+                slot = (slot + 1) & mask;
+            }
+            slots[slot] = entry;
+            header->count++;
+        }
+
+        if (msync(rebuilt.data, rebuilt.size, MS_SYNC) != 0)
+        {
+            throwSystemError("MmapEventStore::_rebuildIndex: Failed to sync " + temporaryPath);
+        }
+        if (rename(temporaryPath.c_str(), path.c_str()) != 0)
+        {
+            throwSystemError("MmapEventStore::_rebuildIndex: Failed to replace " + path);
+        }
+    }
+    catch (...)
+    {
+        _closeFile(rebuilt);
+        throw;
+    }
+
+    _closeFile(this->_index);
+    this->_index = rebuilt;
+};
+
+uint64_t MmapEventStore::_findOffset(const EventId& id) const
+{
+    auto header = reinterpret_cast<const IndexHeader*>(this->_index.data);
+    auto slots = reinterpret_cast<const IndexSlot*>(this->_index.data + FILE_HEADER_SIZE);
+    uint64_t prefix = idPrefix(id.data());
+    uint64_t mask = header->capacity - 1;
+
+    // The index holds only a prefix of each ID, so candidates are confirmed against the log.
+    for (uint64_t slot = prefix & mask; slots[slot].offset != 0; slot = (slot + 1) & mask)
+    {
+        const IndexSlot& entry = slots[slot];
+        bool isCandidate = entry.idPrefix == prefix
+            && entry.offset + sizeof(RecordHeader) + id.size() <= this->_logEnd;
+        if (isCandidate
+            && memcmp(this->_log.data + entry.offset + sizeof(RecordHeader), id.data(), id.size()) == 0)
+        {
+            return entry.offset;
+        }
+    }
+
+    return 0;
+};
+
+void MmapEventStore::_insertIndexEntry(const EventId& id, uint64_t offset)
+{
+    auto header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    if (header->count + 1 > header->capacity * MAX_INDEX_LOAD)
+    {
+        this->_rebuildIndex(header->capacity * 2);
+        header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    }
+
+    auto slots = reinterpret_cast<IndexSlot*>(this->_index.data + FILE_HEADER_SIZE);
+    uint64_t prefix = idPrefix(id.data());
+    uint64_t mask = header->capacity - 1;
+    uint64_t slot = prefix & mask;
+    while (slots[slot].offset != 0)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    slots[slot] = { prefix, offset };
+    header->count++;
+};
+
+size_t MmapEventStore::_validRecordSize(uint64_t offset, uint64_t end) const
+{
+    if (offset + sizeof(RecordHeader) > end)
+    {
+        return 0;
+    }
+
+    RecordHeader header;
+    memcpy(&header, this->_log.data + offset, sizeof(header));
+    if (header.magic != RECORD_MAGIC || header.size < FIXED_PAYLOAD_SIZE)
+    {
+        return 0;
+    }
+
+    size_t recordSize = alignRecord(sizeof(RecordHeader) + header.size);
+    if (offset + recordSize > end)
+    {
+        return 0;
+    }
+
+    const uint8_t* payload = this->_log.data + offset + sizeof(RecordHeader);
+    return crc32c(payload, header.size) == header.checksum ? recordSize : 0;
+};
+
+shared_ptr<Event> MmapEventStore::_decode(uint64_t offset) const
+{
+    RecordHeader header;
+    memcpy(&header, this->_log.data + offset, sizeof(header));
+
+    const uint8_t* payload = this->_log.data + offset + sizeof(RecordHeader);
+    PayloadReader reader = { payload, payload + header.size };
+
+    auto event = make_shared<Event>();
+    int64_t createdAt;
+    int32_t kind;
+    uint32_t tagCount;
+    uint32_t contentSize;
+    bool isValid = reader.read(event->id.data(), event->id.size())
+        && reader.read(event->pubkey.data(), event->pubkey.size())
+        && reader.read(event->sig.data(), event->sig.size())
+        && reader.read(&createdAt, sizeof(createdAt))
+        && reader.read(&kind, sizeof(kind))
+        && reader.read(&tagCount, sizeof(tagCount))
+        && reader.read(&contentSize, sizeof(contentSize));
+
+    for (uint32_t i = 0; isValid && i < tagCount; i++)
+    {
+        uint32_t fieldCount = 0;
+        isValid = reader.read(&fieldCount, sizeof(fieldCount));
+        event->tags.beginTag();
+        for (uint32_t j = 0; isValid && j < fieldCount; j++)
+        {
+            uint32_t fieldSize;
+            string_view field;
+            isValid = reader.read(&fieldSize, sizeof(fieldSize)) && reader.view(fieldSize, field);
+            if (isValid)
+            {
+                event->tags.appendToLastTag(field);
+            }
+        }
+    }
+
+    string_view content;
+    if (!isValid || !reader.view(contentSize, content))
+    {
+        PLOG_WARNING << "The record at offset " << offset << " is malformed.";
+        return nullptr;
+    }
+
+    event->createdAt = static_cast<time_t>(createdAt);
+    event->kind = kind;
+    event->content.assign(content.data(), content.size());
+    event->internPubkey();
+
+    return event;
+};
+
+void MmapEventStore::_writeIndexHeader(uint64_t indexedEnd, bool isClean)
+{
+    auto header = reinterpret_cast<IndexHeader*>(this->_index.data);
+    header->indexedEnd = indexedEnd;
+    header->isClean = isClean ? 1 : 0;
+
+    if (msync(this->_index.data, FILE_HEADER_SIZE, MS_SYNC) != 0)
+    {
+        throwSystemError("MmapEventStore::_writeIndexHeader: Failed to sync the index header");
+    }
+};
+
+void MmapEventStore::_mapFile(MappedFile& file, size_t size)
+{
+    if (file.data != nullptr)
+    {
+        munmap(file.data, file.size);
+        file.data = nullptr;
+        file.size = 0;
+    }
+
+    struct stat status;
+    if (fstat(file.descriptor, &status) != 0)
+    {
+        throwSystemError("MmapEventStore::_mapFile: Failed to read the file size");
+    }
+    if (static_cast<size_t>(status.st_size) != size && ftruncate(file.descriptor, size) != 0)
+    {
+        throwSystemError("MmapEventStore::_mapFile: Failed to resize the file");
+    }
+
+    void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file.descriptor, 0);
+    if (data == MAP_FAILED)
+    {
+        throwSystemError("MmapEventStore::_mapFile: Failed to map the file");
+    }
+
+    file.data = static_cast<uint8_t*>(data);
+    file.size = size;
+};
+
+void MmapEventStore::_closeFile(MappedFile& file)
+{
+    if (file.data != nullptr)
+    {
+        munmap(file.data, file.size);
+    }
+    if (file.descriptor >= 0)
+    {
+        close(file.descriptor);
+    }
+
+    file = MappedFile();
+};
+
+#pragma endregion
@@ -0,0 +1,342 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <plog/Log.h>
+
+#include "store/posting_index.hpp"
+
+using namespace nostr::store;
+using namespace std;
+
+#pragma region Local Statics
+
+static const char POSTING_MAGIC[8] = { 'A', 'E', 'D', 'P', 'S', 'T', '0', '1' };
+
+///< The base file begins with a header of this size.  The sorted postings follow it.
+static const size_t POSTING_HEADER_SIZE = 64;
+
+///< Pending postings are merged into the base once there are more than this many, or more than
+///< an eighth of the base, whichever is larger.
+static const size_t MIN_COMPACTION_COUNT = 1 << 16;
+
+///< Postings are written to a new base file in batches of this many.
+static const size_t WRITE_BATCH_COUNT = 1 << 14;
+
+struct PostingHeader
+{
+    char magic[8];
+    uint64_t count; ///< The number of postings in the file.
+    uint64_t indexedEnd; ///< Every log record before this offset has its postings in the file.
+};
+
+static_assert(sizeof(Posting) == 24, "Postings are stored in files as packed 24-byte entries.");
+
+static void throwSystemError(const string& message)
+{
+    throw system_error(errno, generic_category(), message);
+};
+
+static void writeAll(int descriptor, const void* data, size_t size, const string& path)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (size > 0)
+    {
+        ssize_t written = write(descriptor, bytes, size);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            throwSystemError("PostingIndex::compact: Failed to write " + path);
+        }
+
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+};
+
+#pragma endregion
+
+#pragma region Cursor
+
+PostingIndex::Cursor::Cursor(
+    const Posting* base,
+    const Posting* baseEnd,
+    PendingSet::const_iterator pending,
+    PendingSet::const_iterator pendingEnd)
+    : _base(base), _baseEnd(baseEnd), _pending(pending), _pendingEnd(pendingEnd) { };
+
+bool PostingIndex::Cursor::isValid() const
+{
+    return this->_base != this->_baseEnd || this->_pending != this->_pendingEnd;
+};
+
+const Posting& PostingIndex::Cursor::current() const
+{
+    return this->_isBaseNext() ? *this->_base : *this->_pending;
+};
+
+void PostingIndex::Cursor::advance()
+{
+    if (this->_isBaseNext())
+    {
+        this->_base++;
+    }
+    else
+    {
+        this->_pending++;
+    }
+};
+
+bool PostingIndex::Cursor::_isBaseNext() const
+{
+    if (this->_pending == this->_pendingEnd)
+    {
+        return true;
+    }
+    if (this->_base == this->_baseEnd)
+    {
+        return false;
+    }
+
+    return PostingOrder()(*this->_base, *this->_pending);
+};
+
+#pragma endregion
+
+#pragma region Constructors and Destructors
+
+PostingIndex::PostingIndex(string path) : _path(path)
+{
+    this->_open();
+};
+
+PostingIndex::~PostingIndex()
+{
+    this->_close();
+};
+
+#pragma endregion
+
+#pragma region Public Interface
+
+uint64_t PostingIndex::indexedEnd() const
+{ return this->_indexedEnd; };
+
+size_t PostingIndex::pendingCount() const
+{ return this->_pending.size(); };
+
+bool PostingIndex::needsCompaction() const
+{
+    return this->_pending.size() > max(MIN_COMPACTION_COUNT, this->_baseCount / 8);
+};
+
+void PostingIndex::add(const Posting& posting)
+{
+    if (this->_pending.insert(posting).second)
+    {
+        this->_pendingCounts[posting.key]++;
+    }
+};
+
+void PostingIndex::clear()
+{
+    this->_close();
+    this->_pending.clear();
+    this->_pendingCounts.clear();
+    if (unlink(this->_path.c_str()) != 0 && errno != ENOENT)
+    {
+        PLOG_WARNING << "Failed to remove " << this->_path << ": " << strerror(errno);
+    }
+};
+
+void PostingIndex::compact(uint64_t indexedEnd)
+{
+    string temporaryPath = this->_path + ".tmp";
+    int descriptor = open(temporaryPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (descriptor < 0)
+    {
+        throwSystemError("PostingIndex::compact: Failed to open " + temporaryPath);
+    }
+
+    try
+    {
+        uint8_t header[POSTING_HEADER_SIZE] = {};
+        PostingHeader fields;
+        memcpy(fields.magic, POSTING_MAGIC, sizeof(POSTING_MAGIC));
+        fields.count = this->_baseCount + this->_pending.size();
+        fields.indexedEnd = indexedEnd;
+        memcpy(header, &fields, sizeof(fields));
+        writeAll(descriptor, header, sizeof(header), temporaryPath);
+
+        // Merge the base and the pending postings, which are both sorted, in batches.
+        vector<Posting> batch;
+        batch.reserve(WRITE_BATCH_COUNT);
+        const Posting* base = this->_base;
+        const Posting* baseEnd = this->_base + this->_baseCount;
+        auto pending = this->_pending.begin();
+        while (base != baseEnd || pending != this->_pending.end())
+        {
+            bool isBaseNext = pending == this->_pending.end()
+                || (base != baseEnd && PostingOrder()(*base, *pending));
+            batch.push_back(isBaseNext ? *base++ : *pending++);
+
+            if (batch.size() == WRITE_BATCH_COUNT)
+            {
+                writeAll(descriptor, batch.data(), batch.size() * sizeof(Posting), temporaryPath);
+                batch.clear();
+            }
+        }
+        writeAll(descriptor, batch.data(), batch.size() * sizeof(Posting), temporaryPath);
+
+        if (fsync(descriptor) != 0)
+        {
+            throwSystemError("PostingIndex::compact: Failed to sync " + temporaryPath);
+        }
+        if (rename(temporaryPath.c_str(), this->_path.c_str()) != 0)
+        {
+            throwSystemError("PostingIndex::compact: Failed to replace " + this->_path);
+        }
+    }
+    catch (...)
+    {
+        close(descriptor);
+        unlink(temporaryPath.c_str());
+        throw;
+    }
+    close(descriptor);
+
+    this->_close();
+    this->_pending.clear();
+    this->_pendingCounts.clear();
+    this->_open();
+};
+
+size_t PostingIndex::count(uint64_t key, int64_t since, int64_t until, size_t limit) const
+{
+    if (since > until)
+    {
+        return 0;
+    }
+
+    const Posting* begin;
+    const Posting* end;
+    this->_baseRange(key, since, until, begin, end);
+
+    size_t count = static_cast<size_t>(end - begin);
+    auto pendingCount = this->_pendingCounts.find(key);
+    if (pendingCount != this->_pendingCounts.end())
+    {
+        count += pendingCount->second;
+    }
+
+    return min(count, limit);
+};
+
+PostingIndex::Cursor PostingIndex::find(uint64_t key, int64_t since, int64_t until) const
+{
+    if (since > until)
+    {
+        return Cursor(nullptr, nullptr, this->_pending.end(), this->_pending.end());
+    }
+
+    const Posting* begin;
+    const Posting* end;
+    this->_baseRange(key, since, until, begin, end);
+
+    return Cursor(
+        begin,
+        end,
+        this->_pending.lower_bound({ key, until, numeric_limits<uint64_t>::max() }),
+        this->_pending.upper_bound({ key, since, 0 }));
+};
+
+#pragma endregion
+
+#pragma region Private Methods
+
+void PostingIndex::_open()
+{
+    this->_descriptor = open(this->_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->_descriptor < 0)
+    {
+        return;
+    }
+
+    struct stat status;
+    bool isValid = fstat(this->_descriptor, &status) == 0
+        && static_cast<size_t>(status.st_size) >= POSTING_HEADER_SIZE;
+    if (isValid)
+    {
+        this->_size = static_cast<size_t>(status.st_size);
+        void* data = mmap(nullptr, this->_size, PROT_READ, MAP_SHARED, this->_descriptor, 0);
+        isValid = data != MAP_FAILED;
+        this->_data = isValid ? static_cast<const uint8_t*>(data) : nullptr;
+    }
+
+    PostingHeader header;
+    if (isValid)
+    {
+        memcpy(&header, this->_data, sizeof(header));
+        isValid = memcmp(header.magic, POSTING_MAGIC, sizeof(POSTING_MAGIC)) == 0
+            && this->_size == POSTING_HEADER_SIZE + header.count * sizeof(Posting);
+    }
+
+    if (!isValid)
+    {
+        PLOG_WARNING << this->_path << " is unreadable, and will be rebuilt from the log.";
+        this->_close();
+        return;
+    }
+
+    this->_base = reinterpret_cast<const Posting*>(this->_data + POSTING_HEADER_SIZE);
+    this->_baseCount = header.count;
+    this->_indexedEnd = header.indexedEnd;
+};
+
+void PostingIndex::_close()
+{
+    if (this->_data != nullptr)
+    {
+        munmap(const_cast<uint8_t*>(this->_data), this->_size);
+    }
+    if (this->_descriptor >= 0)
+    {
+        close(this->_descriptor);
+    }
+
+    this->_descriptor = -1;
+    this->_data = nullptr;
+    this->_size = 0;
+    this->_base = nullptr;
+    this->_baseCount = 0;
+    this->_indexedEnd = 0;
+};
+
+void PostingIndex::_baseRange(
+    uint64_t key,
+    int64_t since,
+    int64_t until,
+    const Posting*& begin,
+    const Posting*& end) const
+{
+    const Posting* baseEnd = this->_base + this->_baseCount;
+    begin = lower_bound(
+        this->_base,
+        baseEnd,
+        Posting{ key, until, numeric_limits<uint64_t>::max() },
+        PostingOrder());
+    end = upper_bound(begin, baseEnd, Posting{ key, since, 0 }, PostingOrder());
+};
+
+#pragma endregion
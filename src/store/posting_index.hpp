@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+namespace nostr
+{
+namespace store
+{
+/**
+ * @brief One entry in a posting index: the log offset of an event record, filed under a key
+ * derived from one of the event's fields.
+ */
+struct Posting
+{
+    uint64_t key;
+    int64_t createdAt;
+    uint64_t offset;
+};
+
+/**
+ * @brief Orders postings by key, then newest first, so the postings for one key and time range
+ * are contiguous and already in the order queries return them.
+ */
+struct PostingOrder
+{
+    bool operator()(const Posting& left, const Posting& right) const
+    {
+        if (left.key != right.key)
+        {
+            return left.key < right.key;
+        }
+        if (left.createdAt != right.createdAt)
+        {
+            return left.createdAt > right.createdAt;
+        }
+        return left.offset > right.offset;
+    };
+};
+
+/**
+ * @brief A persistent, sorted index from keys to the event records filed under them.
+ * @remark The index is kept in two parts.  The base is a sorted array of postings in a file,
+ * mapped read-only and searched in place.  Postings added since the base was written are held
+ * in memory, in a sorted set.  `compact` merges the two into a new base file, which replaces
+ * the old one with a rename, so the file on disk is always a complete index of the log up to
+ * the offset recorded in its header.
+ * @remark The index is not synchronized.  `MmapEventStore` guards it with its own lock.
+ */
+class PostingIndex
+{
+private:
+    using PendingSet = std::set<Posting, PostingOrder>;
+
+public:
+    /**
+     * @brief Walks the postings for one key and time range, newest first, across the base and
+     * the pending postings.
+     * @remark A cursor is invalidated by any change to the index.
+     */
+    class Cursor
+    {
+    public:
+        bool isValid() const;
+
+        ///< The current posting.  The cursor must be valid.
+        const Posting& current() const;
+
+        void advance();
+
+    private:
+        friend class PostingIndex;
+
+        const Posting* _base;
+        const Posting* _baseEnd;
+        PendingSet::const_iterator _pending;
+        PendingSet::const_iterator _pendingEnd;
+
+        Cursor(
+            const Posting* base,
+            const Posting* baseEnd,
+            PendingSet::const_iterator pending,
+            PendingSet::const_iterator pendingEnd);
+
+        bool _isBaseNext() const;
+    };
+
+    /**
+     * @brief Opens the index stored at the given path.  A missing or unreadable file yields an
+     * empty index that covers none of the log.
+     */
+    explicit PostingIndex(std::string path);
+
+    ~PostingIndex();
+
+    PostingIndex(const PostingIndex&) = delete;
+
+    PostingIndex& operator=(const PostingIndex&) = delete;
+
+    /**
+     * @brief The log offset up to which the file on disk indexes every record, or 0 if it
+     * indexes none.
+     */
+    uint64_t indexedEnd() const;
+
+    ///< The number of postings added since the base was last written.
+    std::size_t pendingCount() const;
+
+    /**
+     * @brief Whether enough postings are pending that they should be merged into the base.
+     * @remark The threshold grows with the base, so each posting is rewritten a bounded number
+     * of times as the index grows.
+     */
+    bool needsCompaction() const;
+
+    void add(const Posting& posting);
+
+    /**
+     * @brief Discards every posting, including the file on disk.
+     */
+    void clear();
+
+    /**
+     * @brief Merges the pending postings into a new base file.
+     * @param indexedEnd The log offset up to which the index is now complete.  The log must
+     * already be durable up to this offset.
+     * @throws `std::system_error` if the file cannot be written.
+     */
+    void compact(uint64_t indexedEnd);
+
+    /**
+     * @brief Estimates the number of postings for the given key with
+     * `since <= createdAt <= until`, for choosing between indexes.
+     * @param limit The estimate is capped at this number.
+     * @remark Postings in the base are counted exactly.  Pending postings are counted
+     * regardless of their time, so the estimate costs two binary searches however many
+     * postings are pending.
+     */
+    std::size_t count(uint64_t key, int64_t since, int64_t until, std::size_t limit) const;
+
+    /**
+     * @brief Finds the postings for the given key with `since <= createdAt <= until`.
+     */
+    Cursor find(uint64_t key, int64_t since, int64_t until) const;
+
+private:
+    std::string _path;
+
+    int _descriptor = -1;
+
+    ///< The mapping of the base file, including its header.
+    const uint8_t* _data = nullptr;
+
+    std::size_t _size = 0;
+
+    const Posting* _base = nullptr;
+
+    std::size_t _baseCount = 0;
+
+    uint64_t _indexedEnd = 0;
+
+    PendingSet _pending;
+
+    ///< The number of pending postings for each key.
+    std::unordered_map<uint64_t, std::size_t> _pendingCounts;
+
+    /**
+     * @brief Maps the base file, or leaves the index empty if the file is missing or invalid.
+     */
+    void _open();
+
+    void _close();
+
+    /**
+     * @brief Finds the range of base postings for the given key and time range.
+     */
+    void _baseRange(
+        uint64_t key,
+        int64_t since,
+        int64_t until,
+        const Posting*& begin,
+        const Posting*& end) const;
+};
+} // namespace store
+} // namespace nostr
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "service/cancellation_token.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+TEST(CancellationTokenTest, Cancel_InvokesEachHandlerOnce)
+{
+    service::CancellationToken token;
+    int firstCount = 0;
+    int secondCount = 0;
+    token.onCancel([&firstCount]() { firstCount++; });
+    token.onCancel([&secondCount]() { secondCount++; });
+
+    EXPECT_FALSE(token.isCancelled());
+    token.cancel();
+    token.cancel();
+
+    EXPECT_TRUE(token.isCancelled());
+    EXPECT_EQ(firstCount, 1);
+    EXPECT_EQ(secondCount, 1);
+};
+
+TEST(CancellationTokenTest, RemoveHandler_PreventsInvocation)
+{
+    service::CancellationToken token;
+    bool isCalled = false;
+    size_t handle = token.onCancel([&isCalled]() { isCalled = true; });
+
+    token.removeHandler(handle);
+    token.cancel();
+
+    EXPECT_FALSE(isCalled);
+};
+
+TEST(CancellationTokenTest, OnCancel_AfterCancel_InvokesHandlerAtOnce)
+{
+    service::CancellationToken token;
+    token.cancel();
+
+    bool isCalled = false;
+    size_t handle = token.onCancel([&isCalled]() { isCalled = true; });
+
+    EXPECT_TRUE(isCalled);
+    EXPECT_EQ(handle, 0u);
+};
+} // namespace nostr_test
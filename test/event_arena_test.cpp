@@ -0,0 +1,88 @@
+#include <memory_resource>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+#include "data/relay_message_parser.hpp"
+
+using namespace nostr::data;
+using namespace std;
+using namespace ::testing;
+
+static string arenaTestFrame(const string& content)
+{
+    nlohmann::json event = {
+        { "id", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" },
+        { "pubkey", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" },
+        { "created_at", 1627846261 },
+        { "kind", 1 },
+        { "tags", nlohmann::json::array({ nlohmann::json::array({ "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" }) }) },
+        { "content", content },
+        { "sig", "" }
+    };
+
+    return nlohmann::json::array({ "EVENT", "sub-1", event }).dump();
+};
+
+TEST(EventArenaTest, MakeEvent_AllocatesTagsAndContent_FromArena)
+{
+    auto arena = EventArena::create();
+    auto event = arena->makeEvent();
+    size_t bytesBefore = arena->bytesAllocated();
+
+    event->content = string(1000, 'x');
+    event->tags.push_back({ "t", string(1000, 'y') });
+
+    EXPECT_GE(arena->bytesAllocated(), bytesBefore + 2000);
+    EXPECT_EQ(event->content.get_allocator().resource(), arena.get());
+};
+
+TEST(EventArenaTest, Events_KeepArenaAlive)
+{
+    auto arena = EventArena::create();
+    weak_ptr<EventArena> weakArena = arena;
+    auto event = arena->makeEvent();
+    event->content = "Hello, World!";
+    arena.reset();
+
+    EXPECT_FALSE(weakArena.expired());
+    EXPECT_EQ(event->content, "Hello, World!");
+
+    event.reset();
+    EXPECT_TRUE(weakArena.expired());
+};
+
+TEST(EventArenaTest, CopiedEvents_UseDefaultResource)
+{
+    auto arena = EventArena::create();
+    auto event = arena->makeEvent();
+    event->content = string(100, 'x');
+    event->tags.push_back({ "t", "nostr" });
+
+    Event copy = *event;
+    arena.reset();
+    event.reset();
+
+    EXPECT_EQ(copy.content.get_allocator().resource(), pmr::get_default_resource());
+    EXPECT_EQ(string(copy.content), string(100, 'x'));
+    EXPECT_EQ(copy.tags.firstValue("t"), "nostr");
+};
+
+TEST(EventArenaTest, Parser_ConstructsEvents_InArena)
+{
+    auto arena = EventArena::create();
+    RelayMessageParser arenaParser(RelayMessageParser::DEFAULT_MAX_MESSAGE_SIZE, arena);
+    RelayMessageParser heapParser;
+
+    string frame = arenaTestFrame(string(500, 'x'));
+    auto arenaEvent = arenaParser.parse(frame).event;
+    auto heapEvent = heapParser.parse(frame).event;
+
+    EXPECT_EQ(arenaEvent->content.get_allocator().resource(), arena.get());
+    EXPECT_EQ(arenaEvent->content, heapEvent->content);
+    EXPECT_EQ(arenaEvent->tags, heapEvent->tags);
+    EXPECT_EQ(arenaEvent->id, heapEvent->id);
+    EXPECT_GT(arena->bytesAllocated(), 500);
+};
@@ -0,0 +1,136 @@
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "service/event_channel.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+class EventChannelTest : public testing::Test
+{
+public:
+    static shared_ptr<data::Event> testEvent(int kind)
+    {
+        auto event = make_shared<data::Event>();
+        event->kind = kind;
+        return event;
+    };
+};
+
+TEST_F(EventChannelTest, Next_ReturnsEventsInOrder_ThenNullAfterComplete)
+{
+    service::EventChannel channel(4);
+    ASSERT_TRUE(channel.push(testEvent(1)));
+    ASSERT_TRUE(channel.push(testEvent(2)));
+    channel.complete();
+
+    EXPECT_FALSE(channel.push(testEvent(3)));
+    EXPECT_EQ(channel.next()->kind, 1);
+    EXPECT_EQ(channel.next()->kind, 2);
+    EXPECT_EQ(channel.next(), nullptr);
+};
+
+TEST_F(EventChannelTest, Push_WaitsWhileFull_UntilEventIsTaken)
+{
+    service::EventChannel channel(1);
+    ASSERT_TRUE(channel.push(testEvent(1)));
+
+    atomic<bool> isPushed{false};
+    thread producer([&channel, &isPushed]()
+    {
+        channel.push(testEvent(2));
+        isPushed = true;
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(50));
+    EXPECT_FALSE(isPushed);
+    EXPECT_EQ(channel.size(), 1u);
+
+    EXPECT_EQ(channel.next()->kind, 1);
+    producer.join();
+    EXPECT_TRUE(isPushed);
+    EXPECT_EQ(channel.next()->kind, 2);
+};
+
+TEST_F(EventChannelTest, TryPush_WhenFull_DropsEvent_AndEndsChannelWithOverflow)
+{
+    service::EventChannel channel(1);
+    ASSERT_TRUE(channel.tryPush(testEvent(1)));
+    EXPECT_FALSE(channel.isOverflowed());
+
+    EXPECT_FALSE(channel.tryPush(testEvent(2)));
+    EXPECT_TRUE(channel.isOverflowed());
+    EXPECT_TRUE(channel.isComplete());
+
+    // Events already in the channel are still taken, but no more are accepted, and the
+    // consumer is then told that events were dropped.
+    EXPECT_EQ(channel.next()->kind, 1);
+    EXPECT_FALSE(channel.tryPush(testEvent(3)));
+    EXPECT_THROW(channel.next(), overflow_error);
+    EXPECT_THROW(channel.next(), overflow_error);
+
+    // A consumer that gives up on the channel stops seeing the overflow.
+    channel.close();
+    EXPECT_EQ(channel.next(), nullptr);
+};
+
+TEST_F(EventChannelTest, Next_WaitsForEvent_FromAnotherThread)
+{
+    service::EventChannel channel;
+    thread producer([&channel]()
+    {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        channel.push(testEvent(7));
+        channel.complete();
+    });
+
+    auto event = channel.next();
+    producer.join();
+
+    ASSERT_NE(event, nullptr);
+    EXPECT_EQ(event->kind, 7);
+    EXPECT_EQ(channel.next(), nullptr);
+};
+
+TEST_F(EventChannelTest, Close_DropsEvents_WakesProducer_AndCallsHandlerOnce)
+{
+    service::EventChannel channel(1);
+    int closeCount = 0;
+    channel.onClose([&closeCount]() { closeCount++; });
+    ASSERT_TRUE(channel.push(testEvent(1)));
+
+    atomic<bool> isAccepted{true};
+    thread producer([&channel, &isAccepted]()
+    {
+        isAccepted = channel.push(testEvent(2));
+    });
+
+    this_thread::sleep_for(chrono::milliseconds(20));
+    channel.close();
+    channel.close();
+    producer.join();
+
+    EXPECT_FALSE(isAccepted);
+    EXPECT_TRUE(channel.isClosed());
+    EXPECT_EQ(channel.size(), 0u);
+    EXPECT_EQ(channel.next(), nullptr);
+    EXPECT_EQ(closeCount, 1);
+
+    // A handler set after the channel is closed runs at once.
+    bool isLateHandlerCalled = false;
+    channel.onClose([&isLateHandlerCalled]() { isLateHandlerCalled = true; });
+    EXPECT_TRUE(isLateHandlerCalled);
+};
+
+TEST_F(EventChannelTest, Constructor_ZeroCapacity_Throws)
+{
+    EXPECT_THROW(service::EventChannel channel(0), invalid_argument);
+};
+} // namespace nostr_test
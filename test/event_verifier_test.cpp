@@ -0,0 +1,205 @@
+#include <cstring>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <noscrypt.h>
+#include <noscryptutil.h>
+
+#include "service/event_verifier.hpp"
+
+using namespace nostr::data;
+using namespace nostr::service;
+using namespace std;
+
+namespace nostr_test
+{
+static shared_ptr<Event> signedTestEvent(int index)
+{
+    Event event;
+    event.pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+    event.kind = 1;
+    event.createdAt = 1627846261 + index;
+    event.tags = { { "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" } };
+    event.content = "Event number " + to_string(index) + string(index * 13, 'x');
+
+    // Serializing an event assigns its ID.
+    event.serialize();
+
+    return make_shared<Event>(event);
+}
+
+/**
+ * @brief Signs events with a fixed test key.
+ */
+class TestSigner
+{
+public:
+    TestSigner() : _context(NCUtilContextAlloc(), &NCUtilContextFree)
+    {
+        uint8_t entropy[NC_CONTEXT_ENTROPY_SIZE] = { 0 };
+        NCInitContext(this->_context.get(), entropy);
+
+        for (size_t i = 0; i < sizeof(this->_secretKey.key); i++)
+        {
+            this->_secretKey.key[i] = static_cast<uint8_t>(i + 1);
+        }
+        NCGetPublicKey(this->_context.get(), &this->_secretKey, &this->_publicKey);
+    };
+
+    shared_ptr<Event> sign(shared_ptr<Event> event)
+    {
+        memcpy(event->pubkey.data(), this->_publicKey.key, sizeof(this->_publicKey.key));
+        event->serialize();
+
+        uint8_t random[32] = { 0 };
+        NCSignDigest(
+            this->_context.get(),
+            &this->_secretKey,
+            random,
+            event->id.data(),
+            event->sig.data());
+
+        return event;
+    };
+
+private:
+    shared_ptr<NCContext> _context;
+    NCSecretKey _secretKey;
+    NCPublicKey _publicKey;
+};
+
+static EventVerifierOptions testOptions(bool verifySignatures)
+{
+    EventVerifierOptions options;
+    options.workerCount = 2;
+    options.verifySignatures = verifySignatures;
+
+    return options;
+}
+
+TEST(EventVerifierTest, Verify_AcceptsMatchingIds_AndRejectsTamperedEvents)
+{
+    EventVerifier verifier(testOptions(false));
+
+    vector<shared_ptr<Event>> events;
+    for (int i = 0; i < 37; i++)
+    {
+        events.push_back(signedTestEvent(i));
+    }
+    events[3]->content += "!";
+    events[20]->kind = 7;
+    events[36]->id[0] ^= 0x01;
+
+    vector<bool> results = verifier.verify(events);
+
+    ASSERT_EQ(results.size(), events.size());
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        bool isTampered = i == 3 || i == 20 || i == 36;
+        EXPECT_EQ(results[i], !isTampered) << "event " << i;
+    }
+
+    EventVerifierCounters counters = verifier.counters();
+    EXPECT_EQ(counters.eventsVerified, 34);
+    EXPECT_EQ(counters.eventsRejected, 3);
+    EXPECT_EQ(counters.batches, 1);
+}
+
+TEST(EventVerifierTest, Submit_DeliversVerifiedEvents_InOrder_BeforeBarrier)
+{
+    EventVerifier verifier(testOptions(false));
+
+    mutex deliveredMutex;
+    vector<int> delivered;
+    promise<void> barrierReached;
+
+    for (int i = 0; i < 20; i++)
+    {
+        auto event = signedTestEvent(i);
+        if (i % 5 == 0)
+        {
+            event->content = "tampered";
+        }
+
+        verifier.submit(event, [&deliveredMutex, &delivered, i](shared_ptr<Event>)
+        {
+            lock_guard<mutex> lock(deliveredMutex);
+            delivered.push_back(i);
+        });
+    }
+    verifier.submit([&barrierReached]() { barrierReached.set_value(); });
+
+    barrierReached.get_future().wait();
+
+    lock_guard<mutex> lock(deliveredMutex);
+    vector<int> expected;
+    for (int i = 0; i < 20; i++)
+    {
+        if (i % 5 != 0)
+        {
+            expected.push_back(i);
+        }
+    }
+    EXPECT_EQ(delivered, expected);
+    EXPECT_EQ(verifier.counters().eventsRejected, 4);
+}
+TEST(EventVerifierTest, Verify_RejectsInvalidSignatures_WhenEnabled)
+{
+    EventVerifier verifier(testOptions(true));
+    TestSigner signer;
+
+    vector<shared_ptr<Event>> events;
+    for (int i = 0; i < 10; i++)
+    {
+        events.push_back(signer.sign(signedTestEvent(i)));
+    }
+    events[4]->sig[10] ^= 0x01;
+    events[7]->sig.fill(0);
+
+    vector<bool> results = verifier.verify(events);
+
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        EXPECT_EQ(results[i], i != 4 && i != 7) << "event " << i;
+    }
+
+    EventVerifierCounters counters = verifier.counters();
+    EXPECT_EQ(counters.signaturesChecked, 10);
+    EXPECT_EQ(counters.signaturesRejected, 2);
+}
+
+TEST(EventVerifierTest, Verify_ChecksEachSignatureOnce_AcrossRelayCopies)
+{
+    EventVerifier verifier(testOptions(true));
+    TestSigner signer;
+
+    // The same event arrives from five relays, three copies in one batch and two in another.
+    auto event = signer.sign(signedTestEvent(1));
+    vector<shared_ptr<Event>> firstBatch;
+    for (int i = 0; i < 3; i++)
+    {
+        firstBatch.push_back(make_shared<Event>(*event));
+    }
+    vector<shared_ptr<Event>> secondBatch = { make_shared<Event>(*event), make_shared<Event>(*event) };
+
+    vector<bool> firstResults = verifier.verify(firstBatch);
+    vector<bool> secondResults = verifier.verify(secondBatch);
+
+    EXPECT_EQ(firstResults, vector<bool>(3, true));
+    EXPECT_EQ(secondResults, vector<bool>(2, true));
+
+    EventVerifierCounters counters = verifier.counters();
+    EXPECT_EQ(counters.signaturesChecked, 1);
+    EXPECT_EQ(counters.signatureCacheHits, 4);
+
+    // A copy carrying a different signature is not vouched for by the cached one.
+    auto forged = make_shared<Event>(*event);
+    forged->sig[0] ^= 0x01;
+    EXPECT_EQ(verifier.verify({ forged }), vector<bool>{ false });
+    EXPECT_EQ(verifier.counters().signaturesChecked, 2);
+}
+} // namespace nostr_test
@@ -0,0 +1,141 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+using namespace ::testing;
+
+static const string authorKey = "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca";
+static const string otherKey = "13adc511de7e1cfcf1c6b7f6365fb5a03442d7bcacf565ea57fa7770912c023d";
+
+static shared_ptr<Event> matcherTestEvent(time_t createdAt = 1627846261)
+{
+    auto event = make_shared<Event>();
+    event->pubkey = fromHex<PublicKey>(authorKey);
+    event->createdAt = createdAt;
+    event->kind = 1;
+    event->tags = {
+        { "e", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" },
+        { "t", "nostr" }
+    };
+    event->content = "Hello, World!";
+    event->id = Event::fromString(event->serialize()).id;
+
+    return event;
+};
+
+TEST(FilterMatcherTest, Matches_EventSatisfyingEveryCondition)
+{
+    auto event = matcherTestEvent();
+
+    Filters filters;
+    filters.ids = { toHex(event->id) };
+    filters.authors = { otherKey, authorKey };
+    filters.kinds = { 0, 1 };
+    filters.tags["#t"] = { "bitcoin", "nostr" };
+    filters.tags["e"] = { "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" };
+    filters.since = event->createdAt;
+    filters.until = event->createdAt;
+
+    EXPECT_TRUE(filters.compile().matches(*event));
+};
+
+TEST(FilterMatcherTest, Rejects_EventFailingAnyCondition)
+{
+    auto event = matcherTestEvent();
+
+    Filters wrongAuthor;
+    wrongAuthor.authors = { otherKey };
+    EXPECT_FALSE(wrongAuthor.compile().matches(*event));
+
+    Filters wrongKind;
+    wrongKind.kinds = { 0, 7, 65535 };
+    EXPECT_FALSE(wrongKind.compile().matches(*event));
+
+    Filters wrongTag;
+    wrongTag.tags["t"] = { "bitcoin" };
+    EXPECT_FALSE(wrongTag.compile().matches(*event));
+
+    Filters missingTag;
+    missingTag.tags["p"] = { authorKey };
+    EXPECT_FALSE(missingTag.compile().matches(*event));
+
+    Filters tooOld;
+    tooOld.since = event->createdAt + 1;
+    EXPECT_FALSE(tooOld.compile().matches(*event));
+
+    Filters tooNew;
+    tooNew.until = event->createdAt - 1;
+    EXPECT_FALSE(tooNew.compile().matches(*event));
+
+    Filters invalidId;
+    invalidId.ids = { "5c83da77" };
+    EXPECT_FALSE(invalidId.compile().matches(*event));
+};
+
+TEST(FilterMatcherTest, Ignores_LaterChangesToFilters)
+{
+    auto event = matcherTestEvent();
+
+    Filters filters;
+    filters.authors = { authorKey };
+    auto matcher = filters.compile();
+    filters.authors = { otherKey };
+
+    EXPECT_TRUE(matcher.matches(*event));
+    EXPECT_FALSE(filters.compile().matches(*event));
+};
+
+TEST(FilterMatcherTest, Matches_ManyAuthors)
+{
+    Filters filters;
+    for (int i = 0; i < 1000; i++)
+    {
+        PublicKey key{};
+        key[0] = static_cast<uint8_t>(i);
+        key[1] = static_cast<uint8_t>(i >> 8);
+        key[31] = 1;
+        filters.authors.push_back(toHex(key));
+    }
+    auto matcher = filters.compile();
+
+    auto event = matcherTestEvent();
+    EXPECT_FALSE(matcher.matches(*event));
+
+    for (int i = 0; i < 1000; i += 37)
+    {
+        event->pubkey = PublicKey{};
+        event->pubkey[0] = static_cast<uint8_t>(i);
+        event->pubkey[1] = static_cast<uint8_t>(i >> 8);
+        event->pubkey[31] = 1;
+        EXPECT_TRUE(matcher.matches(*event));
+    }
+};
+
+TEST(FilterMatcherTest, Select_ReturnsNewestEventsUpToLimit)
+{
+    vector<shared_ptr<Event>> events;
+    for (time_t createdAt : { 100, 400, 200, 300, 400 })
+    {
+        events.push_back(matcherTestEvent(createdAt));
+    }
+    events[4]->content = "A different event at the same time.";
+    events[4]->id = Event::fromString(events[4]->serialize()).id;
+
+    auto unrelated = matcherTestEvent(500);
+    unrelated->kind = 7;
+    events.push_back(unrelated);
+
+    Filters filters;
+    filters.kinds = { 1 };
+    filters.limit = 3;
+    auto selected = filters.compile().select(events);
+
+    ASSERT_EQ(selected.size(), 3);
+    EXPECT_EQ(selected[0]->createdAt, 400);
+    EXPECT_EQ(selected[1]->createdAt, 400);
+    EXPECT_LT(selected[0]->id, selected[1]->id);
+    EXPECT_EQ(selected[2]->createdAt, 300);
+};
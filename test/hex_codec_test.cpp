@@ -0,0 +1,91 @@
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "encoding/hex_codec.hpp"
+
+using namespace nostr::encoding;
+using namespace std;
+
+namespace nostr_test
+{
+static string scalarHex(const vector<uint8_t>& bytes)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    string hex;
+    for (uint8_t byte : bytes)
+    {
+        hex += hexDigits[byte >> 4];
+        hex += hexDigits[byte & 0x0F];
+    }
+
+    return hex;
+}
+
+TEST(HexCodecTest, Encode_MatchesReference_ForAllLengths)
+{
+    // Lengths up to 100 exercise every combination of vector blocks and scalar tail.
+    for (size_t length = 0; length <= 100; length++)
+    {
+        vector<uint8_t> bytes(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            bytes[i] = static_cast<uint8_t>(i * 37 + length);
+        }
+
+        string hex(2 * length, '\0');
+        HexCodec::encode(bytes.data(), length, &hex[0]);
+
+        ASSERT_EQ(hex, scalarHex(bytes)) << "length " << length;
+    }
+}
+
+TEST(HexCodecTest, Decode_RoundTrips_ForAllLengthsAndCases)
+{
+    for (size_t length = 0; length <= 100; length++)
+    {
+        vector<uint8_t> bytes(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            bytes[i] = static_cast<uint8_t>(i * 91 + length);
+        }
+
+        string hex = scalarHex(bytes);
+        string upperHex = hex;
+        for (char& c : upperHex)
+        {
+            c = toupper(c);
+        }
+
+        vector<uint8_t> decoded(length);
+        ASSERT_TRUE(HexCodec::decode(hex.data(), length, decoded.data())) << "length " << length;
+        ASSERT_EQ(decoded, bytes);
+
+        vector<uint8_t> decodedUpper(length);
+        ASSERT_TRUE(HexCodec::decode(upperHex.data(), length, decodedUpper.data()));
+        ASSERT_EQ(decodedUpper, bytes);
+    }
+}
+
+TEST(HexCodecTest, Decode_RejectsNonHexCharacters_AtEveryPosition)
+{
+    const string invalidChars = "gG/:@`' \x7f\x80\xff";
+    const size_t length = 64;
+    string valid(2 * length, 'a');
+
+    for (size_t position = 0; position < valid.length(); position++)
+    {
+        for (char c : invalidChars)
+        {
+            string hex = valid;
+            hex[position] = c;
+
+            vector<uint8_t> decoded(length);
+            ASSERT_FALSE(HexCodec::decode(hex.data(), length, decoded.data()))
+                << "position " << position << ", char " << static_cast<int>(c);
+        }
+    }
+}
+} // namespace nostr_test
@@ -0,0 +1,348 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "data/data.hpp"
+#include "store/mmap_event_store.hpp"
+
+using namespace nostr;
+using namespace std;
+using namespace ::testing;
+
+namespace nostr_test
+{
+class MmapEventStoreTest : public testing::Test
+{
+public:
+    static data::Event testEvent(uint32_t number, const string& content = "Hello, World!")
+    {
+        data::Event event;
+        // The index slots IDs on their leading bytes, which are uniform in real, hashed IDs.
+        event.id[0] = static_cast<uint8_t>(number);
+        event.id[1] = static_cast<uint8_t>(number >> 8);
+        event.id[2] = static_cast<uint8_t>(number >> 16);
+        event.id[3] = static_cast<uint8_t>(number >> 24);
+        event.id[31] = 1;
+        event.pubkey = data::fromHex<data::PublicKey>(
+            "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+        event.createdAt = 1627846261 + number;
+        event.kind = 1;
+        event.tags.push_back({ "t", "test" });
+        event.tags.push_back({ "p", "3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d", "wss://relay.damus.io" });
+        event.content = content;
+        return event;
+    };
+
+protected:
+    string directory;
+
+    void SetUp() override
+    {
+        string pattern = (filesystem::temp_directory_path() / "aedile-store-XXXXXX").string();
+        ASSERT_NE(mkdtemp(pattern.data()), nullptr);
+        this->directory = pattern;
+    };
+
+    void TearDown() override
+    {
+        filesystem::remove_all(this->directory);
+    };
+
+    store::MmapEventStoreOptions smallGrowth()
+    {
+        store::MmapEventStoreOptions options;
+        options.growthSize = 4096;
+        return options;
+    };
+
+    /**
+     * @brief Flips one byte of the first record in the log whose content contains the marker.
+     */
+    void corruptRecord(const string& marker)
+    {
+        string path = this->directory + "/events.log";
+        ifstream input(path, ios::binary);
+        string log((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+        input.close();
+
+        size_t position = log.find(marker);
+        ASSERT_NE(position, string::npos);
+        log[position] ^= 0x20;
+
+        ofstream output(path, ios::binary | ios::trunc);
+        output.write(log.data(), log.size());
+    };
+};
+
+TEST_F(MmapEventStoreTest, Append_ThenFind_ReturnsEqualEvent)
+{
+    store::MmapEventStore eventStore(this->directory);
+    auto event = testEvent(1);
+
+    ASSERT_TRUE(eventStore.append(event));
+    auto found = eventStore.find(event.id);
+
+    ASSERT_NE(found, nullptr);
+    EXPECT_EQ(found->id, event.id);
+    EXPECT_EQ(found->pubkey, event.pubkey);
+    EXPECT_EQ(found->createdAt, event.createdAt);
+    EXPECT_EQ(found->kind, event.kind);
+    EXPECT_EQ(found->tags, event.tags);
+    EXPECT_EQ(string(found->content), string(event.content));
+    EXPECT_NE(found->pubkeyHandle, data::PublicKeyHandle::NONE);
+    EXPECT_EQ(eventStore.find(testEvent(2).id), nullptr);
+};
+
+TEST_F(MmapEventStoreTest, Append_RejectsDuplicates_AndEventsWithoutIds)
+{
+    store::MmapEventStore eventStore(this->directory);
+
+    EXPECT_TRUE(eventStore.append(testEvent(1)));
+    EXPECT_FALSE(eventStore.append(testEvent(1)));
+    EXPECT_THROW(eventStore.append(data::Event()), invalid_argument);
+    EXPECT_EQ(eventStore.size(), 1);
+};
+
+TEST_F(MmapEventStoreTest, Scan_VisitsEvents_InAppendOrder_UntilStopped)
+{
+    store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        eventStore.append(testEvent(i, "Event " + to_string(i)));
+    }
+
+    vector<uint32_t> visited;
+    eventStore.scan([&visited](shared_ptr<data::Event> event)
+    {
+        visited.push_back(static_cast<uint32_t>(event->createdAt - 1627846261));
+        return visited.size() < 60;
+    });
+
+    ASSERT_EQ(visited.size(), 60);
+    for (uint32_t i = 0; i < visited.size(); i++)
+    {
+        EXPECT_EQ(visited[i], i);
+    }
+};
+
+TEST_F(MmapEventStoreTest, Reopen_KeepsEvents)
+{
+    {
+        store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+        for (uint32_t i = 0; i < 500; i++)
+        {
+            eventStore.append(testEvent(i));
+        }
+    }
+
+    store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+    EXPECT_EQ(eventStore.size(), 500);
+    EXPECT_NE(eventStore.find(testEvent(0).id), nullptr);
+    EXPECT_NE(eventStore.find(testEvent(499).id), nullptr);
+    EXPECT_FALSE(eventStore.append(testEvent(250)));
+    EXPECT_TRUE(eventStore.append(testEvent(500)));
+};
+
+TEST_F(MmapEventStoreTest, Reopen_AfterCrash_KeepsUnflushedEvents)
+{
+    // The child process exits without closing the store, as it would on a crash.
+    EXPECT_EXIT(
+        {
+            auto eventStore = new store::MmapEventStore(this->directory, this->smallGrowth());
+            for (uint32_t i = 0; i < 10; i++)
+            {
+                eventStore->append(testEvent(i));
+            }
+            eventStore->flush();
+            for (uint32_t i = 10; i < 20; i++)
+            {
+                eventStore->append(testEvent(i));
+            }
+            _exit(0);
+        },
+        ExitedWithCode(0),
+        "");
+
+    store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+    EXPECT_EQ(eventStore.size(), 20);
+    EXPECT_NE(eventStore.find(testEvent(19).id), nullptr);
+};
+
+TEST_F(MmapEventStoreTest, Reopen_AfterCrash_DiscardsTornRecord_AndEverythingAfter)
+{
+    EXPECT_EXIT(
+        {
+            auto eventStore = new store::MmapEventStore(this->directory, this->smallGrowth());
+            for (uint32_t i = 0; i < 20; i++)
+            {
+                eventStore->append(testEvent(i, "Event " + to_string(i) + (i == 15 ? " torn" : "")));
+            }
+            _exit(0);
+        },
+        ExitedWithCode(0),
+        "");
+    this->corruptRecord("torn");
+
+    {
+        store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+        EXPECT_EQ(eventStore.size(), 15);
+        EXPECT_NE(eventStore.find(testEvent(14).id), nullptr);
+        EXPECT_EQ(eventStore.find(testEvent(15).id), nullptr);
+        EXPECT_EQ(eventStore.find(testEvent(19).id), nullptr);
+
+        // The discarded events can be stored again.
+        EXPECT_TRUE(eventStore.append(testEvent(15)));
+    }
+
+    store::MmapEventStore eventStore(this->directory, this->smallGrowth());
+    EXPECT_EQ(eventStore.size(), 16);
+    EXPECT_NE(eventStore.find(testEvent(15).id), nullptr);
+};
+
+TEST_F(MmapEventStoreTest, Reopen_RebuildsMissingIndex)
+{
+    {
+        store::MmapEventStore eventStore(this->directory);
+        for (uint32_t i = 0; i < 50; i++)
+        {
+            eventStore.append(testEvent(i));
+        }
+    }
+    filesystem::remove(this->directory + "/events.idx");
+
+    store::MmapEventStore eventStore(this->directory);
+    EXPECT_EQ(eventStore.size(), 50);
+    EXPECT_NE(eventStore.find(testEvent(42).id), nullptr);
+};
+TEST_F(MmapEventStoreTest, Query_ByAuthor_ReturnsNewestFirst_UpToLimit)
+{
+    store::MmapEventStore eventStore(this->directory);
+    string otherAuthor = "3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d";
+    for (uint32_t i = 0; i < 50; i++)
+    {
+        auto event = testEvent(i);
+        if (i % 2 == 1)
+        {
+            event.pubkey = data::fromHex<data::PublicKey>(otherAuthor);
+        }
+        eventStore.append(event);
+    }
+
+    data::Filters filters;
+    filters.authors = { otherAuthor };
+    filters.limit = 5;
+    auto events = eventStore.query(filters);
+
+    ASSERT_EQ(events.size(), 5);
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        EXPECT_EQ(events[i]->createdAt, 1627846261 + 49 - 2 * i);
+        EXPECT_EQ(events[i]->pubkey, data::fromHex<data::PublicKey>(otherAuthor));
+    }
+};
+
+TEST_F(MmapEventStoreTest, Query_CombinesConditions_AndTimeRange)
+{
+    store::MmapEventStore eventStore(this->directory);
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        auto event = testEvent(i);
+        event.kind = i % 4;
+        event.tags.clear();
+        event.tags.push_back({ "e", "event-" + to_string(i % 10) });
+        eventStore.append(event);
+    }
+
+    data::Filters filters;
+    filters.kinds = { 1, 3 };
+    filters.tags["#e"] = { "event-1", "event-3", "event-5" };
+    filters.since = 1627846261 + 20;
+    filters.until = 1627846261 + 79;
+    auto events = eventStore.query(filters);
+
+    // Kinds 1 and 3 are the odd events, and 18 of those from 20 to 79 have one of the tags.
+    ASSERT_EQ(events.size(), 18);
+    for (size_t i = 1; i < events.size(); i++)
+    {
+        EXPECT_GT(events[i - 1]->createdAt, events[i]->createdAt);
+    }
+    for (const auto& event : events)
+    {
+        EXPECT_THAT(event->kind, AnyOf(1, 3));
+        EXPECT_THAT(string(*event->tags.firstValue("e")), AnyOf("event-1", "event-3", "event-5"));
+    }
+};
+
+TEST_F(MmapEventStoreTest, Query_ByIds_AndWithoutIndexedConditions)
+{
+    store::MmapEventStore eventStore(this->directory);
+    for (uint32_t i = 0; i < 20; i++)
+    {
+        eventStore.append(testEvent(i));
+    }
+
+    data::Filters byIds;
+    byIds.ids = { data::toHex(testEvent(3).id), data::toHex(testEvent(7).id), data::toHex(testEvent(99).id) };
+    auto events = eventStore.query(byIds);
+    ASSERT_EQ(events.size(), 2);
+    EXPECT_EQ(events[0]->id, testEvent(7).id);
+    EXPECT_EQ(events[1]->id, testEvent(3).id);
+
+    data::Filters byTime;
+    byTime.since = 1627846261 + 10;
+    byTime.limit = 3;
+    events = eventStore.query(byTime);
+    ASSERT_EQ(events.size(), 3);
+    EXPECT_EQ(events[0]->id, testEvent(19).id);
+    EXPECT_EQ(events[2]->id, testEvent(17).id);
+};
+
+TEST_F(MmapEventStoreTest, Query_AfterReopen_UsesWrittenAndRebuiltPostings)
+{
+    // Enough events to write out the posting indexes, and some more that are only in the log.
+    const uint32_t eventCount = 70000;
+    {
+        store::MmapEventStore eventStore(this->directory);
+        for (uint32_t i = 0; i < eventCount; i++)
+        {
+            auto event = testEvent(i);
+            event.kind = i % 7;
+            event.tags.clear();
+            event.tags.push_back({ "t", "topic-" + to_string(i % 100) });
+            eventStore.append(event);
+        }
+    }
+    EXPECT_TRUE(filesystem::exists(this->directory + "/tags.pst"));
+
+    store::MmapEventStore eventStore(this->directory);
+    eventStore.append(testEvent(eventCount));
+
+    data::Filters filters;
+    filters.kinds = { 5 };
+    filters.tags["t"] = { "topic-12" };
+    filters.limit = 10;
+    auto events = eventStore.query(filters);
+
+    ASSERT_EQ(events.size(), 10);
+    for (const auto& event : events)
+    {
+        uint32_t number = static_cast<uint32_t>(event->createdAt - 1627846261);
+        EXPECT_EQ(number % 7, 5);
+        EXPECT_EQ(number % 100, 12);
+    }
+    EXPECT_EQ(events[0]->createdAt, 1627846261 + 69312);
+
+    data::Filters latest;
+    latest.kinds = { 1 };
+    latest.limit = 1;
+    events = eventStore.query(latest);
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0]->id, testEvent(eventCount).id);
+};
+
+} // namespace nostr_test
@@ -0,0 +1,239 @@
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "service/negentropy.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+class NegentropyTest : public testing::Test
+{
+public:
+    /**
+     * @brief Makes a distinct, well-spread ID for the given number.
+     */
+    static data::EventId testId(uint64_t number)
+    {
+        data::EventId id;
+        uint64_t state = number * 0x9e3779b97f4a7c15 + 1;
+        for (auto& byte : id)
+        {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            byte = static_cast<uint8_t>(state >> 56);
+        }
+        return id;
+    };
+
+    static time_t testCreatedAt(uint64_t number)
+    {
+        // Several events share each second, so bounds must sometimes split on ID prefixes.
+        return 1700000000 + static_cast<time_t>(number / 3);
+    };
+
+    static shared_ptr<service::NegentropyStorage> testStorage(const vector<uint64_t>& numbers)
+    {
+        auto storage = make_shared<service::NegentropyStorage>();
+        for (uint64_t number : numbers)
+        {
+            storage->insert(testCreatedAt(number), testId(number));
+        }
+        storage->seal();
+        return storage;
+    };
+
+    static vector<data::EventId> testIds(const vector<uint64_t>& numbers)
+    {
+        vector<data::EventId> ids;
+        for (uint64_t number : numbers)
+        {
+            ids.push_back(testId(number));
+        }
+        sort(ids.begin(), ids.end());
+        return ids;
+    };
+
+    /**
+     * @brief Runs a reconciliation to completion between two storages.
+     * @returns The number of messages the initiator sent.
+     */
+    static size_t reconcile(
+        shared_ptr<service::NegentropyStorage> initiatorStorage,
+        shared_ptr<service::NegentropyStorage> responderStorage,
+        size_t frameSizeLimit,
+        vector<data::EventId>& haveIds,
+        vector<data::EventId>& needIds)
+    {
+        service::Negentropy initiator(initiatorStorage, frameSizeLimit);
+        service::Negentropy responder(responderStorage, frameSizeLimit);
+
+        optional<string> message = initiator.initiate();
+        size_t messageCount = 0;
+        while (message.has_value())
+        {
+            messageCount++;
+            if (frameSizeLimit != 0)
+            {
+                EXPECT_LE(message->size(), frameSizeLimit);
+            }
+
+            string reply = responder.reconcile(*message);
+            if (frameSizeLimit != 0)
+            {
+                EXPECT_LE(reply.size(), frameSizeLimit);
+            }
+            message = initiator.reconcile(reply, haveIds, needIds);
+        }
+
+        sort(haveIds.begin(), haveIds.end());
+        sort(needIds.begin(), needIds.end());
+        return messageCount;
+    };
+};
+
+TEST_F(NegentropyTest, Fingerprint_MatchesReferenceValues)
+{
+    service::NegentropyStorage storage;
+    data::EventId ascending;
+    for (size_t i = 0; i < ascending.size(); i++)
+    {
+        ascending[i] = static_cast<uint8_t>(i + 1);
+    }
+    data::EventId ones;
+    ones.fill(0xff);
+    storage.insert(1, ascending);
+    storage.insert(2, ones);
+    storage.insert(3, ones);
+    storage.seal();
+
+    EXPECT_EQ(data::toHex(storage.fingerprint(0, 0)), "7f9c9e31ac8256ca2f258583df262dbc");
+    EXPECT_EQ(data::toHex(storage.fingerprint(0, 1)), "7ff62750b87eaf828d2373a16d07498f");
+
+    // The sum of two all-ones IDs carries through every word.
+    EXPECT_EQ(data::toHex(storage.fingerprint(1, 3)), "c66ec0b91041dd7d6987a5478d39fdb0");
+};
+
+TEST_F(NegentropyTest, Initiate_EmptyStorage_SendsEmptyIdList)
+{
+    service::Negentropy negentropy(testStorage({}));
+
+    string message = negentropy.initiate();
+
+    EXPECT_EQ(data::toHex(reinterpret_cast<const uint8_t*>(message.data()), message.size()), "6100000200");
+};
+
+TEST_F(NegentropyTest, Reconcile_SmallSets_FindsEachSidesMissingIds)
+{
+    vector<data::EventId> haveIds;
+    vector<data::EventId> needIds;
+    reconcile(testStorage({ 1, 2, 3, 4, 5 }), testStorage({ 3, 4, 5, 6, 7, 8 }), 0, haveIds, needIds);
+
+    EXPECT_EQ(haveIds, testIds({ 1, 2 }));
+    EXPECT_EQ(needIds, testIds({ 6, 7, 8 }));
+};
+
+TEST_F(NegentropyTest, Reconcile_LargeSets_SplitsRanges_WithinFrameSizeLimit)
+{
+    vector<uint64_t> initiatorNumbers;
+    vector<uint64_t> responderNumbers;
+    vector<uint64_t> expectedHave;
+    vector<uint64_t> expectedNeed;
+    for (uint64_t number = 0; number < 20000; number++)
+    {
+        // Most events are shared, and a scattering are held by only one side.
+        if (number % 97 == 0)
+        {
+            initiatorNumbers.push_back(number);
+            expectedHave.push_back(number);
+        }
+        else if (number % 89 == 0 || (number >= 15000 && number < 15600))
+        {
+            responderNumbers.push_back(number);
+            expectedNeed.push_back(number);
+        }
+        else
+        {
+            initiatorNumbers.push_back(number);
+            responderNumbers.push_back(number);
+        }
+    }
+
+    vector<data::EventId> haveIds;
+    vector<data::EventId> needIds;
+    size_t messageCount = reconcile(
+        testStorage(initiatorNumbers),
+        testStorage(responderNumbers),
+        4096,
+        haveIds,
+        needIds);
+
+    EXPECT_EQ(haveIds, testIds(expectedHave));
+    EXPECT_EQ(needIds, testIds(expectedNeed));
+    EXPECT_GT(messageCount, 2u);
+};
+
+TEST_F(NegentropyTest, Reconcile_IdenticalSets_CompletesAfterOneRoundTrip)
+{
+    vector<uint64_t> numbers;
+    for (uint64_t number = 0; number < 5000; number++)
+    {
+        numbers.push_back(number);
+    }
+
+    vector<data::EventId> haveIds;
+    vector<data::EventId> needIds;
+    size_t messageCount = reconcile(testStorage(numbers), testStorage(numbers), 0, haveIds, needIds);
+
+    EXPECT_EQ(messageCount, 1u);
+    EXPECT_TRUE(haveIds.empty());
+    EXPECT_TRUE(needIds.empty());
+};
+
+TEST_F(NegentropyTest, Reconcile_EmptyInitiator_NeedsEveryId)
+{
+    vector<uint64_t> numbers;
+    for (uint64_t number = 0; number < 1000; number++)
+    {
+        numbers.push_back(number);
+    }
+
+    vector<data::EventId> haveIds;
+    vector<data::EventId> needIds;
+    reconcile(testStorage({}), testStorage(numbers), 0, haveIds, needIds);
+
+    EXPECT_TRUE(haveIds.empty());
+    EXPECT_EQ(needIds, testIds(numbers));
+};
+
+TEST_F(NegentropyTest, Reconcile_OtherProtocolVersion_AnsweredWithOwnVersion)
+{
+    service::Negentropy responder(testStorage({ 1 }));
+
+    EXPECT_EQ(responder.reconcile(string(1, '\x62')), string(1, '\x61'));
+};
+
+TEST_F(NegentropyTest, Reconcile_MalformedMessage_Throws)
+{
+    service::Negentropy responder(testStorage({ 1 }));
+
+    EXPECT_THROW(responder.reconcile(""), invalid_argument);
+    EXPECT_THROW(responder.reconcile("{}"), invalid_argument);
+
+    // An ID list that claims more IDs than the message holds.
+    EXPECT_THROW(responder.reconcile(string("\x61\x00\x00\x02\x05", 5)), invalid_argument);
+};
+
+TEST_F(NegentropyTest, Constructor_UnsealedStorage_Throws)
+{
+    auto storage = make_shared<service::NegentropyStorage>();
+
+    EXPECT_THROW(service::Negentropy negentropy(storage), invalid_argument);
+    EXPECT_THROW(service::Negentropy negentropy(testStorage({}), 1024), invalid_argument);
+};
+} // namespace nostr_test
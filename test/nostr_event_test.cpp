@@ -11,7 +11,7 @@ shared_ptr<Event> testEvent()
 {
     auto event = make_shared<Event>();
 
-    event->pubkey = "13tn5ccv2guflxgffq4aj0hw5x39pz70zcdrfd6vym887gry38zys28dask";
+    event->pubkey = fromHex<PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
     event->createdAt = 1627846261;
     event->kind = 1;
     event->tags = {
@@ -38,8 +38,8 @@ TEST(NostrEventTest, Equivalent_Events_Have_Same_ID)
     auto event2WithId = Event::fromString(serializedEvent2);
 
     // Hash both serialized events using sha256
-    string id1 = event1WithId.id;
-    string id2 = event2WithId.id;
+    EventId id1 = event1WithId.id;
+    EventId id2 = event2WithId.id;
 
     // Verify that both hashes are equal
     ASSERT_EQ(id1, id2);
@@ -90,3 +90,106 @@ TEST(NostrEventTest, Special_Characters_Are_Escaped_When_Serialized)
     EXPECT_THAT(serializedBackslash, HasSubstr("\\\\"));
 }
 
+
+TEST(NostrEventTest, ID_Matches_Hash_Of_Canonical_JSON_Array)
+{
+    auto event = testEvent();
+    event->content = string("Quotes \" and \\ backslashes, ") + char(0x01) + char(0x1F) + char(0x7F)
+        + "\b\t\n\f\r and unicode: \xE2\x9C\x93 \xF0\x9F\x98\x80";
+    event->tags.push_back({ "t", string(3000, 'x') });
+
+    auto eventWithId = Event::fromString(event->serialize());
+
+    // Compute the expected ID from the canonical array as dumped by the JSON library.
+    nlohmann::json canonical = { 0, toHex(event->pubkey), event->createdAt, event->kind, event->tags, event->content };
+    string serialized = canonical.dump();
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    EVP_Digest(serialized.c_str(), serialized.length(), hash, NULL, EVP_sha256(), NULL);
+
+    char expectedId[2 * SHA256_DIGEST_LENGTH + 1];
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++)
+    {
+        snprintf(expectedId + 2 * i, 3, "%02x", hash[i]);
+    }
+
+    ASSERT_EQ(toHex(eventWithId.id), string(expectedId));
+}
+
+TEST(NostrEventTest, Repeat_Serialization_Of_Unchanged_Event_Returns_Same_Buffer)
+{
+    auto event = testEvent();
+
+    auto first = event->serializeShared();
+    auto second = event->serializeShared();
+
+    ASSERT_EQ(first, second);
+    ASSERT_EQ(event->serialize(), *first);
+}
+
+TEST(NostrEventTest, Serialization_Reflects_Direct_Field_Changes)
+{
+    auto event = testEvent();
+    auto original = event->serializeShared();
+    EventId originalId = event->id;
+
+    event->content = "Goodbye, World!";
+    auto changedContent = event->serializeShared();
+    EXPECT_NE(changedContent, original);
+    EXPECT_NE(event->id, originalId);
+    EXPECT_THAT(*changedContent, HasSubstr("Goodbye, World!"));
+
+    event->content = "Hello, World!";
+    event->tags.push_back({ "t", "nostr" });
+    event->serializeShared();
+    EXPECT_NE(event->id, originalId);
+
+    // A new event with the original fields has the original ID.
+    auto copy = testEvent();
+    copy->serializeShared();
+    EXPECT_EQ(copy->id, originalId);
+}
+
+TEST(NostrEventTest, Serialization_Reflects_Tags_Moved_Out_And_Back)
+{
+    auto event = testEvent();
+    event->serializeShared();
+    EventId originalId = event->id;
+
+    Tags tags = move(event->tags);
+    EXPECT_TRUE(event->tags.empty());
+    event->serializeShared();
+    EXPECT_NE(event->id, originalId);
+
+    event->tags = tags;
+    event->serializeShared();
+    EXPECT_EQ(event->id, originalId);
+}
+
+TEST(NostrEventTest, Assigning_To_Arena_Event_Does_Not_Take_Cached_Json)
+{
+    auto heapEvent = testEvent();
+    auto heapJson = heapEvent->serializeShared();
+
+    auto arena = EventArena::create();
+    auto arenaEvent = arena->makeEvent();
+    *arenaEvent = *heapEvent;
+    auto arenaJson = arenaEvent->serializeShared();
+
+    EXPECT_NE(arenaJson, heapJson);
+    EXPECT_EQ(*arenaJson, *heapJson);
+    EXPECT_EQ(arenaEvent->id, heapEvent->id);
+}
+
+TEST(NostrEventTest, Signing_Rerenders_Json_Without_Changing_ID)
+{
+    auto event = testEvent();
+    auto unsignedJson = event->serializeShared();
+    EventId id = event->id;
+
+    event->sig.fill(0xab);
+    auto signedJson = event->serializeShared();
+
+    EXPECT_NE(signedJson, unsignedJson);
+    EXPECT_EQ(event->id, id);
+    EXPECT_EQ(Event::fromString(*signedJson).sig, event->sig);
+}
@@ -1,15 +1,26 @@
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
 #include <future>
 #include <iostream>
+#include <stdexcept>
+#include <thread>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <nlohmann/json.hpp>
+#include <noscrypt.h>
+#include <noscryptutil.h>
 #include <plog/Appenders/ConsoleAppender.h>
 #include <plog/Formatters/TxtFormatter.h>
 #include <websocketpp/client.hpp>
 
+#include "service/negentropy.hpp"
 #include "service/nostr_service_base.hpp"
+#include "store/mmap_event_store.hpp"
 
 using namespace nostr;
 using namespace std;
@@ -31,6 +42,239 @@ public:
     MOCK_METHOD(void, closeConnection, (string uri), (override));
 };
 
+class MockEventStore : public store::IEventStore
+{
+public:
+    MOCK_METHOD(bool, append, (const data::Event& event), (override));
+    MOCK_METHOD(shared_ptr<data::Event>, find, (const data::EventId& id), (override));
+    MOCK_METHOD(vector<shared_ptr<data::Event>>, query, (const data::Filters& filters), (override));
+    MOCK_METHOD(void, scan, (function<bool(shared_ptr<data::Event>)> visitor), (override));
+    MOCK_METHOD(size_t, size, (), (override));
+    MOCK_METHOD(void, flush, (), (override));
+};
+
+/**
+ * @brief A mock client that records the shared buffers passed to it, and accepts every event.
+ */
+class SharedFrameWebSocketClient : public MockWebSocketClient
+{
+public:
+    vector<shared_ptr<const string>> sentFrames;
+    mutex sentFramesMutex;
+
+    tuple<string, bool> send(
+        shared_ptr<const string> message,
+        string uri,
+        function<void(const string&)> messageHandler) override
+    {
+        {
+            lock_guard<mutex> lock(this->sentFramesMutex);
+            this->sentFrames.push_back(message);
+        }
+
+        json messageArr = json::parse(*message);
+        auto event = nostr::data::Event::fromJson(messageArr[1]);
+        messageHandler(json::array({ "OK", nostr::data::toHex(event.id), true, "" }).dump());
+
+        return make_tuple(uri, true);
+    };
+};
+
+/**
+ * @brief A stand-in relay that answers the messages sent to it from its own set of events, on
+ * its own thread, as a relay process would.  It supports REQ, EVENT, and the NIP-77 messages.
+ * @remark An unruly relay also closes each request after ending it, and answers each upload
+ * for an event it was not sent before answering for the event itself.
+ */
+class StandInRelayClient : public MockWebSocketClient
+{
+public:
+    explicit StandInRelayClient(vector<nostr::data::Event> events, bool isUnruly = false)
+        : _events(events), _isUnruly(isUnruly)
+    {
+        this->_worker = thread([this]() { this->_run(); });
+    };
+
+    ~StandInRelayClient() override
+    {
+        {
+            lock_guard<mutex> lock(this->_mutex);
+            this->_isStopping = true;
+        }
+        this->_received.notify_all();
+        this->_worker.join();
+    };
+
+    tuple<string, bool> send(string message, string uri) override
+    {
+        this->_enqueue(message);
+        return make_tuple(uri, true);
+    };
+
+    tuple<string, bool> send(string message, string uri, function<void(const string&)> messageHandler) override
+    {
+        {
+            lock_guard<mutex> lock(this->_mutex);
+            this->_messageHandler = messageHandler;
+        }
+        this->_enqueue(message);
+        return make_tuple(uri, true);
+    };
+
+    vector<nostr::data::Event> events()
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        return this->_events;
+    };
+
+    ///< The filter of the last NEG-OPEN message received.
+    json negentropyFilter()
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        return this->_negentropyFilter;
+    };
+
+private:
+    mutex _mutex;
+    condition_variable _received;
+    deque<string> _inbox;
+    bool _isStopping = false;
+    function<void(const string&)> _messageHandler;
+    vector<nostr::data::Event> _events;
+    bool _isUnruly;
+    json _negentropyFilter;
+    unique_ptr<nostr::service::Negentropy> _negentropy;
+    thread _worker;
+
+    void _enqueue(const string& message)
+    {
+        {
+            lock_guard<mutex> lock(this->_mutex);
+            this->_inbox.push_back(message);
+        }
+        this->_received.notify_all();
+    };
+
+    void _run()
+    {
+        while (true)
+        {
+            string message;
+            {
+                unique_lock<mutex> lock(this->_mutex);
+                this->_received.wait(lock, [this]() { return this->_isStopping || !this->_inbox.empty(); });
+                if (this->_inbox.empty())
+                {
+                    return;
+                }
+                message = this->_inbox.front();
+                this->_inbox.pop_front();
+            }
+
+            vector<string> replies = this->_respond(json::parse(message));
+
+            function<void(const string&)> messageHandler;
+            {
+                lock_guard<mutex> lock(this->_mutex);
+                messageHandler = this->_messageHandler;
+            }
+            for (const string& reply : replies)
+            {
+                messageHandler(reply);
+            }
+        }
+    };
+
+    vector<string> _respond(const json& message)
+    {
+        lock_guard<mutex> lock(this->_mutex);
+        string label = message.at(0);
+        vector<string> replies;
+
+        if (label == "NEG-OPEN")
+        {
+            this->_negentropyFilter = message.at(2);
+            auto storage = make_shared<nostr::service::NegentropyStorage>();
+            for (const auto& event : this->_events)
+            {
+                storage->insert(event.createdAt, event.id);
+            }
+            storage->seal();
+            this->_negentropy = make_unique<nostr::service::Negentropy>(storage);
+        }
+        if (label == "NEG-OPEN" || label == "NEG-MSG")
+        {
+            string hex = message.at(label == "NEG-OPEN" ? 3 : 2);
+            string query(hex.size() / 2, '\0');
+            nostr::data::fromHex(hex, reinterpret_cast<uint8_t*>(query.data()), query.size());
+            string reply = this->_negentropy->reconcile(query);
+            replies.push_back(json::array({
+                "NEG-MSG",
+                message.at(1),
+                nostr::data::toHex(reinterpret_cast<const uint8_t*>(reply.data()), reply.size())
+            }).dump());
+        }
+        else if (label == "REQ")
+        {
+            for (const auto& id : message.at(2).at("ids"))
+            {
+                for (auto& event : this->_events)
+                {
+                    if (nostr::data::toHex(event.id) == id.get<string>())
+                    {
+                        replies.push_back(json::array({ "EVENT", message.at(1), json::parse(event.serialize()) }).dump());
+                    }
+                }
+            }
+            replies.push_back(json::array({ "EOSE", message.at(1) }).dump());
+            if (this->_isUnruly)
+            {
+                replies.push_back(json::array({ "CLOSED", message.at(1), "" }).dump());
+            }
+        }
+        else if (label == "EVENT")
+        {
+            auto event = nostr::data::Event::fromJson(message.at(1));
+            this->_events.push_back(event);
+            if (this->_isUnruly)
+            {
+                replies.push_back(json::array({ "OK", string(64, 'f'), true, "" }).dump());
+            }
+            replies.push_back(json::array({ "OK", nostr::data::toHex(event.id), true, "" }).dump());
+        }
+
+        return replies;
+    };
+};
+
+/**
+ * @brief Signs events with a test key derived from the given seed, replacing their authors.
+ */
+static void signTestEvent(nostr::data::Event& event, uint8_t keySeed = 1)
+{
+    static const shared_ptr<NCContext> context = []()
+    {
+        shared_ptr<NCContext> context(NCUtilContextAlloc(), &NCUtilContextFree);
+        uint8_t entropy[NC_CONTEXT_ENTROPY_SIZE] = { 0 };
+        NCInitContext(context.get(), entropy);
+        return context;
+    }();
+
+    NCSecretKey secretKey;
+    for (size_t i = 0; i < sizeof(secretKey.key); i++)
+    {
+        secretKey.key[i] = static_cast<uint8_t>(i + keySeed);
+    }
+    NCPublicKey publicKey;
+    NCGetPublicKey(context.get(), &secretKey, &publicKey);
+
+    memcpy(event.pubkey.data(), publicKey.key, sizeof(publicKey.key));
+    event.serialize();
+
+    uint8_t random[32] = { 0 };
+    NCSignDigest(context.get(), &secretKey, random, event.id.data(), event.sig.data());
+};
+
 class NostrServiceBaseTest : public testing::Test
 {
 public:
@@ -43,7 +287,7 @@ public:
     static const nostr::data::Event getTextNoteTestEvent()
     {
         nostr::data::Event event;
-        event.pubkey = "13tn5ccv2guflxgffq4aj0hw5x39pz70zcdrfd6vym887gry38zys28dask";
+        event.pubkey = nostr::data::fromHex<nostr::data::PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
         event.kind = 1;
         event.tags =
         {
@@ -62,7 +306,7 @@ public:
         std::time_t currentTime = std::chrono::system_clock::to_time_t(now);
 
         nostr::data::Event event1;
-        event1.pubkey = "13tn5ccv2guflxgffq4aj0hw5x39pz70zcdrfd6vym887gry38zys28dask";
+        event1.pubkey = nostr::data::fromHex<nostr::data::PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
         event1.kind = 1;
         event1.tags =
         {
@@ -74,7 +318,7 @@ public:
         event1.createdAt = currentTime;
 
         nostr::data::Event event2;
-        event2.pubkey = "1l9d9jh67rkwayalrxcy686aujyz5pper5kzjv8jvg8pu9v9ns4ls0xvq42";
+        event2.pubkey = nostr::data::fromHex<nostr::data::PublicKey>("3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d");
         event2.kind = 1;
         event2.tags =
         {
@@ -86,7 +330,7 @@ public:
         event2.createdAt = currentTime;
         
         nostr::data::Event event3;
-        event3.pubkey = "187ujhtmnv82ftg03h4heetwk3dd9mlfkf8th3fvmrk20nxk9mansuzuyla";
+        event3.pubkey = nostr::data::fromHex<nostr::data::PublicKey>("82341f882b6eabcd2ba7f1ef90aad961cf074af15b9ef44a09f9d2a8fbfbe6a2");
         event3.kind = 1;
         event3.tags =
         {
@@ -103,7 +347,7 @@ public:
     static const nostr::data::Event getLongFormTestEvent()
     {
         nostr::data::Event event;
-        event.pubkey = "13tn5ccv2guflxgffq4aj0hw5x39pz70zcdrfd6vym887gry38zys28dask";
+        event.pubkey = nostr::data::fromHex<nostr::data::PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
         event.kind = 30023;
         event.tags =
         {
@@ -126,6 +370,62 @@ public:
         return jarr.dump();
     }
 
+    /**
+     * @brief An old and a new version of a signed profile, and a signed note by the same author.
+     */
+    static const tuple<nostr::data::Event, nostr::data::Event, nostr::data::Event> getProfileVersionTestEvents()
+    {
+        nostr::data::Event oldProfile = getTextNoteTestEvent();
+        oldProfile.kind = 0;
+        oldProfile.content = R"({"name":"old"})";
+        oldProfile.createdAt = 1700000000;
+        signTestEvent(oldProfile);
+
+        nostr::data::Event newProfile = oldProfile;
+        newProfile.content = R"({"name":"new"})";
+        newProfile.createdAt = 1700000100;
+        signTestEvent(newProfile);
+
+        nostr::data::Event note = getTextNoteTestEvent();
+        note.createdAt = 1700000050;
+        signTestEvent(note);
+
+        return { oldProfile, newProfile, note };
+    };
+
+    static nostr::service::EventVerifierOptions signingVerifierOptions()
+    {
+        nostr::service::EventVerifierOptions options;
+        options.verifySignatures = true;
+        return options;
+    };
+
+    /**
+     * @brief Has each relay answer every query with the given events, followed by an EOSE.
+     */
+    void expectRelayEvents(unordered_map<string, vector<nostr::data::Event>> relayEvents)
+    {
+        EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+            .WillRepeatedly(Invoke([relayEvents](
+                string message,
+                string uri,
+                function<void(const string&)> messageHandler)
+            {
+                string subscriptionId = json::parse(message).at(1);
+                for (auto event : relayEvents.at(uri))
+                {
+                    auto sendableEvent = make_shared<nostr::data::Event>(event);
+                    json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                    messageHandler(jarr.dump());
+                }
+                messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+                return make_tuple(uri, true);
+            }));
+        EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+            .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+    };
+
     static const nostr::data::Filters getKind0And1TestFilters()
     {
         nostr::data::Filters filters;
@@ -444,9 +744,9 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_AllSuccesses)
         .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
         {
             json messageArr = json::parse(message);
-            auto event = nostr::data::Event::fromString(messageArr[1]);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
 
-            json jarr = json::array({ "OK", event.id, true, "Event accepted" });
+            json jarr = json::array({ "OK", nostr::data::toHex(event.id), true, "Event accepted" });
             messageHandler(jarr.dump());
 
             return make_tuple(uri, true);
@@ -464,6 +764,45 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_AllSuccesses)
     ASSERT_EQ(failures.size(), 0);
 };
 
+TEST_F(NostrServiceBaseTest, PublishEvent_IgnoresAnswers_ForOtherEvents)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // Each relay first answers for another event published on the same connection.
+    EXPECT_CALL(*mockClient, send(_, _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            json messageArr = json::parse(message);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
+
+            string otherId(64, 'a');
+            messageHandler(json::array({ "OK", otherId, false, "blocked: other event" }).dump());
+            messageHandler(json::array({ "OK", nostr::data::toHex(event.id), true, "Event accepted" }).dump());
+
+            return make_tuple(uri, true);
+        }));
+
+    auto testEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+    auto result = nostrService->publishEvent(testEvent, nostr::service::RequestOptions());
+
+    ASSERT_EQ(result.relayStatuses.size(), defaultTestRelays.size());
+    for (const string& relay : defaultTestRelays)
+    {
+        EXPECT_EQ(result.relayStatuses[relay], nostr::service::RelayRequestStatus::COMPLETED);
+        EXPECT_EQ(result.relayMessages[relay], "Event accepted");
+    }
+};
+
 TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_AllFailures)
 {
     mutex connectionStatusMutex;
@@ -547,9 +886,9 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_MixedSuccessesAndFa
         .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
         {
             json messageArr = json::parse(message);
-            auto event = nostr::data::Event::fromString(messageArr[1]);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
 
-            json jarr = json::array({ "OK", event.id, true, "Event accepted" });
+            json jarr = json::array({ "OK", nostr::data::toHex(event.id), true, "Event accepted" });
             messageHandler(jarr.dump());
 
             return make_tuple(uri, true);
@@ -596,9 +935,9 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_RejectedEvent)
         .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
         {
             json messageArr = json::parse(message);
-            auto event = nostr::data::Event::fromString(messageArr[1]);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
 
-            json jarr = json::array({ "OK", event.id, false, "Event rejected" });
+            json jarr = json::array({ "OK", nostr::data::toHex(event.id), false, "Event rejected" });
             messageHandler(jarr.dump());
 
             return make_tuple(uri, true);
@@ -646,9 +985,9 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_EventRejectedBySome
         .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
         {
             json messageArr = json::parse(message);
-            auto event = nostr::data::Event::fromString(messageArr[1]);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
 
-            json jarr = json::array({ "OK", event.id, true, "Event accepted" });
+            json jarr = json::array({ "OK", nostr::data::toHex(event.id), true, "Event accepted" });
             messageHandler(jarr.dump());
 
             return make_tuple(uri, true);
@@ -658,9 +997,9 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_EventRejectedBySome
         .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
         {
             json messageArr = json::parse(message);
-            auto event = nostr::data::Event::fromString(messageArr[1]);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
 
-            json jarr = json::array({ "OK", event.id, false, "Event rejected" });
+            json jarr = json::array({ "OK", nostr::data::toHex(event.id), false, "Event rejected" });
             messageHandler(jarr.dump());
 
             return make_tuple(uri, true);
@@ -676,6 +1015,130 @@ TEST_F(NostrServiceBaseTest, PublishEvent_CorrectlyIndicates_EventRejectedBySome
     ASSERT_EQ(failures[0], defaultTestRelays[1]);
 };
 
+TEST_F(NostrServiceBaseTest, PublishEvent_DeadlinePasses_ReportsSilentRelayTimedOut)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The first relay accepts the event, and the second never answers.
+    EXPECT_CALL(*mockClient, send(_, defaultTestRelays[0], _))
+        .WillOnce(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            json messageArr = json::parse(message);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
+            messageHandler(json::array({ "OK", nostr::data::toHex(event.id), true, "" }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(_, defaultTestRelays[1], _))
+        .WillOnce(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            return make_tuple(uri, true);
+        }));
+
+    auto testEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+    auto options = nostr::service::RequestOptions::withTimeout(chrono::milliseconds(50));
+    auto result = nostrService->publishEvent(testEvent, options);
+
+    EXPECT_EQ(result.relayStatuses.at(defaultTestRelays[0]), nostr::service::RelayRequestStatus::COMPLETED);
+    EXPECT_EQ(result.relayStatuses.at(defaultTestRelays[1]), nostr::service::RelayRequestStatus::TIMED_OUT);
+};
+
+TEST_F(NostrServiceBaseTest, PublishEvent_Quorum_ReturnsAfterFirstAcceptance_AndReportsLaterAnswers)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The first relay accepts the event at once, and the second answers only later.
+    function<void(const string&)> slowRelayHandler;
+    EXPECT_CALL(*mockClient, send(_, defaultTestRelays[0], _))
+        .WillOnce(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            json messageArr = json::parse(message);
+            auto event = nostr::data::Event::fromJson(messageArr[1]);
+            messageHandler(json::array({ "OK", nostr::data::toHex(event.id), true, "saved" }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(_, defaultTestRelays[1], _))
+        .WillOnce(Invoke([&slowRelayHandler](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            slowRelayHandler = messageHandler;
+            return make_tuple(uri, true);
+        }));
+
+    vector<tuple<string, nostr::service::RelayRequestStatus, string>> lateAnswers;
+    nostr::service::RequestOptions options;
+    options.completion = nostr::service::CompletionPolicy::firstK(1);
+    options.lateAnswerHandler = [&lateAnswers](
+        const string& relay,
+        nostr::service::RelayRequestStatus status,
+        const string& message)
+    {
+        lateAnswers.emplace_back(relay, status, message);
+    };
+
+    auto testEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+    auto result = nostrService->publishEvent(testEvent, options);
+
+    EXPECT_EQ(result.relayStatuses.at(defaultTestRelays[0]), nostr::service::RelayRequestStatus::COMPLETED);
+    EXPECT_EQ(result.relayStatuses.at(defaultTestRelays[1]), nostr::service::RelayRequestStatus::SUPERSEDED);
+    EXPECT_EQ(result.relayMessages.at(defaultTestRelays[0]), "saved");
+    EXPECT_TRUE(lateAnswers.empty());
+
+    ASSERT_TRUE(slowRelayHandler);
+    slowRelayHandler(json::array({ "OK", nostr::data::toHex(testEvent->id), false, "blocked: spam" }).dump());
+
+    ASSERT_EQ(lateAnswers.size(), 1u);
+    EXPECT_EQ(get<0>(lateAnswers[0]), defaultTestRelays[1]);
+    EXPECT_EQ(get<1>(lateAnswers[0]), nostr::service::RelayRequestStatus::REJECTED);
+    EXPECT_EQ(get<2>(lateAnswers[0]), "blocked: spam");
+};
+
+TEST_F(NostrServiceBaseTest, PublishEvent_SendsOneSharedFrame_ToAllRelays)
+{
+    auto sharedFrameClient = make_shared<SharedFrameWebSocketClient>();
+    EXPECT_CALL(*sharedFrameClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        sharedFrameClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    auto testEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+    auto [successes, failures] = nostrService->publishEvent(testEvent);
+
+    ASSERT_EQ(successes.size(), defaultTestRelays.size());
+    ASSERT_EQ(sharedFrameClient->sentFrames.size(), defaultTestRelays.size());
+    EXPECT_EQ(sharedFrameClient->sentFrames[0], sharedFrameClient->sentFrames[1]);
+
+    // The event is sent as a JSON object, not as a string holding the object.
+    json frame = json::parse(*sharedFrameClient->sentFrames[0]);
+    EXPECT_EQ(frame[0], "EVENT");
+    EXPECT_TRUE(frame[1].is_object());
+    EXPECT_EQ(frame[1]["id"], nostr::data::toHex(testEvent->id));
+};
+
 TEST_F(NostrServiceBaseTest, QueryRelays_ReturnsEvents_UpToEOSE)
 {
     mutex connectionStatusMutex;
@@ -768,7 +1231,7 @@ TEST_F(NostrServiceBaseTest, QueryRelays_ReturnsEvents_UpToEOSE)
     ASSERT_TRUE(subscriptions.empty());
 };
 
-TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
+TEST_F(NostrServiceBaseTest, QueryRelays_DropsEvents_WithMismatchedIds)
 {
     mutex connectionStatusMutex;
     auto connectionStatus = make_shared<unordered_map<string, bool>>();
@@ -794,17 +1257,9 @@ TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
     nostrService->openRelayConnections();
 
     auto testEvents = getMultipleTextNoteTestEvents();
-    vector<shared_ptr<nostr::data::Event>> sendableTestEvents;
-    for (nostr::data::Event testEvent : testEvents)
-    {
-        auto event = make_shared<nostr::data::Event>(testEvent);
-        auto serializedEvent = event->serialize();
-        auto deserializedEvent = nostr::data::Event::fromString(serializedEvent);
-
-        event = make_shared<nostr::data::Event>(deserializedEvent);
-        sendableTestEvents.push_back(event);
-    }
 
+    // Each relay sends every test event, but alters the content of the first one after its ID
+    // has been computed.
     EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
         .Times(2)
         .WillRepeatedly(Invoke([&testEvents](
@@ -815,10 +1270,16 @@ TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
             json messageArr = json::parse(message);
             string subscriptionId = messageArr.at(1);
 
-            for (auto event : testEvents)
+            for (size_t i = 0; i < testEvents.size(); i++)
             {
-                auto sendableEvent = make_shared<nostr::data::Event>(event);
-                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                auto sendableEvent = make_shared<nostr::data::Event>(testEvents[i]);
+                json eventJson = json::parse(sendableEvent->serialize());
+                if (i == 0)
+                {
+                    eventJson["content"] = "Tampered content";
+                }
+
+                json jarr = json::array({ "EVENT", subscriptionId, eventJson });
                 messageHandler(jarr.dump());
             }
 
@@ -827,46 +1288,6 @@ TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
 
             return make_tuple(uri, true);
         }));
-
-    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
-    promise<void> eoseReceivedPromise;
-    auto eoseReceivedFuture = eoseReceivedPromise.get_future();
-    int eoseCount = 0;
-
-    string generatedSubscriptionId = nostrService->queryRelays(
-        filters,
-        [&generatedSubscriptionId, &sendableTestEvents](const string& subscriptionId, shared_ptr<nostr::data::Event> event)
-        {
-            ASSERT_STREQ(subscriptionId.c_str(), generatedSubscriptionId.c_str());
-            ASSERT_NE(
-                find_if(
-                    sendableTestEvents.begin(),
-                    sendableTestEvents.end(),
-                    [&event](shared_ptr<nostr::data::Event> testEvent)
-                    {
-                        return *testEvent == *event;
-                    }),
-                sendableTestEvents.end());
-        },
-        [&generatedSubscriptionId, &eoseReceivedPromise, &eoseCount]
-        (const string& subscriptionId)
-        {
-            ASSERT_STREQ(subscriptionId.c_str(), generatedSubscriptionId.c_str());
-
-            if (++eoseCount == 2)
-            {
-                eoseReceivedPromise.set_value();
-            }
-        },
-        [](const string&, const string&) {});
-
-    eoseReceivedFuture.wait();
-
-    // Check that the service is keeping track of its active subscriptions.
-    auto subscriptions = nostrService->subscriptions();
-    ASSERT_NO_THROW(subscriptions.at(generatedSubscriptionId));
-    ASSERT_EQ(subscriptions.at(generatedSubscriptionId).size(), 2);
-
     EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
         .Times(2)
         .WillRepeatedly(Invoke([](string message, string uri)
@@ -874,22 +1295,26 @@ TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
             return make_tuple(uri, true);
         }));
 
-    auto [successes, failures] = nostrService->closeSubscription(generatedSubscriptionId);
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto results = nostrService->queryRelays(filters).get();
 
-    ASSERT_TRUE(failures.empty());
+    ASSERT_EQ(results.size(), testEvents.size() - 1);
+    for (auto resultEvent : results)
+    {
+        ASSERT_NE(resultEvent->content, "Tampered content");
+    }
 
-    // Check that the service has forgotten about the subscriptions after closing them.
-    subscriptions = nostrService->subscriptions();
-    ASSERT_TRUE(subscriptions.empty());
+    auto counters = nostrService->eventVerifier()->counters();
+    ASSERT_EQ(counters.eventsRejected, 2);
+    ASSERT_EQ(counters.eventsVerified, 2 * (testEvents.size() - 1));
 };
 
-TEST_F(NostrServiceBaseTest, Service_MaintainsMultipleSubscriptions_ThenClosesAll)
+TEST_F(NostrServiceBaseTest, QueryRelays_SendsMultipleFilters_InOneRequest)
 {
-    // Mock connections.
     mutex connectionStatusMutex;
     auto connectionStatus = make_shared<unordered_map<string, bool>>();
-    vector<string> testRelays = { "wss://theforest.nostr1.com" };
-    connectionStatus->insert({ testRelays[0], false });
+    connectionStatus->insert({ defaultTestRelays[0], false });
+    connectionStatus->insert({ defaultTestRelays[1], false });
 
     EXPECT_CALL(*mockClient, isConnected(_))
         .WillRepeatedly(Invoke([connectionStatus, &connectionStatusMutex](string uri)
@@ -906,7 +1331,1221 @@ TEST_F(NostrServiceBaseTest, Service_MaintainsMultipleSubscriptions_ThenClosesAl
     auto nostrService = make_unique<nostr::service::NostrServiceBase>(
         testAppender,
         mockClient,
-        testRelays);
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    auto longFormEvent = getLongFormTestEvent();
+    longFormEvent.createdAt = testEvents[0].createdAt;
+    testEvents.push_back(longFormEvent);
+
+    // Each relay receives one REQ carrying both filters, and answers it with one EOSE.
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            json messageArr = json::parse(message);
+            EXPECT_EQ(messageArr.size(), 4);
+            EXPECT_EQ(messageArr.at(2).at("kinds"), json::array({ 0, 1 }));
+            EXPECT_EQ(messageArr.at(3).at("kinds"), json::array({ 30023 }));
+            string subscriptionId = messageArr.at(1);
+
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+
+            json jarr = json::array({ "EOSE", subscriptionId });
+            messageHandler(jarr.dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri)
+        {
+            return make_tuple(uri, true);
+        }));
+
+    vector<shared_ptr<nostr::data::Filters>> filters = {
+        make_shared<nostr::data::Filters>(getKind0And1TestFilters()),
+        make_shared<nostr::data::Filters>(getKind30023TestFilters())
+    };
+    auto results = nostrService->queryRelays(filters).get();
+
+    ASSERT_EQ(results.size(), testEvents.size());
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_WritesReceivedEvents_ToEventStore)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    // Both relays return every event, and the service offers each copy to the store.
+    auto eventStore = make_shared<MockEventStore>();
+    EXPECT_CALL(*eventStore, append(_))
+        .Times(testEvents.size() * defaultTestRelays.size())
+        .WillRepeatedly(Return(true));
+    nostrService->setEventStore(eventStore);
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto results = nostrService->queryRelays(filters).get();
+
+    ASSERT_EQ(results.size(), testEvents.size());
+    ASSERT_EQ(nostrService->eventStore(), eventStore);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_KeepsOnlyNewestVersion_OfReplaceableEvents)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays,
+        make_shared<nostr::service::EventVerifier>(signingVerifierOptions()));
+    nostrService->openRelayConnections();
+
+    auto [oldProfile, newProfile, note] = getProfileVersionTestEvents();
+    expectRelayEvents({
+        { defaultTestRelays[0], { oldProfile, note } },
+        { defaultTestRelays[1], { newProfile, oldProfile } }
+    });
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto results = nostrService->queryRelays(filters).get();
+
+    ASSERT_EQ(results.size(), 2u);
+    size_t profileCount = 0;
+    for (const auto& event : results)
+    {
+        if (event->kind == 0)
+        {
+            profileCount++;
+            EXPECT_EQ(event->content, newProfile.content);
+        }
+    }
+    EXPECT_EQ(profileCount, 1u);
+    EXPECT_EQ(nostrService->replaceableEvents()->size(), 1u);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_DoesNotRecordVersions_WhenSignaturesAreNotVerified)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    auto [oldProfile, newProfile, note] = getProfileVersionTestEvents();
+    expectRelayEvents({
+        { defaultTestRelays[0], { oldProfile, note } },
+        { defaultTestRelays[1], { newProfile, oldProfile } }
+    });
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto results = nostrService->queryRelays(filters).get();
+
+    // The query still keeps the newest version it received, but no version is trusted to hide
+    // others from later queries.
+    EXPECT_EQ(results.size(), 2u);
+    EXPECT_EQ(nostrService->replaceableEvents()->size(), 0u);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_ForIds_ReturnsTheNamedVersions)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays,
+        make_shared<nostr::service::EventVerifier>(signingVerifierOptions()));
+    nostrService->openRelayConnections();
+
+    auto [oldProfile, newProfile, note] = getProfileVersionTestEvents();
+    expectRelayEvents({
+        { defaultTestRelays[0], { oldProfile } },
+        { defaultTestRelays[1], { newProfile, oldProfile } }
+    });
+
+    // An earlier query has already seen the newest version.
+    nostrService->queryRelays(make_shared<nostr::data::Filters>(getKind0And1TestFilters())).get();
+    ASSERT_EQ(nostrService->replaceableEvents()->size(), 1u);
+
+    auto filters = make_shared<nostr::data::Filters>();
+    filters->ids = { nostr::data::toHex(oldProfile.id), nostr::data::toHex(newProfile.id) };
+    filters->limit = 2;
+    auto results = nostrService->queryRelays(filters).get();
+
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_THAT(results, Contains(Pointee(Field(&nostr::data::Event::content, oldProfile.content))));
+    EXPECT_THAT(results, Contains(Pointee(Field(&nostr::data::Event::content, newProfile.content))));
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_DeadlinePasses_ReturnsPartialResults_WithRelayStatuses)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The first relay answers at once, and the second never sends EOSE.
+    auto testEvents = getMultipleTextNoteTestEvents();
+    string fastRelay = defaultTestRelays[0];
+    string slowRelay = defaultTestRelays[1];
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents, fastRelay](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            if (uri != fastRelay)
+            {
+                return make_tuple(uri, true);
+            }
+
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto options = nostr::service::RequestOptions::withTimeout(chrono::milliseconds(100));
+    auto result = nostrService->queryRelays({ filters }, options).get();
+
+    EXPECT_EQ(result.events.size(), testEvents.size());
+    EXPECT_EQ(result.relayStatuses.at(fastRelay), nostr::service::RelayRequestStatus::COMPLETED);
+    EXPECT_EQ(result.relayStatuses.at(slowRelay), nostr::service::RelayRequestStatus::TIMED_OUT);
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_Cancelled_ReportsUnansweredRelaysCancelled)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // Neither relay answers.
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri, function<void(const string&)> messageHandler)
+        {
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    nostr::service::RequestOptions options;
+    options.cancellationToken = make_shared<nostr::service::CancellationToken>();
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto resultFuture = nostrService->queryRelays({ filters }, options);
+
+    EXPECT_EQ(resultFuture.wait_for(chrono::milliseconds(50)), future_status::timeout);
+    options.cancellationToken->cancel();
+    auto result = resultFuture.get();
+
+    EXPECT_TRUE(result.events.empty());
+    for (const string& relay : defaultTestRelays)
+    {
+        EXPECT_EQ(result.relayStatuses.at(relay), nostr::service::RelayRequestStatus::CANCELLED);
+    }
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, CompletionPolicy_RequiredCount_FollowsMode)
+{
+    using nostr::service::CompletionPolicy;
+
+    EXPECT_EQ(CompletionPolicy::all().requiredCount(5), 5u);
+    EXPECT_EQ(CompletionPolicy::firstK(2).requiredCount(5), 2u);
+    EXPECT_EQ(CompletionPolicy::firstK(8).requiredCount(5), 5u);
+    EXPECT_EQ(CompletionPolicy::fractionOf(0.5).requiredCount(5), 3u);
+    EXPECT_EQ(CompletionPolicy::fractionOf(1.5).requiredCount(5), 5u);
+    EXPECT_EQ(CompletionPolicy::hedged(1).requiredCount(5), 1u);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_FirstK_ReturnsAfterFirstRelayFinishes_AndClosesTheRest)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The first relay answers at once, and the second never sends EOSE.
+    auto testEvents = getMultipleTextNoteTestEvents();
+    string fastRelay = defaultTestRelays[0];
+    string slowRelay = defaultTestRelays[1];
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents, fastRelay](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            if (uri != fastRelay)
+            {
+                return make_tuple(uri, true);
+            }
+
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    nostr::service::RequestOptions options;
+    options.completion = nostr::service::CompletionPolicy::firstK(1);
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto result = nostrService->queryRelays({ filters }, options).get();
+
+    EXPECT_EQ(result.events.size(), testEvents.size());
+    EXPECT_EQ(result.relayStatuses.at(fastRelay), nostr::service::RelayRequestStatus::COMPLETED);
+    EXPECT_EQ(result.relayStatuses.at(slowRelay), nostr::service::RelayRequestStatus::SUPERSEDED);
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_Hedged_AsksFastestRelayFirst_AndSpillsWhenItIsSlow)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The second relay has been the faster of the two.
+    string slowRelay = defaultTestRelays[0];
+    string fastRelay = defaultTestRelays[1];
+    nostrService->relayLatencies()->record(slowRelay, chrono::milliseconds(1000));
+    nostrService->relayLatencies()->record(fastRelay, chrono::milliseconds(20));
+
+    // The fast relay answers the first query, but not the second.
+    atomic<int> fastRelayQueryCount{0};
+    auto answer = [](string message, string uri, function<void(const string&)> messageHandler)
+    {
+        string subscriptionId = json::parse(message).at(1);
+        messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+        return make_tuple(uri, true);
+    };
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), fastRelay, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&fastRelayQueryCount, answer](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            if (fastRelayQueryCount++ > 0)
+            {
+                return make_tuple(uri, true);
+            }
+            return answer(message, uri, messageHandler);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), slowRelay, _))
+        .Times(1)
+        .WillOnce(Invoke(answer));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    nostr::service::RequestOptions options;
+    options.completion = nostr::service::CompletionPolicy::hedged(1);
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+
+    auto fastResult = nostrService->queryRelays({ filters }, options).get();
+    EXPECT_EQ(fastResult.relayStatuses.size(), 1u);
+    EXPECT_EQ(fastResult.relayStatuses.at(fastRelay), nostr::service::RelayRequestStatus::COMPLETED);
+
+    auto hedgedResult = nostrService->queryRelays({ filters }, options).get();
+    EXPECT_EQ(hedgedResult.relayStatuses.at(fastRelay), nostr::service::RelayRequestStatus::SUPERSEDED);
+    EXPECT_EQ(hedgedResult.relayStatuses.at(slowRelay), nostr::service::RelayRequestStatus::COMPLETED);
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_WithRelayRouter_AsksEachRelayOnlyForItsAuthors)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays,
+        make_shared<nostr::service::EventVerifier>(signingVerifierOptions()));
+    nostrService->openRelayConnections();
+    auto relayRouter = make_shared<nostr::service::RelayRouter>(nostr::service::RelayRouterOptions{ 1, {} });
+    nostrService->setRelayRouter(relayRouter);
+
+    // Each author writes to a different one of the relays.
+    vector<nostr::data::Event> relayLists;
+    vector<string> authors;
+    for (size_t i = 0; i < defaultTestRelays.size(); i++)
+    {
+        nostr::data::Event relayList = getTextNoteTestEvent();
+        relayList.kind = nostr::service::RelayRouter::RELAY_LIST_KIND;
+        relayList.tags = { { "r", defaultTestRelays[i] } };
+        relayList.content = "";
+        relayList.createdAt = 1700000000;
+        signTestEvent(relayList, static_cast<uint8_t>(i + 1));
+        relayLists.push_back(relayList);
+        authors.push_back(nostr::data::toHex(relayList.pubkey));
+    }
+
+    unordered_map<string, vector<string>> requestedAuthors;
+    mutex requestedAuthorsMutex;
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(4)
+        .WillRepeatedly(Invoke([&relayLists, &requestedAuthors, &requestedAuthorsMutex](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            json request = json::parse(message);
+            string subscriptionId = request.at(1);
+            if (request.at(2).at("kinds") == json::array({ nostr::service::RelayRouter::RELAY_LIST_KIND }))
+            {
+                for (auto relayList : relayLists)
+                {
+                    json jarr = json::array({ "EVENT", subscriptionId, relayList.serialize() });
+                    messageHandler(jarr.dump());
+                }
+            }
+            else
+            {
+                lock_guard<mutex> lock(requestedAuthorsMutex);
+                requestedAuthors[uri] = request.at(2).at("authors").get<vector<string>>();
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    // The relay lists are not yet known, so they are asked of every relay.
+    auto relayListFilters = make_shared<nostr::data::Filters>();
+    relayListFilters->authors = authors;
+    relayListFilters->kinds = { nostr::service::RelayRouter::RELAY_LIST_KIND };
+    relayListFilters->limit = 10;
+    nostrService->queryRelays(relayListFilters).get();
+
+    ASSERT_EQ(relayRouter->size(), defaultTestRelays.size());
+
+    auto noteFilters = make_shared<nostr::data::Filters>();
+    noteFilters->authors = authors;
+    noteFilters->kinds = { 1 };
+    noteFilters->limit = 10;
+    nostrService->queryRelays(noteFilters).get();
+
+    ASSERT_EQ(requestedAuthors.size(), defaultTestRelays.size());
+    for (size_t i = 0; i < defaultTestRelays.size(); i++)
+    {
+        EXPECT_EQ(requestedAuthors[defaultTestRelays[i]], vector<string>{ authors[i] });
+    }
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_WithRelayRouter_IgnoresRelayLists_WhenSignaturesAreNotVerified)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+    auto relayRouter = make_shared<nostr::service::RelayRouter>();
+    nostrService->setRelayRouter(relayRouter);
+
+    nostr::data::Event relayList = getTextNoteTestEvent();
+    relayList.kind = nostr::service::RelayRouter::RELAY_LIST_KIND;
+    relayList.tags = { { "r", "wss://forged.example.com" } };
+    relayList.content = "";
+    expectRelayEvents({
+        { defaultTestRelays[0], { relayList } },
+        { defaultTestRelays[1], { relayList } }
+    });
+
+    auto filters = make_shared<nostr::data::Filters>();
+    filters->kinds = { nostr::service::RelayRouter::RELAY_LIST_KIND };
+    filters->limit = 10;
+    auto results = nostrService->queryRelays(filters).get();
+
+    EXPECT_EQ(results.size(), 1u);
+    EXPECT_EQ(relayRouter->size(), 0u);
+};
+
+TEST_F(NostrServiceBaseTest, StreamRelays_PassesEachEventOnce_ThenCompletes)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // Both relays hold every event, so each is received twice.
+    auto testEvents = getMultipleTextNoteTestEvents();
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto channel = nostrService->streamRelays({ filters }, testEvents.size());
+
+    vector<shared_ptr<nostr::data::Event>> results;
+    while (auto event = channel->next())
+    {
+        results.push_back(event);
+    }
+
+    EXPECT_EQ(results.size(), testEvents.size());
+    EXPECT_TRUE(channel->isComplete());
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, StreamRelays_PassesEvents_BeforeEveryRelayFinishes_AndClosesOnRelease)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // The first relay answers at once, and the second never answers.
+    auto testEvents = getMultipleTextNoteTestEvents();
+    string fastRelay = defaultTestRelays[0];
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents, fastRelay](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            if (uri != fastRelay)
+            {
+                return make_tuple(uri, true);
+            }
+
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto channel = nostrService->streamRelays({ filters }, testEvents.size());
+
+    for (size_t i = 0; i < testEvents.size(); i++)
+    {
+        ASSERT_NE(channel->next(), nullptr);
+    }
+    EXPECT_FALSE(channel->isComplete());
+
+    channel.reset();
+
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, StreamRelays_ConsumerFallsBehind_EndsStreamWithOverflow_WithoutHoldingBackOthers)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    ASSERT_GT(testEvents.size(), 1u);
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(3)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                messageHandler(json::array({ "EVENT", subscriptionId, sendableEvent->serialize() }).dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    // The consumer takes nothing, so the relay's second event overflows the channel.
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto stalledChannel = nostrService->streamRelays({ filters }, 1);
+
+    // Another query of the service is still answered.
+    auto results = nostrService->queryRelays(filters).get();
+    EXPECT_EQ(results.size(), testEvents.size());
+
+    // The consumer takes the event already in the channel, then learns the stream was cut short.
+    EXPECT_TRUE(stalledChannel->isOverflowed());
+    EXPECT_NE(stalledChannel->next(), nullptr);
+    EXPECT_THROW(stalledChannel->next(), overflow_error);
+
+    // A retry with room for every event receives them all.
+    auto retriedChannel = nostrService->streamRelays({ filters }, testEvents.size());
+    size_t retriedCount = 0;
+    while (retriedChannel->next() != nullptr)
+    {
+        retriedCount++;
+    }
+    EXPECT_EQ(retriedCount, testEvents.size());
+    EXPECT_TRUE(nostrService->subscriptions().empty());
+};
+
+TEST_F(NostrServiceBaseTest, StreamRelays_ChannelReleasedAfterServiceDestroyed_DoesNotCloseSubscription)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+
+    // The relay never ends the subscription.
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .WillOnce(Invoke([](string message, string uri, function<void(const string&)>)
+        {
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _)).Times(0);
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    auto channel = nostrService->streamRelays({ filters }, 4);
+
+    nostrService.reset();
+    channel.reset();
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_AsksForEventsSinceWatermark_AndMergesStoredEvents)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    nostr::data::Filters filters;
+    filters.kinds = { 1 };
+    filters.limit = 10;
+    string filterKey = nostr::service::SyncWatermarks::filterKey(filters);
+
+    // Only the first relay has been synchronized before.
+    const time_t watermark = 1700000000;
+    auto syncWatermarks = make_shared<nostr::service::SyncWatermarks>();
+    syncWatermarks->advance(defaultTestRelays[0], filterKey, watermark);
+    nostrService->setSyncWatermarks(syncWatermarks);
+
+    auto storedEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+    storedEvent->createdAt = watermark - 60;
+    storedEvent->serialize();
+    auto eventStore = make_shared<MockEventStore>();
+    EXPECT_CALL(*eventStore, append(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(*eventStore, query(_))
+        .WillOnce(Return(vector<shared_ptr<nostr::data::Event>>{ storedEvent }));
+    nostrService->setEventStore(eventStore);
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    unordered_map<string, time_t> requestedSince;
+    mutex requestedSinceMutex;
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents, &requestedSince, &requestedSinceMutex](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            json request = json::parse(message);
+            string subscriptionId = request.at(1);
+            {
+                lock_guard<mutex> lock(requestedSinceMutex);
+                requestedSince[uri] = request.at(2).at("since");
+            }
+
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto results = nostrService->queryRelays(make_shared<nostr::data::Filters>(filters)).get();
+
+    EXPECT_EQ(requestedSince[defaultTestRelays[0]], watermark);
+    EXPECT_EQ(requestedSince[defaultTestRelays[1]], 0);
+    ASSERT_EQ(results.size(), testEvents.size() + 1);
+    EXPECT_THAT(results, Contains(storedEvent));
+
+    // Each relay is now synchronized up to the newest event it returned.
+    EXPECT_EQ(syncWatermarks->get(defaultTestRelays[0], filterKey), testEvents[0].createdAt);
+    EXPECT_EQ(syncWatermarks->get(defaultTestRelays[1], filterKey), testEvents[0].createdAt);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_KeepsWatermark_WhenRelayReachesLimit_AndKeepsMergedResultsWithinLimit)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    nostr::data::Filters filters;
+    filters.kinds = { 1 };
+    filters.limit = 2;
+    string filterKey = nostr::service::SyncWatermarks::filterKey(filters);
+    auto syncWatermarks = make_shared<nostr::service::SyncWatermarks>();
+    nostrService->setSyncWatermarks(syncWatermarks);
+
+    // The store holds older events, which the relays' newer events push out of the limit.
+    vector<shared_ptr<nostr::data::Event>> storedEvents;
+    for (int i = 0; i < 3; i++)
+    {
+        auto storedEvent = make_shared<nostr::data::Event>(getTextNoteTestEvent());
+        storedEvent->createdAt = 1600000000 + i;
+        storedEvent->serialize();
+        storedEvents.push_back(storedEvent);
+    }
+    auto eventStore = make_shared<MockEventStore>();
+    EXPECT_CALL(*eventStore, append(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(*eventStore, query(_)).WillOnce(Return(storedEvents));
+    nostrService->setEventStore(eventStore);
+
+    // The first relay fills the limit and may hold more, while the second returns less.
+    auto testEvents = getMultipleTextNoteTestEvents();
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([this, &testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            string subscriptionId = json::parse(message).at(1);
+            size_t count = uri == defaultTestRelays[0] ? testEvents.size() : 1;
+            for (size_t i = 0; i < count; i++)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(testEvents[i]);
+                messageHandler(json::array({ "EVENT", subscriptionId, sendableEvent->serialize() }).dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto results = nostrService->queryRelays(make_shared<nostr::data::Filters>(filters)).get();
+
+    EXPECT_EQ(syncWatermarks->get(defaultTestRelays[0], filterKey), 0);
+    EXPECT_EQ(syncWatermarks->get(defaultTestRelays[1], filterKey), testEvents[0].createdAt);
+    ASSERT_EQ(results.size(), 2);
+    for (const auto& storedEvent : storedEvents)
+    {
+        EXPECT_THAT(results, Not(Contains(storedEvent)));
+    }
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_PagesBackwardsWithUntil_BelowWatermark)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    // Both relays are already synchronized up to the present for the unbounded filter.
+    time_t watermark = time(nullptr);
+    nostr::data::Filters latestFilters;
+    latestFilters.kinds = { 1 };
+    latestFilters.limit = 10;
+    string filterKey = nostr::service::SyncWatermarks::filterKey(latestFilters);
+    auto syncWatermarks = make_shared<nostr::service::SyncWatermarks>();
+    for (const auto& relay : defaultTestRelays)
+    {
+        syncWatermarks->advance(relay, filterKey, watermark);
+    }
+    nostrService->setSyncWatermarks(syncWatermarks);
+
+    // The store missed the older page, so it must come from the relays.
+    auto eventStore = make_shared<MockEventStore>();
+    EXPECT_CALL(*eventStore, append(_)).WillRepeatedly(Return(true));
+    EXPECT_CALL(*eventStore, query(_)).Times(0);
+    nostrService->setEventStore(eventStore);
+
+    // The next page ends below the watermark, but otherwise matches the same filter.
+    time_t pageUntil = 1700000100;
+    nostr::data::Filters pageFilters = latestFilters;
+    pageFilters.until = pageUntil;
+
+    vector<nostr::data::Event> olderEvents;
+    for (int i = 0; i < 3; i++)
+    {
+        auto event = getTextNoteTestEvent();
+        event.content = "Older note " + to_string(i);
+        event.createdAt = 1700000000 + i;
+        olderEvents.push_back(event);
+    }
+
+    mutex requestMutex;
+    vector<json> requestedFilters;
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&olderEvents, &requestMutex, &requestedFilters](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            json request = json::parse(message);
+            string subscriptionId = request.at(1);
+            {
+                lock_guard<mutex> lock(requestMutex);
+                requestedFilters.push_back(request.at(2));
+            }
+
+            for (const auto& event : olderEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                messageHandler(json::array({ "EVENT", subscriptionId, sendableEvent->serialize() }).dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .WillRepeatedly(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto results = nostrService->queryRelays(make_shared<nostr::data::Filters>(pageFilters)).get();
+
+    // Each relay was asked for the page as given, not only for events above its watermark.
+    ASSERT_EQ(requestedFilters.size(), 2);
+    for (const auto& requestedFilter : requestedFilters)
+    {
+        EXPECT_EQ(requestedFilter.at("since"), 0);
+        EXPECT_EQ(requestedFilter.at("until"), pageUntil);
+    }
+    ASSERT_EQ(results.size(), olderEvents.size());
+    for (const auto& olderEvent : olderEvents)
+    {
+        EXPECT_THAT(results, Contains(Pointee(Field(&nostr::data::Event::createdAt, olderEvent.createdAt))));
+    }
+
+    // The page says nothing about the events between it and the present.
+    for (const auto& relay : defaultTestRelays)
+    {
+        EXPECT_EQ(syncWatermarks->get(relay, filterKey), watermark);
+    }
+};
+
+TEST_F(NostrServiceBaseTest, Service_Destroyed_SkipsCallbacksQueuedOnSharedVerifier)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto eventVerifier = make_shared<nostr::service::EventVerifier>();
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays,
+        eventVerifier);
+    nostrService->openRelayConnections();
+
+    // Hold the verifier's dispatch thread, so the relays' events stay queued.
+    promise<void> release;
+    shared_future<void> released = release.get_future().share();
+    eventVerifier->submit([released]() { released.wait(); });
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            string subscriptionId = json::parse(message).at(1);
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                messageHandler(json::array({ "EVENT", subscriptionId, sendableEvent->serialize() }).dump());
+            }
+            messageHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+            return make_tuple(uri, true);
+        }));
+
+    atomic<int> handlerCount{0};
+    nostrService->queryRelays(
+        make_shared<nostr::data::Filters>(getKind0And1TestFilters()),
+        [&handlerCount](const string&, shared_ptr<nostr::data::Event>) { handlerCount++; },
+        [&handlerCount](const string&) { handlerCount++; },
+        [&handlerCount](const string&, const string&) { handlerCount++; });
+
+    nostrService.reset();
+    release.set_value();
+
+    promise<void> drained;
+    eventVerifier->submit([&drained]() { drained.set_value(); });
+    drained.get_future().wait();
+
+    EXPECT_EQ(handlerCount, 0);
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandlers_ForMessagesAfterReturning)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+
+    // The relay keeps the message handler, and answers only once the query has returned.
+    function<void(const string&)> relayHandler;
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .WillOnce(Invoke([&relayHandler](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            relayHandler = messageHandler;
+            return make_tuple(uri, true);
+        }));
+
+    promise<size_t> eosePromise;
+    auto eoseFuture = eosePromise.get_future();
+    auto eventCount = make_shared<atomic<size_t>>(0);
+    string subscriptionId;
+    {
+        vector<shared_ptr<nostr::data::Filters>> filters = {
+            make_shared<nostr::data::Filters>(getKind0And1TestFilters())
+        };
+        subscriptionId = nostrService->queryRelays(
+            filters,
+            [eventCount](const string&, shared_ptr<nostr::data::Event>) { (*eventCount)++; },
+            [eventCount, &eosePromise](const string&) { eosePromise.set_value(*eventCount); },
+            [](const string&, const string&) {});
+    }
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    for (auto event : testEvents)
+    {
+        auto sendableEvent = make_shared<nostr::data::Event>(event);
+        relayHandler(json::array({ "EVENT", subscriptionId, sendableEvent->serialize() }).dump());
+    }
+    relayHandler(json::array({ "EOSE", subscriptionId }).dump());
+
+    ASSERT_EQ(eoseFuture.wait_for(chrono::seconds(5)), future_status::ready);
+    EXPECT_EQ(eoseFuture.get(), testEvents.size());
+};
+
+TEST_F(NostrServiceBaseTest, QueryRelays_CallsHandler_WithReturnedEvents)
+{
+    mutex connectionStatusMutex;
+    auto connectionStatus = make_shared<unordered_map<string, bool>>();
+    connectionStatus->insert({ defaultTestRelays[0], false });
+    connectionStatus->insert({ defaultTestRelays[1], false });
+
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillRepeatedly(Invoke([connectionStatus, &connectionStatusMutex](string uri)
+        {
+            lock_guard<mutex> lock(connectionStatusMutex);
+            bool status = connectionStatus->at(uri);
+            if (status == false)
+            {
+                connectionStatus->at(uri) = true;
+            }
+            return status;
+        }));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        defaultTestRelays);
+    nostrService->openRelayConnections();
+
+    auto testEvents = getMultipleTextNoteTestEvents();
+    vector<shared_ptr<nostr::data::Event>> sendableTestEvents;
+    for (nostr::data::Event testEvent : testEvents)
+    {
+        auto event = make_shared<nostr::data::Event>(testEvent);
+        auto serializedEvent = event->serialize();
+        auto deserializedEvent = nostr::data::Event::fromString(serializedEvent);
+
+        event = make_shared<nostr::data::Event>(deserializedEvent);
+        sendableTestEvents.push_back(event);
+    }
+
+    EXPECT_CALL(*mockClient, send(HasSubstr("REQ"), _, _))
+        .Times(2)
+        .WillRepeatedly(Invoke([&testEvents](
+            string message,
+            string uri,
+            function<void(const string&)> messageHandler)
+        {
+            json messageArr = json::parse(message);
+            string subscriptionId = messageArr.at(1);
+
+            for (auto event : testEvents)
+            {
+                auto sendableEvent = make_shared<nostr::data::Event>(event);
+                json jarr = json::array({ "EVENT", subscriptionId, sendableEvent->serialize() });
+                messageHandler(jarr.dump());
+            }
+
+            json jarr = json::array({ "EOSE", subscriptionId });
+            messageHandler(jarr.dump());
+
+            return make_tuple(uri, true);
+        }));
+
+    auto filters = make_shared<nostr::data::Filters>(getKind0And1TestFilters());
+    promise<void> eoseReceivedPromise;
+    auto eoseReceivedFuture = eoseReceivedPromise.get_future();
+    int eoseCount = 0;
+
+    string generatedSubscriptionId = nostrService->queryRelays(
+        filters,
+        [&generatedSubscriptionId, &sendableTestEvents](const string& subscriptionId, shared_ptr<nostr::data::Event> event)
+        {
+            ASSERT_STREQ(subscriptionId.c_str(), generatedSubscriptionId.c_str());
+            ASSERT_NE(
+                find_if(
+                    sendableTestEvents.begin(),
+                    sendableTestEvents.end(),
+                    [&event](shared_ptr<nostr::data::Event> testEvent)
+                    {
+                        return *testEvent == *event;
+                    }),
+                sendableTestEvents.end());
+        },
+        [&generatedSubscriptionId, &eoseReceivedPromise, &eoseCount]
+        (const string& subscriptionId)
+        {
+            ASSERT_STREQ(subscriptionId.c_str(), generatedSubscriptionId.c_str());
+
+            if (++eoseCount == 2)
+            {
+                eoseReceivedPromise.set_value();
+            }
+        },
+        [](const string&, const string&) {});
+
+    eoseReceivedFuture.wait();
+
+    // Check that the service is keeping track of its active subscriptions.
+    auto subscriptions = nostrService->subscriptions();
+    ASSERT_NO_THROW(subscriptions.at(generatedSubscriptionId));
+    ASSERT_EQ(subscriptions.at(generatedSubscriptionId).size(), 2);
+
+    EXPECT_CALL(*mockClient, send(HasSubstr("CLOSE"), _))
+        .Times(2)
+        .WillRepeatedly(Invoke([](string message, string uri)
+        {
+            return make_tuple(uri, true);
+        }));
+
+    auto [successes, failures] = nostrService->closeSubscription(generatedSubscriptionId);
+
+    ASSERT_TRUE(failures.empty());
+
+    // Check that the service has forgotten about the subscriptions after closing them.
+    subscriptions = nostrService->subscriptions();
+    ASSERT_TRUE(subscriptions.empty());
+};
+
+TEST_F(NostrServiceBaseTest, Service_MaintainsMultipleSubscriptions_ThenClosesAll)
+{
+    // Mock connections.
+    mutex connectionStatusMutex;
+    auto connectionStatus = make_shared<unordered_map<string, bool>>();
+    vector<string> testRelays = { "wss://theforest.nostr1.com" };
+    connectionStatus->insert({ testRelays[0], false });
+
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillRepeatedly(Invoke([connectionStatus, &connectionStatusMutex](string uri)
+        {
+            lock_guard<mutex> lock(connectionStatusMutex);
+            bool status = connectionStatus->at(uri);
+            if (status == false)
+            {
+                connectionStatus->at(uri) = true;
+            }
+            return status;
+        }));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        testRelays);
     nostrService->openRelayConnections();
 
     // Mock relay responses.
@@ -1045,4 +2684,177 @@ TEST_F(NostrServiceBaseTest, Service_MaintainsMultipleSubscriptions_ThenClosesAl
     subscriptions = nostrService->subscriptions();
     ASSERT_TRUE(subscriptions.empty());
 };
+
+TEST_F(NostrServiceBaseTest, SyncWithRelay_FetchesOnlyMissingEvents_AndUploadsOnlyRelaysMissingEvents)
+{
+    auto syncTestEvent = [](int number)
+    {
+        nostr::data::Event event = getTextNoteTestEvent();
+        event.content = "Note number " + to_string(number);
+        event.createdAt = 1700000000 + number;
+        event.serialize();
+        return event;
+    };
+
+    // The store and the relay share most events, and each holds a few the other lacks.
+    vector<nostr::data::Event> storedEvents;
+    vector<nostr::data::Event> relayEvents;
+    vector<nostr::data::EventId> storeOnlyIds;
+    vector<nostr::data::EventId> relayOnlyIds;
+    for (int number = 0; number < 300; number++)
+    {
+        nostr::data::Event event = syncTestEvent(number);
+        if (number % 50 == 7)
+        {
+            storedEvents.push_back(event);
+            storeOnlyIds.push_back(event.id);
+        }
+        else if (number % 40 == 3)
+        {
+            relayEvents.push_back(event);
+            relayOnlyIds.push_back(event.id);
+        }
+        else
+        {
+            storedEvents.push_back(event);
+            relayEvents.push_back(event);
+        }
+    }
+
+    auto directory = filesystem::temp_directory_path() / "aedile-sync-test";
+    filesystem::remove_all(directory);
+    auto eventStore = make_shared<nostr::store::MmapEventStore>(directory.string());
+    for (const auto& event : storedEvents)
+    {
+        eventStore->append(event);
+    }
+
+    auto relay = make_shared<StandInRelayClient>(relayEvents);
+    EXPECT_CALL(*relay, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        relay,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+    nostrService->setEventStore(eventStore);
+
+    auto filters = make_shared<nostr::data::Filters>();
+    filters->kinds = { 1 };
+    filters->limit = 10;
+    auto result = nostrService->syncWithRelay(defaultTestRelays[0], filters).get();
+
+    sort(result.haveIds.begin(), result.haveIds.end());
+    sort(result.needIds.begin(), result.needIds.end());
+    sort(storeOnlyIds.begin(), storeOnlyIds.end());
+    sort(relayOnlyIds.begin(), relayOnlyIds.end());
+    EXPECT_EQ(result.haveIds, storeOnlyIds);
+    EXPECT_EQ(result.needIds, relayOnlyIds);
+    EXPECT_EQ(result.fetchedCount, relayOnlyIds.size());
+    EXPECT_EQ(result.uploadedCount, storeOnlyIds.size());
+
+    // The relay was asked about every matching event, not just the limit.
+    json negentropyFilter = relay->negentropyFilter();
+    EXPECT_FALSE(negentropyFilter.contains("limit"));
+    EXPECT_EQ(negentropyFilter.at("kinds"), json::array({ 1 }));
+
+    // Both sides now hold every event.
+    EXPECT_EQ(eventStore->size(), storedEvents.size() + relayOnlyIds.size());
+    for (const auto& id : relayOnlyIds)
+    {
+        EXPECT_NE(eventStore->find(id), nullptr);
+    }
+    EXPECT_EQ(relay->events().size(), relayEvents.size() + storeOnlyIds.size());
+
+    nostrService.reset();
+    eventStore.reset();
+    filesystem::remove_all(directory);
+};
+
+TEST_F(NostrServiceBaseTest, SyncWithRelay_CountsOnlyAnswers_ForTransferredEvents)
+{
+    vector<nostr::data::Event> storedEvents;
+    vector<nostr::data::Event> relayEvents;
+    for (int number = 0; number < 6; number++)
+    {
+        nostr::data::Event event = getTextNoteTestEvent();
+        event.content = "Note number " + to_string(number);
+        event.createdAt = 1700000000 + number;
+        event.serialize();
+        (number % 2 == 0 ? storedEvents : relayEvents).push_back(event);
+    }
+
+    auto directory = filesystem::temp_directory_path() / "aedile-unruly-sync-test";
+    filesystem::remove_all(directory);
+    auto eventStore = make_shared<nostr::store::MmapEventStore>(directory.string());
+    for (const auto& event : storedEvents)
+    {
+        eventStore->append(event);
+    }
+
+    // The relay ends each request twice, and answers for an event it was never sent.
+    auto relay = make_shared<StandInRelayClient>(relayEvents, true);
+    EXPECT_CALL(*relay, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        relay,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+    nostrService->setEventStore(eventStore);
+
+    auto filters = make_shared<nostr::data::Filters>();
+    filters->kinds = { 1 };
+    auto result = nostrService->syncWithRelay(
+        defaultTestRelays[0],
+        filters,
+        nostr::service::RequestOptions::withTimeout(chrono::seconds(10))).get();
+
+    EXPECT_EQ(result.fetchedCount, relayEvents.size());
+    EXPECT_EQ(result.uploadedCount, storedEvents.size());
+    EXPECT_EQ(relay->events().size(), relayEvents.size() + storedEvents.size());
+
+    nostrService.reset();
+    eventStore.reset();
+    filesystem::remove_all(directory);
+};
+
+TEST_F(NostrServiceBaseTest, SyncWithRelay_RelayStopsAnswering_ThrowsAtDeadline)
+{
+    EXPECT_CALL(*mockClient, isConnected(_))
+        .WillOnce(Return(false))
+        .WillRepeatedly(Return(true));
+
+    auto nostrService = make_unique<nostr::service::NostrServiceBase>(
+        testAppender,
+        mockClient,
+        vector<string>{ defaultTestRelays[0] });
+    nostrService->openRelayConnections();
+    auto eventStore = make_shared<MockEventStore>();
+    EXPECT_CALL(*eventStore, query(_)).WillOnce(Return(vector<shared_ptr<nostr::data::Event>>()));
+    nostrService->setEventStore(eventStore);
+
+    // The relay takes the NEG-OPEN message, but never answers it.
+    EXPECT_CALL(*mockClient, send(HasSubstr("NEG-OPEN"), _, _))
+        .WillOnce(Invoke([](string message, string uri, function<void(const string&)>)
+        {
+            return make_tuple(uri, true);
+        }));
+    EXPECT_CALL(*mockClient, send(HasSubstr("NEG-CLOSE"), _))
+        .WillOnce(Invoke([](string message, string uri) { return make_tuple(uri, true); }));
+
+    auto filters = make_shared<nostr::data::Filters>();
+    filters->kinds = { 1 };
+    auto sync = nostrService->syncWithRelay(
+        defaultTestRelays[0],
+        filters,
+        nostr::service::RequestOptions::withTimeout(chrono::milliseconds(50)));
+
+    ASSERT_EQ(sync.wait_for(chrono::seconds(5)), future_status::ready);
+    EXPECT_THROW(sync.get(), runtime_error);
+};
 } // namespace nostr_test
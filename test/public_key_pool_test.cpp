@@ -0,0 +1,126 @@
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "data/data.hpp"
+#include "data/relay_message_parser.hpp"
+
+using namespace nostr::data;
+using namespace std;
+using namespace ::testing;
+
+static const string poolTestKey = "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca";
+static const string poolTestOtherKey = "13adc511de7e1cfcf1c6b7f6365fb5a03442d7bcacf565ea57fa7770912c023d";
+
+static PublicKey poolTestKeyAt(uint32_t index)
+{
+    PublicKey key{};
+    key[0] = 0xff;
+    memcpy(key.data() + 1, &index, sizeof(index));
+    key[31] = static_cast<uint8_t>(index);
+    return key;
+};
+
+TEST(PublicKeyPoolTest, Intern_ReturnsSameHandle_ForEqualKeys)
+{
+    PublicKeyPool pool;
+
+    PublicKeyHandle first = pool.intern(fromHex<PublicKey>(poolTestKey));
+    PublicKeyHandle again = pool.intern(fromHex<PublicKey>(poolTestKey));
+    PublicKeyHandle other = pool.intern(fromHex<PublicKey>(poolTestOtherKey));
+
+    EXPECT_NE(first, PublicKeyHandle::NONE);
+    EXPECT_EQ(first, again);
+    EXPECT_NE(first, other);
+    EXPECT_EQ(pool.size(), 2);
+    EXPECT_EQ(toHex(pool.key(first)), poolTestKey);
+    EXPECT_EQ(pool.find(fromHex<PublicKey>(poolTestOtherKey)), other);
+};
+
+TEST(PublicKeyPoolTest, Intern_RejectsInvalidHex)
+{
+    PublicKeyPool pool;
+
+    EXPECT_EQ(pool.intern(poolTestKey), pool.intern(fromHex<PublicKey>(poolTestKey)));
+    EXPECT_EQ(pool.intern(string("not a key")), nullopt);
+    EXPECT_EQ(pool.find(fromHex<PublicKey>(poolTestOtherKey)), PublicKeyHandle::NONE);
+    EXPECT_THROW(pool.key(PublicKeyHandle::NONE), invalid_argument);
+    EXPECT_THROW(pool.key(static_cast<PublicKeyHandle>(1000)), invalid_argument);
+};
+
+TEST(PublicKeyPoolTest, Intern_IsConsistent_AcrossThreads)
+{
+    PublicKeyPool pool;
+    const uint32_t keyCount = 5000;
+    const int threadCount = 8;
+
+    // Every thread interns the same keys, in a different order.
+    vector<vector<PublicKeyHandle>> handles(threadCount, vector<PublicKeyHandle>(keyCount));
+    vector<thread> threads;
+    for (int t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&pool, &handles, t, keyCount]()
+        {
+            for (uint32_t i = 0; i < keyCount; i++)
+            {
+                uint32_t index = (i * 7919 + t * 613) % keyCount;
+                handles[t][index] = pool.intern(poolTestKeyAt(index));
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(pool.size(), keyCount);
+    for (uint32_t i = 0; i < keyCount; i++)
+    {
+        for (int t = 1; t < threadCount; t++)
+        {
+            ASSERT_EQ(handles[t][i], handles[0][i]);
+        }
+        ASSERT_EQ(pool.key(handles[0][i]), poolTestKeyAt(i));
+    }
+};
+
+TEST(PublicKeyPoolTest, Parser_InternsEventPubkeys)
+{
+    string message = R"(["EVENT","sub-1",{"id":"","pubkey":")" + poolTestKey
+        + R"(","created_at":1627846261,"kind":1,"tags":[],"content":"","sig":""}])";
+
+    auto event = RelayMessageParser().parse(message).event;
+
+    EXPECT_NE(event->pubkeyHandle, PublicKeyHandle::NONE);
+    EXPECT_EQ(event->pubkeyHandle, PublicKeyPool::global().find(fromHex<PublicKey>(poolTestKey)));
+};
+
+TEST(PublicKeyPoolTest, Filters_MatchAndSerialize_AuthorHandles)
+{
+    PublicKeyHandle author = PublicKeyPool::global().intern(fromHex<PublicKey>(poolTestKey));
+
+    Filters filters;
+    filters.authorHandles = { author };
+    filters.limit = 10;
+    FilterMatcher matcher = filters.compile();
+
+    Event interned;
+    interned.pubkey = fromHex<PublicKey>(poolTestKey);
+    interned.kind = 1;
+    interned.internPubkey();
+    Event notInterned = interned;
+    notInterned.pubkeyHandle = PublicKeyHandle::NONE;
+    Event other = interned;
+    other.pubkey = fromHex<PublicKey>(poolTestOtherKey);
+    other.internPubkey();
+
+    EXPECT_TRUE(matcher.matches(interned));
+    EXPECT_TRUE(matcher.matches(notInterned));
+    EXPECT_FALSE(matcher.matches(other));
+
+    string subscriptionId = "sub-1";
+    auto request = nlohmann::json::parse(filters.serialize(subscriptionId));
+    EXPECT_THAT(request[2]["authors"], ElementsAre(poolTestKey));
+};
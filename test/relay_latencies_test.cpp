@@ -0,0 +1,56 @@
+#include <chrono>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "service/relay_latencies.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+TEST(RelayLatenciesTest, Percentile_UsesNearestRank_OverGivenRelays)
+{
+    service::RelayLatencies latencies;
+    for (int latency = 1; latency <= 10; latency++)
+    {
+        latencies.record("wss://a", chrono::milliseconds(latency));
+        latencies.record("wss://b", chrono::milliseconds(100 + latency));
+    }
+
+    EXPECT_EQ(latencies.percentile({ "wss://a" }, 0.5), chrono::milliseconds(5));
+    EXPECT_EQ(latencies.percentile({ "wss://a" }, 0.9), chrono::milliseconds(9));
+    EXPECT_EQ(latencies.percentile({ "wss://a" }, 1.0), chrono::milliseconds(10));
+    EXPECT_EQ(latencies.percentile({ "wss://a", "wss://b" }, 0.5), chrono::milliseconds(10));
+    EXPECT_FALSE(latencies.percentile({ "wss://c" }, 0.5).has_value());
+};
+
+TEST(RelayLatenciesTest, Record_KeepsOnlyRecentLatencies)
+{
+    service::RelayLatencies latencies(2);
+    latencies.record("wss://a", chrono::milliseconds(1000));
+    latencies.record("wss://a", chrono::milliseconds(10));
+    latencies.record("wss://a", chrono::milliseconds(20));
+
+    EXPECT_EQ(latencies.percentile({ "wss://a" }, 1.0), chrono::milliseconds(20));
+};
+
+TEST(RelayLatenciesTest, RankFastest_OrdersByMedian_WithUnknownRelaysLast)
+{
+    service::RelayLatencies latencies;
+    latencies.record("wss://slow", chrono::milliseconds(300));
+    latencies.record("wss://fast", chrono::milliseconds(30));
+    latencies.record("wss://middle", chrono::milliseconds(100));
+
+    vector<string> ranked = latencies.rankFastest({ "wss://new", "wss://slow", "wss://fast", "wss://middle" });
+
+    vector<string> expected = { "wss://fast", "wss://middle", "wss://slow", "wss://new" };
+    EXPECT_EQ(ranked, expected);
+};
+
+TEST(RelayLatenciesTest, Constructor_ZeroWindowSize_Throws)
+{
+    EXPECT_THROW(service::RelayLatencies latencies(0), invalid_argument);
+};
+} // namespace nostr_test
@@ -0,0 +1,162 @@
+#include <stdexcept>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+#include "data/relay_message_parser.hpp"
+
+using namespace nostr::data;
+using namespace std;
+using namespace ::testing;
+
+using nlohmann::json;
+
+namespace nostr_test
+{
+static const json testEventJson()
+{
+    return {
+        { "id", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36" },
+        { "pubkey", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" },
+        { "created_at", 1627846261 },
+        { "kind", 1 },
+        { "tags", {
+            { "e", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36", "wss://nostr.example.com" },
+            { "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" }
+        } },
+        { "content", "Hello, \"World\"!\n" },
+        { "sig", "908a15e46fb4d8675bab026fc230a0e3542bfade63da02d542fb78b2a8513fcd0092619a2c8c1221e581946e0191f2af505dfdf8657a414dbca329186f009262" }
+    };
+}
+
+TEST(RelayMessageParserTest, Parse_DecodesEventMessage_InOnePass)
+{
+    json message = json::array({ "EVENT", "sub-1", testEventJson() });
+
+    RelayMessageParser parser;
+    RelayMessage result = parser.parse(message.dump());
+
+    ASSERT_EQ(result.type, RelayMessageType::EVENT);
+    ASSERT_EQ(result.subscriptionId, "sub-1");
+    ASSERT_NE(result.event, nullptr);
+
+    Event expected = Event::fromJson(testEventJson());
+    EXPECT_EQ(result.event->id, expected.id);
+    EXPECT_EQ(result.event->pubkey, expected.pubkey);
+    EXPECT_EQ(result.event->createdAt, expected.createdAt);
+    EXPECT_EQ(result.event->kind, expected.kind);
+    EXPECT_EQ(result.event->tags, expected.tags);
+    EXPECT_EQ(result.event->content, expected.content);
+    EXPECT_EQ(result.event->sig, expected.sig);
+}
+
+TEST(RelayMessageParserTest, Parse_DecodesEventMessage_WithStringifiedEvent)
+{
+    json message = json::array({ "EVENT", "sub-1", testEventJson().dump() });
+
+    RelayMessageParser parser;
+    RelayMessage result = parser.parse(message.dump());
+
+    ASSERT_EQ(result.type, RelayMessageType::EVENT);
+    ASSERT_NE(result.event, nullptr);
+    EXPECT_EQ(result.event->content, "Hello, \"World\"!\n");
+}
+
+TEST(RelayMessageParserTest, Parse_SkipsUnknownEventFields)
+{
+    json event = testEventJson();
+    event["relays"] = { { "nested", { 1, 2, 3 } } };
+    event["extra"] = nullptr;
+    json message = json::array({ "EVENT", "sub-1", event, "trailing" });
+
+    RelayMessageParser parser;
+    RelayMessage result = parser.parse(message.dump());
+
+    ASSERT_EQ(result.type, RelayMessageType::EVENT);
+    EXPECT_EQ(result.event->tags.size(), 2);
+}
+
+TEST(RelayMessageParserTest, Parse_DecodesControlMessages)
+{
+    RelayMessageParser parser;
+
+    RelayMessage eose = parser.parse(R"(["EOSE","sub-1"])");
+    EXPECT_EQ(eose.type, RelayMessageType::EOSE);
+    EXPECT_EQ(eose.subscriptionId, "sub-1");
+
+    RelayMessage closed = parser.parse(R"(["CLOSED","sub-1","error: shutting down"])");
+    EXPECT_EQ(closed.type, RelayMessageType::CLOSED);
+    EXPECT_EQ(closed.subscriptionId, "sub-1");
+    EXPECT_EQ(closed.message, "error: shutting down");
+
+    RelayMessage ok = parser.parse(R"(["OK","abcd",false,"blocked: no"])");
+    EXPECT_EQ(ok.type, RelayMessageType::OK);
+    EXPECT_EQ(ok.eventId, "abcd");
+    EXPECT_FALSE(ok.accepted);
+    EXPECT_EQ(ok.message, "blocked: no");
+
+    RelayMessage notice = parser.parse(R"(["NOTICE","hello"])");
+    EXPECT_EQ(notice.type, RelayMessageType::NOTICE);
+    EXPECT_EQ(notice.message, "hello");
+
+    RelayMessage negMsg = parser.parse(R"(["NEG-MSG","neg-1","6100"])");
+    EXPECT_EQ(negMsg.type, RelayMessageType::NEG_MSG);
+    EXPECT_EQ(negMsg.subscriptionId, "neg-1");
+    EXPECT_EQ(negMsg.message, "6100");
+
+    RelayMessage negErr = parser.parse(R"(["NEG-ERR","neg-1","blocked: too many records"])");
+    EXPECT_EQ(negErr.type, RelayMessageType::NEG_ERR);
+    EXPECT_EQ(negErr.subscriptionId, "neg-1");
+    EXPECT_EQ(negErr.message, "blocked: too many records");
+
+    RelayMessage unknown = parser.parse(R"(["AUTH",{"challenge":"x"}])");
+    EXPECT_EQ(unknown.type, RelayMessageType::UNKNOWN);
+}
+
+TEST(RelayMessageParserTest, Parse_RejectsMalformedMessages)
+{
+    RelayMessageParser parser;
+
+    // Not JSON.
+    EXPECT_THROW(parser.parse("[\"EVENT\", "), invalid_argument);
+    // Not an array.
+    EXPECT_THROW(parser.parse(R"({"type":"EVENT"})"), invalid_argument);
+    // Missing elements.
+    EXPECT_THROW(parser.parse(R"(["EOSE"])"), invalid_argument);
+    // Wrong element types.
+    EXPECT_THROW(parser.parse(R"(["OK","abcd","true",""])"), invalid_argument);
+    EXPECT_THROW(parser.parse(R"(["EOSE",42])"), invalid_argument);
+
+    // Events with missing or mistyped fields.
+    json missingSig = testEventJson();
+    missingSig.erase("sig");
+    EXPECT_THROW(parser.parse(json::array({ "EVENT", "sub-1", missingSig }).dump()), invalid_argument);
+
+    json stringKind = testEventJson();
+    stringKind["kind"] = "1";
+    EXPECT_THROW(parser.parse(json::array({ "EVENT", "sub-1", stringKind }).dump()), invalid_argument);
+
+    json shortId = testEventJson();
+    shortId["id"] = "5c83da77";
+    EXPECT_THROW(parser.parse(json::array({ "EVENT", "sub-1", shortId }).dump()), invalid_argument);
+
+    json nonHexPubkey = testEventJson();
+    nonHexPubkey["pubkey"] = "z7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca";
+    EXPECT_THROW(parser.parse(json::array({ "EVENT", "sub-1", nonHexPubkey }).dump()), invalid_argument);
+
+    json numericTag = testEventJson();
+    numericTag["tags"] = { { "e", 7 } };
+    EXPECT_THROW(parser.parse(json::array({ "EVENT", "sub-1", numericTag }).dump()), invalid_argument);
+}
+
+TEST(RelayMessageParserTest, Parse_RejectsOversizedMessages)
+{
+    RelayMessageParser parser(64);
+    json message = json::array({ "EVENT", "sub-1", testEventJson() });
+
+    EXPECT_THROW(parser.parse(message.dump()), invalid_argument);
+}
+} // namespace nostr_test
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "service/relay_router.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+/**
+ * @brief A relay list of the author with the given key byte, listing the given `r` tags.
+ */
+static data::Event relayListOf(uint8_t keyByte, time_t createdAt, vector<vector<string>> relayTags)
+{
+    data::Event event;
+    event.pubkey.fill(keyByte);
+    event.kind = service::RelayRouter::RELAY_LIST_KIND;
+    event.createdAt = createdAt;
+    for (auto& tag : relayTags)
+    {
+        tag.insert(tag.begin(), "r");
+        event.tags.push_back(tag);
+    }
+    return event;
+};
+
+static string authorOf(uint8_t keyByte)
+{
+    data::PublicKey key;
+    key.fill(keyByte);
+    return data::toHex(key);
+};
+
+TEST(RelayRouterTest, Ingest_KeepsWriteRelays_OfNewestRelayList)
+{
+    service::RelayRouter router;
+
+    EXPECT_TRUE(router.ingest(relayListOf(1, 100, { { "wss://old" } })));
+    EXPECT_TRUE(router.ingest(relayListOf(1, 200, {
+        { "wss://both" },
+        { "wss://read", "read" },
+        { "wss://write", "write" }
+    })));
+    EXPECT_FALSE(router.ingest(relayListOf(1, 150, { { "wss://stale" } })));
+
+    data::Event note = relayListOf(2, 300, { { "wss://note" } });
+    note.kind = 1;
+    EXPECT_FALSE(router.ingest(note));
+
+    EXPECT_EQ(router.writeRelays(authorOf(1)), (vector<string>{ "wss://both", "wss://write" }));
+    EXPECT_TRUE(router.writeRelays(authorOf(2)).empty());
+    EXPECT_EQ(router.size(), 1);
+};
+
+TEST(RelayRouterTest, Route_SplitsAuthors_AmongTheirWriteRelays)
+{
+    service::RelayRouter router({ 1, {} });
+    router.ingest(relayListOf(1, 100, { { "wss://a" } }));
+    router.ingest(relayListOf(2, 100, { { "wss://b" } }));
+
+    auto filter = make_shared<data::Filters>();
+    filter->authors = { authorOf(1), authorOf(2) };
+    filter->kinds = { 1 };
+    filter->limit = 10;
+
+    auto routes = router.route({ filter }, { "wss://a", "wss://b", "wss://c" });
+
+    ASSERT_EQ(routes.size(), 2);
+    ASSERT_EQ(routes["wss://a"].size(), 1);
+    EXPECT_EQ(routes["wss://a"][0]->authors, vector<string>{ authorOf(1) });
+    EXPECT_EQ(routes["wss://a"][0]->kinds, vector<int>{ 1 });
+    EXPECT_EQ(routes["wss://a"][0]->limit, 10);
+    ASSERT_EQ(routes["wss://b"].size(), 1);
+    EXPECT_EQ(routes["wss://b"][0]->authors, vector<string>{ authorOf(2) });
+    EXPECT_EQ(filter->authors.size(), 2);
+};
+
+TEST(RelayRouterTest, Route_PrefersSharedRelays_UpToRedundancy)
+{
+    service::RelayRouter router({ 1, {} });
+    router.ingest(relayListOf(1, 100, { { "wss://own" }, { "wss://shared" } }));
+    router.ingest(relayListOf(2, 100, { { "wss://shared" }, { "wss://other" } }));
+
+    auto filter = make_shared<data::Filters>();
+    filter->authors = { authorOf(1), authorOf(2) };
+
+    auto routes = router.route({ filter }, {});
+
+    ASSERT_EQ(routes.size(), 1);
+    EXPECT_EQ(routes["wss://shared"][0]->authors, (vector<string>{ authorOf(1), authorOf(2) }));
+
+    service::RelayRouter redundantRouter({ 2, {} });
+    redundantRouter.ingest(relayListOf(1, 100, { { "wss://own" }, { "wss://shared" }, { "wss://spare" } }));
+
+    auto redundantRoutes = redundantRouter.route({ filter }, {});
+
+    EXPECT_EQ(redundantRoutes["wss://own"][0]->authors, vector<string>{ authorOf(1) });
+    EXPECT_EQ(redundantRoutes["wss://shared"][0]->authors, vector<string>{ authorOf(1) });
+    EXPECT_EQ(redundantRoutes.count("wss://spare"), 0);
+};
+
+TEST(RelayRouterTest, Route_SendsUnknownAuthorsToFallback_AndOtherFiltersToDefaults)
+{
+    service::RelayRouter router({ 2, { "wss://fallback" } });
+    router.ingest(relayListOf(1, 100, { { "wss://a" } }));
+
+    auto authorFilter = make_shared<data::Filters>();
+    authorFilter->authors = { authorOf(1), authorOf(2) };
+    auto kindFilter = make_shared<data::Filters>();
+    kindFilter->kinds = { 0 };
+
+    auto routes = router.route({ authorFilter, kindFilter }, { "wss://a", "wss://b" });
+
+    ASSERT_EQ(routes.size(), 3);
+    ASSERT_EQ(routes["wss://a"].size(), 2);
+    EXPECT_EQ(routes["wss://a"][0]->authors, vector<string>{ authorOf(1) });
+    EXPECT_EQ(routes["wss://a"][1], kindFilter);
+    EXPECT_EQ(routes["wss://b"], vector<shared_ptr<data::Filters>>{ kindFilter });
+    EXPECT_EQ(routes["wss://fallback"][0]->authors, vector<string>{ authorOf(2) });
+
+    service::RelayRouter defaultRouter;
+    auto defaultRoutes = defaultRouter.route({ authorFilter }, { "wss://a", "wss://b" });
+    EXPECT_EQ(defaultRoutes["wss://b"][0]->authors, authorFilter->authors);
+};
+
+TEST(RelayRouterTest, Route_OpensAtMostMaxNewRelays_AndFallsBackForOthers)
+{
+    service::RelayRouter router({ 1, { "wss://fallback" }, 1 });
+    router.ingest(relayListOf(1, 100, { { "wss://new-a" } }));
+    router.ingest(relayListOf(2, 100, { { "wss://new-b" } }));
+    router.ingest(relayListOf(3, 100, { { "wss://new-c" }, { "wss://open" } }));
+
+    auto filter = make_shared<data::Filters>();
+    filter->authors = { authorOf(1), authorOf(2), authorOf(3) };
+
+    auto routes = router.route({ filter }, { "wss://open" });
+
+    // Only the first author's relay is opened, and the third author is still served by an open
+    // relay rather than a new one.
+    ASSERT_EQ(routes.size(), 3);
+    EXPECT_EQ(routes["wss://new-a"][0]->authors, vector<string>{ authorOf(1) });
+    EXPECT_EQ(routes["wss://fallback"][0]->authors, vector<string>{ authorOf(2) });
+    EXPECT_EQ(routes["wss://open"][0]->authors, vector<string>{ authorOf(3) });
+};
+
+TEST(RelayRouterTest, Constructor_ZeroRedundancy_Throws)
+{
+    EXPECT_THROW(service::RelayRouter({ 0, {} }), invalid_argument);
+};
+} // namespace nostr_test
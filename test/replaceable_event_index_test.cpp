@@ -0,0 +1,115 @@
+#include <chrono>
+#include <ctime>
+
+#include <gtest/gtest.h>
+
+#include "service/replaceable_event_index.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+class ReplaceableEventIndexTest : public testing::Test
+{
+public:
+    static data::Event testEvent(int kind, time_t createdAt, uint8_t idByte, string identifier = "")
+    {
+        data::Event event;
+        event.pubkey = data::fromHex<data::PublicKey>("f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+        event.kind = kind;
+        event.createdAt = createdAt;
+        event.id.fill(idByte);
+        if (!identifier.empty())
+        {
+            event.tags.push_back({ "d", identifier });
+        }
+        return event;
+    };
+};
+
+TEST_F(ReplaceableEventIndexTest, Kinds_FollowNip01Ranges)
+{
+    EXPECT_TRUE(data::Event::isReplaceableKind(0));
+    EXPECT_TRUE(data::Event::isReplaceableKind(3));
+    EXPECT_TRUE(data::Event::isReplaceableKind(10002));
+    EXPECT_FALSE(data::Event::isReplaceableKind(1));
+    EXPECT_FALSE(data::Event::isReplaceableKind(20000));
+    EXPECT_TRUE(data::Event::isAddressableKind(30023));
+    EXPECT_FALSE(data::Event::isAddressableKind(40000));
+
+    EXPECT_FALSE(service::EventAddress::of(testEvent(1, 100, 1)).has_value());
+    EXPECT_EQ(service::EventAddress::of(testEvent(30023, 100, 1, "post")).value().identifier, "post");
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_DropsOlderVersions)
+{
+    service::ReplaceableEventIndex index;
+
+    EXPECT_TRUE(index.admit(testEvent(0, 200, 1)));
+    EXPECT_FALSE(index.admit(testEvent(0, 100, 2)));
+    EXPECT_TRUE(index.admit(testEvent(0, 300, 3)));
+    EXPECT_FALSE(index.admit(testEvent(0, 200, 1)));
+
+    // Repeat copies of the newest version are still admitted.
+    EXPECT_TRUE(index.admit(testEvent(0, 300, 3)));
+    EXPECT_EQ(index.size(), 1u);
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_BreaksTies_ByLowestId)
+{
+    service::ReplaceableEventIndex index;
+
+    EXPECT_TRUE(index.admit(testEvent(3, 100, 5)));
+    EXPECT_FALSE(index.admit(testEvent(3, 100, 9)));
+    EXPECT_TRUE(index.admit(testEvent(3, 100, 2)));
+    EXPECT_FALSE(index.admit(testEvent(3, 100, 5)));
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_KeysAddressableEvents_ByIdentifier)
+{
+    service::ReplaceableEventIndex index;
+
+    EXPECT_TRUE(index.admit(testEvent(30023, 200, 1, "first")));
+    EXPECT_TRUE(index.admit(testEvent(30023, 100, 2, "second")));
+    EXPECT_FALSE(index.admit(testEvent(30023, 100, 3, "first")));
+    EXPECT_EQ(index.size(), 2u);
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_AlwaysAdmitsRegularEvents)
+{
+    service::ReplaceableEventIndex index;
+
+    EXPECT_TRUE(index.admit(testEvent(1, 200, 1)));
+    EXPECT_TRUE(index.admit(testEvent(1, 100, 2)));
+    EXPECT_EQ(index.size(), 0u);
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_RejectsVersionsDatedBeyondClockSkew)
+{
+    service::ReplaceableEventIndex index(16, chrono::minutes(15));
+    time_t now = time(nullptr);
+
+    EXPECT_TRUE(index.admit(testEvent(0, now, 1)));
+    EXPECT_FALSE(index.admit(testEvent(0, now + 365 * 24 * 60 * 60, 2)));
+    EXPECT_TRUE(index.admit(testEvent(0, now + 60, 3)));
+
+    // A far-future version is not recorded, so it hides no later versions.
+    EXPECT_TRUE(index.admit(testEvent(0, now + 120, 4)));
+    EXPECT_TRUE(index.admit(testEvent(1, now + 365 * 24 * 60 * 60, 5)));
+};
+
+TEST_F(ReplaceableEventIndexTest, Admit_StaysWithinCapacity)
+{
+    service::ReplaceableEventIndex index(2);
+
+    index.admit(testEvent(30023, 100, 1, "a"));
+    index.admit(testEvent(30023, 100, 2, "b"));
+    index.admit(testEvent(30023, 100, 3, "c"));
+
+    EXPECT_EQ(index.size(), 2u);
+
+    // The earliest address is forgotten, so an older version of it is admitted again.
+    EXPECT_TRUE(index.admit(testEvent(30023, 50, 4, "a")));
+};
+} // namespace nostr_test
@@ -0,0 +1,326 @@
+#include <chrono>
+#include <future>
+#include <mutex>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include "service/request_coalescer.hpp"
+
+using namespace nostr;
+using namespace std;
+using namespace ::testing;
+
+namespace nostr_test
+{
+class MockNostrServiceBase : public service::INostrServiceBase
+{
+public:
+    MOCK_METHOD(vector<string>, openRelayConnections, (), (override));
+    MOCK_METHOD(vector<string>, openRelayConnections, (vector<string> relays), (override));
+    MOCK_METHOD(void, closeRelayConnections, (), (override));
+    MOCK_METHOD(void, closeRelayConnections, (vector<string> relays), (override));
+    MOCK_METHOD((tuple<vector<string>, vector<string>>), publishEvent, (shared_ptr<data::Event> event), (override));
+    MOCK_METHOD(service::PublishResult, publishEvent, (shared_ptr<data::Event> event, service::RequestOptions options), (override));
+    MOCK_METHOD(future<vector<shared_ptr<data::Event>>>, queryRelays, (shared_ptr<data::Filters> filters), (override));
+    MOCK_METHOD(
+        string,
+        queryRelays,
+        (
+            shared_ptr<data::Filters> filters,
+            function<void(const string&, shared_ptr<data::Event>)> eventHandler,
+            function<void(const string&)> eoseHandler,
+            function<void(const string&, const string&)> closeHandler
+        ),
+        (override));
+    MOCK_METHOD(future<vector<shared_ptr<data::Event>>>, queryRelays, (vector<shared_ptr<data::Filters>> filters), (override));
+    MOCK_METHOD(
+        future<vector<shared_ptr<data::Event>>>,
+        queryRelays,
+        (vector<shared_ptr<data::Filters>> filters, shared_ptr<data::EventArena> arena),
+        (override));
+    MOCK_METHOD(
+        future<service::QueryResult>,
+        queryRelays,
+        (vector<shared_ptr<data::Filters>> filters, service::RequestOptions options, shared_ptr<data::EventArena> arena),
+        (override));
+    MOCK_METHOD(
+        shared_ptr<service::EventChannel>,
+        streamRelays,
+        (vector<shared_ptr<data::Filters>> filters, size_t capacity),
+        (override));
+    MOCK_METHOD(
+        string,
+        queryRelays,
+        (
+            vector<shared_ptr<data::Filters>> filters,
+            function<void(const string&, shared_ptr<data::Event>)> eventHandler,
+            function<void(const string&)> eoseHandler,
+            function<void(const string&, const string&)> closeHandler
+        ),
+        (override));
+    MOCK_METHOD((tuple<vector<string>, vector<string>>), closeSubscription, (string subscriptionId), (override));
+    MOCK_METHOD(bool, closeSubscription, (string subscriptionId, string relay), (override));
+    MOCK_METHOD(vector<string>, closeSubscriptions, (), (override));
+};
+
+/**
+ * @brief Records the filters and handlers of each query the coalescer sends to the service.
+ */
+struct SentQuery
+{
+    shared_ptr<data::Filters> filters;
+    function<void(const string&, shared_ptr<data::Event>)> eventHandler;
+    function<void(const string&)> eoseHandler;
+    function<void(const string&, const string&)> closeHandler;
+};
+
+class RequestCoalescerTest : public testing::Test
+{
+public:
+    inline static const vector<string> testAuthors =
+    {
+        "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca",
+        "3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d",
+        "82341f882b6eabcd2ba7f1ef90aad961cf074af15b9ef44a09f9d2a8fbfbe6a2"
+    };
+
+    static shared_ptr<data::Filters> profileFilters(const string& author)
+    {
+        auto filters = make_shared<data::Filters>();
+        filters->authors = { author };
+        filters->kinds = { 0 };
+        filters->limit = 1;
+        return filters;
+    };
+
+    static shared_ptr<data::Event> profileEvent(const string& author)
+    {
+        auto event = make_shared<data::Event>();
+        event->pubkey = data::fromHex<data::PublicKey>(author);
+        event->createdAt = 1627846261;
+        event->kind = 0;
+        event->content = "{}";
+        return event;
+    };
+
+protected:
+    shared_ptr<MockNostrServiceBase> mockService;
+    vector<SentQuery> sentQueries;
+    mutex sentQueriesMutex;
+
+    void SetUp() override
+    {
+        this->mockService = make_shared<MockNostrServiceBase>();
+        ON_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _))
+            .WillByDefault(Invoke([this](
+                shared_ptr<data::Filters> filters,
+                function<void(const string&, shared_ptr<data::Event>)> eventHandler,
+                function<void(const string&)> eoseHandler,
+                function<void(const string&, const string&)> closeHandler)
+            {
+                lock_guard<mutex> lock(this->sentQueriesMutex);
+                this->sentQueries.push_back({ filters, eventHandler, eoseHandler, closeHandler });
+                return "merged-" + to_string(this->sentQueries.size());
+            }));
+    };
+
+    service::RequestCoalescerOptions longWindow()
+    {
+        service::RequestCoalescerOptions options;
+        options.window = chrono::hours(1);
+        return options;
+    };
+};
+
+TEST_F(RequestCoalescerTest, Flush_MergesCompatibleQueries_IntoOneSubscription)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(1);
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    for (const string& author : testAuthors)
+    {
+        coalescer.queryRelays(profileFilters(author), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    }
+    coalescer.flush();
+
+    ASSERT_EQ(this->sentQueries.size(), 1);
+    EXPECT_THAT(this->sentQueries[0].filters->authors, UnorderedElementsAreArray(testAuthors));
+    EXPECT_THAT(this->sentQueries[0].filters->kinds, ElementsAre(0));
+    EXPECT_EQ(this->sentQueries[0].filters->limit, 3);
+};
+
+TEST_F(RequestCoalescerTest, Flush_KeepsIncompatibleQueries_Separate)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(2);
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    auto notes = profileFilters(testAuthors[1]);
+    notes->kinds = { 1 };
+    coalescer.queryRelays(profileFilters(testAuthors[0]), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    coalescer.queryRelays(notes, [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    coalescer.flush();
+
+    ASSERT_EQ(this->sentQueries.size(), 2);
+    EXPECT_THAT(this->sentQueries[0].filters->authors, ElementsAre(testAuthors[0]));
+    EXPECT_THAT(this->sentQueries[1].filters->authors, ElementsAre(testAuthors[1]));
+};
+
+TEST_F(RequestCoalescerTest, Flush_SplitsMergedQueries_AtKeyCap)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(2);
+    auto options = this->longWindow();
+    options.maxKeysPerFilter = 2;
+    service::RequestCoalescer coalescer(this->mockService, options);
+
+    for (const string& author : testAuthors)
+    {
+        coalescer.queryRelays(profileFilters(author), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    }
+    coalescer.flush();
+
+    ASSERT_EQ(this->sentQueries.size(), 2);
+    EXPECT_EQ(this->sentQueries[0].filters->authors.size(), 2);
+    EXPECT_EQ(this->sentQueries[1].filters->authors.size(), 1);
+};
+
+TEST_F(RequestCoalescerTest, Events_AreDelivered_OnlyToMatchingQueries)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(1);
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    vector<string> queryIds;
+    vector<vector<shared_ptr<data::Event>>> received(testAuthors.size());
+    vector<int> eoseCounts(testAuthors.size(), 0);
+    for (size_t i = 0; i < testAuthors.size(); i++)
+    {
+        queryIds.push_back(coalescer.queryRelays(
+            profileFilters(testAuthors[i]),
+            [&received, i](const string&, shared_ptr<data::Event> event) { received[i].push_back(event); },
+            [&eoseCounts, i](const string&) { eoseCounts[i]++; },
+            [](const string&, const string&) {}));
+    }
+    coalescer.flush();
+    ASSERT_EQ(this->sentQueries.size(), 1);
+
+    auto firstProfile = profileEvent(testAuthors[0]);
+    auto thirdProfile = profileEvent(testAuthors[2]);
+    this->sentQueries[0].eventHandler("merged-1", firstProfile);
+    this->sentQueries[0].eventHandler("merged-1", thirdProfile);
+    this->sentQueries[0].eoseHandler("merged-1");
+
+    EXPECT_THAT(received[0], ElementsAre(firstProfile));
+    EXPECT_THAT(received[1], IsEmpty());
+    EXPECT_THAT(received[2], ElementsAre(thirdProfile));
+    EXPECT_THAT(eoseCounts, ElementsAre(1, 1, 1));
+};
+
+TEST_F(RequestCoalescerTest, FloodingAuthor_NeitherStarvesNorOverfillsOtherQueries)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(3);
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    // Notes are unbounded per author, so each author's query keeps its own subscription and limit.
+    vector<vector<shared_ptr<data::Event>>> notes(2);
+    for (size_t i = 0; i < 2; i++)
+    {
+        auto filters = profileFilters(testAuthors[i]);
+        filters->kinds = { 1 };
+        filters->limit = 2;
+        coalescer.queryRelays(
+            filters,
+            [&notes, i](const string&, shared_ptr<data::Event> event) { notes[i].push_back(event); },
+            [](auto&) {},
+            [](auto&, auto&) {});
+    }
+
+    // Profiles are bounded, so they share a subscription.
+    vector<vector<shared_ptr<data::Event>>> profiles(2);
+    for (size_t i = 0; i < 2; i++)
+    {
+        coalescer.queryRelays(
+            profileFilters(testAuthors[i]),
+            [&profiles, i](const string&, shared_ptr<data::Event> event) { profiles[i].push_back(event); },
+            [](auto&) {},
+            [](auto&, auto&) {});
+    }
+    coalescer.flush();
+
+    ASSERT_EQ(this->sentQueries.size(), 3);
+    EXPECT_THAT(this->sentQueries[0].filters->authors, ElementsAre(testAuthors[0]));
+    EXPECT_EQ(this->sentQueries[0].filters->limit, 2);
+    EXPECT_THAT(this->sentQueries[1].filters->authors, ElementsAre(testAuthors[1]));
+    EXPECT_EQ(this->sentQueries[2].filters->limit, 2);
+
+    // The first author floods both subscriptions with distinct events.
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        auto note = profileEvent(testAuthors[0]);
+        note->kind = 1;
+        note->id.fill(i + 1);
+        this->sentQueries[0].eventHandler("merged-1", note);
+
+        auto profile = profileEvent(testAuthors[0]);
+        profile->id.fill(i + 1);
+        profile->createdAt += i;
+        this->sentQueries[2].eventHandler("merged-3", profile);
+    }
+    auto note = profileEvent(testAuthors[1]);
+    note->kind = 1;
+    note->id.fill(0x10);
+    this->sentQueries[1].eventHandler("merged-2", note);
+    auto profile = profileEvent(testAuthors[1]);
+    profile->id.fill(0x10);
+    this->sentQueries[2].eventHandler("merged-3", profile);
+
+    EXPECT_EQ(notes[0].size(), 5);
+    EXPECT_THAT(notes[1], ElementsAre(note));
+    EXPECT_EQ(profiles[0].size(), 1);
+    EXPECT_THAT(profiles[1], ElementsAre(profile));
+};
+
+TEST_F(RequestCoalescerTest, CloseQuery_ClosesSubscription_AfterLastQueryCloses)
+{
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _)).Times(1);
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    string first = coalescer.queryRelays(profileFilters(testAuthors[0]), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    string second = coalescer.queryRelays(profileFilters(testAuthors[1]), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    coalescer.flush();
+
+    EXPECT_CALL(*this->mockService, closeSubscription("merged-1")).Times(1);
+    coalescer.closeQuery(first);
+    coalescer.closeQuery(second);
+};
+
+TEST_F(RequestCoalescerTest, Queries_AreSent_WhenWindowCloses)
+{
+    promise<void> sent;
+    EXPECT_CALL(*this->mockService, queryRelays(A<shared_ptr<data::Filters>>(), _, _, _))
+        .WillOnce(Invoke([&sent](auto, auto, auto, auto)
+        {
+            sent.set_value();
+            return string("merged-1");
+        }));
+
+    service::RequestCoalescerOptions options;
+    options.window = chrono::milliseconds(5);
+    service::RequestCoalescer coalescer(this->mockService, options);
+
+    coalescer.queryRelays(profileFilters(testAuthors[0]), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+    coalescer.queryRelays(profileFilters(testAuthors[1]), [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {});
+
+    EXPECT_EQ(sent.get_future().wait_for(chrono::seconds(5)), future_status::ready);
+};
+
+TEST_F(RequestCoalescerTest, QueryRelays_Throws_WhenFiltersAreInvalid)
+{
+    service::RequestCoalescer coalescer(this->mockService, this->longWindow());
+
+    auto filters = make_shared<data::Filters>();
+    filters->limit = 1;
+    EXPECT_THROW(
+        coalescer.queryRelays(filters, [](auto&, auto) {}, [](auto&) {}, [](auto&, auto&) {}),
+        invalid_argument);
+};
+} // namespace nostr_test
@@ -0,0 +1,121 @@
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <gtest/gtest.h>
+
+#include "service/seen_event_ids.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+class SeenEventIdsTest : public testing::Test
+{
+public:
+    static data::EventId testId(uint64_t number)
+    {
+        data::EventId id;
+        uint64_t state = number * 0x9e3779b97f4a7c15 + 1;
+        for (auto& byte : id)
+        {
+            state = state * 6364136223846793005 + 1442695040888963407;
+            byte = static_cast<uint8_t>(state >> 56);
+        }
+        return id;
+    };
+
+protected:
+    string path;
+
+    void SetUp() override
+    {
+        this->path = (filesystem::temp_directory_path() / "aedile-seen-ids-test.bin").string();
+        filesystem::remove(this->path);
+        filesystem::remove(this->path + ".tmp");
+    };
+
+    void TearDown() override
+    {
+        filesystem::remove(this->path);
+        filesystem::remove(this->path + ".tmp");
+    };
+};
+
+TEST_F(SeenEventIdsTest, Insert_ReportsOnlyFirstCopy)
+{
+    service::SeenEventIds seenIds;
+
+    EXPECT_TRUE(seenIds.insert(testId(1)));
+    EXPECT_FALSE(seenIds.insert(testId(1)));
+    EXPECT_TRUE(seenIds.insert(testId(2)));
+
+    EXPECT_TRUE(seenIds.contains(testId(1)));
+    EXPECT_FALSE(seenIds.contains(testId(3)));
+    EXPECT_EQ(seenIds.size(), 2u);
+};
+
+TEST_F(SeenEventIdsTest, Insert_GrowsBeyondExpectedCount)
+{
+    for (bool hasBloomFilter : { false, true })
+    {
+        service::SeenEventIds seenIds(16, hasBloomFilter);
+        for (uint64_t number = 0; number < 100000; number++)
+        {
+            ASSERT_TRUE(seenIds.insert(testId(number)));
+        }
+
+        EXPECT_EQ(seenIds.size(), 100000u);
+        for (uint64_t number = 0; number < 100000; number += 997)
+        {
+            EXPECT_TRUE(seenIds.contains(testId(number)));
+            EXPECT_FALSE(seenIds.contains(testId(number + 100000)));
+        }
+    }
+};
+
+TEST_F(SeenEventIdsTest, Insert_DistinguishesIds_WithSamePrefix)
+{
+    service::SeenEventIds seenIds;
+    data::EventId first{};
+    data::EventId second{};
+    first[0] = second[0] = 7;
+    first[8] = 1;
+    second[8] = 2;
+
+    EXPECT_TRUE(seenIds.insert(first));
+    EXPECT_TRUE(seenIds.insert(second));
+    EXPECT_EQ(seenIds.size(), 2u);
+};
+
+TEST_F(SeenEventIdsTest, FileBackedSet_SurvivesReopen)
+{
+    {
+        service::SeenEventIds seenIds(this->path, true);
+        for (uint64_t number = 0; number < 5000; number++)
+        {
+            seenIds.insert(testId(number));
+        }
+        seenIds.flush();
+    }
+
+    service::SeenEventIds reopened(this->path, true);
+    EXPECT_EQ(reopened.size(), 5000u);
+    EXPECT_TRUE(reopened.contains(testId(0)));
+    EXPECT_TRUE(reopened.contains(testId(4999)));
+    EXPECT_FALSE(reopened.contains(testId(5000)));
+    EXPECT_FALSE(reopened.insert(testId(42)));
+    EXPECT_FALSE(filesystem::exists(this->path + ".tmp"));
+};
+
+TEST_F(SeenEventIdsTest, FileBackedSet_RejectsOtherFiles)
+{
+    {
+        ofstream file(this->path);
+        file << "These are not the IDs you are looking for, and this is not a table of them.";
+    }
+
+    EXPECT_THROW(service::SeenEventIds seenIds(this->path), invalid_argument);
+};
+} // namespace nostr_test
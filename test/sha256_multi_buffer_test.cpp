@@ -0,0 +1,62 @@
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "cryptography/sha256_context.hpp"
+#include "cryptography/sha256_multi_buffer.hpp"
+
+using namespace nostr::cryptography;
+using namespace std;
+
+namespace nostr_test
+{
+TEST(Sha256MultiBufferTest, Hash_MatchesSingleBufferDigests_ForMixedLengths)
+{
+    // Lengths straddle the padding boundaries at 55/56 and 63/64 bytes, and differ by several
+    // blocks within one call.
+    const vector<size_t> lengths = { 0, 1, 55, 56, 63, 64, 119, 120, 300, 1000, 3 };
+
+    vector<vector<uint8_t>> messages;
+    for (size_t length : lengths)
+    {
+        vector<uint8_t> message(length);
+        for (size_t i = 0; i < length; i++)
+        {
+            message[i] = static_cast<uint8_t>(i * 131 + length);
+        }
+        messages.push_back(message);
+    }
+
+    for (size_t first = 0; first < messages.size(); first += Sha256MultiBuffer::LANES)
+    {
+        size_t count = min(Sha256MultiBuffer::LANES, messages.size() - first);
+
+        const uint8_t* pointers[Sha256MultiBuffer::LANES];
+        size_t messageLengths[Sha256MultiBuffer::LANES];
+        uint8_t digests[Sha256MultiBuffer::LANES][Sha256MultiBuffer::DIGEST_SIZE];
+        uint8_t* digestPointers[Sha256MultiBuffer::LANES];
+        for (size_t i = 0; i < count; i++)
+        {
+            pointers[i] = messages[first + i].data();
+            messageLengths[i] = messages[first + i].size();
+            digestPointers[i] = digests[i];
+        }
+
+        Sha256MultiBuffer::hash(pointers, messageLengths, count, digestPointers);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            uint8_t expected[Sha256Context::DIGEST_SIZE];
+            Sha256Context context;
+            context.update(pointers[i], messageLengths[i]);
+            context.finalize(expected);
+
+            EXPECT_EQ(
+                vector<uint8_t>(digests[i], digests[i] + Sha256MultiBuffer::DIGEST_SIZE),
+                vector<uint8_t>(expected, expected + Sha256Context::DIGEST_SIZE))
+                << "length " << messageLengths[i];
+        }
+    }
+}
+} // namespace nostr_test
@@ -0,0 +1,111 @@
+#include <filesystem>
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include "service/sync_watermarks.hpp"
+
+using namespace nostr;
+using namespace std;
+
+namespace nostr_test
+{
+class SyncWatermarksTest : public testing::Test
+{
+public:
+    inline static const string testRelay = "wss://relay.damus.io";
+
+    static data::Filters testFilters()
+    {
+        data::Filters filters;
+        filters.authors = {
+            "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca",
+            "3bf0c63fcb93463407af97a5e5ee64fa883d107ef9e558472c4eb9aaaefa459d"
+        };
+        filters.kinds = { 1, 6 };
+        filters.tags["#t"] = { "nostr", "bitcoin" };
+        filters.limit = 20;
+        return filters;
+    };
+
+protected:
+    string path;
+
+    void SetUp() override
+    {
+        this->path = (filesystem::temp_directory_path() / "aedile-watermarks-test.json").string();
+        filesystem::remove(this->path);
+    };
+
+    void TearDown() override
+    {
+        filesystem::remove(this->path);
+    };
+};
+
+TEST_F(SyncWatermarksTest, FilterKey_IgnoresEntryOrder_AndUntil)
+{
+    data::Filters reordered = testFilters();
+    reordered.authors = { reordered.authors[1], reordered.authors[0] };
+    reordered.kinds = { 6, 1, 6 };
+    reordered.tags.clear();
+    reordered.tags["t"] = { "bitcoin", "nostr" };
+    reordered.until = 1700000000;
+
+    EXPECT_EQ(service::SyncWatermarks::filterKey(reordered), service::SyncWatermarks::filterKey(testFilters()));
+};
+
+TEST_F(SyncWatermarksTest, FilterKey_DependsOnSinceAndLimit)
+{
+    data::Filters earlier = testFilters();
+    earlier.since = 1600000000;
+    data::Filters larger = testFilters();
+    larger.limit = 50;
+
+    string key = service::SyncWatermarks::filterKey(testFilters());
+    EXPECT_NE(service::SyncWatermarks::filterKey(earlier), key);
+    EXPECT_NE(service::SyncWatermarks::filterKey(larger), key);
+};
+
+TEST_F(SyncWatermarksTest, Advance_NeverMovesBack)
+{
+    service::SyncWatermarks watermarks;
+    string key = service::SyncWatermarks::filterKey(testFilters());
+    EXPECT_EQ(watermarks.get(testRelay, key), 0);
+
+    watermarks.advance(testRelay, key, 1700000000);
+    watermarks.advance(testRelay, key, 1600000000);
+    watermarks.advance(testRelay, key, 0);
+
+    EXPECT_EQ(watermarks.get(testRelay, key), 1700000000);
+    EXPECT_EQ(watermarks.get("wss://nos.lol", key), 0);
+    EXPECT_EQ(watermarks.size(), 1);
+};
+
+TEST_F(SyncWatermarksTest, Save_PersistsWatermarks_AcrossInstances)
+{
+    string key = service::SyncWatermarks::filterKey(testFilters());
+    {
+        service::SyncWatermarks watermarks(this->path);
+        watermarks.advance(testRelay, key, 1700000000);
+        watermarks.advance("wss://nos.lol", key, 1700000123);
+        watermarks.save();
+    }
+
+    service::SyncWatermarks watermarks(this->path);
+    EXPECT_EQ(watermarks.size(), 2);
+    EXPECT_EQ(watermarks.get(testRelay, key), 1700000000);
+    EXPECT_EQ(watermarks.get("wss://nos.lol", key), 1700000123);
+};
+
+TEST_F(SyncWatermarksTest, Load_IgnoresUnreadableFile)
+{
+    {
+        ofstream file(this->path);
+        file << "{ \"watermarks\": ";
+    }
+
+    service::SyncWatermarks watermarks(this->path);
+    EXPECT_EQ(watermarks.size(), 0);
+};
+} // namespace nostr_test
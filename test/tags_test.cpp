@@ -0,0 +1,86 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <nlohmann/json.hpp>
+
+#include "data/data.hpp"
+
+using namespace nostr::data;
+using namespace std;
+using namespace ::testing;
+
+static Tags testTags()
+{
+    return {
+        { "e", "5c83da77af1dec6d7289834998ad7aafbd9e2191396d75ec3cc27f5a77226f36", "wss://gitcitadel.nostr1.com" },
+        { "p", "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca" },
+        { },
+        { "p" },
+        { "p", "13adc511de7e1cfcf1c6b7f6365fb5a03442d7bcacf565ea57fa7770912c023d", "" },
+        { "published_at", "1627846261" }
+    };
+};
+
+TEST(TagsTest, Iterates_TagsAndFields_InOrder)
+{
+    Tags tags = testTags();
+
+    ASSERT_EQ(tags.size(), 6);
+    EXPECT_EQ(tags[0].size(), 3);
+    EXPECT_EQ(tags[0].name(), "e");
+    EXPECT_EQ(tags[0][2], "wss://gitcitadel.nostr1.com");
+    EXPECT_TRUE(tags[2].empty());
+    EXPECT_EQ(tags[2].name(), "");
+    EXPECT_EQ(tags[4][2], "");
+
+    vector<vector<string>> copied;
+    for (Tags::Tag tag : tags)
+    {
+        copied.emplace_back(tag.begin(), tag.end());
+    }
+    EXPECT_EQ(copied, tags.toVector());
+    EXPECT_EQ(Tags(copied), tags);
+};
+
+TEST(TagsTest, FirstValue_ReturnsValue_OfFirstTagWithName)
+{
+    Tags tags = testTags();
+
+    EXPECT_EQ(tags.firstValue("p"), "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca");
+    EXPECT_EQ(tags.firstValue("published_at"), "1627846261");
+    EXPECT_EQ(tags.firstValue("published"), nullopt);
+    EXPECT_EQ(tags.firstValue("d"), nullopt);
+    EXPECT_EQ(tags.firstValue(""), nullopt);
+};
+
+TEST(TagsTest, Values_ListsValues_OfEveryTagWithName)
+{
+    Tags tags = testTags();
+
+    vector<string_view> values;
+    for (string_view value : tags.values("p"))
+    {
+        values.push_back(value);
+    }
+
+    // The `["p"]` tag has no value, so it is skipped.
+    EXPECT_THAT(values, ElementsAre(
+        "f7234bd4c1394dda46d09f35bd384dd30cc552ad5541990f98844fb06676e9ca",
+        "13adc511de7e1cfcf1c6b7f6365fb5a03442d7bcacf565ea57fa7770912c023d"));
+    EXPECT_EQ(tags.values("x").begin(), tags.values("x").end());
+};
+
+TEST(TagsTest, Json_RoundTrips_AsNestedArrays)
+{
+    Tags tags = testTags();
+
+    nlohmann::json j = tags;
+    EXPECT_EQ(j, nlohmann::json(tags.toVector()));
+    EXPECT_EQ(j.get<Tags>(), tags);
+    EXPECT_THROW(nlohmann::json::parse(R"([["e", 7]])").get<Tags>(), nlohmann::json::type_error);
+};
+
+TEST(TagsTest, AppendToLastTag_Throws_WhenThereIsNoTag)
+{
+    Tags tags;
+    EXPECT_THROW(tags.appendToLastTag("p"), logic_error);
+};